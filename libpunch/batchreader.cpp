@@ -0,0 +1,115 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <batchreader.hpp>
+#include <threadpool.hpp>
+#include <stats.hpp>
+#include <trace.hpp>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+std::vector<SourceFile> discover_sources(const std::string& root, const std::string& extension) {
+  std::vector<SourceFile> result;
+  boost::system::error_code ec;
+
+  fs::file_status status = fs::status(root, ec);
+  if (!fs::is_directory(status)) {
+    // a missing root is kept, reading it reports the error.
+    uintmax_t size = fs::is_regular_file(status) ? fs::file_size(root, ec) : 0;
+    result.push_back(SourceFile{root, ec ? 0 : size});
+    return result;
+  }
+
+  // entries that can not be read are skipped, like directory symlinks.
+  std::vector<fs::path> directories(1, root);
+  while (!directories.empty()) {
+    fs::path directory = directories.back();
+    directories.pop_back();
+
+    for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+      if (fs::is_directory(it->symlink_status(ec))) {
+        directories.push_back(it->path());
+        continue;
+      }
+      if (ec || !fs::is_regular_file(it->status(ec)) || it->path().extension() != extension) {
+        continue;
+      }
+
+      uintmax_t size = fs::file_size(it->path(), ec);
+      if (!ec) {
+        result.push_back(SourceFile{it->path().string(), size});
+      }
+    }
+    ec.clear();
+  }
+
+  std::sort(result.begin(), result.end(), [](const SourceFile& a, const SourceFile& b) {
+    return a.path < b.path;
+  });
+
+  return result;
+}
+
+FileResult read_source(const std::string& path, std::string& buffer, FormCache* cache, bool recover) {
+  PUNCH_TRACE_SPAN(span, "read source", "batch");
+  PUNCH_TRACING(span.arg("path", path));
+  FileResult result;
+  result.path = path;
+
+  if (!load_file(path, buffer)) {
+    result.ok = false;
+    result.error = "Could not open file";
+    return result;
+  }
+
+  auto read = cache ? cache->try_read(buffer, recover) : try_read_forms(buffer, recover);
+  result.forms = std::move(read.forms);
+
+  if (!read.ok()) {
+    result.ok = false;
+    result.error = read.diagnostics.front().message;
+    result.diagnostics = std::move(read.diagnostics);
+  }
+
+  return result;
+}
+
+std::vector<FileResult> read_sources(const std::vector<SourceFile>& files, unsigned jobs, FormCache* cache,
+                                     bool recover) {
+  PUNCH_TRACE_SPAN(span, "read sources", "batch");
+  PUNCH_TRACING(span.arg("files", files.size()));
+  std::vector<FileResult> results(files.size());
+
+  std::vector<size_t> order(files.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+
+  // largest files first, so the tail of the run is made up of small files
+  // that idle workers can steal.
+  std::stable_sort(order.begin(), order.end(), [&files](size_t a, size_t b) {
+    return files[a].size > files[b].size;
+  });
+
+  ThreadPool pool(jobs);
+  std::vector<std::string> buffers(pool.size());
+
+  for (auto it = order.begin(); it != order.end(); ++it) {
+    size_t index = *it;
+    pool.submit([index, cache, recover, &files, &results, &buffers](unsigned worker) {
+      results[index] = read_source(files[index].path, buffers[worker], cache, recover);
+      PUNCH_STAT(stats::flush());
+    });
+  }
+
+  pool.wait();
+  return results;
+}
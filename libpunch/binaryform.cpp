@@ -0,0 +1,325 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <binaryform.hpp>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace binaryform {
+
+  namespace {
+
+  const char magic[] = {'P', 'N', 'C', 'H'};
+  const uint32_t max_depth = 4096;
+
+  void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+      out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+      v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+  }
+
+  void put_signed(std::string& out, long v) {
+    uint64_t u = static_cast<uint64_t>(v);
+    put_varint(out, (u << 1) ^ (v < 0 ? ~uint64_t(0) : 0));
+  }
+
+  class Encoder {
+  public:
+    Encoder(bool positions) : positions(positions) {}
+
+    void expression(const Expression& e) {
+      put_varint(body, static_cast<uint64_t>(e.type()));
+
+      if (positions) {
+        put_varint(body, std::get<0>(e.pos));
+        put_varint(body, std::get<1>(e.pos));
+      }
+
+      switch (e.type()) {
+        case ExpressionType::EndOfFile:
+          break;
+        case ExpressionType::Keyword:
+          put_varint(body, intern(static_cast<const Keyword&>(e).value()));
+          break;
+        case ExpressionType::Literal:
+          put_varint(body, intern(static_cast<const Literal&>(e).value()));
+          break;
+        case ExpressionType::String:
+          put_varint(body, intern(static_cast<const String&>(e).value()));
+          break;
+        case ExpressionType::Integer:
+          put_signed(body, static_cast<const Integer&>(e).value());
+          break;
+        case ExpressionType::Ratio:
+          put_signed(body, static_cast<const Ratio&>(e).numerator());
+          put_signed(body, static_cast<const Ratio&>(e).denominator());
+          break;
+        case ExpressionType::Float: {
+          double d = static_cast<const Float&>(e).value();
+          uint64_t bits;
+          std::memcpy(&bits, &d, sizeof(bits));
+          for (int i = 0; i < 8; ++i) {
+            body.push_back(static_cast<char>((bits >> (8 * i)) & 0xff));
+          }
+          break;
+        }
+        case ExpressionType::List:
+          children(static_cast<const List&>(e).inner());
+          break;
+        case ExpressionType::Map:
+          children(static_cast<const Map&>(e).inner());
+          break;
+        case ExpressionType::Set:
+          children(static_cast<const Set&>(e).inner());
+          break;
+        case ExpressionType::Vector:
+          children(static_cast<const Vector&>(e).inner());
+          break;
+      }
+    }
+
+    void children(const std::list<UExpression>& inner) {
+      put_varint(body, inner.size());
+      for (auto it = inner.begin(); it != inner.end(); ++it) {
+        expression(**it);
+      }
+    }
+
+    void finish(size_t count, std::string& out) {
+      out.append(magic, sizeof(magic));
+      put_varint(out, version);
+      put_varint(out, positions ? Positions : 0);
+
+      put_varint(out, strings.size());
+      for (auto it = strings.begin(); it != strings.end(); ++it) {
+        put_varint(out, (*it)->size());
+        out.append(**it);
+      }
+
+      put_varint(out, count);
+      out.append(body);
+    }
+
+  private:
+    uint64_t intern(const std::string& s) {
+      auto found = index.find(s);
+      if (found != index.end()) {
+        return found->second;
+      }
+
+      auto inserted = index.insert(std::make_pair(s, strings.size()));
+      strings.push_back(&inserted.first->first);
+      return inserted.first->second;
+    }
+
+    bool positions;
+    std::string body;
+    std::unordered_map<std::string, uint64_t> index;
+    std::vector<const std::string*> strings;
+  };
+
+  class Decoder {
+  public:
+    Decoder(const char* data, size_t size) : cur(data), end(data + size) {}
+
+    std::list<UExpression> run() {
+      if (size_t(end - cur) < sizeof(magic) || std::memcmp(cur, magic, sizeof(magic)) != 0) {
+        fail("Not a binary form file");
+      }
+      cur += sizeof(magic);
+
+      if (varint() != version) {
+        fail("Unsupported binary form version");
+      }
+      positions = (varint() & Positions) != 0;
+
+      uint64_t string_count = varint();
+      if (string_count > size_t(end - cur)) {
+        fail("Corrupt string table");
+      }
+
+      strings.reserve(string_count);
+      for (uint64_t i = 0; i < string_count; ++i) {
+        uint64_t length = varint();
+        if (length > size_t(end - cur)) {
+          fail("Corrupt string table");
+        }
+        strings.push_back(std::string(cur, length));
+        cur += length;
+      }
+
+      std::list<UExpression> forms;
+      uint64_t count = varint();
+      for (uint64_t i = 0; i < count; ++i) {
+        forms.push_back(expression(0));
+      }
+
+      if (cur != end) {
+        fail("Trailing data after forms");
+      }
+
+      return forms;
+    }
+
+  private:
+    UExpression expression(uint32_t depth) {
+      if (depth > max_depth) {
+        fail("Forms nested too deep");
+      }
+
+      uint64_t tag = varint();
+
+      position pos = std::make_tuple(0, 0);
+      if (positions) {
+        uint uline = static_cast<uint>(varint());
+        uint ucol = static_cast<uint>(varint());
+        pos = std::make_tuple(uline, ucol);
+      }
+
+      UExpression result;
+      switch (static_cast<ExpressionType>(tag)) {
+        case ExpressionType::Keyword:
+          result = make_unique<Keyword>(string());
+          break;
+        case ExpressionType::Literal:
+          result = make_unique<Literal>(string());
+          break;
+        case ExpressionType::String:
+          result = make_unique<String>(string());
+          break;
+        case ExpressionType::Integer:
+          result = make_unique<Integer>(signed_varint());
+          break;
+        case ExpressionType::Ratio: {
+          long n = signed_varint();
+          long d = signed_varint();
+          result = make_unique<Ratio>(n, d);
+          break;
+        }
+        case ExpressionType::Float: {
+          if (end - cur < 8) {
+            fail("Unexpected end of data");
+          }
+          uint64_t bits = 0;
+          for (int i = 0; i < 8; ++i) {
+            bits |= uint64_t(static_cast<unsigned char>(cur[i])) << (8 * i);
+          }
+          cur += 8;
+          double d;
+          std::memcpy(&d, &bits, sizeof(d));
+          result = make_unique<Float>(d);
+          break;
+        }
+        case ExpressionType::List: {
+          auto l = children(depth);
+          result = make_unique<List>(l);
+          break;
+        }
+        case ExpressionType::Map: {
+          auto l = children(depth);
+          result = make_unique<Map>(l);
+          break;
+        }
+        case ExpressionType::Set: {
+          auto l = children(depth);
+          result = make_unique<Set>(l);
+          break;
+        }
+        case ExpressionType::Vector: {
+          auto l = children(depth);
+          result = make_unique<Vector>(l);
+          break;
+        }
+        default:
+          fail("Unknown expression tag");
+      }
+
+      result->pos = pos;
+      return result;
+    }
+
+    std::list<UExpression> children(uint32_t depth) {
+      uint64_t count = varint();
+      if (count > size_t(end - cur)) {
+        fail("Corrupt child count");
+      }
+
+      std::list<UExpression> l;
+      for (uint64_t i = 0; i < count; ++i) {
+        l.push_back(expression(depth + 1));
+      }
+      return l;
+    }
+
+    const std::string& string() {
+      uint64_t i = varint();
+      if (i >= strings.size()) {
+        fail("String index out of range");
+      }
+      return strings[i];
+    }
+
+    uint64_t varint() {
+      uint64_t result = 0;
+      for (int shift = 0; shift < 64; shift += 7) {
+        if (cur == end) {
+          fail("Unexpected end of data");
+        }
+        unsigned char b = static_cast<unsigned char>(*cur++);
+        result |= uint64_t(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+          return result;
+        }
+      }
+      fail("Varint too long");
+    }
+
+    long signed_varint() {
+      uint64_t u = varint();
+      return static_cast<long>((u >> 1) ^ (~(u & 1) + 1));
+    }
+
+    [[noreturn]] void fail(const char* msg) {
+      throw ReaderException(msg);
+    }
+
+    const char* cur;
+    const char* end;
+    bool positions = false;
+    std::vector<std::string> strings;
+  };
+
+  }
+
+  void encode(const std::list<UExpression>& forms, std::string& out, bool positions) {
+    Encoder encoder(positions);
+    for (auto it = forms.begin(); it != forms.end(); ++it) {
+      encoder.expression(**it);
+    }
+    encoder.finish(forms.size(), out);
+  }
+
+  std::string encode(const std::list<UExpression>& forms, bool positions) {
+    std::string out;
+    encode(forms, out, positions);
+    return out;
+  }
+
+  std::list<UExpression> decode(const char* data, size_t size) {
+    return Decoder(data, size).run();
+  }
+
+  std::list<UExpression> decode(const std::string& data) {
+    return decode(data.data(), data.size());
+  }
+}
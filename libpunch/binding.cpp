@@ -0,0 +1,49 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <binding.hpp>
+
+namespace binding {
+
+  Binder::Binder(std::unique_ptr<Tokenizer> tokenizer)
+    : tokenizer(std::move(tokenizer)), token(this->tokenizer->next()) {
+    check_tokenizer();
+  }
+
+  void Binder::pop() {
+    token = tokenizer->next();
+    check_tokenizer();
+  }
+
+  bool Binder::fail(const std::string& message, position pos) {
+    if (!m_failed) {
+      m_failed = true;
+      m_diagnostics.push_back(Diagnostic{message, pos, boost::none});
+    }
+
+    return false;
+  }
+
+  bool Binder::expected(const char* what) {
+    if (token.type == TokenType::EndOfFile) {
+      return fail(std::string("EOF, expected ") + what, token.pos);
+    }
+
+    return fail(std::string("Expected ") + what + ", got " +
+                (token.type == TokenType::Literal ? token.value : std::string(tokenTypeTranslations.at(token.type))), token.pos);
+  }
+
+  void Binder::check_tokenizer() {
+    if (tokenizer->failed() && !m_failed) {
+      m_failed = true;
+      m_diagnostics.push_back(tokenizer->error());
+    }
+  }
+}
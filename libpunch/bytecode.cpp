@@ -0,0 +1,1028 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <bytecode.hpp>
+#include <climits>
+
+#if defined(__GNUC__)
+#define PUNCH_THREADED_DISPATCH
+#endif
+
+namespace eval {
+
+  class Closure : public Function {
+  public:
+    Closure(std::shared_ptr<const Prototype> proto, Vm* vm) : Function(proto->name), proto(std::move(proto)), vm(vm) {
+      owner = vm;
+    }
+
+    Value call(const Value* args, size_t argc) override {
+      return vm->call(*this, args, argc);
+    }
+
+    std::shared_ptr<const Prototype> proto;
+    std::vector<Value> captured;
+    Vm* vm;
+  };
+
+  namespace {
+
+  const char* op_names[] = {
+      "Constant", "Integer", "Nil", "True", "False",
+      "Local", "StoreLocal", "Captured", "Self", "Global", "Define",
+      "Pop", "Jump", "JumpIfFalse", "Call", "Return", "Closure",
+      "Add", "Subtract", "Multiply", "Divide", "Negate", "Increment", "Decrement",
+      "Less", "Greater", "LessEqual", "GreaterEqual", "Equal",
+      "Vector", "Map", "Set"
+  };
+
+  static_assert(sizeof(op_names) / sizeof(op_names[0]) == static_cast<size_t>(Op::Set) + 1, "an op without a name");
+
+  const std::string* symbol_of(const Expression& e) {
+    if (e.type() != ExpressionType::Literal) {
+      return nullptr;
+    }
+    auto& value = static_cast<const expression::Literal&>(e).value();
+    if (value == "nil" || value == "true" || value == "false") {
+      return nullptr;
+    }
+    return &value;
+  }
+
+  const std::list<UExpression>& inner_of(const Expression& e) {
+    switch (e.type()) {
+      case ExpressionType::List:
+        return static_cast<const expression::List&>(e).inner();
+      case ExpressionType::Vector:
+        return static_cast<const expression::Vector&>(e).inner();
+      case ExpressionType::Set:
+        return static_cast<const expression::Set&>(e).inner();
+      default:
+        return static_cast<const expression::Map&>(e).inner();
+    }
+  }
+
+  // no symbols or calls inside, so the value is known when compiling.
+  bool is_constant(const Expression& e) {
+    switch (e.type()) {
+      case ExpressionType::Literal:
+        return !symbol_of(e);
+      case ExpressionType::List:
+        return false;
+      case ExpressionType::Vector:
+      case ExpressionType::Map:
+      case ExpressionType::Set:
+        for (auto& item : inner_of(e)) {
+          if (!is_constant(*item)) {
+            return false;
+          }
+        }
+        return true;
+      default:
+        return true;
+    }
+  }
+
+  // the core functions calls of which compile to an instruction, with the number of arguments it takes.
+  struct Inline {
+    const char* name;
+    Op op;
+  };
+
+  const Inline binary_ops[] = {
+      {"<", Op::Less}, {">", Op::Greater}, {"<=", Op::LessEqual}, {">=", Op::GreaterEqual}, {"=", Op::Equal}
+  };
+
+  typedef std::list<UExpression>::const_iterator Element;
+
+  struct Scope {
+    Scope(Scope* enclosing, std::string name) : enclosing(enclosing), proto(std::make_shared<Prototype>()) {
+      proto->name = std::move(name);
+    }
+
+    struct Loop {
+      int32_t start;
+      std::vector<uint32_t> slots;
+      int depth;
+    };
+
+    Scope* enclosing;
+    std::shared_ptr<Prototype> proto;
+
+    // the name a named fn refers to itself by.
+    std::string self;
+
+    std::vector<std::pair<std::string, uint32_t>> locals;
+    std::vector<std::string> captured;
+    uint32_t next_slot = 0;
+    int depth = 0;
+
+    bool has_loop = false;
+    Loop loop;
+  };
+
+  struct Resolved {
+    enum class Kind {
+      Local, Captured, Self, Global
+    };
+
+    Kind kind;
+    uint32_t index;
+  };
+
+  class Compiler {
+  public:
+    explicit Compiler(Environment& env) : env(env) {}
+
+    std::shared_ptr<const Prototype> top_level(const Expression& form) {
+      Scope scope(nullptr, "top-level");
+      this->scope = &scope;
+      compile(form, true);
+      emit(Op::Return, 0, -1, form.pos);
+      return scope.proto;
+    }
+
+  private:
+    void compile(const Expression& e, bool tail) {
+      switch (e.type()) {
+        case ExpressionType::Integer: {
+          long v = static_cast<const expression::Integer&>(e).value();
+          if (v >= INT32_MIN && v <= INT32_MAX) {
+            emit(Op::Integer, static_cast<int32_t>(v), 1, e.pos);
+          }
+          else {
+            constant(Value::integer(v), e.pos);
+          }
+          return;
+        }
+        case ExpressionType::Literal:
+          if (!symbol_of(e)) {
+            auto& value = static_cast<const expression::Literal&>(e).value();
+            emit(value == "nil" ? Op::Nil : value == "true" ? Op::True : Op::False, 0, 1, e.pos);
+          }
+          else {
+            load(*symbol_of(e), e.pos);
+          }
+          return;
+        case ExpressionType::List:
+          call(e, tail);
+          return;
+        case ExpressionType::Vector:
+        case ExpressionType::Map:
+        case ExpressionType::Set: {
+          if (is_constant(e)) {
+            constant(from_expression(e), e.pos);
+            return;
+          }
+          auto& inner = inner_of(e);
+          for (auto& item : inner) {
+            compile(*item, false);
+          }
+          int32_t n = static_cast<int32_t>(inner.size());
+          if (e.type() == ExpressionType::Vector) {
+            emit(Op::Vector, n, 1 - n, e.pos);
+          }
+          else if (e.type() == ExpressionType::Set) {
+            emit(Op::Set, n, 1 - n, e.pos);
+          }
+          else {
+            emit(Op::Map, n / 2, 1 - n, e.pos);
+          }
+          return;
+        }
+        case ExpressionType::EndOfFile:
+          throw EvalError("Cannot evaluate end of file", e.pos);
+        default:
+          constant(from_expression(e), e.pos);
+          return;
+      }
+    }
+
+    void call(const Expression& e, bool tail) {
+      auto& inner = static_cast<const expression::List&>(e).inner();
+      if (inner.empty()) {
+        constant(sequence(Type::List, {}), e.pos);
+        return;
+      }
+
+      Element first = inner.begin();
+      Element args = std::next(first);
+      size_t argc = inner.size() - 1;
+      const std::string* head = symbol_of(**first);
+
+      if (head) {
+        const std::string& name = *head;
+        if (name == "def") {
+          return def(e, args, argc);
+        }
+        if (name == "defn") {
+          return defn(e, args, argc);
+        }
+        if (name == "fn") {
+          return fn(e, args, inner.end(), "");
+        }
+        if (name == "let" || name == "loop") {
+          return let(e, args, argc, tail, name == "loop");
+        }
+        if (name == "if") {
+          return branch(e, args, argc, tail);
+        }
+        if (name == "do") {
+          return body(args, inner.end(), tail, e.pos);
+        }
+        if (name == "recur") {
+          return recur(e, args, argc, tail);
+        }
+        if (name == "quote") {
+          if (argc != 1) {
+            throw EvalError("quote takes one form", e.pos);
+          }
+          constant(from_expression(**args), e.pos);
+          return;
+        }
+        if (inline_call(name, args, argc, e.pos)) {
+          return;
+        }
+      }
+
+      compile(**first, false);
+      for (Element it = args; it != inner.end(); ++it) {
+        compile(**it, false);
+      }
+      emit(Op::Call, static_cast<int32_t>(argc), -static_cast<int>(argc), e.pos);
+    }
+
+    bool inline_call(const std::string& name, Element args, size_t argc, position pos) {
+      Resolved r = resolve(*scope, name, false);
+      if (r.kind != Resolved::Kind::Global || !env.is_core(r.index)) {
+        return false;
+      }
+
+      if (name == "+" || name == "*") {
+        Op op = name == "+" ? Op::Add : Op::Multiply;
+        emit(Op::Integer, name == "+" ? 0 : 1, 1, pos);
+        for (size_t i = 0; i < argc; ++i, ++args) {
+          compile(**args, false);
+          emit(op, 0, -1, pos);
+        }
+        return true;
+      }
+
+      if ((name == "-" && argc >= 1) || (name == "/" && argc >= 2)) {
+        compile(**args, false);
+        if (argc == 1) {
+          emit(Op::Negate, 0, 0, pos);
+          return true;
+        }
+        for (++args; --argc > 0; ++args) {
+          compile(**args, false);
+          emit(name == "-" ? Op::Subtract : Op::Divide, 0, -1, pos);
+        }
+        return true;
+      }
+
+      if ((name == "inc" || name == "dec") && argc == 1) {
+        compile(**args, false);
+        emit(name == "inc" ? Op::Increment : Op::Decrement, 0, 0, pos);
+        return true;
+      }
+
+      for (auto& b : binary_ops) {
+        if (name == b.name && argc == 2) {
+          compile(**args, false);
+          compile(**std::next(args), false);
+          emit(b.op, 0, -1, pos);
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    void def(const Expression& e, Element args, size_t argc) {
+      if (argc < 1 || argc > 2 || !symbol_of(**args)) {
+        throw EvalError("def takes a name and a value", e.pos);
+      }
+
+      const std::string& name = *symbol_of(**args);
+      uint32_t slot = env.slot(name);
+      if (argc == 1) {
+        emit(Op::Nil, 0, 1, e.pos);
+      }
+      else {
+        const Expression& value = **std::next(args);
+        const std::string* head = value.type() == ExpressionType::List && !inner_of(value).empty()
+            ? symbol_of(*inner_of(value).front()) : nullptr;
+        if (head && *head == "fn") {
+          fn(value, std::next(inner_of(value).begin()), inner_of(value).end(), name);
+        }
+        else {
+          compile(value, false);
+        }
+      }
+      emit(Op::Define, static_cast<int32_t>(slot), 0, e.pos);
+    }
+
+    // (defn name "doc"? {attrs}? [params] body...), a def of a fn that knows its own name.
+    void defn(const Expression& e, Element args, size_t argc) {
+      auto& inner = static_cast<const expression::List&>(e).inner();
+      if (argc < 2 || !symbol_of(**args)) {
+        throw EvalError("defn takes a name, parameters and a body", e.pos);
+      }
+
+      const std::string& name = *symbol_of(**args);
+      Element rest = std::next(args);
+      while (rest != inner.end() && ((*rest)->type() == ExpressionType::String || (*rest)->type() == ExpressionType::Map)) {
+        ++rest;
+      }
+
+      function(e, rest, inner.end(), name, name);
+      emit(Op::Define, static_cast<int32_t>(env.slot(name)), 0, e.pos);
+    }
+
+    // (fn name? [params] body...)
+    void fn(const Expression& e, Element args, Element end, const std::string& hint) {
+      std::string self;
+      if (args != end && symbol_of(**args)) {
+        self = *symbol_of(**args);
+        ++args;
+      }
+      function(e, args, end, self.empty() ? (hint.empty() ? "fn" : hint) : self, self);
+    }
+
+    void function(const Expression& e, Element params, Element end, const std::string& name, const std::string& self) {
+      if (params == end || (*params)->type() != ExpressionType::Vector) {
+        if (params != end && (*params)->type() == ExpressionType::List) {
+          throw EvalError("Multi-arity fn is not supported", e.pos);
+        }
+        throw EvalError("fn takes a parameter vector", e.pos);
+      }
+
+      Scope inner(scope, name);
+      inner.self = self;
+      Prototype& proto = *inner.proto;
+
+      auto& names = inner_of(**params);
+      for (auto it = names.begin(); it != names.end(); ++it) {
+        const std::string* param = symbol_of(**it);
+        if (!param) {
+          throw EvalError("Unsupported parameter " + (*it)->DebugInfo(), (*it)->pos);
+        }
+        if (*param == "&") {
+          if (std::next(it) == names.end() || std::next(it, 2) != names.end() || !symbol_of(**std::next(it))) {
+            throw EvalError("& takes one parameter after it", (*it)->pos);
+          }
+          proto.variadic = true;
+          continue;
+        }
+        if (!proto.variadic) {
+          ++proto.params;
+        }
+        inner.locals.emplace_back(*param, inner.next_slot++);
+      }
+
+      proto.slots = inner.next_slot;
+      inner.has_loop = true;
+      inner.loop.start = 0;
+      inner.loop.depth = 0;
+      for (uint32_t i = 0; i < inner.next_slot; ++i) {
+        inner.loop.slots.push_back(i);
+      }
+
+      Scope* outer = scope;
+      scope = &inner;
+      body(std::next(params), end, true, e.pos);
+      emit(Op::Return, 0, -1, e.pos);
+      scope = outer;
+
+      auto& prototypes = scope->proto->prototypes;
+      prototypes.push_back(inner.proto);
+      emit(Op::Closure, static_cast<int32_t>(prototypes.size() - 1), 1, e.pos);
+    }
+
+    void let(const Expression& e, Element args, size_t argc, bool tail, bool loop) {
+      const char* form = loop ? "loop" : "let";
+      if (argc < 1 || (*args)->type() != ExpressionType::Vector || inner_of(**args).size() % 2 != 0) {
+        throw EvalError(std::string(form) + " takes a vector of bindings", e.pos);
+      }
+
+      size_t locals = scope->locals.size();
+      uint32_t next_slot = scope->next_slot;
+      std::vector<uint32_t> slots;
+
+      auto& bindings = inner_of(**args);
+      for (auto it = bindings.begin(); it != bindings.end(); std::advance(it, 2)) {
+        const std::string* name = symbol_of(**it);
+        if (!name) {
+          throw EvalError("Unsupported binding " + (*it)->DebugInfo(), (*it)->pos);
+        }
+
+        compile(**std::next(it), false);
+        uint32_t slot = scope->next_slot++;
+        scope->proto->slots = std::max(scope->proto->slots, scope->next_slot);
+        emit(Op::StoreLocal, static_cast<int32_t>(slot), -1, (*it)->pos);
+        scope->locals.emplace_back(*name, slot);
+        slots.push_back(slot);
+      }
+
+      auto& inner = static_cast<const expression::List&>(e).inner();
+      if (loop) {
+        bool had_loop = scope->has_loop;
+        Scope::Loop outer = scope->loop;
+        scope->has_loop = true;
+        scope->loop = Scope::Loop{static_cast<int32_t>(scope->proto->code.size()), slots, scope->depth};
+        body(std::next(args), inner.end(), true, e.pos);
+        scope->has_loop = had_loop;
+        scope->loop = outer;
+      }
+      else {
+        body(std::next(args), inner.end(), tail, e.pos);
+      }
+
+      scope->locals.resize(locals);
+      scope->next_slot = next_slot;
+    }
+
+    void branch(const Expression& e, Element args, size_t argc, bool tail) {
+      if (argc < 2 || argc > 3) {
+        throw EvalError("if takes a test, a then and an optional else", e.pos);
+      }
+
+      compile(**args, false);
+      size_t test = emit(Op::JumpIfFalse, 0, -1, e.pos);
+      compile(**std::next(args), tail);
+      size_t skip = emit(Op::Jump, 0, -1, e.pos);
+
+      patch(test);
+      if (argc == 3) {
+        compile(**std::next(args, 2), tail);
+      }
+      else {
+        emit(Op::Nil, 0, 1, e.pos);
+      }
+      patch(skip);
+    }
+
+    void body(Element it, Element end, bool tail, position pos) {
+      if (it == end) {
+        emit(Op::Nil, 0, 1, pos);
+        return;
+      }
+
+      for (; std::next(it) != end; ++it) {
+        compile(**it, false);
+        emit(Op::Pop, 0, -1, (*it)->pos);
+      }
+      compile(**it, tail);
+    }
+
+    void recur(const Expression& e, Element args, size_t argc, bool tail) {
+      if (!scope->has_loop) {
+        throw EvalError("recur outside of loop or fn", e.pos);
+      }
+      if (!tail) {
+        throw EvalError("Can only recur from tail position", e.pos);
+      }
+      if (argc != scope->loop.slots.size()) {
+        throw EvalError("Mismatched argument count to recur, expected " + std::to_string(scope->loop.slots.size()) +
+                        " args, got " + std::to_string(argc), e.pos);
+      }
+
+      for (size_t i = 0; i < argc; ++i, ++args) {
+        compile(**args, false);
+      }
+      for (size_t i = argc; i-- > 0;) {
+        emit(Op::StoreLocal, static_cast<int32_t>(scope->loop.slots[i]), -1, e.pos);
+      }
+
+      size_t jump = emit(Op::Jump, 0, 0, e.pos);
+      scope->proto->code[jump].arg = scope->loop.start - static_cast<int32_t>(jump);
+
+      // never reached, the form counts as one value like any other.
+      ++scope->depth;
+    }
+
+    void load(const std::string& name, position pos) {
+      Resolved r = resolve(*scope, name, true);
+      switch (r.kind) {
+        case Resolved::Kind::Local:
+          emit(Op::Local, static_cast<int32_t>(r.index), 1, pos);
+          break;
+        case Resolved::Kind::Captured:
+          emit(Op::Captured, static_cast<int32_t>(r.index), 1, pos);
+          break;
+        case Resolved::Kind::Self:
+          emit(Op::Self, 0, 1, pos);
+          break;
+        case Resolved::Kind::Global:
+          emit(Op::Global, static_cast<int32_t>(r.index), 1, pos);
+          break;
+      }
+    }
+
+    // with capture unset only looks, so no capture is added for a name that is not used.
+    Resolved resolve(Scope& s, const std::string& name, bool capture) {
+      for (auto it = s.locals.rbegin(); it != s.locals.rend(); ++it) {
+        if (it->first == name) {
+          return Resolved{Resolved::Kind::Local, it->second};
+        }
+      }
+      if (s.self == name) {
+        return Resolved{Resolved::Kind::Self, 0};
+      }
+      for (size_t i = 0; i < s.captured.size(); ++i) {
+        if (s.captured[i] == name) {
+          return Resolved{Resolved::Kind::Captured, static_cast<uint32_t>(i)};
+        }
+      }
+
+      if (s.enclosing) {
+        Resolved outer = resolve(*s.enclosing, name, capture);
+        if (outer.kind == Resolved::Kind::Global || !capture) {
+          return outer.kind == Resolved::Kind::Global ? outer : Resolved{Resolved::Kind::Captured, 0};
+        }
+
+        Capture::Kind kind = outer.kind == Resolved::Kind::Local ? Capture::Kind::Local
+            : outer.kind == Resolved::Kind::Captured ? Capture::Kind::Captured : Capture::Kind::Self;
+        s.proto->captures.push_back(Capture{kind, outer.index});
+        s.captured.push_back(name);
+        return Resolved{Resolved::Kind::Captured, static_cast<uint32_t>(s.captured.size() - 1)};
+      }
+
+      uint32_t slot;
+      if (!capture && !env.find(name, slot)) {
+        return Resolved{Resolved::Kind::Global, UINT32_MAX};
+      }
+      return Resolved{Resolved::Kind::Global, env.slot(name)};
+    }
+
+    void constant(Value v, position pos) {
+      scope->proto->constants.push_back(std::move(v));
+      emit(Op::Constant, static_cast<int32_t>(scope->proto->constants.size() - 1), 1, pos);
+    }
+
+    size_t emit(Op op, int32_t arg, int effect, position pos) {
+      Prototype& proto = *scope->proto;
+      proto.code.push_back(Instruction{op, arg});
+      proto.positions.push_back(pos);
+
+      scope->depth += effect;
+      proto.stack = std::max(proto.stack, static_cast<uint32_t>(std::max(scope->depth, 0)));
+      return proto.code.size() - 1;
+    }
+
+    // points the jump at the next instruction.
+    void patch(size_t jump) {
+      scope->proto->code[jump].arg = static_cast<int32_t>(scope->proto->code.size() - jump);
+    }
+
+    Environment& env;
+    Scope* scope = nullptr;
+  };
+
+  void disassemble(const Prototype& proto, std::string& out) {
+    out += proto.name + " (" + std::to_string(proto.params) + (proto.variadic ? "+" : "") + " params, " +
+           std::to_string(proto.slots) + " slots)\n";
+    for (size_t i = 0; i < proto.code.size(); ++i) {
+      out += "  " + std::to_string(i) + " " + op_names[static_cast<size_t>(proto.code[i].op)];
+      switch (proto.code[i].op) {
+        case Op::Constant:
+          out += " " + print(proto.constants[proto.code[i].arg]);
+          break;
+        case Op::Jump:
+        case Op::JumpIfFalse:
+          out += " " + std::to_string(static_cast<int32_t>(i) + proto.code[i].arg);
+          break;
+        case Op::Nil: case Op::True: case Op::False: case Op::Self: case Op::Pop: case Op::Return:
+        case Op::Add: case Op::Subtract: case Op::Multiply: case Op::Divide: case Op::Negate:
+        case Op::Increment: case Op::Decrement: case Op::Less: case Op::Greater: case Op::LessEqual:
+        case Op::GreaterEqual: case Op::Equal:
+          break;
+        default:
+          out += " " + std::to_string(proto.code[i].arg);
+          break;
+      }
+      out += "\n";
+    }
+    for (auto& nested : proto.prototypes) {
+      disassemble(*nested, out);
+    }
+  }
+
+  EvalError arity_error(const Function& f, size_t argc) {
+    return EvalError("Wrong number of args (" + std::to_string(argc) + ") passed to " + f.name);
+  }
+
+  }
+
+  std::shared_ptr<const Prototype> compile(const Expression& form, Environment& env) {
+    return Compiler(env).top_level(form);
+  }
+
+  std::string disassemble(const Prototype& proto) {
+    std::string out;
+    disassemble(proto, out);
+    return out;
+  }
+
+  Vm::Vm(Environment& env, size_t stack_size)
+    : env(env), stack(new Value[stack_size]), limit(stack.get() + stack_size), top(stack.get()) {
+    frames.reserve(256);
+  }
+
+  Vm::~Vm() {}
+
+  Value Vm::eval(const std::string& source) {
+    Value last;
+    auto forms = read_forms(source);
+    for (auto& form : forms) {
+      last = eval(*form);
+    }
+    return last;
+  }
+
+  Value Vm::run(const Prototype& proto) {
+    if (proto.params != 0 || proto.variadic) {
+      throw EvalError("Only top-level prototypes can be run");
+    }
+    if (limit - top < static_cast<ptrdiff_t>(proto.slots + proto.stack)) {
+      throw EvalError("Stack overflow");
+    }
+
+    frames.push_back(Frame{&proto, nullptr, proto.code.data(), top, top});
+    top += proto.slots;
+    return execute(frames.size() - 1);
+  }
+
+  Value Vm::call(Closure& closure, const Value* args, size_t argc) {
+    Value* base = top;
+    if (static_cast<size_t>(limit - base) < argc) {
+      throw EvalError("Stack overflow");
+    }
+    for (size_t i = 0; i < argc; ++i) {
+      base[i] = args[i];
+    }
+
+    Value* sp;
+    try {
+      sp = enter(closure, base, argc);
+    }
+    catch (...) {
+      for (size_t i = 0; i < argc; ++i) {
+        base[i] = Value();
+      }
+      throw;
+    }
+
+    frames.push_back(Frame{closure.proto.get(), &closure, closure.proto->code.data(), base, base});
+    top = sp;
+    return execute(frames.size() - 1);
+  }
+
+  // checks the arguments at base and packs the variadic ones, the stack pointer of the new frame.
+  Value* Vm::enter(Closure& closure, Value* base, size_t argc) {
+    const Prototype& proto = *closure.proto;
+    if (argc != proto.params && (!proto.variadic || argc < proto.params)) {
+      throw arity_error(closure, argc);
+    }
+    if (limit - base < static_cast<ptrdiff_t>(proto.slots + proto.stack + 1)) {
+      throw EvalError("Stack overflow");
+    }
+
+    if (proto.variadic) {
+      std::vector<Value> rest;
+      if (argc > proto.params) {
+        rest.assign(std::make_move_iterator(base + proto.params), std::make_move_iterator(base + argc));
+      }
+      base[proto.params] = sequence(Type::List, std::move(rest));
+    }
+    return base + proto.slots;
+  }
+
+  void Vm::unwind(size_t entry, Value* sp) {
+    Value* bottom = frames[entry].bottom;
+    while (sp > bottom) {
+      *--sp = Value();
+    }
+    frames.resize(entry);
+    top = bottom;
+  }
+
+  Value Vm::execute(size_t entry) {
+    Frame* frame = &frames.back();
+    const Instruction* pc = frame->pc;
+    Value* base = frame->base;
+    Value* sp = top;
+    Closure* closure = frame->closure;
+    const Value* constants = frame->proto->constants.data();
+
+#ifdef PUNCH_THREADED_DISPATCH
+    static const void* labels[] = {
+        &&op_Constant, &&op_Integer, &&op_Nil, &&op_True, &&op_False,
+        &&op_Local, &&op_StoreLocal, &&op_Captured, &&op_Self, &&op_Global, &&op_Define,
+        &&op_Pop, &&op_Jump, &&op_JumpIfFalse, &&op_Call, &&op_Return, &&op_Closure,
+        &&op_Add, &&op_Subtract, &&op_Multiply, &&op_Divide, &&op_Negate, &&op_Increment, &&op_Decrement,
+        &&op_Less, &&op_Greater, &&op_LessEqual, &&op_GreaterEqual, &&op_Equal,
+        &&op_Vector, &&op_Map, &&op_Set
+    };
+    static_assert(sizeof(labels) / sizeof(labels[0]) == static_cast<size_t>(Op::Set) + 1, "an op without a label");
+
+#define CASE(name) op_##name:
+#define DISPATCH() goto *labels[static_cast<uint8_t>(pc->op)]
+#else
+#define CASE(name) case Op::name:
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT() do { ++pc; DISPATCH(); } while (false)
+
+// the arithmetic of two integers inline, everything else through value.hpp.
+#define ARITHMETIC(checked, slow) { \
+      Value& a = sp[-2]; \
+      const Value& b = sp[-1]; \
+      long r; \
+      if (a.type() == Type::Integer && b.type() == Type::Integer && !checked(a.as_integer(), b.as_integer(), &r)) { \
+        a = Value::integer(r); \
+      } \
+      else { \
+        a = slow(a, b); \
+      } \
+      *--sp = Value(); \
+      NEXT(); \
+    }
+
+#define COMPARISON(holds) { \
+      Value& a = sp[-2]; \
+      const Value& b = sp[-1]; \
+      bool r = a.type() == Type::Integer && b.type() == Type::Integer \
+          ? a.as_integer() holds b.as_integer() : compare(a, b) holds 0; \
+      a = Value::boolean(r); \
+      *--sp = Value(); \
+      NEXT(); \
+    }
+
+    try {
+#ifdef PUNCH_THREADED_DISPATCH
+      DISPATCH();
+#else
+      dispatch:
+      switch (pc->op) {
+#endif
+
+      CASE(Constant)
+        *sp++ = constants[pc->arg];
+        NEXT();
+
+      CASE(Integer)
+        *sp++ = Value::integer(pc->arg);
+        NEXT();
+
+      // the slots above the stack pointer are always nil.
+      CASE(Nil)
+        ++sp;
+        NEXT();
+
+      CASE(True)
+        *sp++ = Value::boolean(true);
+        NEXT();
+
+      CASE(False)
+        *sp++ = Value::boolean(false);
+        NEXT();
+
+      CASE(Local)
+        *sp++ = base[pc->arg];
+        NEXT();
+
+      CASE(StoreLocal)
+        base[pc->arg] = std::move(*--sp);
+        NEXT();
+
+      CASE(Captured)
+        *sp++ = closure->captured[pc->arg];
+        NEXT();
+
+      CASE(Self)
+        *sp++ = Value(Type::Function, closure);
+        NEXT();
+
+      CASE(Global)
+        if (!env.bound(pc->arg)) {
+          throw EvalError("Unable to resolve symbol: " + env.name(pc->arg));
+        }
+        *sp++ = env.get(pc->arg);
+        NEXT();
+
+      CASE(Define)
+        env.set(pc->arg, sp[-1]);
+        NEXT();
+
+      CASE(Pop)
+        *--sp = Value();
+        NEXT();
+
+      CASE(Jump)
+        pc += pc->arg;
+        DISPATCH();
+
+      CASE(JumpIfFalse) {
+        bool truthy = sp[-1].truthy();
+        *--sp = Value();
+        if (!truthy) {
+          pc += pc->arg;
+          DISPATCH();
+        }
+        NEXT();
+      }
+
+      CASE(Call) {
+        Value* callee = sp - pc->arg - 1;
+        if (callee->type() == Type::Function && callee->as<Function>().owner == this) {
+          Closure& next = callee->as<Closure>();
+          Value* next_sp = enter(next, callee + 1, pc->arg);
+
+          frame->pc = pc + 1;
+          frames.push_back(Frame{next.proto.get(), &next, nullptr, callee + 1, callee});
+          frame = &frames.back();
+          pc = next.proto->code.data();
+          base = frame->base;
+          sp = next_sp;
+          closure = &next;
+          constants = next.proto->constants.data();
+          DISPATCH();
+        }
+
+        top = sp;
+        Value r = invoke(*callee, callee + 1, pc->arg);
+        // closures called from natives push frames too, which may move them.
+        frame = &frames.back();
+        while (sp > callee) {
+          *--sp = Value();
+        }
+        *sp++ = std::move(r);
+        NEXT();
+      }
+
+      CASE(Return) {
+        Value r = std::move(sp[-1]);
+        while (sp > frame->bottom) {
+          *--sp = Value();
+        }
+        frames.pop_back();
+        if (frames.size() == entry) {
+          top = sp;
+          return r;
+        }
+
+        *sp++ = std::move(r);
+        frame = &frames.back();
+        pc = frame->pc;
+        base = frame->base;
+        closure = frame->closure;
+        constants = frame->proto->constants.data();
+        DISPATCH();
+      }
+
+      CASE(Closure) {
+        auto& proto = frame->proto->prototypes[pc->arg];
+        Value made(Type::Function, new Closure(proto, this));
+        Closure& c = made.as<Closure>();
+        c.captured.reserve(proto->captures.size());
+        for (auto& capture : proto->captures) {
+          switch (capture.kind) {
+            case Capture::Kind::Local:
+              c.captured.push_back(base[capture.index]);
+              break;
+            case Capture::Kind::Captured:
+              c.captured.push_back(closure->captured[capture.index]);
+              break;
+            case Capture::Kind::Self:
+              c.captured.push_back(Value(Type::Function, closure));
+              break;
+          }
+        }
+        *sp++ = std::move(made);
+        NEXT();
+      }
+
+      CASE(Add) ARITHMETIC(__builtin_add_overflow, add)
+      CASE(Subtract) ARITHMETIC(__builtin_sub_overflow, subtract)
+      CASE(Multiply) ARITHMETIC(__builtin_mul_overflow, multiply)
+
+      CASE(Divide)
+        sp[-2] = divide(sp[-2], sp[-1]);
+        *--sp = Value();
+        NEXT();
+
+      CASE(Negate)
+        sp[-1] = subtract(Value::integer(0), sp[-1]);
+        NEXT();
+
+      CASE(Increment)
+        if (sp[-1].type() == Type::Integer && sp[-1].as_integer() != LONG_MAX) {
+          sp[-1] = Value::integer(sp[-1].as_integer() + 1);
+        }
+        else {
+          sp[-1] = add(sp[-1], Value::integer(1));
+        }
+        NEXT();
+
+      CASE(Decrement)
+        if (sp[-1].type() == Type::Integer && sp[-1].as_integer() != LONG_MIN) {
+          sp[-1] = Value::integer(sp[-1].as_integer() - 1);
+        }
+        else {
+          sp[-1] = subtract(sp[-1], Value::integer(1));
+        }
+        NEXT();
+
+      CASE(Less) COMPARISON(<)
+      CASE(Greater) COMPARISON(>)
+      CASE(LessEqual) COMPARISON(<=)
+      CASE(GreaterEqual) COMPARISON(>=)
+
+      CASE(Equal)
+        sp[-2] = Value::boolean(equal(sp[-2], sp[-1]));
+        *--sp = Value();
+        NEXT();
+
+      CASE(Vector) {
+        Value* first = sp - pc->arg;
+        Value v = sequence(Type::Vector, std::vector<Value>(std::make_move_iterator(first), std::make_move_iterator(sp)));
+        sp = first;
+        *sp++ = std::move(v);
+        NEXT();
+      }
+
+      CASE(Set) {
+        Value* first = sp - pc->arg;
+        std::vector<Value> items;
+        for (Value* it = first; it != sp; ++it) {
+          bool seen = false;
+          for (auto& item : items) {
+            seen = seen || equal(item, *it);
+          }
+          if (!seen) {
+            items.push_back(std::move(*it));
+          }
+          *it = Value();
+        }
+        sp = first;
+        *sp++ = sequence(Type::Set, std::move(items));
+        NEXT();
+      }
+
+      CASE(Map) {
+        Value* first = sp - 2 * pc->arg;
+        std::vector<std::pair<Value, Value>> entries;
+        for (Value* it = first; it != sp; it += 2) {
+          bool replaced = false;
+          for (auto& e : entries) {
+            if (!replaced && equal(e.first, it[0])) {
+              e.second = std::move(it[1]);
+              replaced = true;
+            }
+          }
+          if (!replaced) {
+            entries.emplace_back(std::move(it[0]), std::move(it[1]));
+          }
+          it[0] = Value();
+          it[1] = Value();
+        }
+        sp = first;
+        *sp++ = map(std::move(entries));
+        NEXT();
+      }
+
+#ifndef PUNCH_THREADED_DISPATCH
+      }
+#endif
+    }
+    catch (EvalError& e) {
+      if (e.pos == std::make_tuple(0u, 0u)) {
+        const Prototype& proto = *frames.back().proto;
+        e.pos = proto.positions[pc - proto.code.data()];
+      }
+      unwind(entry, sp);
+      throw;
+    }
+    catch (...) {
+      unwind(entry, sp);
+      throw;
+    }
+
+#undef CASE
+#undef DISPATCH
+#undef NEXT
+#undef ARITHMETIC
+#undef COMPARISON
+
+    return Value();
+  }
+}
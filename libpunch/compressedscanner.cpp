@@ -0,0 +1,491 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <compressedscanner.hpp>
+#include <stats.hpp>
+#include <trace.hpp>
+#include <utf8.hpp>
+#include <util.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef PUNCH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef PUNCH_ZSTD
+#include <zstd.h>
+#endif
+
+/*
+ * Decompresses a stream in steps: decode() takes what it can from in and
+ * writes what it can to out, moving both on.
+ */
+class CompressedScanner::Decoder {
+public:
+  virtual ~Decoder() {}
+
+  // false with failure set when the input is corrupt.
+  virtual bool decode(const char*& in, size_t& in_size, char*& out, size_t& out_size, std::string& failure) = 0;
+
+  // whether the input so far ends between two compressed frames or members.
+  virtual bool complete() const = 0;
+};
+
+namespace {
+
+#ifdef PUNCH_ZLIB
+  // gzip members one after the other, as gzip itself writes appended files.
+  class GzipDecoder : public CompressedScanner::Decoder {
+  public:
+    GzipDecoder() {
+      std::memset(&stream, 0, sizeof(stream));
+      // 32 detects the gzip header.
+      inflateInit2(&stream, 15 + 32);
+    }
+
+    ~GzipDecoder() {
+      inflateEnd(&stream);
+    }
+
+    bool decode(const char*& in, size_t& in_size, char*& out, size_t& out_size, std::string& failure) override {
+      stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+      stream.avail_in = static_cast<uInt>(std::min<size_t>(in_size, UINT32_MAX));
+      stream.next_out = reinterpret_cast<Bytef*>(out);
+      stream.avail_out = static_cast<uInt>(std::min<size_t>(out_size, UINT32_MAX));
+      uInt avail_in = stream.avail_in;
+      uInt avail_out = stream.avail_out;
+
+      int result = inflate(&stream, Z_NO_FLUSH);
+
+      size_t used = avail_in - stream.avail_in;
+      size_t produced = avail_out - stream.avail_out;
+      in += used;
+      in_size -= used;
+      out += produced;
+      out_size -= produced;
+      member = member || used > 0;
+
+      if (result == Z_STREAM_END) {
+        inflateReset(&stream);
+        member = false;
+        return true;
+      }
+      if (result == Z_OK || result == Z_BUF_ERROR) {
+        return true;
+      }
+
+      failure = std::string("Corrupt gzip stream") + (stream.msg ? std::string(": ") + stream.msg : "");
+      return false;
+    }
+
+    bool complete() const override {
+      return !member;
+    }
+
+  private:
+    z_stream stream;
+    bool member = false;
+  };
+#endif
+
+#ifdef PUNCH_ZSTD
+  class ZstdDecoder : public CompressedScanner::Decoder {
+  public:
+    ZstdDecoder() : context(ZSTD_createDStream()) {
+      ZSTD_initDStream(context);
+    }
+
+    ~ZstdDecoder() {
+      ZSTD_freeDStream(context);
+    }
+
+    bool decode(const char*& in, size_t& in_size, char*& out, size_t& out_size, std::string& failure) override {
+      ZSTD_inBuffer input = {in, in_size, 0};
+      ZSTD_outBuffer output = {out, out_size, 0};
+
+      size_t result = ZSTD_decompressStream(context, &output, &input);
+      if (ZSTD_isError(result)) {
+        failure = std::string("Corrupt zstd stream: ") + ZSTD_getErrorName(result);
+        return false;
+      }
+
+      in += input.pos;
+      in_size -= input.pos;
+      out += output.pos;
+      out_size -= output.pos;
+      // 0 once a frame is decoded and flushed completely.
+      frame_done = result == 0;
+      return true;
+    }
+
+    bool complete() const override {
+      return frame_done;
+    }
+
+  private:
+    ZSTD_DStream* context;
+    bool frame_done = true;
+  };
+#endif
+
+  std::unique_ptr<CompressedScanner::Decoder> make_decoder(CompressedScanner::Format format) {
+#ifdef PUNCH_ZLIB
+    if (format == CompressedScanner::Format::Gzip) {
+      return make_unique<GzipDecoder>();
+    }
+#endif
+#ifdef PUNCH_ZSTD
+    if (format == CompressedScanner::Format::Zstd) {
+      return make_unique<ZstdDecoder>();
+    }
+#endif
+    return nullptr;
+  }
+
+  // the bytes of a UTF-8 sequence cut off at the end of data, which go with the next chunk.
+  size_t cut_off(const std::string& data) {
+    for (size_t k = 1; k <= 3 && k <= data.size(); ++k) {
+      unsigned char c = static_cast<unsigned char>(data[data.size() - k]);
+      if ((c & 0xC0) != 0x80) {
+        size_t length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        return length > k ? k : 0;
+      }
+    }
+    return 0;
+  }
+}
+
+CompressedScanner::CompressedScanner(const std::string& path, Format format, size_t chunk_size, size_t ahead)
+  : chunk_size(std::max<size_t>(chunk_size, 16)), ahead(std::max<size_t>(ahead, 1)) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    finish("Could not open file", ::position(1, 1));
+    return;
+  }
+
+  helper = std::thread(&CompressedScanner::decompress, this, fd, format);
+}
+
+CompressedScanner::~CompressedScanner() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+
+  if (helper.joinable()) {
+    helper.join();
+  }
+}
+
+bool CompressedScanner::detect(const std::string& path, Format& format) {
+  unsigned char magic[4] = {0, 0, 0, 0};
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  ssize_t n = ::read(fd, magic, sizeof(magic));
+  ::close(fd);
+
+  if (n >= 2 && magic[0] == 0x1F && magic[1] == 0x8B) {
+    format = Format::Gzip;
+    return true;
+  }
+  if (n == 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD) {
+    format = Format::Zstd;
+    return true;
+  }
+  return false;
+}
+
+void CompressedScanner::decompress(int fd, Format format) {
+  PUNCH_TRACE_SPAN(span, "decompress", "scanner");
+  std::unique_ptr<Decoder> decoder = make_decoder(format);
+  if (!decoder) {
+    ::close(fd);
+    finish(format == Format::Gzip ? "Gzip input is not supported by this build"
+                                  : "Zstd input is not supported by this build", ::position(1, 1));
+    return;
+  }
+
+  std::vector<char> input(64 << 10);
+  const char* in = input.data();
+  size_t in_size = 0;
+  bool eof = false;
+
+  // where the next chunk starts, for the position of an error.
+  uint line = 1;
+  uint col = 1;
+  std::string carried;
+  std::string failure;
+
+  while (true) {
+    std::string chunk;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!spare.empty()) {
+        chunk = std::move(spare.back());
+        spare.pop_back();
+      }
+    }
+
+    chunk.resize(chunk_size);
+    std::memcpy(&chunk[0], carried.data(), carried.size());
+    char* out = &chunk[carried.size()];
+    size_t out_size = chunk_size - carried.size();
+    bool last = false;
+
+    while (out_size > 0) {
+      if (in_size == 0 && !eof) {
+        ssize_t n = ::read(fd, input.data(), input.size());
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n < 0) {
+          failure = "Could not read file";
+          last = true;
+          break;
+        }
+        in = input.data();
+        in_size = static_cast<size_t>(n);
+        eof = n == 0;
+      }
+
+      size_t before = out_size;
+      if (!decoder->decode(in, in_size, out, out_size, failure)) {
+        last = true;
+        break;
+      }
+
+      // all of the input is in and the decoder has nothing more to give.
+      if (eof && in_size == 0 && out_size == before) {
+        if (!decoder->complete()) {
+          failure = "Compressed input ends early";
+        }
+        last = true;
+        break;
+      }
+    }
+
+    chunk.resize(out - chunk.data());
+    carried.clear();
+    if (!last) {
+      size_t cut = cut_off(chunk);
+      carried.assign(chunk, chunk.size() - cut, cut);
+      chunk.resize(chunk.size() - cut);
+    }
+    else if (!failure.empty()) {
+      // text cut off by the failure is not invalid, it is missing.
+      chunk.resize(chunk.size() - cut_off(chunk));
+    }
+
+    // the text is checked here, off the scanning thread; it ends before the first invalid byte.
+    size_t invalid = utf8::validate(chunk.data(), chunk.size());
+    if (invalid < chunk.size()) {
+      chunk.resize(invalid);
+      failure = "Invalid UTF-8";
+      last = true;
+    }
+    utf8::advance(chunk.data(), chunk.size(), line, col);
+
+    if (!deliver(chunk)) {
+      break;
+    }
+    if (last) {
+      finish(failure, ::position(line, col));
+      break;
+    }
+  }
+
+  ::close(fd);
+}
+
+void CompressedScanner::finish(const std::string& message, ::position where) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ended = true;
+    m_error = message;
+    m_error_pos = where;
+  }
+  changed.notify_all();
+}
+
+bool CompressedScanner::deliver(std::string& chunk) {
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [this] { return stopping || ready.size() < ahead; });
+  if (stopping) {
+    return false;
+  }
+
+  if (!chunk.empty()) {
+    ready.push_back(std::move(chunk));
+    lock.unlock();
+    changed.notify_all();
+  }
+  return true;
+}
+
+bool CompressedScanner::take(std::string& chunk) {
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [this] { return ended || !ready.empty(); });
+  if (ready.empty()) {
+    return false;
+  }
+
+  // the buffer of the chunk scanned before is written to by the helper again.
+  std::string done = std::move(chunk);
+  chunk = std::move(ready.front());
+  ready.pop_front();
+  if (done.capacity() > 0 && spare.size() < 2) {
+    spare.push_back(std::move(done));
+  }
+  lock.unlock();
+
+  changed.notify_all();
+  PUNCH_STAT(stats::local().bytes_scanned += chunk.size());
+  return true;
+}
+
+bool CompressedScanner::fill() {
+  if (index < current.size()) {
+    return true;
+  }
+
+  if (!has_next && !take(next)) {
+    return false;
+  }
+
+  // the column is counted up to the end of the chunk before it goes.
+  position();
+  if (!current.empty()) {
+    previous = current.back();
+  }
+  current.swap(next);
+  has_next = false;
+  index = 0;
+  counted = 0;
+  return true;
+}
+
+boost::optional<char> CompressedScanner::current_char() {
+  if (!fill()) {
+    return boost::none;
+  }
+  return current[index];
+}
+
+boost::optional<char> CompressedScanner::next_char() {
+  if (!fill()) {
+    return boost::none;
+  }
+  if (index + 1 < current.size()) {
+    return current[index + 1];
+  }
+
+  if (!has_next) {
+    has_next = take(next);
+  }
+  if (has_next) {
+    return next[0];
+  }
+  return boost::none;
+}
+
+boost::optional<char> CompressedScanner::previous_char() {
+  if (index > 0) {
+    return current[index - 1];
+  }
+  return previous;
+}
+
+void CompressedScanner::pop() {
+  if (fill()) {
+    if (current[index] == '\n') {
+      line += 1;
+      col = 1;
+      counted = index + 1;
+    }
+    index += 1;
+  }
+}
+
+void CompressedScanner::flush_line() {
+  while (fill()) {
+    char c = current[index];
+    pop();
+    if (c == '\n') {
+      break;
+    }
+  }
+}
+
+::position CompressedScanner::position() {
+  if (counted < index) {
+    col += static_cast<uint>(utf8::code_points(current.data() + counted, index - counted));
+    counted = index;
+  }
+  return std::make_tuple(line, col);
+}
+
+const char* CompressedScanner::remaining(size_t& size) {
+  if (!fill()) {
+    size = 0;
+    return nullptr;
+  }
+  size = current.size() - index;
+  return current.data() + index;
+}
+
+void CompressedScanner::skip(size_t n) {
+  while (n > 0 && fill()) {
+    size_t k = std::min(n, current.size() - index);
+    const char* data = current.data() + index;
+    const char* end = data + k;
+    for (const char* p = data; (p = static_cast<const char*>(std::memchr(p, '\n', end - p))); ++p) {
+      line += 1;
+      col = 1;
+      counted = p + 1 - current.data();
+    }
+    index += k;
+    n -= k;
+  }
+}
+
+bool CompressedScanner::validate(::position&) {
+  // checked while decompressing, an invalid byte ends the input with error().
+  return true;
+}
+
+bool CompressedScanner::error(std::string& message, ::position& where) {
+  if (fill()) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (m_error.empty()) {
+    return false;
+  }
+  message = m_error;
+  where = m_error_pos;
+  return true;
+}
+
+std::unique_ptr<Scanner> open_scanner(const std::string& path) {
+  CompressedScanner::Format format;
+  if (CompressedScanner::detect(path, format)) {
+    return make_unique<CompressedScanner>(path, format);
+  }
+
+  std::string contents;
+  load_file(path, contents);
+  return make_unique<StringScanner>(contents);
+}
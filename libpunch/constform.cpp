@@ -0,0 +1,80 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <constform.hpp>
+
+#if __cplusplus >= 202002L
+
+namespace constform {
+
+  namespace {
+
+    std::list<UExpression> to_expressions(const Children& children) {
+      std::list<UExpression> l;
+      for (auto it = children.begin(); it != children.end(); ++it) {
+        l.push_back(to_expression(*it));
+      }
+      return l;
+    }
+  }
+
+  UExpression to_expression(const Node& node) {
+    UExpression result;
+
+    switch (node.type()) {
+      case ExpressionType::Keyword:
+        result = make_unique<expression::Keyword>(std::string(node.as<Keyword>().value()));
+        break;
+      case ExpressionType::Literal:
+        result = make_unique<expression::Literal>(std::string(node.as<Literal>().value()));
+        break;
+      case ExpressionType::String:
+        result = make_unique<expression::String>(std::string(node.as<String>().value()));
+        break;
+      case ExpressionType::Integer:
+        result = make_unique<expression::Integer>(node.as<Integer>().value());
+        break;
+      case ExpressionType::Float:
+        result = make_unique<expression::Float>(node.as<Float>().value());
+        break;
+      case ExpressionType::Ratio:
+        result = make_unique<expression::Ratio>(node.as<Ratio>().numerator(), node.as<Ratio>().denominator());
+        break;
+      case ExpressionType::List: {
+        auto l = to_expressions(node.as<List>().inner());
+        result = make_unique<expression::List>(l);
+        break;
+      }
+      case ExpressionType::Map: {
+        auto l = to_expressions(node.as<Map>().inner());
+        result = make_unique<expression::Map>(l);
+        break;
+      }
+      case ExpressionType::Set: {
+        auto l = to_expressions(node.as<Set>().inner());
+        result = make_unique<expression::Set>(l);
+        break;
+      }
+      case ExpressionType::Vector: {
+        auto l = to_expressions(node.as<Vector>().inner());
+        result = make_unique<expression::Vector>(l);
+        break;
+      }
+      case ExpressionType::EndOfFile:
+        result = make_unique<EndOfFile>();
+        break;
+    }
+
+    result->pos = node.pos;
+    return result;
+  }
+}
+
+#endif
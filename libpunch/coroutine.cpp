@@ -0,0 +1,27 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <coroutine.hpp>
+
+#ifdef PUNCH_COROUTINES
+
+Generator<Token> tokens(Tokenizer& tokenizer) {
+  for (auto token = tokenizer.next(); token != Token::EndOfFile; token = tokenizer.next()) {
+    co_yield token;
+  }
+}
+
+Generator<UExpression> forms(Reader& reader) {
+  for (auto expr = reader.try_next(); expr && expr->type() != ExpressionType::EndOfFile; expr = reader.try_next()) {
+    co_yield expr;
+  }
+}
+
+#endif
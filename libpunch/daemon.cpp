@@ -0,0 +1,357 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <daemon.hpp>
+#include <trace.hpp>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+
+namespace {
+
+  std::system_error system_error(const std::string& what) {
+    return std::system_error(errno, std::generic_category(), what);
+  }
+
+  sockaddr_un address(const std::string& path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+      errno = ENAMETOOLONG;
+      throw system_error("Invalid socket path " + path);
+    }
+    std::memcpy(addr.sun_path, path.data(), path.size());
+    return addr;
+  }
+
+  int connect_to(const std::string& path) {
+    sockaddr_un addr = address(path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      throw system_error("Could not create socket");
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+      int saved = errno;
+      ::close(fd);
+      errno = saved;
+      return -1;
+    }
+    return fd;
+  }
+
+  bool read_all(int fd, char* data, size_t size) {
+    while (size > 0) {
+      ssize_t n = ::recv(fd, data, size, 0);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      data += n;
+      size -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  bool write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+      // a client that went away must not kill the daemon with SIGPIPE.
+      ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      data += n;
+      size -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  // what the socket takes of data without blocking, data and size are left at the rest.
+  bool send_some(int fd, const char*& data, size_t& size) {
+    while (size > 0) {
+      ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return true;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      data += n;
+      size -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  uint32_t frame_length(const char* header) {
+    const unsigned char* h = reinterpret_cast<const unsigned char*>(header);
+    return h[0] | h[1] << 8 | h[2] << 16 | static_cast<uint32_t>(h[3]) << 24;
+  }
+
+  bool read_frame(int fd, std::string& payload) {
+    char header[4];
+    if (!read_all(fd, header, sizeof(header))) {
+      return false;
+    }
+
+    uint32_t length = frame_length(header);
+    payload.resize(length);
+    return length == 0 || read_all(fd, &payload[0], length);
+  }
+
+  void frame_header(char* header, size_t size) {
+    header[0] = static_cast<char>(size);
+    header[1] = static_cast<char>(size >> 8);
+    header[2] = static_cast<char>(size >> 16);
+    header[3] = static_cast<char>(size >> 24);
+  }
+
+  bool write_frame(int fd, const std::string& payload) {
+    char header[4];
+    frame_header(header, payload.size());
+    return write_all(fd, header, sizeof(header)) && write_all(fd, payload.data(), payload.size());
+  }
+}
+
+DaemonServer::DaemonServer(const std::string& socket_path, FileCache& cache)
+  : socket_path(socket_path), cache(cache) {
+  sockaddr_un addr = address(socket_path);
+
+  int running = connect_to(socket_path);
+  if (running >= 0) {
+    ::close(running);
+    errno = EADDRINUSE;
+    throw system_error("A daemon is already listening on " + socket_path);
+  }
+  // left behind by a daemon that did not shut down cleanly.
+  ::unlink(socket_path.c_str());
+
+  listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener < 0) {
+    throw system_error("Could not create socket");
+  }
+
+  if (::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listener, 64) != 0) {
+    auto e = system_error("Could not listen on " + socket_path);
+    ::close(listener);
+    throw e;
+  }
+
+  if (::pipe2(wakeup, O_CLOEXEC | O_NONBLOCK) != 0) {
+    auto e = system_error("Could not create pipe");
+    ::close(listener);
+    ::unlink(socket_path.c_str());
+    throw e;
+  }
+}
+
+DaemonServer::~DaemonServer() {
+  for (auto it = clients.begin(); it != clients.end(); ++it) {
+    ::close(it->fd);
+  }
+  ::close(listener);
+  ::close(wakeup[0]);
+  ::close(wakeup[1]);
+  ::unlink(socket_path.c_str());
+}
+
+void DaemonServer::stop() {
+  char c = 0;
+  ssize_t ignored = ::write(wakeup[1], &c, 1);
+  (void) ignored;
+}
+
+void DaemonServer::run() {
+  std::vector<pollfd> fds;
+
+  while (true) {
+    fds.clear();
+    fds.push_back(pollfd{wakeup[0], POLLIN, 0});
+    fds.push_back(pollfd{listener, POLLIN, 0});
+    fds.push_back(pollfd{cache.watch_fd(), POLLIN, 0});
+    for (auto it = clients.begin(); it != clients.end(); ++it) {
+      fds.push_back(pollfd{it->fd, static_cast<short>(it->output.empty() ? POLLIN : POLLOUT), 0});
+    }
+
+    if (::poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw system_error("Could not poll");
+    }
+
+    if (fds[0].revents != 0) {
+      char buf[16];
+      while (::read(wakeup[0], buf, sizeof(buf)) > 0) {
+      }
+      return;
+    }
+
+    if (fds[2].revents & POLLIN) {
+      cache.process_events();
+    }
+
+    // clients are served before new connections are accepted, so the indices still match.
+    std::vector<Client> open;
+    for (size_t i = 3; i < fds.size(); ++i) {
+      Client& client = clients[i - 3];
+      // once the pending response is out, the requests that came in meanwhile are answered.
+      if (fds[i].revents == 0 || (flush(client) && (!client.output.empty() || receive(client)))) {
+        open.push_back(std::move(client));
+      }
+      else {
+        ::close(client.fd);
+      }
+    }
+    clients.swap(open);
+
+    if (fds[1].revents & POLLIN) {
+      accept();
+    }
+  }
+}
+
+void DaemonServer::accept() {
+  int client = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+  if (client >= 0) {
+    clients.push_back(Client{client, std::string(), std::string()});
+  }
+}
+
+bool DaemonServer::receive(Client& client) {
+  char buf[16 * 1024];
+  // a whole request fits, more is left in the socket until it is answered.
+  while (client.input.size() < sizeof(uint32_t) + max_request) {
+    ssize_t n = ::recv(client.fd, buf, sizeof(buf), 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    client.input.append(buf, static_cast<size_t>(n));
+  }
+
+  size_t used = 0;
+  while (client.output.empty() && client.input.size() - used >= sizeof(uint32_t)) {
+    uint32_t length = frame_length(&client.input[used]);
+    if (length > max_request) {
+      return false;
+    }
+    if (client.input.size() - used - sizeof(uint32_t) < length) {
+      break;
+    }
+
+    auto& response = respond(client.input.substr(used + sizeof(uint32_t), length));
+    used += sizeof(uint32_t) + length;
+
+    // the body is sent straight from the cache, it is only copied when the socket does not take all of it.
+    char header[5];
+    frame_header(header, response.body.size() + 1);
+    header[4] = response.ok ? 0 : 1;
+    if (!send(client, header, sizeof(header)) || !send(client, response.body.data(), response.body.size())) {
+      return false;
+    }
+  }
+  client.input.erase(0, used);
+  return true;
+}
+
+bool DaemonServer::flush(Client& client) {
+  const char* data = client.output.data();
+  size_t size = client.output.size();
+  if (!send_some(client.fd, data, size)) {
+    return false;
+  }
+
+  client.output.erase(0, client.output.size() - size);
+  return true;
+}
+
+bool DaemonServer::send(Client& client, const char* data, size_t size) {
+  if (client.output.empty() && !send_some(client.fd, data, size)) {
+    return false;
+  }
+
+  client.output.append(data, size);
+  return true;
+}
+
+std::string DaemonServer::handle(const std::string& request) {
+  auto& result = respond(request);
+  std::string out;
+  out.reserve(result.body.size() + 1);
+  out.push_back(result.ok ? 0 : 1);
+  out.append(result.body);
+  return out;
+}
+
+const FileCache::Response& DaemonServer::respond(const std::string& request) {
+  PUNCH_TRACE_SPAN(span, "request", "daemon");
+  size_t space = request.find(' ');
+  FileCache::Query query;
+  if (space == std::string::npos || !FileCache::parse(request.substr(0, space), query)) {
+    rejected = FileCache::Response{false, "Unknown request\n"};
+    return rejected;
+  }
+
+  std::string path = request.substr(space + 1);
+  PUNCH_TRACING(span.arg("path", path));
+  if (path.empty() || path[0] != '/') {
+    rejected = FileCache::Response{false, "Path must be absolute\n"};
+    return rejected;
+  }
+
+  return cache.get(path, query);
+}
+
+DaemonClient::DaemonClient(const std::string& socket_path) {
+  fd = connect_to(socket_path);
+  if (fd < 0) {
+    throw system_error("No daemon listening on " + socket_path);
+  }
+}
+
+DaemonClient::~DaemonClient() {
+  ::close(fd);
+}
+
+FileCache::Response DaemonClient::query(FileCache::Query query, const std::string& path) {
+  frame = FileCache::name(query);
+  frame.push_back(' ');
+  frame.append(boost::filesystem::absolute(path).string());
+
+  if (!write_frame(fd, frame) || !read_frame(fd, frame)) {
+    errno = ECONNRESET;
+    throw system_error("Lost the connection to the daemon");
+  }
+  if (frame.empty()) {
+    errno = EPROTO;
+    throw system_error("Invalid response from the daemon");
+  }
+
+  return FileCache::Response{frame[0] == 0, frame.substr(1)};
+}
@@ -0,0 +1,582 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <definitionindex.hpp>
+#include <threadpool.hpp>
+#include <trace.hpp>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+  const char magic[] = {'P', 'N', 'D', 'X'};
+  const size_t header_size = 40;
+  const size_t file_record = 24;
+  const size_t definition_record = 28;
+  const uint32_t variadic = 0x80000000;
+
+  bool is_little_endian() {
+    const uint32_t one = 1;
+    char first;
+    std::memcpy(&first, &one, 1);
+    return first == 1;
+  }
+
+  uint32_t read_u32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  template <class T>
+  void put(std::string& out, T v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+  bool contains(const std::vector<std::string>& heads, const std::string& value) {
+    return std::find(heads.begin(), heads.end(), value) != heads.end();
+  }
+
+  const std::string* literal(const Expression& e) {
+    if (e.type() != ExpressionType::Literal) {
+      return nullptr;
+    }
+    return &static_cast<const expression::Literal&>(e).value();
+  }
+
+  // [a b & more] takes two parameters and is variadic.
+  Arity arity(const expression::Vector& params) {
+    Arity result{0, false};
+    for (auto it = params.inner().begin(); it != params.inner().end(); ++it) {
+      const std::string* name = literal(**it);
+      if (name && *name == "&") {
+        result.variadic = true;
+        break;
+      }
+      ++result.params;
+    }
+    return result;
+  }
+
+  // (f "doc" {:meta} [params] body) or (f "doc" {:meta} ([params] body) ..), from the first element after the name.
+  void arities(std::list<UExpression>::const_iterator it, std::list<UExpression>::const_iterator end,
+               std::vector<Arity>& out) {
+    while (it != end && ((*it)->type() == ExpressionType::String || (*it)->type() == ExpressionType::Map)) {
+      ++it;
+    }
+
+    if (it != end && (*it)->type() == ExpressionType::Vector) {
+      out.push_back(arity(static_cast<const expression::Vector&>(**it)));
+      return;
+    }
+
+    for (; it != end && (*it)->type() == ExpressionType::List; ++it) {
+      auto& body = static_cast<const expression::List&>(**it).inner();
+      if (body.empty() || body.front()->type() != ExpressionType::Vector) {
+        break;
+      }
+      out.push_back(arity(static_cast<const expression::Vector&>(*body.front())));
+    }
+  }
+
+  uint64_t heads_hash(const DefinitionHeads& heads) {
+    std::string key;
+    for (auto it = heads.plain.begin(); it != heads.plain.end(); ++it) {
+      key += *it;
+      key.push_back('\0');
+    }
+    key.push_back('\1');
+    for (auto it = heads.functions.begin(); it != heads.functions.end(); ++it) {
+      key += *it;
+      key.push_back('\0');
+    }
+    return content_hash(key.data(), key.size());
+  }
+
+  bool string_in_bounds(const char* strings, size_t size, uint32_t at) {
+    if (size < 5 || at > size - 5) {
+      return false;
+    }
+    uint32_t length = read_u32(strings + at);
+    return length <= size - at - 5 && strings[at + 4 + length] == '\0';
+  }
+
+  bool fail(std::string& error, const char* message) {
+    error = message;
+    return false;
+  }
+
+  struct IndexedFile {
+    std::string path;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+
+    bool ok = false;
+    uint32_t diagnostics = 0;
+    std::vector<Definition> definitions;
+  };
+
+  class IndexWriter {
+  public:
+    IndexWriter(const std::vector<IndexedFile>& files, uint64_t heads) : files(files), heads(heads) {}
+
+    std::string write() {
+      std::vector<Record> records;
+      std::vector<uint32_t> file_indices(files.size());
+      uint32_t kept = 0;
+      for (size_t f = 0; f < files.size(); ++f) {
+        if (!files[f].ok) {
+          continue;
+        }
+        file_indices[f] = kept++;
+        for (auto it = files[f].definitions.begin(); it != files[f].definitions.end(); ++it) {
+          records.push_back(Record{content_hash(it->name.data(), it->name.size()), &*it, file_indices[f]});
+        }
+      }
+
+      uint32_t buckets = 1;
+      while (buckets < records.size()) {
+        buckets <<= 1;
+      }
+      for (auto it = records.begin(); it != records.end(); ++it) {
+        it->hash &= buckets - 1;
+      }
+
+      std::sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+        if (a.hash != b.hash) {
+          return a.hash < b.hash;
+        }
+        if (a.definition->name != b.definition->name) {
+          return a.definition->name < b.definition->name;
+        }
+        if (a.file != b.file) {
+          return a.file < b.file;
+        }
+        return a.definition->pos < b.definition->pos;
+      });
+
+      std::string table;
+      for (size_t f = 0; f < files.size(); ++f) {
+        if (files[f].ok) {
+          put(table, intern(files[f].path));
+          put(table, files[f].diagnostics);
+          put(table, files[f].size);
+          put(table, files[f].mtime);
+        }
+      }
+
+      std::string arities;
+      std::vector<uint32_t> starts(buckets + 1, static_cast<uint32_t>(records.size()));
+      for (size_t i = records.size(); i-- > 0;) {
+        starts[records[i].hash] = static_cast<uint32_t>(i);
+      }
+      for (size_t b = buckets; b-- > 0;) {
+        starts[b] = std::min(starts[b], starts[b + 1]);
+      }
+
+      for (auto it = records.begin(); it != records.end(); ++it) {
+        const Definition& d = *it->definition;
+        put(table, intern(d.name));
+        put(table, intern(d.head));
+        put(table, it->file);
+        put(table, std::get<0>(d.pos));
+        put(table, std::get<1>(d.pos));
+        put(table, static_cast<uint32_t>(arities.size() / 4));
+        put(table, static_cast<uint32_t>(d.arities.size()));
+        for (auto a = d.arities.begin(); a != d.arities.end(); ++a) {
+          put(arities, a->params | (a->variadic ? variadic : 0));
+        }
+      }
+
+      for (auto it = starts.begin(); it != starts.end(); ++it) {
+        put(table, *it);
+      }
+
+      if (strings.size() > UINT32_MAX || records.size() > UINT32_MAX / 2) {
+        throw ReaderException("Definition index exceeds 4GB");
+      }
+
+      std::string out;
+      out.reserve(header_size + table.size() + arities.size() + strings.size());
+      out.append(magic, sizeof(magic));
+      put(out, DefinitionIndex::version);
+      put(out, kept);
+      put(out, static_cast<uint32_t>(records.size()));
+      put(out, buckets);
+      put(out, static_cast<uint32_t>(arities.size() / 4));
+      put(out, heads);
+      put(out, static_cast<uint32_t>(strings.size()));
+      put(out, uint32_t(0));
+      out += table;
+      out += arities;
+      out += strings;
+      return out;
+    }
+
+  private:
+    struct Record {
+      uint64_t hash;
+      const Definition* definition;
+      uint32_t file;
+    };
+
+    // names, heads and paths are stored once.
+    uint32_t intern(const std::string& s) {
+      auto found = interned.find(s);
+      if (found != interned.end()) {
+        return found->second;
+      }
+
+      uint32_t at = static_cast<uint32_t>(strings.size());
+      put(strings, static_cast<uint32_t>(s.size()));
+      strings += s;
+      strings.push_back('\0');
+      interned.emplace(s, at);
+      return at;
+    }
+
+    const std::vector<IndexedFile>& files;
+    uint64_t heads;
+
+    std::string strings;
+    std::unordered_map<std::string, uint32_t> interned;
+  };
+
+  void write_atomically(const std::string& path, const std::string& data) {
+    fs::path target(path);
+    fs::path tmp = (target.has_parent_path() ? target.parent_path() : fs::path("."))
+                   / fs::unique_path(target.filename().string() + ".%%%%-%%%%-%%%%.tmp");
+    {
+      std::ofstream out(tmp.string(), std::ios::out | std::ios::binary);
+      out.write(data.data(), data.size());
+      if (!out) {
+        out.close();
+        boost::system::error_code ec;
+        fs::remove(tmp, ec);
+        throw ReaderException("Could not write " + path);
+      }
+    }
+
+    boost::system::error_code ec;
+    fs::rename(tmp, target, ec);
+    if (ec) {
+      fs::remove(tmp, ec);
+      throw ReaderException("Could not write " + path);
+    }
+  }
+}
+
+std::vector<Definition> extract_definitions(const std::list<UExpression>& forms, const DefinitionHeads& heads) {
+  std::vector<Definition> result;
+
+  for (auto it = forms.begin(); it != forms.end(); ++it) {
+    if ((*it)->type() != ExpressionType::List) {
+      continue;
+    }
+
+    auto& inner = static_cast<const expression::List&>(**it).inner();
+    if (inner.size() < 2) {
+      continue;
+    }
+
+    const std::string* head = literal(*inner.front());
+    const std::string* name = literal(**std::next(inner.begin()));
+    if (!head || !name) {
+      continue;
+    }
+
+    bool function = contains(heads.functions, *head);
+    if (!function && !contains(heads.plain, *head)) {
+      continue;
+    }
+
+    result.push_back(Definition{*head, *name, (*it)->pos, std::vector<Arity>()});
+    if (function) {
+      arities(std::next(inner.begin(), 2), inner.end(), result.back().arities);
+    }
+  }
+
+  return result;
+}
+
+DefinitionIndex::DefinitionIndex(const std::string& path, bool validate) : m_data(nullptr), m_size(0) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw ReaderException("Could not open " + path);
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    throw ReaderException("Could not map " + path);
+  }
+
+  void* mapped = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (mapped == MAP_FAILED) {
+    throw ReaderException("Could not map " + path);
+  }
+
+  m_data = static_cast<const char*>(mapped);
+  m_size = static_cast<size_t>(st.st_size);
+
+  std::string error;
+  if (validate && !DefinitionIndex::validate(m_data, m_size, error)) {
+    ::munmap(const_cast<char*>(m_data), m_size);
+    throw ReaderException(error);
+  }
+
+  file_count = word(8);
+  definitions = word(12);
+  buckets = word(16);
+  files_at = header_size;
+  definitions_at = files_at + file_record * file_count;
+  buckets_at = definitions_at + definition_record * definitions;
+  arities_at = buckets_at + 4 * (size_t(buckets) + 1);
+  strings_at = arities_at + 4 * size_t(word(20));
+}
+
+DefinitionIndex::~DefinitionIndex() {
+  ::munmap(const_cast<char*>(m_data), m_size);
+}
+
+DefinitionIndex::Entries DefinitionIndex::find(boost::string_ref name) const {
+  uint32_t bucket = static_cast<uint32_t>(content_hash(name.data(), name.size()) & (buckets - 1));
+  uint32_t end = word(buckets_at + 4 * (bucket + 1));
+
+  // names are sorted within the bucket.
+  for (uint32_t i = word(buckets_at + 4 * bucket); i < end; ++i) {
+    int order = string(read_u32(definition(i))).compare(name);
+    if (order < 0) {
+      continue;
+    }
+    if (order > 0) {
+      break;
+    }
+
+    uint32_t last = i + 1;
+    while (last < end && string(read_u32(definition(last))) == name) {
+      ++last;
+    }
+    return Entries(*this, i, last - i);
+  }
+
+  return Entries(*this, 0, 0);
+}
+
+uint64_t DefinitionIndex::file_size(size_t i) const {
+  uint64_t v;
+  std::memcpy(&v, m_data + files_at + file_record * i + 8, sizeof(v));
+  return v;
+}
+
+int64_t DefinitionIndex::file_mtime(size_t i) const {
+  int64_t v;
+  std::memcpy(&v, m_data + files_at + file_record * i + 16, sizeof(v));
+  return v;
+}
+
+uint64_t DefinitionIndex::heads_hash() const {
+  uint64_t v;
+  std::memcpy(&v, m_data + 24, sizeof(v));
+  return v;
+}
+
+bool DefinitionIndex::validate(const char* data, size_t size, std::string& error) {
+  if (!is_little_endian()) {
+    return fail(error, "Definition indexes are only supported on little-endian hosts");
+  }
+  if (size < header_size || std::memcmp(data, magic, sizeof(magic)) != 0) {
+    return fail(error, "Not a definition index");
+  }
+  if (read_u32(data + 4) != version) {
+    return fail(error, "Unsupported definition index version");
+  }
+
+  uint64_t files = read_u32(data + 8);
+  uint64_t definitions = read_u32(data + 12);
+  uint64_t buckets = read_u32(data + 16);
+  uint64_t arities = read_u32(data + 20);
+  uint64_t strings = read_u32(data + 32);
+
+  if (buckets == 0 || (buckets & (buckets - 1)) != 0) {
+    return fail(error, "Invalid bucket count");
+  }
+
+  uint64_t buckets_at = header_size + file_record * files + definition_record * definitions;
+  uint64_t strings_at = buckets_at + 4 * (buckets + 1) + 4 * arities;
+  if (strings_at + strings != size) {
+    return fail(error, "Sections out of bounds");
+  }
+
+  const char* s = data + strings_at;
+  for (uint64_t i = 0; i < files; ++i) {
+    if (!string_in_bounds(s, strings, read_u32(data + header_size + file_record * i))) {
+      return fail(error, "String out of bounds");
+    }
+  }
+
+  const char* d = data + header_size + file_record * files;
+  for (uint64_t i = 0; i < definitions; ++i, d += definition_record) {
+    if (!string_in_bounds(s, strings, read_u32(d)) || !string_in_bounds(s, strings, read_u32(d + 4))) {
+      return fail(error, "String out of bounds");
+    }
+    if (read_u32(d + 8) >= files) {
+      return fail(error, "File out of bounds");
+    }
+    if (uint64_t(read_u32(d + 20)) + read_u32(d + 24) > arities) {
+      return fail(error, "Arities out of bounds");
+    }
+  }
+
+  uint32_t previous = 0;
+  for (uint64_t i = 0; i <= buckets; ++i) {
+    uint32_t start = read_u32(data + buckets_at + 4 * i);
+    if (start < previous || start > definitions) {
+      return fail(error, "Bucket out of bounds");
+    }
+    previous = start;
+  }
+  if (previous != definitions) {
+    return fail(error, "Bucket out of bounds");
+  }
+
+  return true;
+}
+
+IndexUpdate update_definition_index(const std::string& path, const std::vector<SourceFile>& files,
+                                    const DefinitionHeads& heads, unsigned jobs) {
+  PUNCH_TRACE_SPAN(span, "update index", "index");
+  PUNCH_TRACING(span.arg("files", files.size()));
+  uint64_t key = heads_hash(heads);
+
+  std::unique_ptr<DefinitionIndex> previous;
+  try {
+    previous = make_unique<DefinitionIndex>(path);
+    if (previous->heads_hash() != key) {
+      previous.reset();
+    }
+  }
+  catch (const ReaderException&) {
+    // missing or damaged, every file is read.
+  }
+
+  std::unordered_map<std::string, size_t> previous_files;
+  std::vector<std::vector<uint32_t>> previous_definitions;
+  if (previous) {
+    for (size_t i = 0; i < previous->files(); ++i) {
+      previous_files.emplace(previous->file_path(i).to_string(), i);
+    }
+    previous_definitions.resize(previous->files());
+    auto all = previous->all();
+    for (size_t i = 0; i < all.size(); ++i) {
+      previous_definitions[all[i].file()].push_back(static_cast<uint32_t>(i));
+    }
+  }
+
+  IndexUpdate update;
+  update.files = files.size();
+  std::vector<IndexedFile> indexed(files.size());
+  std::vector<size_t> changed;
+
+  for (size_t i = 0; i < files.size(); ++i) {
+    IndexedFile& file = indexed[i];
+    file.path = files[i].path;
+
+    struct stat st;
+    if (::stat(file.path.c_str(), &st) != 0) {
+      ++update.failed;
+      continue;
+    }
+    file.size = static_cast<uint64_t>(st.st_size);
+    file.mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+    auto found = previous_files.find(file.path);
+    if (found == previous_files.end()) {
+      changed.push_back(i);
+      continue;
+    }
+
+    if (previous->file_size(found->second) != file.size || previous->file_mtime(found->second) != file.mtime) {
+      changed.push_back(i);
+      continue;
+    }
+
+    file.ok = true;
+    file.diagnostics = static_cast<uint32_t>(previous->file_diagnostics(found->second));
+    auto all = previous->all();
+    auto& kept = previous_definitions[found->second];
+    for (auto it = kept.begin(); it != kept.end(); ++it) {
+      auto entry = all[*it];
+      Definition d{entry.head().to_string(), entry.name().to_string(), entry.position(), std::vector<Arity>()};
+      for (size_t a = 0; a < entry.arities(); ++a) {
+        d.arities.push_back(entry.arity(a));
+      }
+      file.definitions.push_back(std::move(d));
+    }
+    std::sort(file.definitions.begin(), file.definitions.end(), [](const Definition& a, const Definition& b) {
+      return a.pos < b.pos;
+    });
+    ++update.reused;
+  }
+
+  // largest files first, as in read_sources.
+  std::stable_sort(changed.begin(), changed.end(), [&files](size_t a, size_t b) {
+    return files[a].size > files[b].size;
+  });
+
+  {
+    ThreadPool pool(jobs);
+    std::vector<std::string> buffers(pool.size());
+
+    for (auto it = changed.begin(); it != changed.end(); ++it) {
+      IndexedFile* file = &indexed[*it];
+      pool.submit([file, &heads, &buffers](unsigned worker) {
+        FileResult result = read_source(file->path, buffers[worker], nullptr, true);
+        if (!result.ok && result.diagnostics.empty()) {
+          return;
+        }
+
+        file->ok = true;
+        file->diagnostics = static_cast<uint32_t>(result.diagnostics.size());
+        file->definitions = extract_definitions(result.forms, heads);
+      });
+    }
+
+    pool.wait();
+  }
+
+  for (auto it = changed.begin(); it != changed.end(); ++it) {
+    if (indexed[*it].ok) {
+      ++update.read;
+    }
+    else {
+      ++update.failed;
+    }
+  }
+  for (auto it = indexed.begin(); it != indexed.end(); ++it) {
+    update.definitions += it->definitions.size();
+  }
+
+  std::string data = IndexWriter(indexed, key).write();
+  previous.reset();
+  write_atomically(path, data);
+  return update;
+}
@@ -0,0 +1,225 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <document.hpp>
+#include <utf8.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+  void shift(Expression& e, int lines) {
+    std::get<0>(e.pos) += lines;
+
+    const std::list<UExpression>* inner = nullptr;
+    switch (e.type()) {
+      case ExpressionType::List: inner = &static_cast<List&>(e).inner(); break;
+      case ExpressionType::Map: inner = &static_cast<Map&>(e).inner(); break;
+      case ExpressionType::Set: inner = &static_cast<Set&>(e).inner(); break;
+      case ExpressionType::Vector: inner = &static_cast<Vector&>(e).inner(); break;
+      default: return;
+    }
+
+    for (auto it = inner->begin(); it != inner->end(); ++it) {
+      shift(**it, lines);
+    }
+  }
+
+  int newlines(const std::string& s, size_t offset, size_t length) {
+    return static_cast<int>(std::count(s.begin() + offset, s.begin() + offset + length, '\n'));
+  }
+}
+
+Document::Document(std::string text) : m_text(std::move(text)) {
+  valid = utf8::validate(m_text.data(), m_text.size()) == m_text.size();
+  lines.push_back(0);
+  index_lines(0);
+
+  size_t stop;
+  entries = read(0, std::make_tuple(1, 1), 0, 0, stop);
+  m_reread = entries.size();
+}
+
+void Document::edit(size_t offset, size_t removed, const std::string& inserted) {
+  if (offset > m_text.size() || removed > m_text.size() - offset) {
+    throw std::out_of_range("Edit outside the document");
+  }
+
+  size_t old_end = offset + removed;
+  uint end_line = line_of(old_end);
+  long delta = static_cast<long>(inserted.size()) - static_cast<long>(removed);
+  int line_delta = newlines(inserted, 0, inserted.size()) - newlines(m_text, offset, removed);
+
+  // an entry is unaffected when the text up to the start of the next one is
+  // unchanged, and the two bytes there that decide the kind of its token.
+  size_t unchanged = offset < 1 ? 0 : offset - 1;
+  auto after = std::lower_bound(entries.begin(), entries.end(), unchanged, [](const Entry& e, size_t o) {
+    return e.offset < o;
+  });
+  size_t first = after == entries.begin() ? 0 : (after - entries.begin()) - 1;
+
+  // text before the first entry can be a comment that the edit ends.
+  size_t start = first == 0 ? 0 : entries[first].offset;
+  position start_pos = first == 0 ? std::make_tuple(1u, 1u) : entries[first].pos;
+
+  // entries that can be kept start after the edit on a later line, their text is unchanged.
+  size_t keep = first;
+  while (keep < entries.size() && (entries[keep].offset < old_end || std::get<0>(entries[keep].pos) <= end_line)) {
+    ++keep;
+  }
+
+  // the text stays valid UTF-8 when valid inserted text replaces whole code points.
+  bool was_valid = valid;
+  bool whole = (offset == m_text.size() || !utf8::is_continuation(m_text[offset])) &&
+               (old_end == m_text.size() || !utf8::is_continuation(m_text[old_end]));
+
+  m_text.replace(offset, removed, inserted);
+
+  valid = was_valid && whole && utf8::validate(inserted.data(), inserted.size()) == inserted.size() ?
+          true : utf8::validate(m_text.data(), m_text.size()) == m_text.size();
+
+  // line starts after the edit move, the ones inside it are found again.
+  uint edit_line = line_of(offset);
+  auto kept_line = std::upper_bound(lines.begin(), lines.end(), old_end);
+  std::vector<size_t> tail(kept_line, lines.end());
+  lines.resize(edit_line);
+  for (size_t i = offset; i < offset + inserted.size(); ++i) {
+    if (m_text[i] == '\n') {
+      lines.push_back(i + 1);
+    }
+  }
+  for (auto it = tail.begin(); it != tail.end(); ++it) {
+    lines.push_back(*it + delta);
+  }
+
+  size_t stop;
+
+  // the reader rejects all of the text when any of it is invalid, so read it again when that changes.
+  if (!valid || !was_valid) {
+    entries.clear();
+    entries = read(0, std::make_tuple(1, 1), 0, 0, stop);
+    m_reread = entries.size();
+    return;
+  }
+
+  auto fresh = read(start, start_pos, keep, delta, stop);
+  m_reread = fresh.size();
+
+  for (size_t i = stop; i < entries.size(); ++i) {
+    entries[i].offset += delta;
+    std::get<0>(entries[i].pos) += line_delta;
+    entries[i].pending += line_delta;
+  }
+
+  entries.erase(entries.begin() + first, entries.begin() + stop);
+  entries.insert(entries.begin() + first, std::make_move_iterator(fresh.begin()), std::make_move_iterator(fresh.end()));
+}
+
+std::vector<Document::Entry> Document::read(size_t offset, position pos, size_t from, long delta, size_t& stop) {
+  Reader reader(make_unique<Tokenizer>(make_unique<StringScanner>(m_text, offset, pos)), true);
+  std::vector<Entry> result;
+  stop = entries.size();
+
+  size_t candidate = from;
+  size_t reported = 0;
+
+  for (;;) {
+    Token token = reader.current_token();
+    bool end = token.type == TokenType::EndOfFile;
+    size_t at = end ? m_text.size() : offset_of(token.pos);
+
+    while (candidate < entries.size() && entries[candidate].offset + delta < at) {
+      ++candidate;
+    }
+    if (!end && candidate < entries.size() && entries[candidate].offset + delta == at) {
+      stop = candidate;
+      break;
+    }
+
+    auto form = reader.try_next();
+
+    Entry entry;
+    entry.offset = at;
+    entry.pos = end ? position(0, 0) : token.pos;
+    entry.pending = 0;
+
+    // diagnostics of the lookahead after a form are reported with that form.
+    entry.diagnostics.assign(reader.diagnostics().begin() + reported, reader.diagnostics().end());
+    reported = reader.diagnostics().size();
+
+    if (form && form->type() != ExpressionType::EndOfFile) {
+      entry.form = std::move(form);
+      result.push_back(std::move(entry));
+    }
+    else {
+      // the end, or a failure the reader can not recover from.
+      if (!entry.diagnostics.empty()) {
+        result.push_back(std::move(entry));
+      }
+      break;
+    }
+  }
+
+  return result;
+}
+
+size_t Document::size() const {
+  return entries.empty() || entries.back().form ? entries.size() : entries.size() - 1;
+}
+
+const Expression& Document::form(size_t i) {
+  Entry& entry = entries.at(i);
+
+  if (entry.pending != 0) {
+    shift(*entry.form, entry.pending);
+    for (auto it = entry.diagnostics.begin(); it != entry.diagnostics.end(); ++it) {
+      std::get<0>(it->pos) += entry.pending;
+    }
+    entry.pending = 0;
+  }
+
+  return *entry.form;
+}
+
+std::vector<Diagnostic> Document::diagnostics() const {
+  std::vector<Diagnostic> result;
+
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    for (auto d = it->diagnostics.begin(); d != it->diagnostics.end(); ++d) {
+      result.push_back(*d);
+      std::get<0>(result.back().pos) += it->pending;
+    }
+  }
+
+  return result;
+}
+
+void Document::index_lines(size_t from) {
+  for (size_t i = from; i < m_text.size(); ++i) {
+    if (m_text[i] == '\n') {
+      lines.push_back(i + 1);
+    }
+  }
+}
+
+size_t Document::offset_of(position pos) const {
+  // columns count code points, step over the continuation bytes of each.
+  size_t offset = lines[std::get<0>(pos) - 1];
+  for (uint column = 1; column < std::get<1>(pos) && offset < m_text.size(); ++column) {
+    do {
+      ++offset;
+    } while (offset < m_text.size() && utf8::is_continuation(m_text[offset]));
+  }
+  return offset;
+}
+
+uint Document::line_of(size_t offset) const {
+  return static_cast<uint>(std::upper_bound(lines.begin(), lines.end(), offset) - lines.begin());
+}
@@ -0,0 +1,1075 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <evaluator.hpp>
+#include <algorithm>
+#include <climits>
+#include <unordered_set>
+
+namespace eval {
+
+  struct Evaluator::Frame {
+    Value* slots;
+    const Value* captured;
+    Function* self;
+
+    // set by recur, the loop or function it targets runs its body again.
+    bool recur;
+  };
+
+  namespace {
+
+  typedef Evaluator::Frame Frame;
+  typedef Evaluator::Code Code;
+  typedef Evaluator::Stack Stack;
+  typedef std::list<UExpression>::const_iterator Element;
+
+  void locate(EvalError& e, position pos) {
+    if (e.pos == std::make_tuple(0u, 0u)) {
+      e.pos = pos;
+    }
+  }
+
+  inline uintptr_t native_address() {
+    return reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+  }
+
+  // n nil slots on top of the stack, set back to nil when it goes out of scope.
+  class Reserved {
+  public:
+    Reserved(Stack& stack, size_t n) : base(stack.top), stack(stack) {
+      if (static_cast<size_t>(stack.limit - base) < n) {
+        throw EvalError("Stack overflow");
+      }
+      stack.top = base + n;
+    }
+
+    ~Reserved() {
+      while (stack.top > base) {
+        *--stack.top = Value();
+      }
+    }
+
+    Value* const base;
+
+  private:
+    Stack& stack;
+  };
+
+  // marks where on the native stack the outermost evaluation started.
+  class Entered {
+  public:
+    explicit Entered(Stack& stack) : stack(stack), outermost(stack.entry == 0) {
+      if (outermost) {
+        stack.entry = native_address();
+      }
+    }
+
+    ~Entered() {
+      if (outermost) {
+        stack.entry = 0;
+      }
+    }
+
+  private:
+    Stack& stack;
+    bool outermost;
+  };
+
+  // how a closure fills one of its captured values from the frame that makes it.
+  struct Capture {
+    enum class Kind {
+      Local, Captured, Self
+    };
+
+    Kind kind;
+    uint32_t index;
+  };
+
+  struct Body {
+    std::string name;
+    uint32_t params = 0;
+
+    // the arguments from params on are passed as a list in slot params.
+    bool variadic = false;
+
+    uint32_t slots = 0;
+    Code code;
+    std::vector<Capture> captures;
+  };
+
+  class Lambda : public Function {
+  public:
+    Lambda(std::shared_ptr<const Body> body, Stack* stack) : Function(body->name), body(std::move(body)), stack(stack) {
+      owner = stack;
+    }
+
+    Value call(const Value* args, size_t argc) override {
+      Entered entered(*stack);
+      Reserved frame(*stack, std::max<size_t>(argc, body->slots));
+      std::copy(args, args + argc, frame.base);
+      return run(frame.base, argc);
+    }
+
+    // runs the body on the arguments at slots, which has room for all of its slots.
+    Value run(Value* slots, size_t argc) {
+      const Body& b = *body;
+      if (argc != b.params && (!b.variadic || argc < b.params)) {
+        throw EvalError("Wrong number of args (" + std::to_string(argc) + ") passed to " + name);
+      }
+      if (stack->entry - native_address() > stack->native_size) {
+        throw EvalError("Stack overflow");
+      }
+
+      if (b.variadic) {
+        std::vector<Value> rest;
+        if (argc > b.params) {
+          rest.assign(std::make_move_iterator(slots + b.params), std::make_move_iterator(slots + argc));
+        }
+        slots[b.params] = sequence(Type::List, std::move(rest));
+      }
+
+      Frame f{slots, captured.data(), this, false};
+      while (true) {
+        Value r = b.code(f);
+        if (!f.recur) {
+          return r;
+        }
+        f.recur = false;
+      }
+    }
+
+    std::shared_ptr<const Body> body;
+    std::vector<Value> captured;
+    Stack* stack;
+  };
+
+  Value make_set(std::vector<Value> values) {
+    std::vector<Value> items;
+    for (auto& v : values) {
+      bool seen = false;
+      for (auto& item : items) {
+        seen = seen || equal(item, v);
+      }
+      if (!seen) {
+        items.push_back(std::move(v));
+      }
+    }
+    return sequence(Type::Set, std::move(items));
+  }
+
+  // later keys replace the values of earlier equal ones.
+  Value make_map(std::vector<Value> values) {
+    std::vector<std::pair<Value, Value>> entries;
+    for (size_t i = 0; i + 1 < values.size(); i += 2) {
+      bool replaced = false;
+      for (auto& e : entries) {
+        if (!replaced && equal(e.first, values[i])) {
+          e.second = std::move(values[i + 1]);
+          replaced = true;
+        }
+      }
+      if (!replaced) {
+        entries.emplace_back(std::move(values[i]), std::move(values[i + 1]));
+      }
+    }
+    return map(std::move(entries));
+  }
+
+  Value make_collection(ExpressionType type, std::vector<Value> values) {
+    switch (type) {
+      case ExpressionType::Vector:
+        return sequence(Type::Vector, std::move(values));
+      case ExpressionType::Set:
+        return make_set(std::move(values));
+      default:
+        return make_map(std::move(values));
+    }
+  }
+
+  /*
+   * The operands of the inlined arithmetic: locals and constants are read
+   * in place, without calling the code of their node.
+   */
+  struct LocalArg {
+    uint32_t slot;
+
+    const Value& operator()(Frame& f) const {
+      return f.slots[slot];
+    }
+  };
+
+  struct ConstantArg {
+    Value value;
+
+    const Value& operator()(Frame&) const {
+      return value;
+    }
+  };
+
+  struct CodeArg {
+    Code code;
+
+    Value operator()(Frame& f) const {
+      return code(f);
+    }
+  };
+
+#define PUNCH_ARITHMETIC(Name, checked, slow) \
+  struct Name { \
+    Value operator()(const Value& a, const Value& b) const { \
+      long r; \
+      if (a.type() == Type::Integer && b.type() == Type::Integer && !checked(a.as_integer(), b.as_integer(), &r)) { \
+        return Value::integer(r); \
+      } \
+      return slow(a, b); \
+    } \
+  };
+
+#define PUNCH_COMPARISON(Name, holds) \
+  struct Name { \
+    Value operator()(const Value& a, const Value& b) const { \
+      return Value::boolean(a.type() == Type::Integer && b.type() == Type::Integer \
+          ? a.as_integer() holds b.as_integer() : compare(a, b) holds 0); \
+    } \
+  };
+
+  PUNCH_ARITHMETIC(AddOp, __builtin_add_overflow, add)
+  PUNCH_ARITHMETIC(SubtractOp, __builtin_sub_overflow, subtract)
+  PUNCH_ARITHMETIC(MultiplyOp, __builtin_mul_overflow, multiply)
+  PUNCH_COMPARISON(LessOp, <)
+  PUNCH_COMPARISON(GreaterOp, >)
+  PUNCH_COMPARISON(LessEqualOp, <=)
+  PUNCH_COMPARISON(GreaterEqualOp, >=)
+
+#undef PUNCH_ARITHMETIC
+#undef PUNCH_COMPARISON
+
+  struct DivideOp {
+    Value operator()(const Value& a, const Value& b) const {
+      return divide(a, b);
+    }
+  };
+
+  struct EqualOp {
+    Value operator()(const Value& a, const Value& b) const {
+      return Value::boolean(equal(a, b));
+    }
+  };
+
+  // pure core functions, calls of which on constants are folded.
+  const std::unordered_set<std::string> pure = {
+      "+", "-", "*", "/", "<", ">", "<=", ">=", "=", "not=", "inc", "dec", "mod", "rem", "quot", "min", "max",
+      "abs", "sqrt", "double", "int", "not", "nil?", "zero?", "pos?", "neg?", "even?", "odd?", "empty?",
+      "number?", "string?", "keyword?", "vector?", "map?", "fn?", "count", "first", "second", "last", "rest",
+      "next", "nth", "get", "contains?", "assoc", "dissoc", "conj", "cons", "list", "vector", "hash-map",
+      "hash-set", "vec", "keys", "vals", "concat", "reverse", "into", "str", "keyword", "identity"
+  };
+
+  const std::string* symbol_of(const Expression& e) {
+    if (e.type() != ExpressionType::Literal) {
+      return nullptr;
+    }
+    auto& value = static_cast<const expression::Literal&>(e).value();
+    if (value == "nil" || value == "true" || value == "false") {
+      return nullptr;
+    }
+    return &value;
+  }
+
+  const std::list<UExpression>& inner_of(const Expression& e) {
+    switch (e.type()) {
+      case ExpressionType::List:
+        return static_cast<const expression::List&>(e).inner();
+      case ExpressionType::Vector:
+        return static_cast<const expression::Vector&>(e).inner();
+      case ExpressionType::Set:
+        return static_cast<const expression::Set&>(e).inner();
+      default:
+        return static_cast<const expression::Map&>(e).inner();
+    }
+  }
+
+  // the compiled form of an expression, with what is known about its value.
+  struct Node {
+    Code code;
+    bool constant = false;
+    Value value;
+
+    // the slot when all it does is read a local, -1 otherwise.
+    int64_t local = -1;
+  };
+
+  Node constant_node(Value v) {
+    Node n;
+    n.code = [v](Frame&) {
+      return v;
+    };
+    n.constant = true;
+    n.value = std::move(v);
+    return n;
+  }
+
+  struct Local {
+    std::string name;
+    uint32_t slot;
+
+    // bound by let to a constant, which is used in place of the slot.
+    bool constant;
+    Value value;
+  };
+
+  struct Scope {
+    Scope(Scope* enclosing, std::shared_ptr<Body> body) : enclosing(enclosing), body(std::move(body)) {}
+
+    Scope* enclosing;
+    std::shared_ptr<Body> body;
+
+    // the name a named fn refers to itself by.
+    std::string self;
+
+    std::vector<Local> locals;
+    std::vector<std::string> captured;
+    uint32_t next_slot = 0;
+
+    bool has_loop = false;
+    std::vector<uint32_t> loop;
+  };
+
+  struct Resolved {
+    enum class Kind {
+      Local, Constant, Captured, Self, Global
+    };
+
+    Kind kind;
+    uint32_t index;
+    Value value;
+  };
+
+  class Compiler {
+  public:
+    Compiler(Environment& env, Stack& stack) : env(env), stack(&stack) {}
+
+    Node top_level(const Expression& form, uint32_t& slots) {
+      Scope scope(nullptr, std::make_shared<Body>());
+      this->scope = &scope;
+      Node n = compile(form, false);
+      slots = scope.body->slots;
+      return n;
+    }
+
+  private:
+    Node compile(const Expression& e, bool tail) {
+      switch (e.type()) {
+        case ExpressionType::Literal:
+          if (symbol_of(e)) {
+            return load(*symbol_of(e), e.pos);
+          }
+          return constant_node(from_expression(e));
+        case ExpressionType::List:
+          return call(e, tail);
+        case ExpressionType::Vector:
+        case ExpressionType::Map:
+        case ExpressionType::Set:
+          return collection(e);
+        case ExpressionType::EndOfFile:
+          throw EvalError("Cannot evaluate end of file", e.pos);
+        default:
+          return constant_node(from_expression(e));
+      }
+    }
+
+    Node collection(const Expression& e) {
+      ExpressionType type = e.type();
+      std::vector<Node> items;
+      bool constant = true;
+      for (auto& item : inner_of(e)) {
+        items.push_back(compile(*item, false));
+        constant = constant && items.back().constant;
+      }
+
+      if (constant) {
+        std::vector<Value> values;
+        for (auto& item : items) {
+          values.push_back(item.value);
+        }
+        return constant_node(make_collection(type, std::move(values)));
+      }
+
+      std::vector<Code> codes = codes_of(items);
+      Node n;
+      n.code = [type, codes](Frame& f) {
+        std::vector<Value> values;
+        values.reserve(codes.size());
+        for (auto& code : codes) {
+          values.push_back(code(f));
+        }
+        return make_collection(type, std::move(values));
+      };
+      return n;
+    }
+
+    Node call(const Expression& e, bool tail) {
+      auto& inner = static_cast<const expression::List&>(e).inner();
+      if (inner.empty()) {
+        return constant_node(sequence(Type::List, {}));
+      }
+
+      Element first = inner.begin();
+      Element args = std::next(first);
+      size_t argc = inner.size() - 1;
+      const std::string* head = symbol_of(**first);
+
+      if (head) {
+        const std::string& name = *head;
+        if (name == "def") {
+          return def(e, args, argc);
+        }
+        if (name == "defn") {
+          return defn(e, args, argc);
+        }
+        if (name == "fn") {
+          return fn(e, args, inner.end(), "");
+        }
+        if (name == "let" || name == "loop") {
+          return let(e, args, argc, tail, name == "loop");
+        }
+        if (name == "if") {
+          return branch(e, args, argc, tail);
+        }
+        if (name == "do") {
+          return body(args, inner.end(), tail);
+        }
+        if (name == "recur") {
+          return recur(e, args, argc, tail);
+        }
+        if (name == "quote") {
+          if (argc != 1) {
+            throw EvalError("quote takes one form", e.pos);
+          }
+          return constant_node(from_expression(**args));
+        }
+      }
+
+      Node callee = compile(**first, false);
+      std::vector<Node> operands;
+      for (Element it = args; it != inner.end(); ++it) {
+        operands.push_back(compile(**it, false));
+      }
+
+      if (head) {
+        Resolved r = resolve(*scope, *head, false);
+        if (r.kind == Resolved::Kind::Global && env.is_core(r.index)) {
+          Node n;
+          if (fold(*head, r.index, operands, n) || inline_call(*head, operands, e.pos, n)) {
+            return n;
+          }
+        }
+      }
+
+      Code code = callee.code;
+      std::vector<Code> codes = codes_of(operands);
+      Stack* stack = this->stack;
+      position pos = e.pos;
+      Node n;
+      n.code = [code, codes, stack, pos](Frame& f) -> Value {
+        Value fn = code(f);
+        size_t argc = codes.size();
+        try {
+          if (fn.type() == Type::Function && fn.as<Function>().owner == stack) {
+            Lambda& lambda = fn.as<Lambda>();
+            Reserved frame(*stack, std::max<size_t>(argc, lambda.body->slots));
+            for (size_t i = 0; i < argc; ++i) {
+              frame.base[i] = codes[i](f);
+            }
+            return lambda.run(frame.base, argc);
+          }
+
+          Reserved frame(*stack, argc);
+          for (size_t i = 0; i < argc; ++i) {
+            frame.base[i] = codes[i](f);
+          }
+          return invoke(fn, frame.base, argc);
+        }
+        catch (EvalError& error) {
+          locate(error, pos);
+          throw;
+        }
+      };
+      return n;
+    }
+
+    // calls a pure core function when every argument is constant; errors are left to happen when running.
+    bool fold(const std::string& name, uint32_t slot, const std::vector<Node>& operands, Node& n) {
+      if (!pure.count(name)) {
+        return false;
+      }
+
+      std::vector<Value> args;
+      for (auto& operand : operands) {
+        if (!operand.constant) {
+          return false;
+        }
+        args.push_back(operand.value);
+      }
+
+      try {
+        n = constant_node(invoke(env.get(slot), args.data(), args.size()));
+        return true;
+      }
+      catch (EvalError&) {
+        return false;
+      }
+    }
+
+    bool inline_call(const std::string& name, const std::vector<Node>& operands, position pos, Node& n) {
+      size_t argc = operands.size();
+      if (name == "+" || name == "*") {
+        Node acc = constant_node(Value::integer(name == "+" ? 0 : 1));
+        for (auto& operand : operands) {
+          acc = name == "+" ? binary(AddOp(), acc, operand, pos) : binary(MultiplyOp(), acc, operand, pos);
+        }
+        n = acc;
+        return true;
+      }
+
+      if (name == "-" && argc == 1) {
+        n = binary(SubtractOp(), constant_node(Value::integer(0)), operands[0], pos);
+        return true;
+      }
+
+      if ((name == "-" || name == "/") && argc >= 2) {
+        Node acc = operands[0];
+        for (size_t i = 1; i < argc; ++i) {
+          acc = name == "-" ? binary(SubtractOp(), acc, operands[i], pos) : binary(DivideOp(), acc, operands[i], pos);
+        }
+        n = acc;
+        return true;
+      }
+
+      if ((name == "inc" || name == "dec") && argc == 1) {
+        Node one = constant_node(Value::integer(1));
+        n = name == "inc" ? binary(AddOp(), operands[0], one, pos) : binary(SubtractOp(), operands[0], one, pos);
+        return true;
+      }
+
+      if (argc != 2) {
+        return false;
+      }
+      if (name == "<") {
+        n = binary(LessOp(), operands[0], operands[1], pos);
+      }
+      else if (name == ">") {
+        n = binary(GreaterOp(), operands[0], operands[1], pos);
+      }
+      else if (name == "<=") {
+        n = binary(LessEqualOp(), operands[0], operands[1], pos);
+      }
+      else if (name == ">=") {
+        n = binary(GreaterEqualOp(), operands[0], operands[1], pos);
+      }
+      else if (name == "=") {
+        n = binary(EqualOp(), operands[0], operands[1], pos);
+      }
+      else {
+        return false;
+      }
+      return true;
+    }
+
+    template <class Op, class A, class B>
+    static Code binary_code(Op op, A a, B b, position pos) {
+      return [op, a, b, pos](Frame& f) -> Value {
+        auto&& x = a(f);
+        auto&& y = b(f);
+        try {
+          return op(x, y);
+        }
+        catch (EvalError& error) {
+          locate(error, pos);
+          throw;
+        }
+      };
+    }
+
+    template <class Op, class A>
+    static Code binary_code(Op op, A a, const Node& b, position pos) {
+      if (b.constant) {
+        return binary_code(op, a, ConstantArg{b.value}, pos);
+      }
+      if (b.local >= 0) {
+        return binary_code(op, a, LocalArg{static_cast<uint32_t>(b.local)}, pos);
+      }
+      return binary_code(op, a, CodeArg{b.code}, pos);
+    }
+
+    template <class Op>
+    static Node binary(Op op, const Node& a, const Node& b, position pos) {
+      if (a.constant && b.constant) {
+        try {
+          return constant_node(op(a.value, b.value));
+        }
+        catch (EvalError&) {
+        }
+      }
+
+      Node n;
+      if (a.constant) {
+        n.code = binary_code(op, ConstantArg{a.value}, b, pos);
+      }
+      else if (a.local >= 0) {
+        n.code = binary_code(op, LocalArg{static_cast<uint32_t>(a.local)}, b, pos);
+      }
+      else {
+        n.code = binary_code(op, CodeArg{a.code}, b, pos);
+      }
+      return n;
+    }
+
+    Node def(const Expression& e, Element args, size_t argc) {
+      if (argc < 1 || argc > 2 || !symbol_of(**args)) {
+        throw EvalError("def takes a name and a value", e.pos);
+      }
+
+      const std::string& name = *symbol_of(**args);
+      uint32_t slot = env.slot(name);
+      Node value;
+      if (argc == 1) {
+        value = constant_node(Value());
+      }
+      else {
+        const Expression& form = **std::next(args);
+        const std::string* head = form.type() == ExpressionType::List && !inner_of(form).empty()
+            ? symbol_of(*inner_of(form).front()) : nullptr;
+        if (head && *head == "fn") {
+          value = fn(form, std::next(inner_of(form).begin()), inner_of(form).end(), name);
+        }
+        else {
+          value = compile(form, false);
+        }
+      }
+      return define(slot, value);
+    }
+
+    // (defn name "doc"? {attrs}? [params] body...), a def of a fn that knows its own name.
+    Node defn(const Expression& e, Element args, size_t argc) {
+      auto& inner = static_cast<const expression::List&>(e).inner();
+      if (argc < 2 || !symbol_of(**args)) {
+        throw EvalError("defn takes a name, parameters and a body", e.pos);
+      }
+
+      const std::string& name = *symbol_of(**args);
+      Element rest = std::next(args);
+      while (rest != inner.end() && ((*rest)->type() == ExpressionType::String || (*rest)->type() == ExpressionType::Map)) {
+        ++rest;
+      }
+
+      return define(env.slot(name), function(e, rest, inner.end(), name, name));
+    }
+
+    Node define(uint32_t slot, const Node& value) {
+      Environment* env = &this->env;
+      Code code = value.code;
+      Node n;
+      n.code = [env, slot, code](Frame& f) {
+        Value v = code(f);
+        env->set(slot, v);
+        return v;
+      };
+      return n;
+    }
+
+    // (fn name? [params] body...)
+    Node fn(const Expression& e, Element args, Element end, const std::string& hint) {
+      std::string self;
+      if (args != end && symbol_of(**args)) {
+        self = *symbol_of(**args);
+        ++args;
+      }
+      return function(e, args, end, self.empty() ? (hint.empty() ? "fn" : hint) : self, self);
+    }
+
+    Node function(const Expression& e, Element params, Element end, const std::string& name, const std::string& self) {
+      if (params == end || (*params)->type() != ExpressionType::Vector) {
+        if (params != end && (*params)->type() == ExpressionType::List) {
+          throw EvalError("Multi-arity fn is not supported", e.pos);
+        }
+        throw EvalError("fn takes a parameter vector", e.pos);
+      }
+
+      auto made = std::make_shared<Body>();
+      made->name = name;
+      Scope inner(scope, made);
+      inner.self = self;
+
+      auto& names = inner_of(**params);
+      for (auto it = names.begin(); it != names.end(); ++it) {
+        const std::string* param = symbol_of(**it);
+        if (!param) {
+          throw EvalError("Unsupported parameter " + (*it)->DebugInfo(), (*it)->pos);
+        }
+        if (*param == "&") {
+          if (std::next(it) == names.end() || std::next(it, 2) != names.end() || !symbol_of(**std::next(it))) {
+            throw EvalError("& takes one parameter after it", (*it)->pos);
+          }
+          made->variadic = true;
+          continue;
+        }
+        if (!made->variadic) {
+          ++made->params;
+        }
+        inner.loop.push_back(inner.next_slot);
+        inner.locals.push_back(Local{*param, inner.next_slot++, false, Value()});
+      }
+      made->slots = inner.next_slot;
+      inner.has_loop = true;
+
+      Scope* outer = scope;
+      scope = &inner;
+      made->code = body(std::next(params), end, true).code;
+      scope = outer;
+
+      // nothing to capture, so every evaluation would make the same function.
+      if (made->captures.empty()) {
+        return constant_node(Value(Type::Function, new Lambda(made, stack)));
+      }
+
+      Stack* stack = this->stack;
+      Node n;
+      n.code = [made, stack](Frame& f) {
+        Lambda* lambda = new Lambda(made, stack);
+        Value v(Type::Function, lambda);
+        lambda->captured.reserve(made->captures.size());
+        for (auto& capture : made->captures) {
+          switch (capture.kind) {
+            case Capture::Kind::Local:
+              lambda->captured.push_back(f.slots[capture.index]);
+              break;
+            case Capture::Kind::Captured:
+              lambda->captured.push_back(f.captured[capture.index]);
+              break;
+            case Capture::Kind::Self:
+              lambda->captured.push_back(Value(Type::Function, f.self));
+              break;
+          }
+        }
+        return v;
+      };
+      return n;
+    }
+
+    Node let(const Expression& e, Element args, size_t argc, bool tail, bool loop) {
+      const char* form = loop ? "loop" : "let";
+      if (argc < 1 || (*args)->type() != ExpressionType::Vector || inner_of(**args).size() % 2 != 0) {
+        throw EvalError(std::string(form) + " takes a vector of bindings", e.pos);
+      }
+
+      size_t locals = scope->locals.size();
+      uint32_t next_slot = scope->next_slot;
+      std::vector<std::pair<uint32_t, Code>> inits;
+      std::vector<uint32_t> slots;
+
+      auto& bindings = inner_of(**args);
+      for (auto it = bindings.begin(); it != bindings.end(); std::advance(it, 2)) {
+        const std::string* name = symbol_of(**it);
+        if (!name) {
+          throw EvalError("Unsupported binding " + (*it)->DebugInfo(), (*it)->pos);
+        }
+
+        Node value = compile(**std::next(it), false);
+        // recur rebinds the names of a loop, so only those of a let can stand for their constant.
+        if (value.constant && !loop) {
+          scope->locals.push_back(Local{*name, 0, true, value.value});
+          continue;
+        }
+
+        uint32_t slot = scope->next_slot++;
+        scope->body->slots = std::max(scope->body->slots, scope->next_slot);
+        inits.emplace_back(slot, value.code);
+        scope->locals.push_back(Local{*name, slot, false, Value()});
+        slots.push_back(slot);
+      }
+
+      auto& inner = static_cast<const expression::List&>(e).inner();
+      Node result;
+      if (loop) {
+        bool had_loop = scope->has_loop;
+        std::vector<uint32_t> outer = scope->loop;
+        scope->has_loop = true;
+        scope->loop = slots;
+        result = body(std::next(args), inner.end(), true);
+        scope->has_loop = had_loop;
+        scope->loop = outer;
+      }
+      else {
+        result = body(std::next(args), inner.end(), tail);
+      }
+
+      scope->locals.resize(locals);
+      scope->next_slot = next_slot;
+
+      Code code = result.code;
+      if (loop) {
+        Node n;
+        n.code = [inits, code](Frame& f) {
+          for (auto& init : inits) {
+            f.slots[init.first] = init.second(f);
+          }
+          while (true) {
+            Value r = code(f);
+            if (!f.recur) {
+              return r;
+            }
+            f.recur = false;
+          }
+        };
+        return n;
+      }
+
+      if (inits.empty()) {
+        return result;
+      }
+
+      Node n;
+      n.code = [inits, code](Frame& f) {
+        for (auto& init : inits) {
+          f.slots[init.first] = init.second(f);
+        }
+        return code(f);
+      };
+      return n;
+    }
+
+    Node branch(const Expression& e, Element args, size_t argc, bool tail) {
+      if (argc < 2 || argc > 3) {
+        throw EvalError("if takes a test, a then and an optional else", e.pos);
+      }
+
+      Node test = compile(**args, false);
+      Node then = compile(**std::next(args), tail);
+      Node otherwise = argc == 3 ? compile(**std::next(args, 2), tail) : constant_node(Value());
+      if (test.constant) {
+        return test.value.truthy() ? then : otherwise;
+      }
+
+      Code test_code = test.code;
+      Code then_code = then.code;
+      Code otherwise_code = otherwise.code;
+      Node n;
+      n.code = [test_code, then_code, otherwise_code](Frame& f) {
+        return test_code(f).truthy() ? then_code(f) : otherwise_code(f);
+      };
+      return n;
+    }
+
+    // the forms in order, the value of the last one. Constants and locals before it do nothing and are left out.
+    Node body(Element it, Element end, bool tail) {
+      if (it == end) {
+        return constant_node(Value());
+      }
+
+      std::vector<Code> effects;
+      for (; std::next(it) != end; ++it) {
+        Node n = compile(**it, false);
+        if (!n.constant && n.local < 0) {
+          effects.push_back(n.code);
+        }
+      }
+
+      Node last = compile(**it, tail);
+      if (effects.empty()) {
+        return last;
+      }
+
+      Code code = last.code;
+      Node n;
+      n.code = [effects, code](Frame& f) {
+        for (auto& effect : effects) {
+          effect(f);
+        }
+        return code(f);
+      };
+      return n;
+    }
+
+    // stores the new values in the slots of the loop and flags the frame, everything up to the loop returns.
+    Node recur(const Expression& e, Element args, size_t argc, bool tail) {
+      if (!scope->has_loop) {
+        throw EvalError("recur outside of loop or fn", e.pos);
+      }
+      if (!tail) {
+        throw EvalError("Can only recur from tail position", e.pos);
+      }
+      if (argc != scope->loop.size()) {
+        throw EvalError("Mismatched argument count to recur, expected " + std::to_string(scope->loop.size()) +
+                        " args, got " + std::to_string(argc), e.pos);
+      }
+
+      std::vector<Node> values;
+      for (size_t i = 0; i < argc; ++i, ++args) {
+        values.push_back(compile(**args, false));
+      }
+
+      Node n;
+      std::vector<uint32_t> slots = scope->loop;
+      if (argc == 1) {
+        uint32_t slot = slots[0];
+        Code code = values[0].code;
+        n.code = [slot, code](Frame& f) {
+          f.slots[slot] = code(f);
+          f.recur = true;
+          return Value();
+        };
+      }
+      else {
+        std::vector<Code> codes = codes_of(values);
+        Stack* stack = this->stack;
+        n.code = [slots, codes, stack](Frame& f) {
+          Reserved next(*stack, codes.size());
+          for (size_t i = 0; i < codes.size(); ++i) {
+            next.base[i] = codes[i](f);
+          }
+          for (size_t i = 0; i < codes.size(); ++i) {
+            f.slots[slots[i]] = std::move(next.base[i]);
+          }
+          f.recur = true;
+          return Value();
+        };
+      }
+      return n;
+    }
+
+    Node load(const std::string& name, position pos) {
+      Resolved r = resolve(*scope, name, true);
+      Node n;
+      uint32_t index = r.index;
+      Environment* env = &this->env;
+      switch (r.kind) {
+        case Resolved::Kind::Local:
+          n.local = index;
+          n.code = [index](Frame& f) {
+            return f.slots[index];
+          };
+          break;
+        case Resolved::Kind::Constant:
+          return constant_node(r.value);
+        case Resolved::Kind::Captured:
+          n.code = [index](Frame& f) {
+            return f.captured[index];
+          };
+          break;
+        case Resolved::Kind::Self:
+          n.code = [](Frame& f) {
+            return Value(Type::Function, f.self);
+          };
+          break;
+        case Resolved::Kind::Global:
+          n.code = [env, index, pos](Frame&) -> Value {
+            if (!env->bound(index)) {
+              throw EvalError("Unable to resolve symbol: " + env->name(index), pos);
+            }
+            return env->get(index);
+          };
+          break;
+      }
+      return n;
+    }
+
+    // with capture unset only looks, so no capture is added for a name that is not used.
+    Resolved resolve(Scope& s, const std::string& name, bool capture) {
+      for (auto it = s.locals.rbegin(); it != s.locals.rend(); ++it) {
+        if (it->name == name) {
+          return it->constant ? Resolved{Resolved::Kind::Constant, 0, it->value} : Resolved{Resolved::Kind::Local, it->slot, Value()};
+        }
+      }
+      if (s.self == name) {
+        return Resolved{Resolved::Kind::Self, 0, Value()};
+      }
+      for (size_t i = 0; i < s.captured.size(); ++i) {
+        if (s.captured[i] == name) {
+          return Resolved{Resolved::Kind::Captured, static_cast<uint32_t>(i), Value()};
+        }
+      }
+
+      if (s.enclosing) {
+        Resolved outer = resolve(*s.enclosing, name, capture);
+        if (outer.kind == Resolved::Kind::Global || outer.kind == Resolved::Kind::Constant) {
+          return outer;
+        }
+        if (!capture) {
+          return Resolved{Resolved::Kind::Captured, 0, Value()};
+        }
+
+        Capture::Kind kind = outer.kind == Resolved::Kind::Local ? Capture::Kind::Local
+            : outer.kind == Resolved::Kind::Captured ? Capture::Kind::Captured : Capture::Kind::Self;
+        s.body->captures.push_back(Capture{kind, outer.index});
+        s.captured.push_back(name);
+        return Resolved{Resolved::Kind::Captured, static_cast<uint32_t>(s.captured.size() - 1), Value()};
+      }
+
+      uint32_t slot;
+      if (!capture && !env.find(name, slot)) {
+        return Resolved{Resolved::Kind::Global, UINT32_MAX, Value()};
+      }
+      return Resolved{Resolved::Kind::Global, env.slot(name), Value()};
+    }
+
+    static std::vector<Code> codes_of(const std::vector<Node>& nodes) {
+      std::vector<Code> codes;
+      for (auto& n : nodes) {
+        codes.push_back(n.code);
+      }
+      return codes;
+    }
+
+    Environment& env;
+    Stack* stack;
+    Scope* scope = nullptr;
+  };
+
+  }
+
+  Evaluator::Evaluator(Environment& env, size_t stack_size, size_t native_size) : env(env) {
+    stack.values.reset(new Value[stack_size]);
+    stack.limit = stack.values.get() + stack_size;
+    stack.top = stack.values.get();
+    stack.native_size = native_size;
+  }
+
+  Evaluator::Compiled Evaluator::compile(const Expression& form) {
+    Compiled compiled;
+    Node n = Compiler(env, stack).top_level(form, compiled.slots);
+    compiled.stack = &stack;
+    compiled.code = std::move(n.code);
+    compiled.m_constant = n.constant;
+    compiled.m_value = std::move(n.value);
+    return compiled;
+  }
+
+  Value Evaluator::Compiled::operator()() const {
+    if (m_constant) {
+      return m_value;
+    }
+
+    Entered entered(*stack);
+    Reserved frame(*stack, slots);
+    Frame f{frame.base, nullptr, nullptr, false};
+    return code(f);
+  }
+
+  Value Evaluator::eval(const std::string& source) {
+    Value last;
+    auto forms = read_forms(source);
+    for (auto& form : forms) {
+      last = eval(*form);
+    }
+    return last;
+  }
+}
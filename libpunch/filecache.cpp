@@ -0,0 +1,328 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <filecache.hpp>
+#include <binaryform.hpp>
+#include <printer.hpp>
+#include <reader.hpp>
+#include <scanner.hpp>
+#include <stats.hpp>
+#include <trace.hpp>
+#include <cstdio>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+  const uint32_t watched_events = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF;
+
+  const char* query_names[] = {"binary", "punch", "debug", "tokens", "index"};
+
+  void append_diagnostic(std::string& out, const Diagnostic& d) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%u:%u: error: ", std::get<0>(d.pos), std::get<1>(d.pos));
+    out.append(buf, n);
+    out.append(d.message);
+    out.push_back('\n');
+  }
+
+  // "line:column Type head", where head is the first element of a list when it is a literal.
+  void append_index(std::string& out, const Expression& e) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%u:%u ", std::get<0>(e.pos), std::get<1>(e.pos));
+    out.append(buf, n);
+    out.append(stats::name(e.type()));
+
+    if (e.type() == ExpressionType::List) {
+      auto& inner = static_cast<const List&>(e).inner();
+      if (!inner.empty() && inner.front()->type() == ExpressionType::Literal) {
+        out.push_back(' ');
+        out.append(static_cast<const Literal&>(*inner.front()).value());
+      }
+    }
+    out.push_back('\n');
+  }
+
+  int64_t mtime_of(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+  }
+}
+
+FileCache::FileCache(size_t capacity, bool watch) : capacity(capacity) {
+  if (watch) {
+    // without inotify every query stats the file instead.
+    inotify = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  }
+}
+
+FileCache::~FileCache() {
+  if (inotify >= 0) {
+    ::close(inotify);
+  }
+}
+
+size_t FileCache::Entry::bytes() const {
+  size_t n = path.size() + text.size();
+  for (size_t i = 0; i < queries; ++i) {
+    n += responses[i].body.size();
+  }
+  return n;
+}
+
+const char* FileCache::name(Query query) {
+  return query_names[static_cast<size_t>(query)];
+}
+
+bool FileCache::parse(const std::string& name, Query& query) {
+  for (size_t i = 0; i < queries; ++i) {
+    if (name == query_names[i]) {
+      query = static_cast<Query>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+const FileCache::Response& FileCache::get(const std::string& path, Query query) {
+  PUNCH_TRACE_SPAN(span, "file cache", "daemon");
+  process_events();
+
+  auto found = index.find(path);
+  if (found == index.end()) {
+    lru.emplace_front();
+    lru.front().path = path;
+    index[path] = lru.begin();
+    m_bytes += lru.front().bytes();
+  }
+  else {
+    lru.splice(lru.begin(), lru, found->second);
+  }
+
+  Entry& entry = lru.front();
+  bool rendered = false;
+  if (entry.wd < 0 || entry.changed) {
+    if (!refresh(lru.begin(), rendered)) {
+      remove(lru.begin());
+      return error;
+    }
+  }
+
+  size_t i = static_cast<size_t>(query);
+  if (entry.rendered[i] && !(rendered && query == Query::Binary)) {
+    ++m_hits;
+  }
+  else {
+    ++m_misses;
+    if (!entry.rendered[i]) {
+      m_bytes -= entry.bytes();
+      render(entry, query);
+      m_bytes += entry.bytes();
+    }
+    rendered = true;
+  }
+
+  if (rendered) {
+    evict();
+  }
+  return entry.responses[i];
+}
+
+bool FileCache::refresh(Iterator it, bool& rendered) {
+  Entry& entry = *it;
+
+  // watch before looking at the file, so no change after the stat goes unnoticed.
+  if (inotify >= 0 && entry.wd < 0) {
+    watch(it);
+  }
+  entry.changed = false;
+
+  struct stat st;
+  if (::stat(entry.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+    error = Response{false, "Could not open file\n"};
+    return false;
+  }
+
+  bool loaded = entry.rendered[static_cast<size_t>(Query::Binary)];
+  if (loaded && mtime_of(st) == entry.mtime && static_cast<uint64_t>(st.st_size) == entry.size) {
+    return true;
+  }
+
+  std::string text;
+  if (!load_file(entry.path, text)) {
+    error = Response{false, "Could not open file\n"};
+    return false;
+  }
+
+  entry.mtime = mtime_of(st);
+  entry.size = static_cast<uint64_t>(st.st_size);
+
+  // touched or rewritten with the same contents, what was rendered still holds.
+  uint64_t hash = content_hash(text.data(), text.size());
+  if (loaded && hash == entry.hash && text == entry.text) {
+    return true;
+  }
+
+  m_bytes -= entry.bytes();
+  entry.hash = hash;
+  entry.text = std::move(text);
+  for (size_t i = 0; i < queries; ++i) {
+    entry.rendered[i] = false;
+    entry.responses[i] = Response();
+  }
+
+  // every other query is rendered from the binary form.
+  render(entry, Query::Binary);
+  m_bytes += entry.bytes();
+  rendered = true;
+
+  return true;
+}
+
+void FileCache::render(Entry& entry, Query query) {
+  size_t i = static_cast<size_t>(query);
+  Response& response = entry.responses[i];
+  const Response& binary = entry.responses[static_cast<size_t>(Query::Binary)];
+
+  switch (query) {
+    case Query::Binary: {
+      auto result = try_read_forms(entry.text, true);
+      response.ok = result.ok();
+      if (response.ok) {
+        binaryform::encode(result.forms, response.body);
+      }
+      else {
+        for (auto it = result.diagnostics.begin(); it != result.diagnostics.end(); ++it) {
+          append_diagnostic(response.body, *it);
+        }
+      }
+      break;
+    }
+    case Query::Punch:
+    case Query::Debug:
+    case Query::Index: {
+      if (!binary.ok) {
+        response = binary;
+        break;
+      }
+
+      auto forms = binaryform::decode(binary.body);
+      response.ok = true;
+      for (auto it = forms.begin(); it != forms.end(); ++it) {
+        if (query == Query::Index) {
+          append_index(response.body, **it);
+        }
+        else {
+          Printer::append(response.body, **it, query == Query::Debug ? Printer::Format::Debug : Printer::Format::Punch);
+          response.body.push_back('\n');
+        }
+      }
+      break;
+    }
+    case Query::Tokens: {
+      Tokenizer tokenizer(make_unique<StringScanner>(entry.text));
+      auto token = tokenizer.next();
+      while (token != Token::EndOfFile) {
+        Printer::append(response.body, token);
+        response.body.append(", ");
+        token = tokenizer.next();
+      }
+
+      response.ok = !tokenizer.failed();
+      if (!response.ok) {
+        response.body.clear();
+        append_diagnostic(response.body, tokenizer.error());
+      }
+      break;
+    }
+  }
+
+  entry.rendered[i] = true;
+}
+
+void FileCache::process_events() {
+  if (inotify < 0) {
+    return;
+  }
+
+  alignas(struct inotify_event) char buf[4096];
+  ssize_t n;
+  while ((n = ::read(inotify, buf, sizeof(buf))) > 0) {
+    for (char* p = buf; p < buf + n; ) {
+      auto event = reinterpret_cast<struct inotify_event*>(p);
+      p += sizeof(struct inotify_event) + event->len;
+
+      // events were lost, nothing cached can be trusted.
+      if (event->mask & IN_Q_OVERFLOW) {
+        for (auto it = lru.begin(); it != lru.end(); ++it) {
+          it->changed = true;
+        }
+        continue;
+      }
+
+      auto range = watches.equal_range(event->wd);
+      for (auto it = range.first; it != range.second; ++it) {
+        auto found = index.find(it->second);
+        if (found != index.end()) {
+          found->second->changed = true;
+          if (event->mask & IN_IGNORED) {
+            found->second->wd = -1;
+          }
+        }
+      }
+
+      // the file was deleted or replaced and the kernel dropped the watch.
+      if (event->mask & IN_IGNORED) {
+        watches.erase(event->wd);
+      }
+    }
+  }
+}
+
+void FileCache::watch(Iterator it) {
+  int wd = ::inotify_add_watch(inotify, it->path.c_str(), watched_events);
+  if (wd >= 0) {
+    it->wd = wd;
+    watches.insert(std::make_pair(wd, it->path));
+  }
+}
+
+void FileCache::unwatch(Entry& entry) {
+  if (entry.wd < 0) {
+    return;
+  }
+
+  auto range = watches.equal_range(entry.wd);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == entry.path) {
+      watches.erase(it);
+      break;
+    }
+  }
+
+  if (watches.count(entry.wd) == 0) {
+    ::inotify_rm_watch(inotify, entry.wd);
+  }
+  entry.wd = -1;
+}
+
+void FileCache::remove(Iterator it) {
+  unwatch(*it);
+  m_bytes -= it->bytes();
+  index.erase(it->path);
+  lru.erase(it);
+}
+
+void FileCache::evict() {
+  // the front entry was just used and is kept even when it alone exceeds the capacity.
+  while (m_bytes > capacity && lru.size() > 1) {
+    remove(std::prev(lru.end()));
+  }
+}
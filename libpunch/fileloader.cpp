@@ -0,0 +1,625 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <fileloader.hpp>
+#include <threadpool.hpp>
+#include <trace.hpp>
+#include <util.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+  // the size of the open file fd, -1 with errno set when it can not be asked.
+  off_t file_size(int fd) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      return -1;
+    }
+    return st.st_size;
+  }
+}
+
+#if defined(__linux__) && defined(IORING_OP_READ)
+
+/*
+ * The submission and completion rings of an io_uring, set up with the bare
+ * syscalls since liburing is not a dependency. Not thread safe.
+ */
+class FileLoader::Ring {
+
+public:
+  explicit Ring(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      return;
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+      sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cq_ring = single ? sq_ring : ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                        IORING_OFF_CQ_RING);
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* entries_map = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                               IORING_OFF_SQES);
+    if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || entries_map == MAP_FAILED) {
+      if (entries_map != MAP_FAILED) {
+        ::munmap(entries_map, sqes_size);
+      }
+      close();
+      return;
+    }
+
+    char* sq = static_cast<char*>(sq_ring);
+    char* cq = static_cast<char*>(cq_ring);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_entries = params.sq_entries;
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    sqes = static_cast<io_uring_sqe*>(entries_map);
+    tail = *sq_tail;
+
+    if (!supports(IORING_OP_OPENAT) || !supports(IORING_OP_READ)) {
+      close();
+    }
+  }
+
+  ~Ring() {
+    close();
+  }
+
+  bool ok() const {
+    return fd >= 0;
+  }
+
+  // a cleared entry to fill in, nullptr when the submission ring is full.
+  io_uring_sqe* next() {
+    if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+      return nullptr;
+    }
+
+    unsigned index = tail & sq_mask;
+    sq_array[index] = index;
+    ++tail;
+    ++queued;
+    std::memset(&sqes[index], 0, sizeof(io_uring_sqe));
+    return &sqes[index];
+  }
+
+  // submits the entries filled in and waits until at least wait completions are there.
+  void submit(unsigned wait) {
+    __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+    while (true) {
+      long n = ::syscall(__NR_io_uring_enter, fd, queued, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+      if (n >= 0) {
+        queued -= static_cast<unsigned>(n);
+        if (queued == 0) {
+          return;
+        }
+      }
+      else if (errno != EINTR) {
+        throw std::system_error(errno, std::generic_category(), "Could not submit to io_uring");
+      }
+    }
+  }
+
+  bool completion(io_uring_cqe& cqe) {
+    unsigned head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+
+    cqe = cqes[head & cq_mask];
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+private:
+  bool supports(unsigned op) {
+    std::vector<char> memory(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(memory.data());
+    if (::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+      return false;
+    }
+    return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+  }
+
+  void close() {
+    if (sqes) {
+      ::munmap(sqes, sqes_size);
+    }
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+      ::munmap(cq_ring, cq_ring_size);
+    }
+    if (sq_ring != MAP_FAILED) {
+      ::munmap(sq_ring, sq_ring_size);
+    }
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    sqes = nullptr;
+    sq_ring = cq_ring = MAP_FAILED;
+    fd = -1;
+  }
+
+  int fd = -1;
+  void* sq_ring = MAP_FAILED;
+  void* cq_ring = MAP_FAILED;
+  size_t sq_ring_size = 0;
+  size_t cq_ring_size = 0;
+  io_uring_sqe* sqes = nullptr;
+  size_t sqes_size = 0;
+
+  unsigned* sq_head = nullptr;
+  unsigned* sq_tail = nullptr;
+  unsigned* sq_array = nullptr;
+  unsigned sq_mask = 0;
+  unsigned sq_entries = 0;
+  unsigned* cq_head = nullptr;
+  unsigned* cq_tail = nullptr;
+  unsigned cq_mask = 0;
+  io_uring_cqe* cqes = nullptr;
+
+  // the local tail, published by submit, and the entries not yet taken by the kernel.
+  unsigned tail = 0;
+  unsigned queued = 0;
+};
+
+#else
+
+class FileLoader::Ring {
+public:
+  explicit Ring(unsigned) {}
+
+  bool ok() const {
+    return false;
+  }
+};
+
+#endif
+
+LoadedFile::LoadedFile(FileLoader* loader, size_t index, int error, std::string buffer, size_t reserved)
+  : loader(loader), m_index(index), m_error(error), buffer(std::move(buffer)), reserved(reserved) {}
+
+LoadedFile::LoadedFile(LoadedFile&& other) noexcept
+  : loader(other.loader), m_index(other.m_index), m_error(other.m_error), buffer(std::move(other.buffer)),
+    reserved(other.reserved) {
+  other.loader = nullptr;
+}
+
+LoadedFile& LoadedFile::operator=(LoadedFile&& other) noexcept {
+  if (this != &other) {
+    release();
+    loader = other.loader;
+    m_index = other.m_index;
+    m_error = other.m_error;
+    buffer = std::move(other.buffer);
+    reserved = other.reserved;
+    other.loader = nullptr;
+  }
+  return *this;
+}
+
+LoadedFile::~LoadedFile() {
+  release();
+}
+
+std::unique_ptr<Scanner> LoadedFile::scanner() const {
+  return make_unique<SpanScanner>(buffer.data(), buffer.size());
+}
+
+void LoadedFile::release() {
+  if (loader) {
+    loader->release(reserved, std::move(buffer));
+    loader = nullptr;
+  }
+}
+
+FileLoader::FileLoader(unsigned depth, size_t max_bytes, Backend backend)
+  : depth(std::max(depth, 1u)), max_bytes(max_bytes), m_backend(Backend::Threads) {
+  if (backend != Backend::Threads) {
+    ring.reset(new Ring(this->depth));
+    if (ring->ok()) {
+      m_backend = Backend::Uring;
+    }
+    else {
+      ring.reset();
+    }
+  }
+}
+
+FileLoader::~FileLoader() {
+}
+
+void FileLoader::load(const std::vector<std::string>& paths, const Consumer& consume) {
+  PUNCH_TRACE_SPAN(span, "load files", "loader");
+  PUNCH_TRACING(span.arg("files", paths.size()));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    m_peak = held;
+  }
+
+  if (m_backend == Backend::Uring) {
+    load_uring(paths, consume);
+  }
+  else {
+    load_threads(paths, consume);
+  }
+}
+
+#if defined(__linux__) && defined(IORING_OP_READ)
+
+void FileLoader::load_uring(const std::vector<std::string>& paths, const Consumer& consume) {
+  struct File {
+    int fd = -1;
+    size_t size = 0;
+    size_t done = 0;
+    bool reading = false;
+    std::string buffer;
+  };
+
+  std::vector<File> files(paths.size());
+  std::deque<size_t> opened;
+  std::vector<LoadedFile> ready;
+  size_t next = 0;
+  size_t open = 0;
+  size_t outstanding = 0;
+  size_t finished = 0;
+
+  auto read = [&](size_t i) {
+    File& f = files[i];
+    io_uring_sqe* sqe = ring->next();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = f.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&f.buffer[f.done]);
+    sqe->len = static_cast<uint32_t>(std::min<size_t>(f.size - f.done, 1u << 30));
+    sqe->off = f.done;
+    sqe->user_data = i << 1 | 1;
+    ++outstanding;
+  };
+
+  // the file leaves the ring, read or with error.
+  auto finish = [&](size_t i, int error) {
+    File& f = files[i];
+    if (f.fd >= 0) {
+      ::close(f.fd);
+      f.fd = -1;
+    }
+
+    size_t reserved = 0;
+    if (f.reading) {
+      f.reading = false;
+      reserved = f.size;
+      if (error != 0) {
+        release(reserved, std::move(f.buffer));
+        consumed();
+        reserved = 0;
+      }
+    }
+
+    f.buffer.resize(error == 0 ? f.done : 0);
+    ready.push_back(LoadedFile(this, i, error, std::move(f.buffer), reserved));
+    --open;
+  };
+
+  try {
+    while (finished < paths.size()) {
+      // every file takes at most one entry at a time and no more than depth are open, so the ring has room.
+      while (next < paths.size() && open < depth) {
+        io_uring_sqe* sqe = ring->next();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(paths[next].c_str());
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data = next << 1;
+        ++next;
+        ++open;
+        ++outstanding;
+      }
+
+      while (!opened.empty() && reserve(files[opened.front()].size, false)) {
+        File& f = files[opened.front()];
+        opened.pop_front();
+        f.reading = true;
+        f.buffer = take_buffer(f.size);
+        read(&f - files.data());
+      }
+
+      // files that are ready are handed over first, the reads just queued go on meanwhile.
+      ring->submit(ready.empty() && outstanding > 0 ? 1 : 0);
+
+      io_uring_cqe cqe;
+      while (ring->completion(cqe)) {
+        --outstanding;
+        size_t i = static_cast<size_t>(cqe.user_data >> 1);
+        File& f = files[i];
+
+        if ((cqe.user_data & 1) == 0) {
+          if (cqe.res < 0) {
+            finish(i, -cqe.res);
+            continue;
+          }
+
+          f.fd = cqe.res;
+          off_t size = file_size(f.fd);
+          if (size < 0) {
+            finish(i, errno);
+          }
+          else if (size == 0) {
+            finish(i, 0);
+          }
+          else {
+            f.size = static_cast<size_t>(size);
+            opened.push_back(i);
+          }
+        }
+        else if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+          read(i);
+        }
+        else if (cqe.res < 0) {
+          finish(i, -cqe.res);
+        }
+        else {
+          f.done += static_cast<size_t>(cqe.res);
+          // a file that shrank since it was opened ends early.
+          if (cqe.res > 0 && f.done < f.size) {
+            read(i);
+          }
+          else {
+            finish(i, 0);
+          }
+        }
+      }
+
+      for (auto it = ready.begin(); it != ready.end(); ++it) {
+        ++finished;
+        hand_over(*it, consume);
+      }
+      ready.clear();
+    }
+  }
+  catch (...) {
+    // the kernel may still write into the buffers, wait for it before they go.
+    for (auto it = ready.begin(); it != ready.end(); ++it) {
+      if (it->loader && it->reserved > 0) {
+        it->release();
+        consumed();
+      }
+    }
+    ready.clear();
+    while (outstanding > 0) {
+      ring->submit(1);
+      io_uring_cqe cqe;
+      while (ring->completion(cqe)) {
+        --outstanding;
+        if ((cqe.user_data & 1) == 0 && cqe.res >= 0) {
+          files[cqe.user_data >> 1].fd = cqe.res;
+        }
+      }
+    }
+    for (size_t i = 0; i < files.size(); ++i) {
+      if (files[i].fd >= 0 || files[i].reading) {
+        finish(i, ECANCELED);
+      }
+    }
+    throw;
+  }
+}
+
+#else
+
+void FileLoader::load_uring(const std::vector<std::string>& paths, const Consumer& consume) {
+  load_threads(paths, consume);
+}
+
+#endif
+
+void FileLoader::load_threads(const std::vector<std::string>& paths, const Consumer& consume) {
+  std::mutex done_mutex;
+  std::condition_variable done_available;
+  std::deque<LoadedFile> done;
+
+  // declared after what the workers use, so it is joined before that goes.
+  ThreadPool pool(depth);
+
+  auto finish = [&](LoadedFile file) {
+    {
+      std::lock_guard<std::mutex> lock(done_mutex);
+      done.push_back(std::move(file));
+    }
+    done_available.notify_one();
+  };
+
+  for (size_t i = 0; i < paths.size(); ++i) {
+    pool.submit([this, i, &paths, &finish](unsigned) {
+      int fd = ::open(paths[i].c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        finish(LoadedFile(this, i, errno));
+        return;
+      }
+
+      off_t size = file_size(fd);
+      if (size <= 0) {
+        int error = size < 0 ? errno : 0;
+        ::close(fd);
+        finish(LoadedFile(this, i, error));
+        return;
+      }
+
+      size_t total = static_cast<size_t>(size);
+      if (!reserve(total, true)) {
+        ::close(fd);
+        return;
+      }
+
+      std::string buffer = take_buffer(total);
+      size_t read = 0;
+      int error = 0;
+      while (read < total) {
+        ssize_t n = ::pread(fd, &buffer[read], total - read, static_cast<off_t>(read));
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n < 0) {
+          error = errno;
+          break;
+        }
+        if (n == 0) {
+          break;
+        }
+        read += static_cast<size_t>(n);
+      }
+      ::close(fd);
+
+      if (error != 0) {
+        release(total, std::move(buffer));
+        consumed();
+        finish(LoadedFile(this, i, error));
+      }
+      else {
+        buffer.resize(read);
+        finish(LoadedFile(this, i, 0, std::move(buffer), total));
+      }
+    });
+  }
+
+  try {
+    for (size_t finished = 0; finished < paths.size(); ++finished) {
+      std::unique_lock<std::mutex> lock(done_mutex);
+      done_available.wait(lock, [&done] { return !done.empty(); });
+      LoadedFile file = std::move(done.front());
+      done.pop_front();
+      lock.unlock();
+
+      hand_over(file, consume);
+    }
+  }
+  catch (...) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      cancelled = true;
+    }
+    released.notify_all();
+    pool.wait();
+    for (auto it = done.begin(); it != done.end(); ++it) {
+      if (it->reserved > 0) {
+        it->release();
+        consumed();
+      }
+    }
+    done.clear();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    cancelled = false;
+    throw;
+  }
+
+  pool.wait();
+}
+
+bool FileLoader::reserve(size_t size, bool wait) {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  // when every file was handed over only the consumer can give bytes back, the file is read anyway.
+  auto fits = [this, size] {
+    return cancelled || unconsumed == 0 || held + size <= max_bytes;
+  };
+
+  if (!wait && !fits()) {
+    return false;
+  }
+  released.wait(lock, fits);
+  if (cancelled) {
+    return false;
+  }
+
+  held += size;
+  ++unconsumed;
+  m_peak = std::max(m_peak, held);
+  return true;
+}
+
+void FileLoader::hand_over(LoadedFile& file, const Consumer& consume) {
+  bool counted = file.reserved > 0;
+  try {
+    consume(std::move(file));
+  }
+  catch (...) {
+    file.release();
+    if (counted) {
+      consumed();
+    }
+    throw;
+  }
+
+  // released before it counts as done with, so no file is forced in while it still holds its bytes.
+  file.release();
+  if (counted) {
+    consumed();
+  }
+}
+
+void FileLoader::consumed() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    --unconsumed;
+  }
+  released.notify_all();
+}
+
+void FileLoader::release(size_t size, std::string buffer) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    held -= size;
+    if (buffer.capacity() > 0 && buffer.capacity() <= max_bytes && spare.size() < depth) {
+      spare.push_back(std::move(buffer));
+    }
+  }
+  released.notify_all();
+}
+
+std::string FileLoader::take_buffer(size_t size) {
+  std::string buffer;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!spare.empty()) {
+      buffer = std::move(spare.back());
+      spare.pop_back();
+    }
+  }
+
+  // only what the buffer did not hold before is cleared.
+  buffer.resize(size);
+  return buffer;
+}
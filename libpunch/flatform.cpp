@@ -0,0 +1,383 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <flatform.hpp>
+#include <fstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace flatform {
+
+  namespace {
+
+  const char magic[] = {'P', 'N', 'C', 'F'};
+
+  bool is_little_endian() {
+    const uint32_t one = 1;
+    char first;
+    std::memcpy(&first, &one, 1);
+    return first == 1;
+  }
+
+  void put_u32(std::string& out, uint32_t v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+  void set_i32(std::string& out, size_t at, int32_t v) {
+    std::memcpy(&out[at], &v, sizeof(v));
+  }
+
+  void align(std::string& out) {
+    while (out.size() % 4 != 0) {
+      out.push_back('\0');
+    }
+  }
+
+  class Writer {
+  public:
+    Writer(std::string& out) : out(out) {}
+
+    uint32_t node(const Expression& e) {
+      switch (e.type()) {
+        case ExpressionType::Keyword:
+          return text(e, static_cast<const expression::Keyword&>(e).value());
+        case ExpressionType::Literal:
+          return text(e, static_cast<const expression::Literal&>(e).value());
+        case ExpressionType::String:
+          return text(e, static_cast<const expression::String&>(e).value());
+        case ExpressionType::Integer: {
+          int64_t v = static_cast<const expression::Integer&>(e).value();
+          uint32_t at = header(e, 0);
+          out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+          return at;
+        }
+        case ExpressionType::Float: {
+          double v = static_cast<const expression::Float&>(e).value();
+          uint32_t at = header(e, 0);
+          out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+          return at;
+        }
+        case ExpressionType::Ratio: {
+          int64_t n = static_cast<const expression::Ratio&>(e).numerator();
+          int64_t d = static_cast<const expression::Ratio&>(e).denominator();
+          uint32_t at = header(e, 0);
+          out.append(reinterpret_cast<const char*>(&n), sizeof(n));
+          out.append(reinterpret_cast<const char*>(&d), sizeof(d));
+          return at;
+        }
+        case ExpressionType::List:
+          return collection(e, static_cast<const expression::List&>(e).inner());
+        case ExpressionType::Map:
+          return collection(e, static_cast<const expression::Map&>(e).inner());
+        case ExpressionType::Set:
+          return collection(e, static_cast<const expression::Set&>(e).inner());
+        case ExpressionType::Vector:
+          return collection(e, static_cast<const expression::Vector&>(e).inner());
+        case ExpressionType::EndOfFile:
+          break;
+      }
+
+      throw ReaderException("Cannot write end of file");
+    }
+
+  private:
+    uint32_t header(const Expression& e, uint32_t size) {
+      align(out);
+      if (out.size() > uint32_t(INT32_MAX)) {
+        throw ReaderException("Flat form data exceeds 2GB");
+      }
+
+      uint32_t at = static_cast<uint32_t>(out.size());
+      put_u32(out, static_cast<uint32_t>(e.type()));
+      put_u32(out, size);
+      put_u32(out, std::get<0>(e.pos));
+      put_u32(out, std::get<1>(e.pos));
+      return at;
+    }
+
+    uint32_t text(const Expression& e, const std::string& value) {
+      uint32_t at = header(e, static_cast<uint32_t>(value.size()));
+      out.append(value);
+      out.push_back('\0');
+      return at;
+    }
+
+    uint32_t collection(const Expression& e, const std::list<UExpression>& inner) {
+      std::vector<uint32_t> children;
+      children.reserve(inner.size());
+      for (auto it = inner.begin(); it != inner.end(); ++it) {
+        children.push_back(node(**it));
+      }
+
+      uint32_t at = header(e, static_cast<uint32_t>(children.size()));
+      for (auto it = children.begin(); it != children.end(); ++it) {
+        size_t slot = out.size();
+        put_u32(out, 0);
+        set_i32(out, slot, static_cast<int32_t>(int64_t(*it) - int64_t(slot)));
+      }
+      return at;
+    }
+
+    std::string& out;
+  };
+
+  class Validator {
+  public:
+    Validator(const char* data, size_t size, std::string& error)
+      : data(data), size(size), error(error), visited(size / 4, false) {}
+
+    bool run() {
+      if (!is_little_endian()) {
+        return fail("Flat forms are only supported on little-endian hosts");
+      }
+      if (size < header_size || std::memcmp(data, magic, sizeof(magic)) != 0) {
+        return fail("Not a flat form file");
+      }
+      if (read_u32(data + 4) != version) {
+        return fail("Unsupported flat form version");
+      }
+
+      uint32_t count = read_u32(data + 8);
+      if ((size - header_size) / 4 < count) {
+        return fail("Root table out of bounds");
+      }
+
+      std::vector<uint32_t> pending;
+      for (uint32_t i = 0; i < count; ++i) {
+        if (!reference(header_size + 4 * i, size, pending)) {
+          return false;
+        }
+      }
+
+      // every node is checked once, shared subtrees can not blow up the work.
+      while (!pending.empty()) {
+        uint32_t at = pending.back();
+        pending.pop_back();
+
+        if (!node(at, pending)) {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+  private:
+    // children have to start before their parent, which rules out cycles.
+    bool reference(uint32_t slot, size_t parent, std::vector<uint32_t>& pending) {
+      int64_t target = int64_t(slot) + read_i32(data + slot);
+
+      if (target < header_size || target % 4 != 0 || target + node_header_size > int64_t(size)) {
+        return fail("Reference out of bounds");
+      }
+      if (target >= int64_t(parent)) {
+        return fail("Reference does not point backwards");
+      }
+
+      if (!visited[target / 4]) {
+        visited[target / 4] = true;
+        pending.push_back(static_cast<uint32_t>(target));
+      }
+      return true;
+    }
+
+    bool node(uint32_t at, std::vector<uint32_t>& pending) {
+      uint32_t type = read_u32(data + at);
+      uint32_t count = read_u32(data + at + 4);
+      size_t available = size - at - node_header_size;
+      const char* payload = data + at + node_header_size;
+
+      switch (static_cast<ExpressionType>(type)) {
+        case ExpressionType::Keyword:
+        case ExpressionType::Literal:
+        case ExpressionType::String:
+          if (available <= count || payload[count] != '\0') {
+            return fail("Text out of bounds");
+          }
+          return true;
+        case ExpressionType::Integer:
+        case ExpressionType::Float:
+          if (available < 8) {
+            return fail("Number out of bounds");
+          }
+          return true;
+        case ExpressionType::Ratio:
+          if (available < 16) {
+            return fail("Ratio out of bounds");
+          }
+          return true;
+        case ExpressionType::List:
+        case ExpressionType::Map:
+        case ExpressionType::Set:
+        case ExpressionType::Vector:
+          if (available / 4 < count) {
+            return fail("Children out of bounds");
+          }
+          if (static_cast<ExpressionType>(type) == ExpressionType::Map && count % 2 == 1) {
+            return fail("Map entries should be even");
+          }
+          for (uint32_t i = 0; i < count; ++i) {
+            if (!reference(at + node_header_size + 4 * i, at, pending)) {
+              return false;
+            }
+          }
+          return true;
+        default:
+          return fail("Unknown node type");
+      }
+    }
+
+    bool fail(const char* msg) {
+      error = msg;
+      return false;
+    }
+
+    const char* data;
+    size_t size;
+    std::string& error;
+    std::vector<bool> visited;
+  };
+
+  std::list<UExpression> to_expressions(const Children& children) {
+    std::list<UExpression> l;
+    for (auto it = children.begin(); it != children.end(); ++it) {
+      l.push_back(to_expression(*it));
+    }
+    return l;
+  }
+
+  }
+
+  void write(const std::list<UExpression>& forms, std::string& out) {
+    // offsets are relative to the start of the file, so it is built on its own.
+    std::string data;
+    data.append(magic, sizeof(magic));
+    put_u32(data, version);
+    put_u32(data, static_cast<uint32_t>(forms.size()));
+    put_u32(data, 0);
+    data.append(4 * forms.size(), '\0');
+
+    Writer writer(data);
+    uint32_t slot = header_size;
+    for (auto it = forms.begin(); it != forms.end(); ++it, slot += 4) {
+      uint32_t at = writer.node(**it);
+      set_i32(data, slot, static_cast<int32_t>(int64_t(at) - int64_t(slot)));
+    }
+
+    out.append(data);
+  }
+
+  std::string write(const std::list<UExpression>& forms) {
+    std::string out;
+    write(forms, out);
+    return out;
+  }
+
+  void write_file(const std::list<UExpression>& forms, const std::string& path) {
+    std::string data = write(forms);
+
+    std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write(data.data(), data.size());
+    if (!out) {
+      throw ReaderException("Could not write " + path);
+    }
+  }
+
+  bool validate(const char* data, size_t size, std::string& error) {
+    return Validator(data, size, error).run();
+  }
+
+  UExpression to_expression(const Node& node) {
+    UExpression result;
+
+    switch (node.type()) {
+      case ExpressionType::Keyword:
+        result = make_unique<expression::Keyword>(node.as<Keyword>().value().to_string());
+        break;
+      case ExpressionType::Literal:
+        result = make_unique<expression::Literal>(node.as<Literal>().value().to_string());
+        break;
+      case ExpressionType::String:
+        result = make_unique<expression::String>(node.as<String>().value().to_string());
+        break;
+      case ExpressionType::Integer:
+        result = make_unique<expression::Integer>(node.as<Integer>().value());
+        break;
+      case ExpressionType::Float:
+        result = make_unique<expression::Float>(node.as<Float>().value());
+        break;
+      case ExpressionType::Ratio:
+        result = make_unique<expression::Ratio>(node.as<Ratio>().numerator(), node.as<Ratio>().denominator());
+        break;
+      case ExpressionType::List: {
+        auto l = to_expressions(node.as<List>().inner());
+        result = make_unique<expression::List>(l);
+        break;
+      }
+      case ExpressionType::Map: {
+        auto l = to_expressions(node.as<Map>().inner());
+        result = make_unique<expression::Map>(l);
+        break;
+      }
+      case ExpressionType::Set: {
+        auto l = to_expressions(node.as<Set>().inner());
+        result = make_unique<expression::Set>(l);
+        break;
+      }
+      case ExpressionType::Vector: {
+        auto l = to_expressions(node.as<Vector>().inner());
+        result = make_unique<expression::Vector>(l);
+        break;
+      }
+      case ExpressionType::EndOfFile:
+        result = make_unique<EndOfFile>();
+        break;
+    }
+
+    result->pos = node.position();
+    return result;
+  }
+
+  MappedFile::MappedFile(const std::string& path, bool validate) : m_data(nullptr), m_size(0) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw ReaderException("Could not open " + path);
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      throw ReaderException("Could not map " + path);
+    }
+
+    void* mapped = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (mapped == MAP_FAILED) {
+      throw ReaderException("Could not map " + path);
+    }
+
+    m_data = static_cast<const char*>(mapped);
+    m_size = static_cast<size_t>(st.st_size);
+
+    std::string error;
+    if (validate && !flatform::validate(m_data, m_size, error)) {
+      ::munmap(const_cast<char*>(m_data), m_size);
+      throw ReaderException(error);
+    }
+  }
+
+  MappedFile::~MappedFile() {
+    ::munmap(const_cast<char*>(m_data), m_size);
+  }
+}
@@ -0,0 +1,116 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <formcache.hpp>
+#include <binaryform.hpp>
+#include <trace.hpp>
+#include <cstdio>
+#include <fstream>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+FormCache::FormCache(const std::string& directory, bool positions)
+  : directory(directory), positions(positions), m_hits(0), m_misses(0) {
+  fs::create_directories(directory);
+}
+
+std::string FormCache::entry_path(const std::string& source) const {
+  char name[64];
+  std::snprintf(name, sizeof(name), "%016llx-%llx-v%u%s.pform",
+                static_cast<unsigned long long>(content_hash(source.data(), source.size())),
+                static_cast<unsigned long long>(source.size()),
+                binaryform::version,
+                positions ? "p" : "");
+
+  return (fs::path(directory) / name).string();
+}
+
+std::list<UExpression> FormCache::read(const std::string& source) {
+  auto result = try_read(source);
+  if (!result.ok()) {
+    throw ReaderException(result.diagnostics.front().message);
+  }
+
+  return std::move(result.forms);
+}
+
+ReadResult FormCache::try_read(const std::string& source, bool recover) {
+  std::string path = entry_path(source);
+  ReadResult result;
+
+  if (load(path, result.forms)) {
+    ++m_hits;
+    return result;
+  }
+
+  ++m_misses;
+  result = try_read_forms(source, recover);
+  if (result.ok()) {
+    store(path, result.forms);
+  }
+
+  return result;
+}
+
+std::list<UExpression> FormCache::read_file(const std::string& path, std::string& buffer) {
+  if (!load_file(path, buffer)) {
+    throw ReaderException("Could not open file");
+  }
+
+  return read(buffer);
+}
+
+bool FormCache::load(const std::string& path, std::list<UExpression>& forms) {
+  PUNCH_TRACE_SPAN(span, "cache load", "cache");
+  std::string data;
+  if (!load_file(path, data)) {
+    return false;
+  }
+
+  try {
+    forms = binaryform::decode(data);
+    return true;
+  }
+  catch (const ReaderException&) {
+    // a damaged entry is treated as a miss and overwritten.
+    return false;
+  }
+}
+
+void FormCache::store(const std::string& path, const std::list<UExpression>& forms) {
+  PUNCH_TRACE_SPAN(span, "cache store", "cache");
+  std::string data = binaryform::encode(forms, positions);
+
+  // a store that fails leaves the source uncached, it never throws into the reader.
+  boost::system::error_code ec;
+  fs::path tmp = fs::path(directory) / fs::unique_path("%%%%-%%%%-%%%%-%%%%.tmp", ec);
+  if (ec) {
+    return;
+  }
+
+  {
+    std::ofstream out(tmp.string(), std::ios::out | std::ios::binary);
+    if (!out) {
+      return;
+    }
+    out.write(data.data(), data.size());
+    if (!out) {
+      out.close();
+      fs::remove(tmp, ec);
+      return;
+    }
+  }
+
+  fs::rename(tmp, path, ec);
+  if (ec) {
+    fs::remove(tmp, ec);
+  }
+}
@@ -0,0 +1,249 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <generator.hpp>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+
+  const char* words[] = {
+      "map", "reduce", "filter", "config", "value", "state", "request", "handler", "item", "count",
+      "user", "id", "name", "timeout", "retry", "load", "store", "parse", "emit", "result",
+      "inc", "dec", "first", "rest", "assoc", "update", "merge", "select", "keys", "vals"
+  };
+
+  const size_t word_count = sizeof(words) / sizeof(words[0]);
+
+  void append_number(std::string& out, const char* format, unsigned long long v) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), format, v);
+    out.append(buf, n);
+  }
+}
+
+CorpusGenerator::CorpusGenerator(const GeneratorOptions& options) : options(options), state(options.seed) {
+  const AtomMix& a = options.atoms;
+  atom_total = a.keywords + a.symbols + a.integers + a.hex_integers + a.ratios + a.floats
+               + a.strings + a.regexes + a.chars;
+
+  if (atom_total == 0) {
+    throw std::invalid_argument("At least one kind of atom needs a weight");
+  }
+}
+
+uint64_t CorpusGenerator::random() {
+  // splitmix64, fully specified, unlike the standard distributions.
+  uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+unsigned CorpusGenerator::below(unsigned n) {
+  return n == 0 ? 0 : static_cast<unsigned>(random() % n);
+}
+
+bool CorpusGenerator::chance(double p) {
+  return (random() >> 11) * (1.0 / 9007199254740992.0) < p;
+}
+
+bool CorpusGenerator::next(std::string& out) {
+  if (m_generated >= options.size) {
+    return false;
+  }
+
+  size_t before = out.size();
+  form(out);
+  m_generated += out.size() - before;
+
+  return true;
+}
+
+void CorpusGenerator::write(std::ostream& os, size_t chunk_size) {
+  std::string chunk;
+  chunk.reserve(chunk_size * 2);
+
+  while (next(chunk)) {
+    if (chunk.size() >= chunk_size) {
+      os.write(chunk.data(), chunk.size());
+      chunk.clear();
+    }
+  }
+
+  os.write(chunk.data(), chunk.size());
+}
+
+std::string CorpusGenerator::generate() {
+  std::string out;
+  while (next(out)) {
+  }
+  return out;
+}
+
+void CorpusGenerator::form(std::string& out) {
+  if (chance(options.comments)) {
+    out += ";";
+    comment(out);
+    out += "\n";
+  }
+
+  size_t start = out.size();
+  out += "(";
+  word(out);
+  column = out.size() - start;
+
+  unsigned width = 1 + below(options.max_width);
+  for (unsigned i = 0; i < width; ++i) {
+    separate(out, 1);
+    element(out, 1);
+  }
+
+  out += ")\n\n";
+  column = 0;
+}
+
+void CorpusGenerator::element(std::string& out, unsigned depth) {
+  if (depth < options.max_depth && chance(options.nesting)) {
+    collection(out, depth + 1);
+  }
+  else {
+    atom(out);
+  }
+}
+
+void CorpusGenerator::collection(std::string& out, unsigned depth) {
+  size_t before = out.size();
+  unsigned kind = below(20);
+  unsigned width = below(options.max_width + 1);
+
+  if (kind < 7) {
+    out += "(";
+    word(out);
+    width = width == 0 ? 0 : width - 1;
+  }
+  else if (kind < 13) {
+    out += "[";
+  }
+  else if (kind < 17) {
+    out += "{";
+    width = width / 2;
+  }
+  else {
+    out += "#{";
+  }
+  column += out.size() - before;
+
+  bool first = kind >= 7;
+  for (unsigned i = 0; i < width; ++i) {
+    if (!first) {
+      separate(out, depth);
+    }
+    first = false;
+
+    if (kind >= 13 && kind < 17) {
+      size_t key = out.size();
+      out += ":";
+      word(out);
+      column += out.size() - key;
+      separate(out, depth);
+    }
+
+    element(out, depth);
+  }
+
+  out += kind < 7 ? ")" : kind < 13 ? "]" : "}";
+  column += 1;
+}
+
+void CorpusGenerator::atom(std::string& out) {
+  const AtomMix& a = options.atoms;
+  size_t before = out.size();
+  unsigned pick = below(atom_total);
+
+  if (pick < a.keywords) {
+    out += ":";
+    word(out);
+  }
+  else if ((pick -= a.keywords) < a.symbols) {
+    word(out);
+    if (below(4) == 0) {
+      append_number(out, "-%llu", below(100));
+    }
+  }
+  else if ((pick -= a.symbols) < a.integers) {
+    if (below(8) == 0) {
+      out += "-";
+    }
+    append_number(out, "%llu", random() % 1000000);
+  }
+  else if ((pick -= a.integers) < a.hex_integers) {
+    append_number(out, "0x%llX", random() % 0x10000);
+  }
+  else if ((pick -= a.hex_integers) < a.ratios) {
+    append_number(out, "%llu", below(1000));
+    append_number(out, "/%llu", 1 + below(1000));
+  }
+  else if ((pick -= a.ratios) < a.floats) {
+    append_number(out, "%llu", below(100000));
+    append_number(out, ".%llu", below(1000));
+  }
+  else if ((pick -= a.floats) < a.strings) {
+    out += "\"";
+    unsigned count = 1 + below(6);
+    for (unsigned i = 0; i < count; ++i) {
+      if (i > 0) {
+        out += " ";
+      }
+      word(out);
+    }
+    out += "\"";
+  }
+  else if ((pick -= a.strings) < a.regexes) {
+    out += "#\"[a-z]+";
+    word(out);
+    out += "[0-9]*\"";
+  }
+  else {
+    out += "\\";
+    out += static_cast<char>('a' + below(26));
+  }
+
+  column += out.size() - before;
+}
+
+void CorpusGenerator::separate(std::string& out, unsigned depth) {
+  if (column < options.line_length) {
+    out += " ";
+    column += 1;
+    return;
+  }
+
+  if (chance(options.comments)) {
+    out += " ;";
+    comment(out);
+  }
+
+  out += "\n";
+  out.append(2 * depth, ' ');
+  column = 2 * depth;
+}
+
+void CorpusGenerator::comment(std::string& out) {
+  unsigned count = 2 + below(8);
+  for (unsigned i = 0; i < count; ++i) {
+    out += " ";
+    word(out);
+  }
+}
+
+void CorpusGenerator::word(std::string& out) {
+  out += words[below(word_count)];
+}
@@ -0,0 +1,60 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+
+#include <cstdlib>
+#include <new>
+#include <stats.hpp>
+
+/*
+ * Replaces the global allocation functions so the statistics can report the
+ * number and size of heap allocations. Built as the punchalloc object
+ * library, which the punch binary, the tests and the benchmarks link in.
+ */
+
+#ifdef PUNCH_STATS
+namespace {
+  struct Counted {
+    Counted() {
+      stats::allocations_counted = true;
+    }
+  } counted;
+}
+#endif
+
+void* operator new(std::size_t size) {
+  PUNCH_STAT(stats::count_allocation(size));
+
+  void* p = std::malloc(size == 0 ? 1 : size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+  std::free(p);
+}
@@ -0,0 +1,59 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_BATCHREADER_HPP
+#define PUNCH_BATCHREADER_HPP
+
+#include <list>
+#include <string>
+#include <vector>
+#include <reader.hpp>
+#include <formcache.hpp>
+
+struct SourceFile {
+  std::string path;
+  uintmax_t size;
+};
+
+struct FileResult {
+  std::string path;
+  std::list<UExpression> forms;
+
+  bool ok = true;
+  std::string error;
+  std::vector<Diagnostic> diagnostics;
+};
+
+/*
+ * Finds all files below root (or root itself, when it is a file) that end
+ * with extension. The result is sorted by path so runs are reproducible.
+ * Entries that can not be read are skipped; a root that does not exist is
+ * returned as is, so reading it reports the error.
+ */
+std::vector<SourceFile> discover_sources(const std::string& root, const std::string& extension = ".p");
+
+/*
+ * Reads the top-level forms of a single file. buffer is scratch space for
+ * the file contents and is reused between calls by the batch reader. When a
+ * cache is given, unchanged files are loaded from it instead of being read.
+ * With recover every malformed form of the file is reported, see Reader.
+ */
+FileResult read_source(const std::string& path, std::string& buffer, FormCache* cache = nullptr,
+                       bool recover = false);
+
+/*
+ * Reads every file on a work-stealing pool of jobs workers (0 means one per
+ * core). Files are scheduled largest first; results are returned in the
+ * order of the input.
+ */
+std::vector<FileResult> read_sources(const std::vector<SourceFile>& files, unsigned jobs = 0,
+                                     FormCache* cache = nullptr, bool recover = false);
+
+#endif //PUNCH_BATCHREADER_HPP
@@ -0,0 +1,49 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_BINARYFORM_HPP
+#define PUNCH_BINARYFORM_HPP
+
+#include <list>
+#include <string>
+#include <reader.hpp>
+
+/*
+ * Compact binary encoding of a list of top-level forms.
+ *
+ *   "PNCH" version:varint flags:varint
+ *   strings:varint (length:varint bytes)*
+ *   forms:varint expression*
+ *
+ * An expression is its ExpressionType as a varint, followed by the line and
+ * column when positions are stored, and then the payload: a string table
+ * index for keywords, literals and strings, zigzag varints for integers and
+ * ratios, 8 little-endian bytes for floats, and a child count followed by
+ * the children for collections.
+ */
+namespace binaryform {
+
+  const uint32_t version = 1;
+
+  enum Flags {
+    Positions = 1
+  };
+
+  void encode(const std::list<UExpression>& forms, std::string& out, bool positions = true);
+
+  std::string encode(const std::list<UExpression>& forms, bool positions = true);
+
+  // throws ReaderException when data is not a valid encoding
+  std::list<UExpression> decode(const char* data, size_t size);
+
+  std::list<UExpression> decode(const std::string& data);
+}
+
+#endif //PUNCH_BINARYFORM_HPP
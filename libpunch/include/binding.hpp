@@ -0,0 +1,399 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_BINDING_HPP
+#define PUNCH_BINDING_HPP
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <boost/optional.hpp>
+#include <reader.hpp>
+#include <scanner.hpp>
+
+/*
+ * Reads punch data straight into C++ structs. The fields of a struct are
+ * declared once by specializing Schema:
+ *
+ *   template <> struct binding::Schema<Server> {
+ *     static void describe(binding::Fields<Server>& f) {
+ *       f.field("host", &Server::host).field("port", &Server::port).field("tags", &Server::tags);
+ *     }
+ *   };
+ *
+ *   Server server = binding::read<Server>("{:host \"db\" :port 5432 :tags [\"primary\"]}");
+ *
+ * The tokens are bound as they come from the tokenizer, no expressions are
+ * built. A struct is read from a map with a keyword for every field, looked
+ * up in a table made once per struct; fields of boost::optional type may be
+ * left out or nil, every other one is required. Besides structs there are
+ * bindings for bool, integers, floating point, std::string,
+ * std::vector from vectors and boost::optional; more are added by
+ * specializing Bind. Mismatches are reported as diagnostics at the token
+ * they were found at.
+ */
+namespace binding {
+
+  /*
+   * The tokenizer with one token lookahead the bindings read from. A binding
+   * starts at the first token of its value and leaves the token after it
+   * current.
+   */
+  class Binder {
+
+  public:
+    explicit Binder(std::unique_ptr<Tokenizer> tokenizer);
+
+    Token& current() {
+      return token;
+    }
+
+    void pop();
+
+    // records the first failure only, always false.
+    bool fail(const std::string& message, position pos);
+
+    // "Expected what, got" the current token.
+    bool expected(const char* what);
+
+    bool failed() const {
+      return m_failed;
+    }
+
+    const std::vector<Diagnostic>& diagnostics() const {
+      return m_diagnostics;
+    }
+
+  private:
+    void check_tokenizer();
+
+    std::unique_ptr<Tokenizer> tokenizer;
+    Token token;
+    bool m_failed = false;
+    std::vector<Diagnostic> m_diagnostics;
+  };
+
+  // specialized with static void describe(Fields<T>&) for every struct that is bound.
+  template <class T>
+  struct Schema;
+
+  // static bool read(Binder&, T&), false once the binder failed. Structs are read with their Schema.
+  template <class T, class Enable = void>
+  struct Bind;
+
+  template <class T>
+  struct is_optional : std::false_type {};
+
+  template <class T>
+  struct is_optional<boost::optional<T>> : std::true_type {};
+
+  template <class T>
+  class FieldBase {
+  public:
+    explicit FieldBase(const std::string& name) : name(name) {}
+    virtual ~FieldBase() {}
+
+    virtual bool read(Binder& binder, T& object) const = 0;
+    virtual bool optional() const = 0;
+
+    // a left out optional field is none, also when object was bound before.
+    virtual void clear(T& object) const = 0;
+
+    std::string name;
+  };
+
+  template <class T, class M>
+  class Field : public FieldBase<T> {
+  public:
+    Field(const std::string& name, M T::* member) : FieldBase<T>(name), member(member) {}
+
+    bool read(Binder& binder, T& object) const override {
+      return Bind<M>::read(binder, object.*member);
+    }
+
+    bool optional() const override {
+      return is_optional<M>::value;
+    }
+
+    void clear(T& object) const override {
+      object.*member = M();
+    }
+
+  private:
+    M T::* member;
+  };
+
+  template <class T>
+  class Fields {
+
+  public:
+    // at most 64 fields per struct.
+    template <class M>
+    Fields& field(const std::string& name, M T::* member) {
+      if (entries.size() == 64) {
+        throw std::length_error("More than 64 fields bound for :" + name);
+      }
+
+      keys[":" + name] = entries.size();
+      entries.push_back(std::unique_ptr<FieldBase<T>>(new Field<T, M>(name, member)));
+      return *this;
+    }
+
+    // the field for a keyword token value, with its colon, nullptr when there is none.
+    const FieldBase<T>* find(const std::string& keyword, size_t& index) const {
+      auto found = keys.find(keyword);
+      if (found == keys.end()) {
+        return nullptr;
+      }
+
+      index = found->second;
+      return entries[index].get();
+    }
+
+    size_t size() const {
+      return entries.size();
+    }
+
+    const FieldBase<T>& operator[](size_t i) const {
+      return *entries[i];
+    }
+
+    // described on first use.
+    static const Fields& get() {
+      static const Fields fields = describe();
+      return fields;
+    }
+
+  private:
+    static Fields describe() {
+      Fields fields;
+      Schema<T>::describe(fields);
+      return fields;
+    }
+
+    std::vector<std::unique_ptr<FieldBase<T>>> entries;
+    std::unordered_map<std::string, size_t> keys;
+  };
+
+  template <class T, class Enable>
+  struct Bind {
+    static bool read(Binder& b, T& out) {
+      const Fields<T>& fields = Fields<T>::get();
+
+      if (b.current().type != TokenType::CurlyOpen) {
+        return b.expected("map");
+      }
+      position start = b.current().pos;
+      b.pop();
+
+      uint64_t seen = 0;
+      while (b.current().type != TokenType::CurlyClose) {
+        if (b.failed()) {
+          return false;
+        }
+        if (b.current().type == TokenType::EndOfFile) {
+          return b.fail("EOF, expected }", start);
+        }
+        if (b.current().type != TokenType::Literal || b.current().value[0] != ':') {
+          return b.expected("keyword");
+        }
+
+        size_t i;
+        const FieldBase<T>* field = fields.find(b.current().value, i);
+        if (!field) {
+          return b.fail("Unknown key " + b.current().value, b.current().pos);
+        }
+        if (seen & (uint64_t(1) << i)) {
+          return b.fail("Duplicate key " + b.current().value, b.current().pos);
+        }
+        seen |= uint64_t(1) << i;
+
+        b.pop();
+        if (b.current().type == TokenType::CurlyClose) {
+          return b.fail("Map entries should be even", start);
+        }
+        if (!field->read(b, out)) {
+          return false;
+        }
+      }
+
+      for (size_t i = 0; i < fields.size(); ++i) {
+        if (seen & (uint64_t(1) << i)) {
+          continue;
+        }
+        if (!fields[i].optional()) {
+          return b.fail("Missing key :" + fields[i].name, start);
+        }
+        fields[i].clear(out);
+      }
+
+      b.pop();
+      return !b.failed();
+    }
+  };
+
+  template <>
+  struct Bind<std::string> {
+    static bool read(Binder& b, std::string& out) {
+      if (b.current().type != TokenType::String) {
+        return b.expected("string");
+      }
+
+      out = std::move(b.current().value);
+      b.pop();
+      return !b.failed();
+    }
+  };
+
+  template <>
+  struct Bind<bool> {
+    static bool read(Binder& b, bool& out) {
+      if (b.current().type != TokenType::Literal || (b.current().value != "true" && b.current().value != "false")) {
+        return b.expected("true or false");
+      }
+
+      out = b.current().value == "true";
+      b.pop();
+      return !b.failed();
+    }
+  };
+
+  template <class T>
+  struct Bind<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+    static bool read(Binder& b, T& out) {
+      if (!Integer::accepts(b.current())) {
+        return b.expected("integer");
+      }
+
+      long value;
+      if (!parse_integer(b.current().value, value) || !fits(value)) {
+        return b.fail("Invalid integer", b.current().pos);
+      }
+
+      out = static_cast<T>(value);
+      b.pop();
+      return !b.failed();
+    }
+
+    // the maximum of unsigned long does not fit in a long, so unsigned types compare unsigned.
+    static bool fits(long value) {
+      if (std::is_signed<T>::value) {
+        return value >= static_cast<long>(std::numeric_limits<T>::min()) &&
+               value <= static_cast<long>(std::numeric_limits<T>::max());
+      }
+      return value >= 0 && static_cast<unsigned long>(value) <= static_cast<unsigned long>(std::numeric_limits<T>::max());
+    }
+  };
+
+  template <class T>
+  struct Bind<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    static bool read(Binder& b, T& out) {
+      if (Integer::accepts(b.current())) {
+        long value;
+        if (!parse_integer(b.current().value, value)) {
+          return b.fail("Invalid integer", b.current().pos);
+        }
+        out = static_cast<T>(value);
+      }
+      else if (Float::accepts(b.current())) {
+        double value;
+        if (!parse_float(b.current().value, value)) {
+          return b.fail("Float out of range", b.current().pos);
+        }
+        out = static_cast<T>(value);
+      }
+      else {
+        return b.expected("number");
+      }
+
+      b.pop();
+      return !b.failed();
+    }
+  };
+
+  template <class T>
+  struct Bind<std::vector<T>> {
+    static bool read(Binder& b, std::vector<T>& out) {
+      if (b.current().type != TokenType::SquareOpen) {
+        return b.expected("vector");
+      }
+      position start = b.current().pos;
+      b.pop();
+
+      out.clear();
+      while (b.current().type != TokenType::SquareClose) {
+        if (b.failed()) {
+          return false;
+        }
+        if (b.current().type == TokenType::EndOfFile) {
+          return b.fail("EOF, expected ]", start);
+        }
+
+        out.emplace_back();
+        if (!Bind<T>::read(b, out.back())) {
+          return false;
+        }
+      }
+
+      b.pop();
+      return !b.failed();
+    }
+  };
+
+  template <class T>
+  struct Bind<boost::optional<T>> {
+    static bool read(Binder& b, boost::optional<T>& out) {
+      if (b.current().type == TokenType::Literal && b.current().value == "nil") {
+        out = boost::none;
+        b.pop();
+        return !b.failed();
+      }
+
+      out = T();
+      return Bind<T>::read(b, *out);
+    }
+  };
+
+  /*
+   * Binds the single form in source to out, the diagnostics are empty when
+   * it was bound. out is partly bound when it was not.
+   */
+  template <class T>
+  std::vector<Diagnostic> try_read(const std::string& source, T& out) {
+    Binder b(make_unique<Tokenizer>(make_unique<StringScanner>(source)));
+
+    if (b.current().type == TokenType::EndOfFile && !b.failed()) {
+      b.fail("Expected a form", std::make_tuple(1, 1));
+    }
+    else if (Bind<T>::read(b, out) && b.current().type != TokenType::EndOfFile) {
+      b.fail("Expected a single form", b.current().pos);
+    }
+
+    return b.diagnostics();
+  }
+
+  // binds the single form in source, throws ReaderException when it does not fit T.
+  template <class T>
+  T read(const std::string& source) {
+    T out;
+    auto diagnostics = try_read(source, out);
+    if (!diagnostics.empty()) {
+      throw ReaderException(diagnostics.front().message);
+    }
+
+    return out;
+  }
+}
+
+#endif //PUNCH_BINDING_HPP
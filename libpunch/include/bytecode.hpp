@@ -0,0 +1,145 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_BYTECODE_HPP
+#define PUNCH_BYTECODE_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <value.hpp>
+
+/*
+ * Compiles read forms to bytecode for a stack machine and runs it.
+ *
+ * Calls, vector, map and set literals, numbers, strings and keywords
+ * compile to instructions, as do the special forms def, defn, fn, let, if,
+ * do, loop, recur and quote. Symbols are resolved when compiling: locals
+ * to frame slots, the locals of enclosing functions to values captured
+ * when the closure is made, and everything else to a global slot of the
+ * Environment. Calls of the core arithmetic and comparisons that are not
+ * shadowed by a local compile to instructions of their own, so redefining
+ * them only affects code compiled afterwards. Ratios evaluate to floats.
+ */
+namespace eval {
+
+  enum class Op : uint8_t {
+    Constant, Integer, Nil, True, False,
+    Local, StoreLocal, Captured, Self, Global, Define,
+    Pop, Jump, JumpIfFalse, Call, Return, Closure,
+    Add, Subtract, Multiply, Divide, Negate, Increment, Decrement,
+    Less, Greater, LessEqual, GreaterEqual, Equal,
+    Vector, Map, Set
+  };
+
+  struct Instruction {
+    Op op;
+
+    // constant, slot, count or, for jumps, offset from the jump itself.
+    int32_t arg;
+  };
+
+  // how a closure fills one of its captured values from the frame that makes it.
+  struct Capture {
+    enum class Kind : uint8_t {
+      Local, Captured, Self
+    };
+
+    Kind kind;
+    uint32_t index;
+  };
+
+  struct Prototype {
+    std::string name;
+    uint32_t params = 0;
+
+    // the arguments from params on are passed as a list in slot params.
+    bool variadic = false;
+
+    // params and locals.
+    uint32_t slots = 0;
+
+    // deepest the operand stack gets above the slots.
+    uint32_t stack = 0;
+
+    std::vector<Instruction> code;
+    std::vector<position> positions;
+    std::vector<Value> constants;
+    std::vector<std::shared_ptr<const Prototype>> prototypes;
+    std::vector<Capture> captures;
+  };
+
+  // compiles one top-level form into a prototype without parameters, throws EvalError.
+  std::shared_ptr<const Prototype> compile(const Expression& form, Environment& env);
+
+  // one instruction per line, with the nested prototypes after it.
+  std::string disassemble(const Prototype& proto);
+
+  class Closure;
+
+  /*
+   * Runs compiled prototypes. Dispatch is threaded through a table of
+   * label addresses where the compiler supports it, and a switch
+   * elsewhere. The value stack has a fixed size, running out of it is an
+   * EvalError. Closures made by a Vm run on it when they are called from
+   * native functions, so it has to outlive them.
+   */
+  class Vm {
+
+  public:
+    explicit Vm(Environment& env, size_t stack_size = 1 << 16);
+    ~Vm();
+
+    Vm(const Vm&) = delete;
+    Vm& operator=(const Vm&) = delete;
+
+    // runs a prototype made by compile.
+    Value run(const Prototype& proto);
+
+    Value eval(const Expression& form) {
+      return run(*compile(form, env));
+    }
+
+    // reads, compiles and runs every form of source, the value of the last one.
+    Value eval(const std::string& source);
+
+    Environment& environment() {
+      return env;
+    }
+
+  private:
+    friend class Closure;
+
+    struct Frame {
+      const Prototype* proto;
+      Closure* closure;
+
+      // of the caller while a call runs.
+      const Instruction* pc;
+      Value* base;
+
+      // where the stack is cut back to on return.
+      Value* bottom;
+    };
+
+    Value call(Closure& closure, const Value* args, size_t argc);
+    Value* enter(Closure& closure, Value* base, size_t argc);
+    Value execute(size_t entry);
+    void unwind(size_t entry, Value* sp);
+
+    Environment& env;
+    std::unique_ptr<Value[]> stack;
+    Value* limit;
+    Value* top;
+    std::vector<Frame> frames;
+  };
+}
+
+#endif //PUNCH_BYTECODE_HPP
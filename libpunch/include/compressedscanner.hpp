@@ -0,0 +1,111 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_COMPRESSEDSCANNER_HPP
+#define PUNCH_COMPRESSEDSCANNER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <scanner.hpp>
+
+/*
+ * Scans a compressed file while a helper thread decompresses the rest of
+ * it, so decompressing overlaps with tokenizing. The helper stays at most
+ * ahead chunks of chunk_size bytes in front of the scanner; that and the
+ * chunk being scanned is all that is held in memory.
+ *
+ * Gzip needs the build to have zlib (PUNCH_ZLIB) and zstd libzstd
+ * (PUNCH_ZSTD). A build without them, a file that can not be read and a
+ * corrupt or cut off stream end the input with error(). The decompressed
+ * text is checked to be UTF-8 on the helper thread as well; the input ends
+ * at the first invalid byte, which error() points at.
+ */
+class CompressedScanner : public Scanner {
+
+public:
+  enum class Format {
+    Gzip, Zstd
+  };
+
+  class Decoder;
+
+  CompressedScanner(const std::string& path, Format format, size_t chunk_size = 256 << 10, size_t ahead = 4);
+  ~CompressedScanner();
+
+  CompressedScanner(const CompressedScanner&) = delete;
+  CompressedScanner& operator=(const CompressedScanner&) = delete;
+
+  boost::optional<char> current_char() override;
+  boost::optional<char> next_char() override;
+  boost::optional<char> previous_char() override;
+  void pop() override;
+  void flush_line() override;
+  ::position position() override;
+  const char* remaining(size_t& size) override;
+  void skip(size_t n) override;
+  bool validate(::position& where) override;
+  bool error(std::string& message, ::position& where) override;
+
+  // the format of the file at path by its first bytes, false when it is not compressed.
+  static bool detect(const std::string& path, Format& format);
+
+private:
+  void decompress(int fd, Format format);
+
+  // ends the input after the chunks delivered so far.
+  void finish(const std::string& message, ::position where);
+
+  // hands a chunk to the scanner once fewer than ahead are waiting, false when the scanner goes.
+  bool deliver(std::string& chunk);
+
+  // waits for the next chunk, false at the end of the input.
+  bool take(std::string& chunk);
+
+  // makes the current character available, false at the end of the input.
+  bool fill();
+
+  size_t chunk_size;
+  size_t ahead;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::string> ready;
+  std::vector<std::string> spare;
+  bool ended = false;
+  bool stopping = false;
+  std::string m_error;
+  ::position m_error_pos;
+
+  std::thread helper;
+
+  // scanner state, only touched by the scanning thread.
+  std::string current;
+  std::string next;
+  bool has_next = false;
+  size_t index = 0;
+  uint line = 1;
+  uint col = 1;
+  size_t counted = 0;
+  boost::optional<char> previous;
+};
+
+/*
+ * A scanner for the file at path: a CompressedScanner when it starts with
+ * the gzip or zstd magic bytes, a StringScanner over its contents when it
+ * does not.
+ */
+std::unique_ptr<Scanner> open_scanner(const std::string& path);
+
+#endif //PUNCH_COMPRESSEDSCANNER_HPP
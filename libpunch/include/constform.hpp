@@ -0,0 +1,1083 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_CONSTFORM_HPP
+#define PUNCH_CONSTFORM_HPP
+
+#if __cplusplus >= 202002L
+
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <string_view>
+#include <vector>
+#include <reader.hpp>
+
+/*
+ * Forms read at compile time from a string literal, for punch that is
+ * embedded in C++:
+ *
+ *   constexpr auto& config = constform::form<"{:port 8080 :hosts [\"a\" \"b\"]}">;
+ *   static_assert(config.as<constform::Map>().inner()[1].as<constform::Integer>().value() == 8080);
+ *
+ * The forms are read the way Reader reads them and live in static, read-only
+ * storage; nothing is read or allocated when the program runs. A malformed
+ * literal does not compile, the error names what is wrong and where, e.g.
+ * "constform::detail::report<constform::Error::UnclosedCollection, 1, 17>".
+ *
+ * The views mirror the expression classes of the reader: type(), pos,
+ * value(), numerator(), denominator() and inner(); text is a string_view
+ * into the literal.
+ */
+namespace constform {
+
+  enum class Error {
+    None, UnexpectedStreamEnd, ClosingTagWithoutOpen, UnsupportedToken, UnclosedCollection,
+    MismatchedClose, OddMapEntries, InvalidInteger, InvalidRatio, FloatOutOfRange, InvalidEscape, ExpectedOneForm,
+    InvalidUtf8
+  };
+
+  // the message Reader gives for the same error, without the token names.
+  constexpr const char* message(Error error) {
+    switch (error) {
+      case Error::None: return "";
+      case Error::UnexpectedStreamEnd: return "Unexpected stream end";
+      case Error::ClosingTagWithoutOpen: return "Closing tag without open";
+      case Error::UnsupportedToken: return "Unsupported token";
+      case Error::UnclosedCollection: return "EOF, expected close";
+      case Error::MismatchedClose: return "Expected close of another kind";
+      case Error::OddMapEntries: return "Map entries should be even";
+      case Error::InvalidInteger: return "Invalid integer";
+      case Error::InvalidRatio: return "Invalid ratio";
+      case Error::FloatOutOfRange: return "Float out of range";
+      case Error::InvalidEscape: return "Invalid escape";
+      case Error::ExpectedOneForm: return "Expected exactly one form";
+      case Error::InvalidUtf8: return "Invalid UTF-8";
+    }
+    return "";
+  }
+
+  // the literal a template is instantiated with.
+  template <size_t N>
+  struct Source {
+    char text[N];
+
+    consteval Source(const char (&s)[N]) : text() {
+      for (size_t i = 0; i < N; ++i) {
+        text[i] = s[i];
+      }
+    }
+
+    constexpr std::string_view view() const {
+      return std::string_view(text, N - 1);
+    }
+  };
+
+  /*
+   * One read expression. Text is an offset and size into the literal, or
+   * into the decoded strings for a string with escapes; collections refer
+   * to size child indices from offset on in the refs.
+   */
+  struct Slot {
+    ExpressionType type = ExpressionType::EndOfFile;
+    uint32_t line = 0;
+    uint32_t column = 0;
+    uint32_t offset = 0;
+    uint32_t size = 0;
+    int64_t first = 0;
+    int64_t second = 0;
+    double real = 0;
+    bool decoded = false;
+  };
+
+  // where the nodes of one literal are.
+  struct Tables {
+    const Slot* nodes;
+    const uint32_t* refs;
+    const char* text;
+    const char* decoded;
+  };
+
+  class Node {
+  public:
+    constexpr Node(const Tables* tables, uint32_t index)
+      : pos(tables->nodes[index].line, tables->nodes[index].column), tables(tables), index(index) {}
+
+    constexpr ExpressionType type() const {
+      return slot().type;
+    }
+
+    template <class T>
+    constexpr T as() const {
+      return T(*this);
+    }
+
+    ::position pos;
+
+  protected:
+    constexpr const Slot& slot() const {
+      return tables->nodes[index];
+    }
+
+    const Tables* tables;
+    uint32_t index;
+  };
+
+  class Children {
+  public:
+    class iterator {
+    public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef Node value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef Node* pointer;
+      typedef Node reference;
+
+      constexpr iterator(const Tables* tables, uint32_t ref) : tables(tables), ref(ref) {}
+
+      constexpr Node operator*() const {
+        return Node(tables, tables->refs[ref]);
+      }
+
+      constexpr iterator& operator++() {
+        ++ref;
+        return *this;
+      }
+
+      constexpr bool operator==(const iterator& other) const {
+        return ref == other.ref;
+      }
+
+      constexpr bool operator!=(const iterator& other) const {
+        return ref != other.ref;
+      }
+
+    private:
+      const Tables* tables;
+      uint32_t ref;
+    };
+
+    constexpr Children(const Tables* tables, uint32_t first, uint32_t count) : tables(tables), first(first), count(count) {}
+
+    constexpr size_t size() const {
+      return count;
+    }
+
+    constexpr bool empty() const {
+      return count == 0;
+    }
+
+    constexpr Node operator[](size_t i) const {
+      return *iterator(tables, static_cast<uint32_t>(first + i));
+    }
+
+    constexpr iterator begin() const {
+      return iterator(tables, first);
+    }
+
+    constexpr iterator end() const {
+      return iterator(tables, first + count);
+    }
+
+  private:
+    const Tables* tables;
+    uint32_t first;
+    uint32_t count;
+  };
+
+  class Text : public Node {
+  public:
+    constexpr explicit Text(const Node& n) : Node(n) {}
+
+    // a view into the literal unless the string has escapes.
+    constexpr std::string_view value() const {
+      return std::string_view((slot().decoded ? tables->decoded : tables->text) + slot().offset, slot().size);
+    }
+  };
+
+  class Keyword : public Text {
+  public:
+    constexpr explicit Keyword(const Node& n) : Text(n) {}
+  };
+
+  class Literal : public Text {
+  public:
+    constexpr explicit Literal(const Node& n) : Text(n) {}
+  };
+
+  class String : public Text {
+  public:
+    constexpr explicit String(const Node& n) : Text(n) {}
+  };
+
+  class Integer : public Node {
+  public:
+    constexpr explicit Integer(const Node& n) : Node(n) {}
+
+    constexpr long value() const {
+      return static_cast<long>(slot().first);
+    }
+  };
+
+  class Float : public Node {
+  public:
+    constexpr explicit Float(const Node& n) : Node(n) {}
+
+    constexpr double value() const {
+      return slot().real;
+    }
+  };
+
+  class Ratio : public Node {
+  public:
+    constexpr explicit Ratio(const Node& n) : Node(n) {}
+
+    constexpr long numerator() const {
+      return static_cast<long>(slot().first);
+    }
+
+    constexpr long denominator() const {
+      return static_cast<long>(slot().second);
+    }
+  };
+
+  class Collection : public Node {
+  public:
+    constexpr explicit Collection(const Node& n) : Node(n) {}
+
+    constexpr Children inner() const {
+      return Children(tables, slot().offset, slot().size);
+    }
+  };
+
+  class List : public Collection {
+  public:
+    constexpr explicit List(const Node& n) : Collection(n) {}
+  };
+
+  class Map : public Collection {
+  public:
+    constexpr explicit Map(const Node& n) : Collection(n) {}
+  };
+
+  class Set : public Collection {
+  public:
+    constexpr explicit Set(const Node& n) : Collection(n) {}
+  };
+
+  class Vector : public Collection {
+  public:
+    constexpr explicit Vector(const Node& n) : Collection(n) {}
+  };
+
+  // copies a node into an expression tree, for code that takes the runtime one.
+  UExpression to_expression(const Node& node);
+
+  namespace detail {
+
+    constexpr bool is_whitespace(char c) {
+      return c == ' ' || c == ',' || c == '\n' || c == '\t';
+    }
+
+    constexpr bool is_atom_end(char c) {
+      return is_whitespace(c) || c == '{' || c == '}' || c == '[' || c == ']' || c == '(' || c == ')' ||
+          c == '\\' || c == ';' || c == '"';
+    }
+
+    constexpr bool is_digit(char c) {
+      return c >= '0' && c <= '9';
+    }
+
+    constexpr bool is_sign(char c) {
+      return c == '-' || c == '+';
+    }
+
+    constexpr int digit_value(char c) {
+      return is_digit(c) ? c - '0' : c >= 'a' && c <= 'z' ? c - 'a' + 10 : c >= 'A' && c <= 'Z' ? c - 'A' + 10 : 99;
+    }
+
+    constexpr bool all_of(std::string_view s, bool (*accept)(char)) {
+      for (char c : s) {
+        if (!accept(c)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    constexpr bool is_octal(char c) {
+      return c >= '0' && c <= '7';
+    }
+
+    constexpr bool is_hex(char c) {
+      return digit_value(c) < 16;
+    }
+
+    constexpr bool is_alnum(char c) {
+      return digit_value(c) < 36;
+    }
+
+    // parses all of s, false on anything left over or on overflow, like parse_long in the reader.
+    constexpr bool parse_long(std::string_view s, int radix, long& value) {
+      if (radix < 2 || radix > 36 || s.empty()) {
+        return false;
+      }
+
+      bool negative = s[0] == '-';
+      if (is_sign(s[0])) {
+        s.remove_prefix(1);
+      }
+      if (s.empty()) {
+        return false;
+      }
+
+      unsigned long limit = negative ? static_cast<unsigned long>(std::numeric_limits<long>::max()) + 1
+                                     : static_cast<unsigned long>(std::numeric_limits<long>::max());
+      unsigned long v = 0;
+      for (char c : s) {
+        int d = digit_value(c);
+        if (d >= radix || v > (limit - d) / radix) {
+          return false;
+        }
+        v = v * radix + d;
+      }
+
+      value = negative ? static_cast<long>(0 - v) : static_cast<long>(v);
+      return true;
+    }
+
+    // what the int_pattern of the reader matches, split in the parts its groups capture.
+    struct IntegerMatch {
+      bool matched = false;
+      bool zero = false;
+      int radix = 10;
+      std::string_view digits;
+    };
+
+    constexpr IntegerMatch match_integer(std::string_view s) {
+      IntegerMatch m;
+      if (!s.empty() && is_sign(s[0])) {
+        s.remove_prefix(1);
+      }
+
+      std::string_view body = s;
+      if (!body.empty() && body.back() == 'N') {
+        body.remove_suffix(1);
+      }
+
+      if (body.empty() || body == "0") {
+        m.matched = m.zero = true;
+      }
+      else if (body[0] != '0' && is_digit(body[0]) && all_of(body, is_digit)) {
+        m.matched = true;
+        m.digits = body;
+      }
+      else if (body.size() > 2 && body[0] == '0' && (body[1] == 'x' || body[1] == 'X') && all_of(body.substr(2), is_hex)) {
+        m.matched = true;
+        m.radix = 16;
+        m.digits = body.substr(2);
+      }
+      else if (body[0] == '0' && all_of(body, is_octal)) {
+        m.matched = true;
+        m.radix = 8;
+        m.digits = body.substr(1);
+      }
+      else if (body[0] == '0' && all_of(body, is_digit)) {
+        // 0[0-9]+ matches but none of the number groups do.
+        m.matched = true;
+        m.radix = 0;
+      }
+
+      // NrDIGITS takes a trailing N as a digit.
+      size_t r = s.find_first_of("rR");
+      if (!m.matched && (r == 1 || r == 2) && s[0] != '0' && is_digit(s[0]) && (r == 1 || is_digit(s[1])) &&
+          s.size() > r + 1 && all_of(s.substr(r + 1), is_alnum)) {
+        m.matched = true;
+        m.radix = s[0] - '0';
+        if (r == 2) {
+          m.radix = m.radix * 10 + (s[1] - '0');
+        }
+        m.digits = s.substr(r + 1);
+      }
+
+      return m;
+    }
+
+    // [-+]?[0-9]+(\.[0-9]*)?([eE][-+]?[0-9]+)?M?
+    constexpr bool match_float(std::string_view s) {
+      size_t i = 0;
+      auto digits = [&]() {
+        size_t start = i;
+        while (i < s.size() && is_digit(s[i])) {
+          ++i;
+        }
+        return i > start;
+      };
+
+      if (i < s.size() && is_sign(s[i])) {
+        ++i;
+      }
+      if (!digits()) {
+        return false;
+      }
+      if (i < s.size() && s[i] == '.') {
+        ++i;
+        digits();
+      }
+      if (i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+        ++i;
+        if (i < s.size() && is_sign(s[i])) {
+          ++i;
+        }
+        if (!digits()) {
+          return false;
+        }
+      }
+      if (i < s.size() && s[i] == 'M') {
+        ++i;
+      }
+      return i == s.size();
+    }
+
+    // [-+]?[0-9]+/[0-9]+
+    constexpr bool match_ratio(std::string_view s) {
+      size_t slash = s.find('/');
+      if (slash == std::string_view::npos) {
+        return false;
+      }
+      std::string_view n = s.substr(0, slash);
+      if (!n.empty() && is_sign(n[0])) {
+        n.remove_prefix(1);
+      }
+      std::string_view d = s.substr(slash + 1);
+      return !n.empty() && all_of(n, is_digit) && !d.empty() && all_of(d, is_digit);
+    }
+
+    /*
+     * Decimal to double. Exact when the significant digits fit in 53 bits and
+     * the exponent is within the powers of ten a double holds exactly, which
+     * covers what is written by hand; otherwise computed in long double,
+     * which can be one unit in the last place off from strtod.
+     */
+    constexpr bool parse_double(std::string_view s, double& value) {
+      bool negative = s[0] == '-';
+      size_t i = is_sign(s[0]) ? 1 : 0;
+
+      uint64_t mantissa = 0;
+      int digits = 0;
+      int exponent = 0;
+      for (bool fraction = false; i < s.size(); ++i) {
+        if (s[i] == '.') {
+          fraction = true;
+        }
+        else if (is_digit(s[i])) {
+          if (digits < 19) {
+            mantissa = mantissa * 10 + (s[i] - '0');
+            if (mantissa != 0) {
+              ++digits;
+            }
+            exponent -= fraction ? 1 : 0;
+          }
+          else {
+            exponent += fraction ? 0 : 1;
+          }
+        }
+        else {
+          break;
+        }
+      }
+
+      if (i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+        ++i;
+        bool negative_exponent = s[i] == '-';
+        i += is_sign(s[i]) ? 1 : 0;
+        int e = 0;
+        for (; i < s.size() && is_digit(s[i]); ++i) {
+          e = e < 100000 ? e * 10 + (s[i] - '0') : e;
+        }
+        exponent += negative_exponent ? -e : e;
+      }
+
+      double result;
+      if (mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+        double power = 1;
+        for (int k = 0; k < (exponent < 0 ? -exponent : exponent); ++k) {
+          power *= 10;
+        }
+        result = exponent < 0 ? static_cast<double>(mantissa) / power : static_cast<double>(mantissa) * power;
+      }
+      else {
+        long double r = static_cast<long double>(mantissa);
+        for (int k = 0; k < exponent && r <= std::numeric_limits<double>::max(); ++k) {
+          r *= 10;
+        }
+        for (int k = 0; k > exponent && r != 0; --k) {
+          r /= 10;
+        }
+        if (r > std::numeric_limits<double>::max()) {
+          return false;
+        }
+        result = static_cast<double>(r);
+      }
+
+      value = negative ? -result : result;
+      return true;
+    }
+
+    struct Token {
+      TokenType type = TokenType::EndOfFile;
+      uint32_t offset = 0;
+      uint32_t size = 0;
+      uint32_t line = 0;
+      uint32_t column = 0;
+      bool decoded = false;
+    };
+
+    // bytes in the UTF-8 sequence at text[i] when it is valid, 0 when it is not, see utf8::validate.
+    constexpr size_t utf8_sequence(std::string_view text, size_t i) {
+      auto byte = [&](size_t k) {
+        return i + k < text.size() ? static_cast<unsigned char>(text[i + k]) : 0;
+      };
+
+      unsigned char c = byte(0);
+      if (c < 0x80) {
+        return 1;
+      }
+
+      size_t length = c >= 0xC2 && c <= 0xDF ? 2 : c >= 0xE0 && c <= 0xEF ? 3 : c >= 0xF0 && c <= 0xF4 ? 4 : 0;
+      unsigned char low = c == 0xE0 ? 0xA0 : c == 0xF0 ? 0x90 : 0x80;
+      unsigned char high = c == 0xED ? 0x9F : c == 0xF4 ? 0x8F : 0xBF;
+      if (length == 0 || byte(1) < low || byte(1) > high) {
+        return 0;
+      }
+      for (size_t k = 2; k < length; ++k) {
+        if (byte(k) < 0x80 || byte(k) > 0xBF) {
+          return 0;
+        }
+      }
+      return length;
+    }
+
+    constexpr void append_utf8(std::vector<char>& out, uint32_t code) {
+      if (code < 0x80) {
+        out.push_back(static_cast<char>(code));
+      }
+      else if (code < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+      }
+      else if (code < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+      }
+      else {
+        out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+      }
+    }
+
+    /*
+     * The Tokenizer and Reader over a literal, character for character the
+     * same rules; the parts the reader does not support are errors.
+     */
+    class Parser {
+    public:
+      constexpr explicit Parser(std::string_view text) : text(text) {
+        if (!validate()) {
+          return;
+        }
+        pop_token();
+
+        while (!failed() && token.type != TokenType::EndOfFile) {
+          uint32_t index;
+          if (!read(index)) {
+            break;
+          }
+          roots.push_back(index);
+        }
+
+        roots_offset = static_cast<uint32_t>(refs.size());
+        refs.insert(refs.end(), roots.begin(), roots.end());
+      }
+
+      constexpr bool failed() const {
+        return error != Error::None;
+      }
+
+      std::string_view text;
+      std::vector<Slot> nodes;
+      std::vector<uint32_t> refs;
+      std::vector<uint32_t> roots;
+      std::vector<char> decoded;
+      uint32_t roots_offset = 0;
+
+      Error error = Error::None;
+      uint32_t error_line = 0;
+      uint32_t error_column = 0;
+
+    private:
+      constexpr bool has(size_t i) const {
+        return i < text.size();
+      }
+
+      // columns count code points, as the scanners do.
+      constexpr void pop() {
+        if (has(index)) {
+          if (text[index] == '\n') {
+            ++line;
+            column = 1;
+          }
+          else if ((static_cast<unsigned char>(text[index]) & 0xC0) != 0x80) {
+            ++column;
+          }
+          ++index;
+        }
+      }
+
+      constexpr bool validate() {
+        uint32_t at_line = 1;
+        uint32_t at_column = 1;
+        for (size_t i = 0; i < text.size();) {
+          size_t n = utf8_sequence(text, i);
+          if (n == 0) {
+            return fail(Error::InvalidUtf8, at_line, at_column);
+          }
+          if (text[i] == '\n') {
+            ++at_line;
+            at_column = 1;
+          }
+          else {
+            ++at_column;
+          }
+          i += n;
+        }
+        return true;
+      }
+
+      constexpr bool fail(Error e, uint32_t at_line, uint32_t at_column) {
+        if (!failed()) {
+          error = e;
+          error_line = at_line;
+          error_column = at_column;
+        }
+        return false;
+      }
+
+      // the current character and those up to the next one in stop, see Tokenizer::slurp_until.
+      template <class Stop>
+      constexpr bool slurp(Stop stop) {
+        while (has(index)) {
+          if (has(index + 1) && !stop(text[index + 1])) {
+            pop();
+          }
+          else {
+            break;
+          }
+        }
+        return has(index + 1);
+      }
+
+      constexpr void emit(TokenType type, uint32_t offset, uint32_t at_line, uint32_t at_column) {
+        token = Token{type, offset, static_cast<uint32_t>(index + 1 - offset), at_line, at_column};
+        ready = true;
+      }
+
+      constexpr void pop_token() {
+        ready = false;
+        token = Token();
+
+        while (!failed() && has(index)) {
+          char c = text[index];
+          uint32_t l = line;
+          uint32_t col = column;
+
+          if (c == '"') {
+            pop();
+            if (!read_string(l, col)) {
+              token = Token();
+              return;
+            }
+          }
+          else if (c == ';' || (c == '#' && has(index + 1) && text[index + 1] == '!')) {
+            while (has(index) && text[index] != '\n') {
+              pop();
+            }
+            pop();
+            continue;
+          }
+          else if (is_whitespace(c)) {
+            // nothing
+          }
+          else if (c == '#' && has(index + 1) && text[index + 1] == '{') {
+            pop();
+            emit(TokenType::SetOpen, static_cast<uint32_t>(index), l, col);
+          }
+          else if (c == '\\' || c == '#') {
+            // chars, functions, regexes and dispatches, which the reader does not support.
+            fail(Error::UnsupportedToken, l, col);
+            return;
+          }
+          else if (c == '(' || c == ')' || c == '{' || c == '}' || c == '[' || c == ']') {
+            TokenType types[] = {TokenType::RoundOpen, TokenType::RoundClose, TokenType::CurlyOpen,
+                                 TokenType::CurlyClose, TokenType::SquareOpen, TokenType::SquareClose};
+            size_t k = std::string_view("(){}[]").find(c);
+            emit(types[k], static_cast<uint32_t>(index), l, col);
+          }
+          else {
+            uint32_t start = static_cast<uint32_t>(index);
+            slurp(is_atom_end);
+            emit(TokenType::Literal, start, l, col);
+          }
+
+          pop();
+
+          if (ready) {
+            break;
+          }
+        }
+      }
+
+      // up to the closing quote, which is left current. Only strings with escapes are decoded.
+      constexpr bool read_string(uint32_t at_line, uint32_t at_column) {
+        size_t start = index;
+        size_t out = decoded.size();
+        bool escaped = false;
+
+        while (true) {
+          if (!has(index)) {
+            return fail(Error::UnexpectedStreamEnd, at_line, at_column);
+          }
+
+          char c = text[index];
+          if (c == '"') {
+            break;
+          }
+          if (c != '\\') {
+            if (escaped) {
+              decoded.push_back(c);
+            }
+            pop();
+            continue;
+          }
+
+          if (!escaped) {
+            escaped = true;
+            decoded.insert(decoded.end(), text.begin() + start, text.begin() + index);
+          }
+          if (!unescape(at_line, at_column)) {
+            return false;
+          }
+        }
+
+        if (escaped) {
+          token = Token{TokenType::String, static_cast<uint32_t>(out), static_cast<uint32_t>(decoded.size() - out),
+                        at_line, at_column, true};
+        }
+        else {
+          token = Token{TokenType::String, static_cast<uint32_t>(start), static_cast<uint32_t>(index - start),
+                        at_line, at_column};
+        }
+        ready = true;
+        return true;
+      }
+
+      // see Tokenizer::unescape
+      constexpr bool unescape(uint32_t at_line, uint32_t at_column) {
+        uint32_t escape_line = line;
+        uint32_t escape_column = column;
+        pop();
+        if (!has(index)) {
+          return fail(Error::UnexpectedStreamEnd, at_line, at_column);
+        }
+
+        char c = text[index];
+        pop();
+        std::string_view from("ntrbf\"\\");
+        std::string_view to("\n\t\r\b\f\"\\");
+        if (from.find(c) != std::string_view::npos) {
+          decoded.push_back(to[from.find(c)]);
+          return true;
+        }
+        if (c != 'u') {
+          return fail(Error::InvalidEscape, escape_line, escape_column);
+        }
+
+        auto hex = [this](uint32_t& unit) {
+          unit = 0;
+          for (int i = 0; i < 4; ++i) {
+            int digit = has(index) ? digit_value(text[index]) : 99;
+            if (digit >= 16) {
+              return false;
+            }
+            unit = unit * 16 + digit;
+            pop();
+          }
+          return true;
+        };
+
+        uint32_t code = 0;
+        if (!hex(code) || (code >= 0xDC00 && code < 0xE000)) {
+          return fail(Error::InvalidEscape, escape_line, escape_column);
+        }
+        if (code >= 0xD800 && code < 0xDC00) {
+          uint32_t low = 0;
+          if (!has(index + 1) || text[index] != '\\' || text[index + 1] != 'u') {
+            return fail(Error::InvalidEscape, escape_line, escape_column);
+          }
+          pop();
+          pop();
+          if (!hex(low) || low < 0xDC00 || low >= 0xE000) {
+            return fail(Error::InvalidEscape, escape_line, escape_column);
+          }
+          code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        }
+
+        append_utf8(decoded, code);
+        return true;
+      }
+
+      constexpr std::string_view value() const {
+        return text.substr(token.offset, token.size);
+      }
+
+      constexpr uint32_t add(Slot slot) {
+        slot.line = token.line;
+        slot.column = token.column;
+        nodes.push_back(slot);
+        return static_cast<uint32_t>(nodes.size() - 1);
+      }
+
+      constexpr bool read(uint32_t& result) {
+        if (token.type == TokenType::Literal) {
+          if (!read_atom(result)) {
+            return false;
+          }
+        }
+        else if (token.type == TokenType::String) {
+          result = add(Slot{ExpressionType::String, 0, 0, token.offset, token.size});
+          nodes[result].decoded = token.decoded;
+        }
+        else if (token.type == TokenType::RoundOpen) {
+          return read_collection(ExpressionType::List, TokenType::RoundClose, result);
+        }
+        else if (token.type == TokenType::CurlyOpen) {
+          return read_collection(ExpressionType::Map, TokenType::CurlyClose, result);
+        }
+        else if (token.type == TokenType::SetOpen) {
+          return read_collection(ExpressionType::Set, TokenType::CurlyClose, result);
+        }
+        else if (token.type == TokenType::SquareOpen) {
+          return read_collection(ExpressionType::Vector, TokenType::SquareClose, result);
+        }
+        else {
+          return fail(Error::ClosingTagWithoutOpen, token.line, token.column);
+        }
+
+        pop_token();
+        return !failed();
+      }
+
+      constexpr bool read_atom(uint32_t& result) {
+        std::string_view v = value();
+        bool number = is_digit(v[0]) || (v.size() > 1 && is_sign(v[0]));
+
+        if (v[0] == ':') {
+          result = add(Slot{ExpressionType::Keyword, 0, 0, token.offset + 1, token.size - 1});
+        }
+        else if (number && match_integer(v).matched) {
+          IntegerMatch m = match_integer(v);
+          long n = 0;
+          if (!m.zero && !parse_long(m.digits, m.radix, n)) {
+            return fail(Error::InvalidInteger, token.line, token.column);
+          }
+          result = add(Slot{ExpressionType::Integer, 0, 0, 0, 0, v[0] == '-' ? -n : n});
+        }
+        else if (number && match_float(v)) {
+          double d = 0;
+          if (!parse_double(v, d)) {
+            return fail(Error::FloatOutOfRange, token.line, token.column);
+          }
+          result = add(Slot{ExpressionType::Float, 0, 0, 0, 0, 0, 0, d});
+        }
+        else if (number && match_ratio(v)) {
+          size_t slash = v.find('/');
+          std::string_view n = v.substr(0, slash);
+          if (n[0] == '+') {
+            n.remove_prefix(1);
+          }
+          long numerator = 0;
+          long denominator = 0;
+          if (!parse_long(n, 10, numerator) || !parse_long(v.substr(slash + 1), 10, denominator)) {
+            return fail(Error::InvalidRatio, token.line, token.column);
+          }
+          result = add(Slot{ExpressionType::Ratio, 0, 0, 0, 0, numerator, denominator});
+        }
+        else {
+          result = add(Slot{ExpressionType::Literal, 0, 0, token.offset, token.size});
+        }
+        return true;
+      }
+
+      constexpr bool is_close(TokenType type) const {
+        return type == TokenType::RoundClose || type == TokenType::CurlyClose || type == TokenType::SquareClose;
+      }
+
+      constexpr bool read_collection(ExpressionType type, TokenType close, uint32_t& result) {
+        uint32_t start_line = token.line;
+        uint32_t start_column = token.column;
+        result = add(Slot{type});
+        pop_token();
+
+        std::vector<uint32_t> children;
+        while (token.type != close) {
+          if (failed()) {
+            return false;
+          }
+          if (token.type == TokenType::EndOfFile) {
+            return fail(Error::UnclosedCollection, start_line, start_column);
+          }
+          if (is_close(token.type)) {
+            return fail(Error::MismatchedClose, token.line, token.column);
+          }
+
+          uint32_t child;
+          if (!read(child)) {
+            return false;
+          }
+          children.push_back(child);
+        }
+
+        if (type == ExpressionType::Map && children.size() % 2 == 1) {
+          return fail(Error::OddMapEntries, start_line, start_column);
+        }
+
+        nodes[result].offset = static_cast<uint32_t>(refs.size());
+        nodes[result].size = static_cast<uint32_t>(children.size());
+        refs.insert(refs.end(), children.begin(), children.end());
+
+        pop_token();
+        return !failed();
+      }
+
+      size_t index = 0;
+      uint32_t line = 1;
+      uint32_t column = 1;
+      Token token;
+      bool ready = false;
+    };
+
+    struct Measure {
+      Error error = Error::None;
+      uint32_t line = 0;
+      uint32_t column = 0;
+      size_t nodes = 0;
+      size_t refs = 0;
+      size_t decoded = 0;
+    };
+
+    constexpr Measure measure(std::string_view text) {
+      Parser p(text);
+      return Measure{p.error, p.error_line, p.error_column, p.nodes.size(), p.refs.size(), p.decoded.size()};
+    }
+
+    template <size_t Nodes, size_t Refs, size_t Decoded>
+    struct Storage {
+      std::array<Slot, Nodes> nodes;
+      std::array<uint32_t, Refs> refs;
+      std::array<char, Decoded> decoded;
+      uint32_t roots_offset = 0;
+      uint32_t roots = 0;
+    };
+
+    template <size_t Nodes, size_t Refs, size_t Decoded>
+    constexpr Storage<Nodes, Refs, Decoded> build(std::string_view text) {
+      Parser p(text);
+      Storage<Nodes, Refs, Decoded> s{};
+      if (p.failed()) {
+        return s;
+      }
+      for (size_t i = 0; i < Nodes; ++i) {
+        s.nodes[i] = p.nodes[i];
+      }
+      for (size_t i = 0; i < Refs; ++i) {
+        s.refs[i] = p.refs[i];
+      }
+      for (size_t i = 0; i < Decoded; ++i) {
+        s.decoded[i] = p.decoded[i];
+      }
+      s.roots_offset = p.roots_offset;
+      s.roots = static_cast<uint32_t>(p.roots.size());
+      return s;
+    }
+
+    // instantiated with the error of a malformed literal, so the compiler names both.
+    template <Error error, uint32_t line, uint32_t column>
+    struct report {
+      static_assert(error == Error::None, "malformed punch literal, see the report<error, line, column> it is instantiated with");
+      static constexpr bool value = true;
+    };
+  }
+
+  template <Source S>
+  class Forms {
+    static constexpr detail::Measure measured = detail::measure(S.view());
+    static_assert(detail::report<measured.error, measured.line, measured.column>::value);
+    static constexpr auto storage = detail::build<measured.nodes, measured.refs, measured.decoded>(S.view());
+    static constexpr Tables tables{storage.nodes.data(), storage.refs.data(), S.text, storage.decoded.data()};
+
+  public:
+    constexpr size_t size() const {
+      return storage.roots;
+    }
+
+    constexpr bool empty() const {
+      return storage.roots == 0;
+    }
+
+    constexpr Node operator[](size_t i) const {
+      return roots()[i];
+    }
+
+    constexpr Children::iterator begin() const {
+      return roots().begin();
+    }
+
+    constexpr Children::iterator end() const {
+      return roots().end();
+    }
+
+  private:
+    constexpr Children roots() const {
+      return Children(&tables, storage.roots_offset, storage.roots);
+    }
+  };
+
+  // every form of the literal.
+  template <Source S>
+  inline constexpr Forms<S> forms{};
+
+  template <Source S>
+  constexpr Node single() {
+    static_assert(detail::report<forms<S>.size() == 1 ? Error::None : Error::ExpectedOneForm, 1, 1>::value);
+    return forms<S>[0];
+  }
+
+  // the one form of the literal.
+  template <Source S>
+  inline constexpr Node form = single<S>();
+}
+
+#endif
+
+#endif //PUNCH_CONSTFORM_HPP
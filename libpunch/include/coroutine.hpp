@@ -0,0 +1,214 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_COROUTINE_HPP
+#define PUNCH_COROUTINE_HPP
+
+#ifdef PUNCH_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <reader.hpp>
+
+/*
+ * Lazily evaluated sequence of T produced by a coroutine that co_yields
+ * them. Iterating resumes the coroutine up to its next co_yield; the yielded
+ * value is handed out by reference, so move-only values such as UExpression
+ * can be moved out of it.
+ */
+template <class T>
+class Generator {
+
+public:
+  struct promise_type {
+    T* value = nullptr;
+    std::exception_ptr error;
+
+    Generator get_return_object() {
+      return Generator(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept {
+      return {};
+    }
+
+    std::suspend_always final_suspend() noexcept {
+      return {};
+    }
+
+    // the yielded temporary lives until the coroutine is resumed again.
+    std::suspend_always yield_value(T& v) noexcept {
+      value = std::addressof(v);
+      return {};
+    }
+
+    std::suspend_always yield_value(T&& v) noexcept {
+      value = std::addressof(v);
+      return {};
+    }
+
+    void return_void() {}
+
+    void unhandled_exception() {
+      error = std::current_exception();
+    }
+  };
+
+  typedef std::coroutine_handle<promise_type> handle;
+
+  class iterator {
+  public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef T* pointer;
+    typedef T& reference;
+
+    iterator() {}
+    explicit iterator(handle coroutine) : coroutine(coroutine) {}
+
+    T& operator*() const {
+      return *coroutine.promise().value;
+    }
+
+    T* operator->() const {
+      return coroutine.promise().value;
+    }
+
+    iterator& operator++() {
+      advance(coroutine);
+      if (coroutine.done()) {
+        coroutine = nullptr;
+      }
+      return *this;
+    }
+
+    bool operator==(const iterator& other) const {
+      return coroutine == other.coroutine;
+    }
+
+    bool operator!=(const iterator& other) const {
+      return coroutine != other.coroutine;
+    }
+
+  private:
+    handle coroutine;
+  };
+
+  Generator(Generator&& other) noexcept : coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+  Generator& operator=(Generator&& other) noexcept {
+    std::swap(coroutine, other.coroutine);
+    return *this;
+  }
+
+  Generator(const Generator&) = delete;
+  Generator& operator=(const Generator&) = delete;
+
+  ~Generator() {
+    if (coroutine) {
+      coroutine.destroy();
+    }
+  }
+
+  // starts the coroutine; a generator can be iterated once.
+  iterator begin() {
+    advance(coroutine);
+    return coroutine.done() ? end() : iterator(coroutine);
+  }
+
+  iterator end() {
+    return iterator();
+  }
+
+private:
+  explicit Generator(handle coroutine) : coroutine(coroutine) {}
+
+  static void advance(handle coroutine) {
+    coroutine.resume();
+    if (coroutine.promise().error) {
+      std::rethrow_exception(coroutine.promise().error);
+    }
+  }
+
+  handle coroutine;
+};
+
+/*
+ * A coroutine that starts running when it is called and returns nothing;
+ * callers check done() and rethrow() instead of awaiting it. Used to drive
+ * StreamReader and StreamTokenizer consumers from a feeding loop.
+ */
+class Task {
+
+public:
+  struct promise_type {
+    std::exception_ptr error;
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_never initial_suspend() noexcept {
+      return {};
+    }
+
+    // kept until the Task is destroyed, so done() can be asked.
+    std::suspend_always final_suspend() noexcept {
+      return {};
+    }
+
+    void return_void() {}
+
+    void unhandled_exception() {
+      error = std::current_exception();
+    }
+  };
+
+  Task(Task&& other) noexcept : coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  ~Task() {
+    if (coroutine) {
+      coroutine.destroy();
+    }
+  }
+
+  bool done() const {
+    return coroutine.done();
+  }
+
+  // rethrows what escaped the coroutine, if anything did.
+  void rethrow() const {
+    if (coroutine.promise().error) {
+      std::rethrow_exception(coroutine.promise().error);
+    }
+  }
+
+private:
+  explicit Task(std::coroutine_handle<promise_type> coroutine) : coroutine(coroutine) {}
+
+  std::coroutine_handle<promise_type> coroutine;
+};
+
+// the tokens of tokenizer up to, not including, EndOfFile.
+Generator<Token> tokens(Tokenizer& tokenizer);
+
+// the forms of reader up to EndOfFile or the first form it fails on, see Reader::try_next.
+Generator<UExpression> forms(Reader& reader);
+
+#endif //PUNCH_COROUTINES
+
+#endif //PUNCH_COROUTINE_HPP
@@ -0,0 +1,103 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_DAEMON_HPP
+#define PUNCH_DAEMON_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filecache.hpp>
+
+/*
+ * Long running punch process that answers queries on files over a Unix
+ * domain socket from a FileCache, so tools that would start punch for every
+ * file only pay a round-trip for files that did not change.
+ *
+ * Requests and responses are frames of a little-endian uint32 length
+ * followed by that many bytes:
+ *
+ *   request   query name, a space, absolute path   "index /src/core.p"
+ *   response  status byte (0 ok, 1 error), body
+ *
+ * The body of an error is one "line:column: error: message" line per
+ * diagnostic. A connection can carry any number of requests. Requests
+ * longer than max_request bytes close the connection.
+ */
+class DaemonServer {
+
+public:
+  static const uint32_t max_request = 64 * 1024;
+
+  // listens on socket_path, replacing a stale socket file. Throws std::system_error
+  // when the socket cannot be bound or another daemon is listening on it.
+  DaemonServer(const std::string& socket_path, FileCache& cache);
+  ~DaemonServer();
+
+  DaemonServer(const DaemonServer&) = delete;
+  DaemonServer& operator=(const DaemonServer&) = delete;
+
+  // serves requests until stop() is called.
+  void run();
+
+  // safe to call from other threads and signal handlers.
+  void stop();
+
+  // the response frame payload for a request frame payload.
+  std::string handle(const std::string& request);
+
+private:
+  /*
+   * Client sockets do not block, so a client that sends part of a frame
+   * or stops reading cannot hold up the others. What arrived of the next
+   * request and what the socket did not take yet of the responses are
+   * kept per client; no more requests are read while a response is
+   * pending.
+   */
+  struct Client {
+    int fd;
+    std::string input;
+    std::string output;
+  };
+
+  void accept();
+  bool receive(Client& client);
+  bool flush(Client& client);
+  bool send(Client& client, const char* data, size_t size);
+  const FileCache::Response& respond(const std::string& request);
+
+  std::string socket_path;
+  FileCache& cache;
+  int listener = -1;
+  int wakeup[2] = {-1, -1};
+  std::vector<Client> clients;
+  FileCache::Response rejected;
+};
+
+class DaemonClient {
+
+public:
+  // throws std::system_error when no daemon listens on socket_path.
+  explicit DaemonClient(const std::string& socket_path);
+  ~DaemonClient();
+
+  DaemonClient(const DaemonClient&) = delete;
+  DaemonClient& operator=(const DaemonClient&) = delete;
+
+  // relative paths are resolved against the working directory of the client.
+  // Throws std::system_error when the connection breaks.
+  FileCache::Response query(FileCache::Query query, const std::string& path);
+
+private:
+  int fd = -1;
+  std::string frame;
+};
+
+#endif //PUNCH_DAEMON_HPP
@@ -0,0 +1,237 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_DEFINITIONINDEX_HPP
+#define PUNCH_DEFINITIONINDEX_HPP
+
+#include <cstring>
+#include <list>
+#include <string>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+#include <batchreader.hpp>
+#include <reader.hpp>
+
+/*
+ * Index of the top-level definitions of a source tree, so a tool can find
+ * where a name is defined without reading every file again.
+ *
+ * A definition is a top-level list whose head is one of the configured
+ * literals and whose second element is a literal, the name: (defn f [x] ..).
+ * For function heads the arities are taken from the parameter vector, or
+ * from the ([params] body) lists of a multi-arity definition.
+ */
+
+struct DefinitionHeads {
+  // name only: (def x 1), (ns a.b)
+  std::vector<std::string> plain = {"def", "ns"};
+
+  // name and arities: (defn f [x] ..), (defmacro m ([a] ..) ([a & more] ..))
+  std::vector<std::string> functions = {"defn", "defmacro"};
+};
+
+struct Arity {
+  // parameters before &
+  uint32_t params;
+  bool variadic;
+};
+
+struct Definition {
+  std::string head;
+  std::string name;
+
+  // of the list that defines it.
+  position pos;
+  std::vector<Arity> arities;
+};
+
+std::vector<Definition> extract_definitions(const std::list<UExpression>& forms,
+                                            const DefinitionHeads& heads = DefinitionHeads());
+
+/*
+ * Read-only mapping of an index file written by update_definition_index.
+ *
+ *   header:       "PNDX" version:u32 files:u32 definitions:u32 buckets:u32
+ *                 arities:u32 heads:u64 strings:u32 reserved:u32
+ *   files:        path:u32 diagnostics:u32 size:u64 mtime:i64
+ *   definitions:  name:u32 head:u32 file:u32 line:u32 column:u32 arity:u32 arities:u32
+ *   buckets:      (buckets + 1) x u32, the first definition of every bucket
+ *   arities:      params:u32, the top bit set when variadic
+ *   strings:      size:u32 bytes and a terminating zero
+ *
+ * All words are little-endian. Definitions are sorted by the bucket of the
+ * hash of their name, then by name, so find() hashes the name and scans a
+ * single bucket; the definitions of a name are adjacent. String fields are
+ * offsets into the string section, file fields indices into the files.
+ * The file is validated when mapped unless the caller trusts it;
+ * ReaderException is thrown when it cannot be mapped or is invalid.
+ */
+class DefinitionIndex {
+
+public:
+  static const uint32_t version = 1;
+
+  class Entry {
+  public:
+    Entry(const DefinitionIndex& index, uint32_t i) : index(index), record(index.definition(i)) {}
+
+    boost::string_ref name() const {
+      return index.string(word(0));
+    }
+
+    boost::string_ref head() const {
+      return index.string(word(4));
+    }
+
+    // index of the file it is defined in.
+    size_t file() const {
+      return word(8);
+    }
+
+    boost::string_ref path() const {
+      return index.file_path(word(8));
+    }
+
+    ::position position() const {
+      return std::make_tuple(word(12), word(16));
+    }
+
+    size_t arities() const {
+      return word(24);
+    }
+
+    Arity arity(size_t i) const {
+      uint32_t v = index.word(index.arities_at + 4 * (word(20) + i));
+      return Arity{v & 0x7fffffff, (v & 0x80000000) != 0};
+    }
+
+  private:
+    uint32_t word(size_t at) const {
+      uint32_t v;
+      std::memcpy(&v, record + at, sizeof(v));
+      return v;
+    }
+
+    const DefinitionIndex& index;
+    const char* record;
+  };
+
+  // the definitions of one name, in file and position order.
+  class Entries {
+  public:
+    Entries(const DefinitionIndex& index, uint32_t first, uint32_t count) : index(index), first(first), count(count) {}
+
+    size_t size() const {
+      return count;
+    }
+
+    bool empty() const {
+      return count == 0;
+    }
+
+    Entry operator[](size_t i) const {
+      return Entry(index, static_cast<uint32_t>(first + i));
+    }
+
+  private:
+    const DefinitionIndex& index;
+    uint32_t first;
+    uint32_t count;
+  };
+
+  explicit DefinitionIndex(const std::string& path, bool validate = true);
+  ~DefinitionIndex();
+
+  DefinitionIndex(const DefinitionIndex&) = delete;
+  DefinitionIndex& operator=(const DefinitionIndex&) = delete;
+
+  Entries find(boost::string_ref name) const;
+
+  // every definition, grouped by name.
+  Entries all() const {
+    return Entries(*this, 0, definitions);
+  }
+
+  size_t size() const {
+    return definitions;
+  }
+
+  size_t files() const {
+    return file_count;
+  }
+
+  boost::string_ref file_path(size_t i) const {
+    return string(word(files_at + 24 * i));
+  }
+
+  // diagnostics of the file when it was read, its definitions outside the malformed forms are indexed.
+  size_t file_diagnostics(size_t i) const {
+    return word(files_at + 24 * i + 4);
+  }
+
+  // as stat'ed when the file was read.
+  uint64_t file_size(size_t i) const;
+  int64_t file_mtime(size_t i) const;
+
+  uint64_t heads_hash() const;
+
+  // checks that every section and reference is in bounds.
+  static bool validate(const char* data, size_t size, std::string& error);
+
+private:
+  uint32_t word(size_t at) const {
+    uint32_t v;
+    std::memcpy(&v, m_data + at, sizeof(v));
+    return v;
+  }
+
+  const char* definition(uint32_t i) const {
+    return m_data + definitions_at + 28 * size_t(i);
+  }
+
+  boost::string_ref string(uint32_t at) const {
+    return boost::string_ref(m_data + strings_at + at + 4, word(strings_at + at));
+  }
+
+  const char* m_data;
+  size_t m_size;
+
+  uint32_t file_count;
+  uint32_t definitions;
+  uint32_t buckets;
+  size_t files_at;
+  size_t definitions_at;
+  size_t buckets_at;
+  size_t arities_at;
+  size_t strings_at;
+};
+
+struct IndexUpdate {
+  size_t files = 0;
+  size_t read = 0;
+  size_t reused = 0;
+  size_t failed = 0;
+  size_t definitions = 0;
+};
+
+/*
+ * Writes the definition index of files to path. Files whose size and
+ * modification time match the index already at path keep their entries,
+ * the others are read on a work-stealing pool of jobs workers (0 means one
+ * per core), with recovery so a malformed form does not hide the rest of
+ * the file. Files that cannot be opened are left out and counted as
+ * failed. The index is written to a temporary file and renamed into place,
+ * so mappings of the previous one stay valid. Changing the heads reads
+ * every file again. Throws ReaderException when the index cannot be written.
+ */
+IndexUpdate update_definition_index(const std::string& path, const std::vector<SourceFile>& files,
+                                    const DefinitionHeads& heads = DefinitionHeads(), unsigned jobs = 0);
+
+#endif //PUNCH_DEFINITIONINDEX_HPP
@@ -0,0 +1,85 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_DOCUMENT_HPP
+#define PUNCH_DOCUMENT_HPP
+
+#include <string>
+#include <vector>
+#include <reader.hpp>
+
+/*
+ * Source text that is kept read while it is edited, for editors and other
+ * long-lived users.
+ *
+ * The text is split at the top-level forms. An edit re-reads from the last
+ * form that can be affected by it, up to the first form that starts after
+ * the edit on a later line and is reached at the same top-level boundary
+ * as before. The forms from there on are kept as they are; their
+ * positions are moved by the number of lines the edit added, lazily when
+ * a form is accessed. Text that is not valid UTF-8 is rejected as a whole,
+ * so an edit that makes it valid or invalid reads all of it again. The
+ * forms and diagnostics always equal those of try_read_forms(text(), true).
+ */
+class Document {
+
+public:
+  explicit Document(std::string text = "");
+
+  // replaces removed bytes at offset with inserted, throws std::out_of_range outside the text.
+  void edit(size_t offset, size_t removed, const std::string& inserted);
+
+  const std::string& text() const {
+    return m_text;
+  }
+
+  // number of top-level forms
+  size_t size() const;
+
+  const Expression& form(size_t i);
+
+  std::vector<Diagnostic> diagnostics() const;
+
+  // number of reads done by the last edit, each is a top-level form or a failed attempt at one.
+  size_t reread() const {
+    return m_reread;
+  }
+
+private:
+  // one call of Reader::try_next: the diagnostics it recovered from and the form it read, if any.
+  struct Entry {
+    size_t offset;
+    position pos;
+    UExpression form;
+    std::vector<Diagnostic> diagnostics;
+
+    // lines the form and diagnostics still have to be moved by.
+    int pending;
+  };
+
+  // reads from offset at pos to the end of the text, or until a top-level read would start
+  // where entry stop, from from on, starts after moving it by delta bytes.
+  std::vector<Entry> read(size_t offset, position pos, size_t from, long delta, size_t& stop);
+
+  void index_lines(size_t from);
+  size_t offset_of(position pos) const;
+  uint line_of(size_t offset) const;
+
+  std::string m_text;
+  bool valid;
+
+  // offset of the first byte of every line
+  std::vector<size_t> lines;
+
+  std::vector<Entry> entries;
+  size_t m_reread = 0;
+};
+
+#endif //PUNCH_DOCUMENT_HPP
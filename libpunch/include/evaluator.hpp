@@ -0,0 +1,103 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_EVALUATOR_HPP
+#define PUNCH_EVALUATOR_HPP
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <value.hpp>
+
+/*
+ * Evaluates read forms by compiling them into a tree of C++ closures, one
+ * per expression, instead of bytecode. Locals are resolved to frame slots,
+ * the locals of enclosing functions to captured values and other symbols
+ * to global slots of the Environment, all while compiling, so running a
+ * form never looks at the expressions or a name again.
+ *
+ * Calls of pure core functions on constants are folded, as are lets of
+ * constants, ifs with a constant test and fns that capture nothing. The
+ * core arithmetic and comparisons that are not shadowed get closures of
+ * their own, specialized for locals and constants as operands. The special
+ * forms are those of the bytecode compiler: def, defn, fn, let, if, do,
+ * loop, recur and quote.
+ */
+namespace eval {
+
+  class Evaluator {
+
+  public:
+    struct Frame;
+    typedef std::function<Value(Frame&)> Code;
+
+    // the locals of running functions, running out of it is an EvalError.
+    struct Stack {
+      std::unique_ptr<Value[]> values;
+      Value* limit;
+      Value* top;
+
+      // the native stack is used for calls as well, up to native_size bytes below entry.
+      uintptr_t entry = 0;
+      size_t native_size;
+    };
+
+    // a form compiled once, to be run any number of times on the evaluator it was compiled by.
+    class Compiled {
+    public:
+      Value operator()() const;
+
+      // known when compiling, running it gives value().
+      bool constant() const {
+        return m_constant;
+      }
+
+      const Value& value() const {
+        return m_value;
+      }
+
+    private:
+      friend class Evaluator;
+
+      Stack* stack = nullptr;
+      Code code;
+      uint32_t slots = 0;
+      bool m_constant = false;
+      Value m_value;
+    };
+
+    // native_size should leave room for the natives called, on the stack of every thread that evaluates.
+    explicit Evaluator(Environment& env, size_t stack_size = 1 << 16, size_t native_size = 4 << 20);
+
+    Evaluator(const Evaluator&) = delete;
+    Evaluator& operator=(const Evaluator&) = delete;
+
+    // throws EvalError; functions made by the result run on this evaluator, so it has to outlive them.
+    Compiled compile(const Expression& form);
+
+    Value eval(const Expression& form) {
+      return compile(form)();
+    }
+
+    // reads, compiles and runs every form of source, the value of the last one.
+    Value eval(const std::string& source);
+
+    Environment& environment() {
+      return env;
+    }
+
+  private:
+    Environment& env;
+    Stack stack;
+  };
+}
+
+#endif //PUNCH_EVALUATOR_HPP
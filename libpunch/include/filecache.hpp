@@ -0,0 +1,128 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_FILECACHE_HPP
+#define PUNCH_FILECACHE_HPP
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+/*
+ * In-memory cache of read files for the punch daemon, keyed by path and
+ * validated by modification time, size and content hash.
+ *
+ * A file is read once into its binary form encoding; the answers to the
+ * queries on it are rendered from that on first use and kept, so a repeated
+ * query on an unchanged file is a lookup.
+ *
+ * Cached files are watched with inotify. As long as no event arrived for a
+ * file it is not even stat'ed; after an event (or when inotify is not
+ * available) a changed modification time or size makes the file be loaded
+ * again, and only a changed content hash throws away what was rendered.
+ *
+ * The least recently used files are evicted once the cached bytes exceed
+ * the capacity. Not thread safe, the daemon serves from one thread.
+ */
+class FileCache {
+
+public:
+  enum class Query {
+    Binary, Punch, Debug, Tokens, Index
+  };
+
+  static const size_t queries = static_cast<size_t>(Query::Index) + 1;
+
+  struct Response {
+    bool ok;
+    std::string body;
+  };
+
+  explicit FileCache(size_t capacity = 64 << 20, bool watch = true);
+  ~FileCache();
+
+  FileCache(const FileCache&) = delete;
+  FileCache& operator=(const FileCache&) = delete;
+
+  // the answer to query on the file at path. The reference is valid until the next call.
+  const Response& get(const std::string& path, Query query);
+
+  // inotify descriptor to poll for readability, -1 when files are not watched.
+  int watch_fd() const {
+    return inotify;
+  }
+
+  // reads the pending inotify events and marks the files they are about as changed.
+  void process_events();
+
+  size_t hits() const {
+    return m_hits;
+  }
+
+  size_t misses() const {
+    return m_misses;
+  }
+
+  size_t entries() const {
+    return index.size();
+  }
+
+  size_t bytes() const {
+    return m_bytes;
+  }
+
+  static const char* name(Query query);
+
+  // false when name is not the name of a query.
+  static bool parse(const std::string& name, Query& query);
+
+private:
+  struct Entry {
+    std::string path;
+    int64_t mtime = 0;
+    uint64_t size = 0;
+    uint64_t hash = 0;
+    int wd = -1;
+    bool changed = false;
+
+    std::string text;
+    bool rendered[queries] = {};
+    Response responses[queries];
+
+    size_t bytes() const;
+  };
+
+  typedef std::list<Entry>::iterator Iterator;
+
+  // rendered is set when the file was loaded, which renders Query::Binary.
+  bool refresh(Iterator entry, bool& rendered);
+  void render(Entry& entry, Query query);
+  void watch(Iterator entry);
+  void unwatch(Entry& entry);
+  void remove(Iterator entry);
+  void evict();
+
+  size_t capacity;
+  int inotify = -1;
+
+  // most recently used first
+  std::list<Entry> lru;
+  std::unordered_map<std::string, Iterator> index;
+  // one inode can be cached under several paths
+  std::unordered_multimap<int, std::string> watches;
+
+  Response error;
+  size_t m_bytes = 0;
+  size_t m_hits = 0;
+  size_t m_misses = 0;
+};
+
+#endif //PUNCH_FILECACHE_HPP
@@ -0,0 +1,155 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_FILELOADER_HPP
+#define PUNCH_FILELOADER_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <scanner.hpp>
+
+class FileLoader;
+
+/*
+ * A file read by FileLoader. The buffer is handed over as it was read, it
+ * is never copied; scanner() scans it in place. Its bytes count towards the
+ * loader's budget until the file is destroyed, so a consumer that keeps
+ * files around holds back the loading of the next ones.
+ */
+class LoadedFile {
+
+public:
+  LoadedFile(LoadedFile&& other) noexcept;
+  LoadedFile& operator=(LoadedFile&& other) noexcept;
+  ~LoadedFile();
+
+  LoadedFile(const LoadedFile&) = delete;
+  LoadedFile& operator=(const LoadedFile&) = delete;
+
+  // the position of the file in the paths given to FileLoader::load.
+  size_t index() const {
+    return m_index;
+  }
+
+  // 0 when the file was read, the errno it failed with otherwise.
+  int error() const {
+    return m_error;
+  }
+
+  const char* data() const {
+    return buffer.data();
+  }
+
+  size_t size() const {
+    return buffer.size();
+  }
+
+  // scans the buffer, which has to outlive the scanner.
+  std::unique_ptr<Scanner> scanner() const;
+
+private:
+  friend class FileLoader;
+
+  LoadedFile(FileLoader* loader, size_t index, int error, std::string buffer = std::string(), size_t reserved = 0);
+  void release();
+
+  FileLoader* loader;
+  size_t m_index;
+  int m_error;
+  std::string buffer;
+
+  // the bytes of the budget taken for the file, its size when it was opened.
+  size_t reserved;
+};
+
+/*
+ * Reads many files at once, for batches of thousands of source files where
+ * opening and reading them one after the other waits on every syscall.
+ *
+ * On Linux the opens and reads are queued on an io_uring, depth of them in
+ * flight at a time. Where io_uring is not available (or the kernel lacks
+ * its open and read operations) a pool of depth threads does open, fstat
+ * and pread instead. The read files are handed to the consumer on the
+ * thread that called load(), in the order they complete.
+ *
+ * No more than max_bytes are held in read buffers at once, counting the
+ * files the consumer keeps. A file larger than that, or any file while
+ * the consumer keeps all of the budget, is read on its own once every
+ * other file was handed over. Buffers of released files are reused.
+ */
+class FileLoader {
+
+public:
+  // Auto and Uring use io_uring when it is there, Threads never does.
+  enum class Backend {
+    Auto, Uring, Threads
+  };
+
+  typedef std::function<void(LoadedFile&&)> Consumer;
+
+  explicit FileLoader(unsigned depth = 32, size_t max_bytes = 64 << 20, Backend backend = Backend::Auto);
+  ~FileLoader();
+
+  FileLoader(const FileLoader&) = delete;
+  FileLoader& operator=(const FileLoader&) = delete;
+
+  // reads every path and calls consume with each; files that can not be read are handed over with their error.
+  void load(const std::vector<std::string>& paths, const Consumer& consume);
+
+  // Uring or Threads, whichever is used.
+  Backend backend() const {
+    return m_backend;
+  }
+
+  // the most bytes held in buffers at once during the last load.
+  size_t peak_bytes() const {
+    return m_peak;
+  }
+
+private:
+  friend class LoadedFile;
+
+  class Ring;
+
+  void load_uring(const std::vector<std::string>& paths, const Consumer& consume);
+  void load_threads(const std::vector<std::string>& paths, const Consumer& consume);
+
+  // takes size bytes of the budget for a file about to be read. Without wait it is false when
+  // they are not there; with it, it waits for them and is false only when the load is cancelled.
+  bool reserve(size_t size, bool wait);
+
+  // calls consume with file; a file read into the budget is done with once consume returns.
+  void hand_over(LoadedFile& file, const Consumer& consume);
+  void consumed();
+
+  void release(size_t size, std::string buffer);
+  std::string take_buffer(size_t size);
+
+  unsigned depth;
+  size_t max_bytes;
+  Backend m_backend;
+  std::unique_ptr<Ring> ring;
+
+  std::mutex mutex;
+  std::condition_variable released;
+  std::vector<std::string> spare;
+  size_t held = 0;
+
+  // files that have bytes of the budget and were not handed over yet.
+  size_t unconsumed = 0;
+  size_t m_peak = 0;
+  bool cancelled = false;
+};
+
+#endif //PUNCH_FILELOADER_HPP
@@ -0,0 +1,307 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_FLATFORM_HPP
+#define PUNCH_FLATFORM_HPP
+
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <string>
+#include <boost/utility/string_ref.hpp>
+#include <reader.hpp>
+
+/*
+ * Flat, offset based layout of read forms that is traversed in place, for
+ * example straight from an mmap'ed file, without allocating.
+ *
+ *   header:  "PNCF" version:u32 count:u32 reserved:u32
+ *   roots:   count x i32
+ *   nodes:   type:u32 size:u32 line:u32 column:u32 payload
+ *
+ * All words are little-endian and every node starts on a 4 byte boundary.
+ * References are i32 offsets relative to the slot that holds them, and
+ * always point backwards: children are written before their parents. The
+ * payload is the bytes plus a terminating zero for keywords, literals and
+ * strings (size is the length), an i64 for integers, a double for floats,
+ * two i64 for ratios, and size child references for collections.
+ */
+namespace flatform {
+
+  const uint32_t version = 1;
+  const uint32_t header_size = 16;
+  const uint32_t node_header_size = 16;
+
+  inline uint32_t read_u32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  inline int32_t read_i32(const char* p) {
+    int32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  class Node {
+  public:
+    Node(const char* base, uint32_t offset) : base(base), offset(offset) {}
+
+    ExpressionType type() const {
+      return static_cast<ExpressionType>(read_u32(base + offset));
+    }
+
+    ::position position() const {
+      return std::make_tuple(read_u32(base + offset + 8), read_u32(base + offset + 12));
+    }
+
+    template <class T>
+    T as() const {
+      return T(*this);
+    }
+
+  protected:
+    uint32_t size() const {
+      return read_u32(base + offset + 4);
+    }
+
+    const char* payload() const {
+      return base + offset + node_header_size;
+    }
+
+    const char* base;
+    uint32_t offset;
+  };
+
+  class Children {
+  public:
+    class iterator {
+    public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef Node value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef Node* pointer;
+      typedef Node reference;
+
+      iterator(const char* base, uint32_t slot) : base(base), slot(slot) {}
+
+      Node operator*() const {
+        return Node(base, static_cast<uint32_t>(slot + read_i32(base + slot)));
+      }
+
+      iterator& operator++() {
+        slot += 4;
+        return *this;
+      }
+
+      bool operator==(const iterator& other) const {
+        return slot == other.slot;
+      }
+
+      bool operator!=(const iterator& other) const {
+        return slot != other.slot;
+      }
+
+    private:
+      const char* base;
+      uint32_t slot;
+    };
+
+    Children(const char* base, uint32_t first_slot, uint32_t count)
+      : base(base), first_slot(first_slot), count(count) {}
+
+    size_t size() const {
+      return count;
+    }
+
+    bool empty() const {
+      return count == 0;
+    }
+
+    Node operator[](size_t i) const {
+      return *iterator(base, static_cast<uint32_t>(first_slot + 4 * i));
+    }
+
+    iterator begin() const {
+      return iterator(base, first_slot);
+    }
+
+    iterator end() const {
+      return iterator(base, first_slot + 4 * count);
+    }
+
+  private:
+    const char* base;
+    uint32_t first_slot;
+    uint32_t count;
+  };
+
+  class Text : public Node {
+  public:
+    explicit Text(const Node& n) : Node(n) {}
+
+    boost::string_ref value() const {
+      return boost::string_ref(payload(), size());
+    }
+  };
+
+  class Keyword : public Text {
+  public:
+    explicit Keyword(const Node& n) : Text(n) {}
+  };
+
+  class Literal : public Text {
+  public:
+    explicit Literal(const Node& n) : Text(n) {}
+  };
+
+  class String : public Text {
+  public:
+    explicit String(const Node& n) : Text(n) {}
+  };
+
+  class Integer : public Node {
+  public:
+    explicit Integer(const Node& n) : Node(n) {}
+
+    long value() const {
+      int64_t v;
+      std::memcpy(&v, payload(), sizeof(v));
+      return static_cast<long>(v);
+    }
+  };
+
+  class Float : public Node {
+  public:
+    explicit Float(const Node& n) : Node(n) {}
+
+    double value() const {
+      double v;
+      std::memcpy(&v, payload(), sizeof(v));
+      return v;
+    }
+  };
+
+  class Ratio : public Node {
+  public:
+    explicit Ratio(const Node& n) : Node(n) {}
+
+    long numerator() const {
+      int64_t v;
+      std::memcpy(&v, payload(), sizeof(v));
+      return static_cast<long>(v);
+    }
+
+    long denominator() const {
+      int64_t v;
+      std::memcpy(&v, payload() + 8, sizeof(v));
+      return static_cast<long>(v);
+    }
+  };
+
+  class Collection : public Node {
+  public:
+    explicit Collection(const Node& n) : Node(n) {}
+
+    Children inner() const {
+      return Children(base, offset + node_header_size, size());
+    }
+  };
+
+  class List : public Collection {
+  public:
+    explicit List(const Node& n) : Collection(n) {}
+  };
+
+  class Map : public Collection {
+  public:
+    explicit Map(const Node& n) : Collection(n) {}
+  };
+
+  class Set : public Collection {
+  public:
+    explicit Set(const Node& n) : Collection(n) {}
+  };
+
+  class Vector : public Collection {
+  public:
+    explicit Vector(const Node& n) : Collection(n) {}
+  };
+
+  /*
+   * Read-only view over an encoded buffer, does not own the data. Only
+   * validated buffers should be viewed.
+   */
+  class Forms {
+  public:
+    Forms(const char* data, size_t size) : data(data), count(size >= header_size ? read_u32(data + 8) : 0) {}
+
+    Children roots() const {
+      return Children(data, header_size, count);
+    }
+
+    size_t size() const {
+      return count;
+    }
+
+    Node operator[](size_t i) const {
+      return roots()[i];
+    }
+
+  private:
+    const char* data;
+    uint32_t count;
+  };
+
+  /*
+   * Shared, read-only mapping of a flat form file. The file is validated
+   * before use unless the caller trusts it; ReaderException is thrown when
+   * it cannot be mapped or is invalid.
+   */
+  class MappedFile {
+  public:
+    explicit MappedFile(const std::string& path, bool validate = true);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+      return m_data;
+    }
+
+    size_t size() const {
+      return m_size;
+    }
+
+    Forms forms() const {
+      return Forms(m_data, m_size);
+    }
+
+  private:
+    const char* m_data;
+    size_t m_size;
+  };
+
+  void write(const std::list<UExpression>& forms, std::string& out);
+
+  std::string write(const std::list<UExpression>& forms);
+
+  void write_file(const std::list<UExpression>& forms, const std::string& path);
+
+  // checks that every node reachable from the roots is in bounds and well formed.
+  bool validate(const char* data, size_t size, std::string& error);
+
+  // copies a node back into an expression tree.
+  UExpression to_expression(const Node& node);
+}
+
+#endif //PUNCH_FLATFORM_HPP
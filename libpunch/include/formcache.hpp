@@ -0,0 +1,61 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_FORMCACHE_HPP
+#define PUNCH_FORMCACHE_HPP
+
+#include <atomic>
+#include <list>
+#include <string>
+#include <reader.hpp>
+
+/*
+ * On-disk cache of read forms in the binary form encoding, keyed by a hash
+ * of the source text. Safe to share between threads and processes: entries
+ * are written to a temporary file and renamed into place.
+ */
+class FormCache {
+
+public:
+  FormCache(const std::string& directory, bool positions = true);
+
+  // reads the forms of source, from the cache when an entry for its contents exists.
+  std::list<UExpression> read(const std::string& source);
+
+  // as read, but malformed sources are reported in the result instead of thrown,
+  // see try_read_forms for recover. Only sources without diagnostics are cached.
+  ReadResult try_read(const std::string& source, bool recover = false);
+
+  // loads path into buffer and reads it through the cache. Throws ReaderException
+  // when the file cannot be opened or is malformed.
+  std::list<UExpression> read_file(const std::string& path, std::string& buffer);
+
+  std::string entry_path(const std::string& source) const;
+
+  size_t hits() const {
+    return m_hits;
+  }
+
+  size_t misses() const {
+    return m_misses;
+  }
+
+private:
+  bool load(const std::string& path, std::list<UExpression>& forms);
+  void store(const std::string& path, const std::list<UExpression>& forms);
+
+  std::string directory;
+  bool positions;
+
+  std::atomic<size_t> m_hits;
+  std::atomic<size_t> m_misses;
+};
+
+#endif //PUNCH_FORMCACHE_HPP
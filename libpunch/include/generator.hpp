@@ -0,0 +1,98 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_GENERATOR_HPP
+#define PUNCH_GENERATOR_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/*
+ * Weights of the kinds of atoms the generator emits; a kind with weight 0
+ * is never emitted. Regexes and characters are off by default because the
+ * reader does not read them yet, turn them on for tokenizer runs.
+ */
+struct AtomMix {
+  unsigned keywords = 4;
+  unsigned symbols = 6;
+  unsigned integers = 4;
+  unsigned hex_integers = 1;
+  unsigned ratios = 1;
+  unsigned floats = 2;
+  unsigned strings = 2;
+  unsigned regexes = 0;
+  unsigned chars = 0;
+};
+
+struct GeneratorOptions {
+  uint64_t seed = 1;
+
+  // bytes to emit, the last top-level form is always completed
+  uint64_t size = 1 << 20;
+
+  // chance that an element of a collection is itself a collection
+  double nesting = 0.25;
+  unsigned max_depth = 8;
+  unsigned max_width = 8;
+
+  AtomMix atoms;
+
+  // chance of a comment at every line break and before every top-level form
+  double comments = 0.05;
+
+  // lines are broken after this many bytes
+  unsigned line_length = 80;
+};
+
+/*
+ * Emits punch source of a given size and shape. The output only depends on
+ * the options, so a seed reproduces the same corpus on every platform, and
+ * it is produced one top-level form at a time so arbitrarily large corpora
+ * can be streamed without holding them in memory.
+ */
+class CorpusGenerator {
+
+public:
+  explicit CorpusGenerator(const GeneratorOptions& options);
+
+  // appends the next top-level form to out, returns false once size bytes were generated.
+  bool next(std::string& out);
+
+  // streams the whole corpus in chunks of about chunk_size bytes.
+  void write(std::ostream& os, size_t chunk_size = 1 << 16);
+
+  std::string generate();
+
+  uint64_t generated() const {
+    return m_generated;
+  }
+
+private:
+  uint64_t random();
+  unsigned below(unsigned n);
+  bool chance(double p);
+
+  void form(std::string& out);
+  void element(std::string& out, unsigned depth);
+  void collection(std::string& out, unsigned depth);
+  void atom(std::string& out);
+  void separate(std::string& out, unsigned depth);
+  void comment(std::string& out);
+  void word(std::string& out);
+
+  GeneratorOptions options;
+  uint64_t state;
+  uint64_t m_generated = 0;
+  size_t column = 0;
+  unsigned atom_total;
+};
+
+#endif //PUNCH_GENERATOR_HPP
@@ -0,0 +1,96 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_PRINTER_HPP
+#define PUNCH_PRINTER_HPP
+
+#include <ostream>
+#include <string>
+#include <reader.hpp>
+
+/*
+ * Writes expressions and tokens in a single pass into a reusable buffer,
+ * which is handed to the stream in bulk once it grows past its capacity.
+ *
+ * Format::Debug matches DebugInfo(), Format::Punch is punch syntax that
+ * reads back into an equal expression.
+ */
+class Printer {
+
+public:
+  enum class Format {
+    Debug, Punch
+  };
+
+  Printer(std::ostream& os, Format format = Format::Debug, size_t capacity = 64 * 1024)
+    : os(os), format(format), capacity(capacity) {
+    buffer.reserve(capacity);
+  }
+
+  ~Printer() {
+    flush();
+  }
+
+  Printer(const Printer&) = delete;
+  Printer& operator=(const Printer&) = delete;
+
+  Printer& print(const Expression& e) {
+    append(buffer, e, format);
+    return spill();
+  }
+
+  Printer& print(const Token& token) {
+    append(buffer, token);
+    return spill();
+  }
+
+  Printer& write(const std::string& s) {
+    buffer.append(s);
+    return spill();
+  }
+
+  Printer& write(char c) {
+    buffer.push_back(c);
+    return spill();
+  }
+
+  void flush() {
+    if (!buffer.empty()) {
+      os.write(buffer.data(), buffer.size());
+      buffer.clear();
+    }
+    os.flush();
+  }
+
+  static void append(std::string& out, const Expression& e, Format format);
+  static void append(std::string& out, const Token& token);
+
+  static std::string to_string(const Expression& e, Format format) {
+    std::string out;
+    append(out, e, format);
+    return out;
+  }
+
+private:
+  Printer& spill() {
+    if (buffer.size() >= capacity) {
+      os.write(buffer.data(), buffer.size());
+      buffer.clear();
+    }
+    return *this;
+  }
+
+  std::ostream& os;
+  Format format;
+  size_t capacity;
+  std::string buffer;
+};
+
+#endif //PUNCH_PRINTER_HPP
@@ -0,0 +1,123 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_QUERY_HPP
+#define PUNCH_QUERY_HPP
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <reader.hpp>
+
+/*
+ * Pulls nested values out of read data by path, get-in style:
+ *
+ *   query::Plan plan("[:services * :db :pool-size]");
+ *   auto sizes = query::Engine().select(plan, config);
+ *
+ * A path is a vector of steps. A keyword, string, literal or integer step
+ * takes the value of the first map entry with that key; an integer step
+ * also takes that element of a vector or list. The literal * takes every
+ * value of a map and every element of a vector, list or set. Values are
+ * selected in document order.
+ */
+namespace query {
+
+  class Plan {
+
+  public:
+    struct Step {
+      enum class Kind {
+        Key, Wildcard
+      };
+
+      Kind kind;
+      ExpressionType type;
+
+      // value of a keyword, string or literal key.
+      std::string text;
+      long integer;
+
+      // type and value, as map keys are indexed by the Engine.
+      std::string key;
+    };
+
+    // compiles path, throws ReaderException when it is not a vector of steps.
+    explicit Plan(const std::string& path);
+
+    const std::vector<Step>& steps() const {
+      return m_steps;
+    }
+
+    size_t size() const {
+      return m_steps.size();
+    }
+
+  private:
+    std::vector<Step> m_steps;
+  };
+
+  /*
+   * Runs plans against expression trees. Collections with at least
+   * min_size children get a key or element index the first time a query
+   * passes through them, and later queries through the same collection use
+   * it. The indexes point into the trees, so clear() has to be called
+   * before a queried tree is destroyed.
+   */
+  class Engine {
+
+  public:
+    explicit Engine(size_t min_size = 8) : min_size(min_size) {}
+
+    std::vector<const Expression*> select(const Plan& plan, const Expression& root);
+
+    // the path applied to every form.
+    std::vector<const Expression*> select(const Plan& plan, const std::list<UExpression>& forms);
+
+    // the first value selected, nullptr when there is none.
+    const Expression* first(const Plan& plan, const Expression& root);
+
+    void clear() {
+      indexes.clear();
+    }
+
+    // collections an index was built for.
+    size_t indexed() const {
+      return indexes.size();
+    }
+
+  private:
+    struct Index {
+      // first value of every key, see key_of.
+      std::unordered_map<std::string, const Expression*> keys;
+      std::vector<const Expression*> elements;
+    };
+
+    void walk(const Plan& plan, size_t step, const Expression& e, std::vector<const Expression*>& out, bool all);
+    const Expression* child(const Plan::Step& step, const Expression& e);
+    const Index& index(const Expression& e);
+
+    size_t min_size;
+    std::unordered_map<const Expression*, Index> indexes;
+  };
+
+  /*
+   * Applies the path to every top-level form of source while reading it,
+   * and reads only the selected values into expressions. Everything else
+   * is tokenized and skipped by counting brackets, so a malformed subtree
+   * that is skipped is only reported when its brackets do not balance or
+   * its tokens are invalid. The forms of the result are the selected
+   * values, in document order.
+   */
+  ReadResult select(const Plan& plan, const std::string& source);
+}
+
+#endif //PUNCH_QUERY_HPP
@@ -14,6 +14,7 @@
 
 #include <exception>
 #include <algorithm>
+#include <vector>
 #include <tokenizer.hpp>
 #include <util.hpp>
 
@@ -25,16 +26,32 @@ namespace expression {
   typedef std::unique_ptr<Expression> UExpression;
   typedef std::shared_ptr<Expression> SharedExpression;
 
+  // appends the DebugInfo() text of e to out, see Printer.
+  void append_debug(const Expression& e, std::string& out);
+
+  enum class ExpressionType {
+    EndOfFile, Keyword, Integer, Float, Ratio, Literal, List, Map, Set, String, Vector
+  };
+
   class Expression {
   public:
 
     Expression() {}
     virtual ~Expression() {}
 
-    virtual std::string DebugInfo() const = 0;
+    virtual ExpressionType type() const = 0;
+
+    // single pass through the Printer, children are not formatted into temporaries.
+    std::string DebugInfo() const {
+      std::string ret;
+      append_debug(*this, ret);
+      return ret;
+    }
 
     virtual bool equal_to(Expression* e) = 0;
 
+    // position of the first token of the expression, (0, 0) when it was not read from source.
+    position pos = std::make_tuple(0, 0);
   };
 
   inline ::std::ostream &operator<<(::std::ostream &os, const SharedExpression& expression) {
@@ -65,8 +82,8 @@ namespace expression {
   public:
     EndOfFile() {}
 
-    std::string DebugInfo() const override {
-      return "EOF";
+    ExpressionType type() const override {
+      return ExpressionType::EndOfFile;
     }
 
   protected:
@@ -82,20 +99,24 @@ namespace expression {
 
   class Keyword : public Expression {
   public:
-    Keyword(std::string value) : value(value) {}
-    Keyword(Keyword &&other) : value(std::move(other.value)) {}
+    Keyword(std::string value) : m_value(std::move(value)) {}
+    Keyword(Keyword &&other) : m_value(std::move(other.m_value)) {}
 
     static bool accepts(Token&);
     static UExpression create(Reader*);
 
-    std::string DebugInfo() const override {
-      return "KW (" + value + ")";
+    ExpressionType type() const override {
+      return ExpressionType::Keyword;
+    }
+
+    const std::string& value() const {
+      return m_value;
     }
 
   protected:
     bool equal_to(Expression* other) override {
       if (const Keyword *p = dynamic_cast<Keyword const*>(other)) {
-        return value == p->value;
+        return m_value == p->m_value;
       }
       else {
         return false;
@@ -103,25 +124,29 @@ namespace expression {
     }
 
   private:
-    std::string value;
+    std::string m_value;
   };
 
   class Integer : public Expression {
   public:
-    Integer(long value) : value(value) {}
-    Integer(Integer &&other) : value(std::move(other.value)) {}
+    Integer(long value) : m_value(value) {}
+    Integer(Integer &&other) : m_value(std::move(other.m_value)) {}
 
     static bool accepts(Token&);
     static UExpression create(Reader*);
 
-    std::string DebugInfo() const override {
-      return "INT (" + std::to_string(value) + ")";
+    ExpressionType type() const override {
+      return ExpressionType::Integer;
+    }
+
+    long value() const {
+      return m_value;
     }
 
   protected:
     bool equal_to(Expression* other) override {
       if (const Integer *p = dynamic_cast<Integer const*>(other)) {
-        return value == p->value;
+        return m_value == p->m_value;
       }
       else {
         return false;
@@ -129,25 +154,29 @@ namespace expression {
     }
 
   private:
-    long value;
+    long m_value;
   };
 
   class Float : public Expression {
   public:
-    Float(double value) : value(value) {}
-    Float(Float &&other) : value(std::move(other.value)) {}
+    Float(double value) : m_value(value) {}
+    Float(Float &&other) : m_value(std::move(other.m_value)) {}
 
     static bool accepts(Token&);
     static UExpression create(Reader*);
 
-    std::string DebugInfo() const override {
-      return "FLOAT (" + std::to_string(value) + ")";
+    ExpressionType type() const override {
+      return ExpressionType::Float;
+    }
+
+    double value() const {
+      return m_value;
     }
 
   protected:
     bool equal_to(Expression* other) override {
       if (const Float *p = dynamic_cast<Float const*>(other)) {
-        return  std::fabs(value - p->value) < std::numeric_limits<double>::epsilon();
+        return  std::fabs(m_value - p->m_value) < std::numeric_limits<double>::epsilon();
       }
       else {
         return false;
@@ -155,25 +184,33 @@ namespace expression {
     }
 
   private:
-    double value;
+    double m_value;
   };
 
   class Ratio : public Expression {
   public:
-    Ratio(long n, long d) : numerator(n), denominator(d) {}
-    Ratio(Ratio &&other) : numerator(std::move(other.numerator)), denominator(std::move(other.denominator)) {}
+    Ratio(long n, long d) : m_numerator(n), m_denominator(d) {}
+    Ratio(Ratio &&other) : m_numerator(std::move(other.m_numerator)), m_denominator(std::move(other.m_denominator)) {}
 
     static bool accepts(Token&);
     static UExpression create(Reader*);
 
-    std::string DebugInfo() const override {
-      return "RATIO (" + std::to_string(numerator) + "/" + std::to_string(denominator) + ")";
+    ExpressionType type() const override {
+      return ExpressionType::Ratio;
+    }
+
+    long numerator() const {
+      return m_numerator;
+    }
+
+    long denominator() const {
+      return m_denominator;
     }
 
   protected:
     bool equal_to(Expression* other) override {
       if (const Ratio *p = dynamic_cast<Ratio const*>(other)) {
-        return numerator == p->numerator && denominator == p->denominator;
+        return m_numerator == p->m_numerator && m_denominator == p->m_denominator;
       }
       else {
         return false;
@@ -181,26 +218,30 @@ namespace expression {
     }
 
   private:
-    long numerator;
-    long denominator;
+    long m_numerator;
+    long m_denominator;
   };
 
   class Literal : public Expression {
   public:
-    Literal(std::string value) : value(value) {}
-    Literal(Literal &&other) : value(std::move(other.value)) {}
+    Literal(std::string value) : m_value(std::move(value)) {}
+    Literal(Literal &&other) : m_value(std::move(other.m_value)) {}
 
     static bool accepts(Token&);
     static UExpression create(Reader*);
 
-    std::string DebugInfo() const override {
-      return "LIT (" + value + ")";
+    ExpressionType type() const override {
+      return ExpressionType::Literal;
+    }
+
+    const std::string& value() const {
+      return m_value;
     }
 
   protected:
     bool equal_to(Expression* other) override {
       if (const Literal *p = dynamic_cast<Literal const*>(other)) {
-        return value == p->value;
+        return m_value == p->m_value;
       }
       else {
         return false;
@@ -208,32 +249,29 @@ namespace expression {
     }
 
   private:
-    std::string value;
+    std::string m_value;
   };
 
   class List : public Expression {
   public:
-    List(std::list<UExpression>& inner) : inner(std::move(inner)) {}
-    List(List &&other) : inner(std::move(other.inner)) {}
+    List(std::list<UExpression>& inner) : m_inner(std::move(inner)) {}
+    List(List &&other) : m_inner(std::move(other.m_inner)) {}
 
     static bool accepts(Token&);
     static UExpression create(Reader*);
 
-    std::string DebugInfo() const override {
-      auto ret  = std::string("LIST (");
-
-      for (auto it = inner.begin(); it != inner.end(); ++it) {
-        ret += (*it)->DebugInfo() + ", ";
-      }
+    ExpressionType type() const override {
+      return ExpressionType::List;
+    }
 
-      ret += ")";
-      return ret;
+    const std::list<UExpression>& inner() const {
+      return m_inner;
     }
 
   protected:
     bool equal_to(Expression* other) override {
       if (const List *p = dynamic_cast<List const*>(other)) {
-        return inner == p->inner;
+        return m_inner == p->m_inner;
       }
       else {
         return false;
@@ -241,32 +279,29 @@ namespace expression {
     }
 
   private:
-    std::list<UExpression> inner;
+    std::list<UExpression> m_inner;
   };
 
   class Map : public Expression {
   public:
-    Map(std::list<UExpression>& inner) : inner(std::move(inner)) {}
-    Map(Map &&other) : inner(std::move(other.inner)) {}
+    Map(std::list<UExpression>& inner) : m_inner(std::move(inner)) {}
+    Map(Map &&other) : m_inner(std::move(other.m_inner)) {}
 
     static bool accepts(Token&);
     static UExpression create(Reader*);
 
-    std::string DebugInfo() const override {
-      auto ret  = std::string("MAP (");
-
-      for (auto it = inner.begin(); it != inner.end(); ++it) {
-        ret += (*it)->DebugInfo() + ", ";
-      }
+    ExpressionType type() const override {
+      return ExpressionType::Map;
+    }
 
-      ret += ")";
-      return ret;
+    const std::list<UExpression>& inner() const {
+      return m_inner;
     }
 
   protected:
     bool equal_to(Expression* other) override {
       if (const Map *p = dynamic_cast<Map const*>(other)) {
-        return inner == p->inner;
+        return m_inner == p->m_inner;
       }
       else {
         return false;
@@ -274,32 +309,29 @@ namespace expression {
     }
 
   private:
-    std::list<UExpression> inner;
+    std::list<UExpression> m_inner;
   };
 
   class Set : public Expression {
   public:
-    Set(std::list<UExpression>& inner) : inner(std::move(inner)) {}
-    Set(Set &&other) : inner(std::move(other.inner)) {}
+    Set(std::list<UExpression>& inner) : m_inner(std::move(inner)) {}
+    Set(Set &&other) : m_inner(std::move(other.m_inner)) {}
 
     static bool accepts(Token&);
     static UExpression create(Reader*);
 
-    std::string DebugInfo() const override{
-      auto ret  = std::string("SET (");
-
-      for (auto it = inner.begin(); it != inner.end(); ++it) {
-        ret += (*it)->DebugInfo() + ", ";
-      }
+    ExpressionType type() const override {
+      return ExpressionType::Set;
+    }
 
-      ret += ")";
-      return ret;
+    const std::list<UExpression>& inner() const {
+      return m_inner;
     }
 
   protected:
     bool equal_to(Expression* other) override {
       if (const Set *p = dynamic_cast<Set const*>(other)) {
-        return inner == p->inner;
+        return m_inner == p->m_inner;
       }
       else {
         return false;
@@ -307,25 +339,29 @@ namespace expression {
     }
 
   private:
-    std::list<UExpression> inner;
+    std::list<UExpression> m_inner;
   };
 
   class String : public Expression {
   public:
-    String(std::string value) : value(value) {}
-    String(String &&other) : value(std::move(other.value)) {}
+    String(std::string value) : m_value(std::move(value)) {}
+    String(String &&other) : m_value(std::move(other.m_value)) {}
 
     static bool accepts(Token&);
     static UExpression create(Reader*);
 
-    std::string DebugInfo() const override {
-      return "STR (" + value + ")";
+    ExpressionType type() const override {
+      return ExpressionType::String;
+    }
+
+    const std::string& value() const {
+      return m_value;
     }
 
   protected:
     bool equal_to(Expression* other) override {
       if (const String *p = dynamic_cast<String const*>(other)) {
-        return value == p->value;
+        return m_value == p->m_value;
       }
       else {
         return false;
@@ -333,32 +369,29 @@ namespace expression {
     }
 
   private:
-    std::string value;
+    std::string m_value;
   };
 
   class Vector : public Expression {
   public:
-    Vector(std::list<UExpression>& inner) : inner(std::move(inner)) {}
-    Vector(Vector &&other) : inner(std::move(other.inner)) {}
+    Vector(std::list<UExpression>& inner) : m_inner(std::move(inner)) {}
+    Vector(Vector &&other) : m_inner(std::move(other.m_inner)) {}
 
     static bool accepts(Token&);
     static UExpression create(Reader*);
 
-    std::string DebugInfo() const override{
-      auto ret  = std::string("VEC (");
-
-      for (auto it = inner.begin(); it != inner.end(); ++it) {
-        ret += (*it)->DebugInfo() + ", ";
-      }
+    ExpressionType type() const override {
+      return ExpressionType::Vector;
+    }
 
-      ret += ")";
-      return ret;
+    const std::list<UExpression>& inner() const {
+      return m_inner;
     }
 
   protected:
     bool equal_to(Expression* other) override {
       if (const Vector *p = dynamic_cast<Vector const*>(other)) {
-        return inner == p->inner;
+        return m_inner == p->m_inner;
       }
       else {
         return false;
@@ -366,7 +399,7 @@ namespace expression {
     }
 
   private:
-    std::list<UExpression> inner;
+    std::list<UExpression> m_inner;
   };
 
   inline ::std::ostream &operator<<(::std::ostream &os, const Token &token) {
@@ -390,35 +423,163 @@ private:
   std::string msg;
 };
 
+/*
+ * Reads expressions from a tokenizer. Malformed input does not unwind the
+ * stack: try_next() returns nullptr and the problem is added to
+ * diagnostics(), after which the reader stays failed. next() is the
+ * throwing interface on top of it.
+ *
+ * With recover set the reader does not stay failed: it skips ahead to the
+ * next plausible top-level form and try_next() continues from there, so a
+ * single pass reports every malformed form. The boundary is where the
+ * brackets opened by the broken form are balanced again, or the next
+ * opening bracket in column 1, whichever comes first. Recovery assumes the
+ * usual layout where only top-level forms start in column 1, and an opening
+ * bracket in column 1 inside a form is reported as a missing close.
+ */
 class Reader {
 
 public:
-  Reader(std::unique_ptr<Tokenizer> t) : tokenizer{std::move(t)}, cur_tok(tokenizer->next()) {
+  Reader(std::unique_ptr<Tokenizer> t, bool recover = false)
+    : tokenizer{std::move(t)}, cur_tok(tokenizer->next()), recover(recover) {
+    check_tokenizer();
   }
 
   ~Reader() {}
 
+  // throws ReaderException on malformed input.
   UExpression next();
 
+  // nullptr on malformed input, EndOfFile at the end.
+  UExpression try_next();
+
+  // starts over on the input the scanner of the tokenizer was reset to, see MessageReader.
+  void reset();
+
   void pop_token() {
+    if (openTypes.find(cur_tok.type) != openTypes.end()) {
+      ++brackets;
+    }
+    else if (closeTypes.find(cur_tok.type) != closeTypes.end()) {
+      --brackets;
+    }
+
     cur_tok = tokenizer->next();
+    check_tokenizer();
   }
 
-  Token current_token() {
+  bool recovering() const {
+    return recover;
+  }
+
+  const Token& current_token() const {
     return cur_tok;
   }
 
+  // moves the value out of the current token, for the expression made of it.
+  std::string take_value() {
+    return std::move(cur_tok.value);
+  }
+
+  bool failed() const {
+    return m_failed;
+  }
+
+  const std::vector<Diagnostic>& diagnostics() const {
+    return m_diagnostics;
+  }
+
+  // records a diagnostic and returns the nullptr to pass up.
+  UExpression fail(std::string message, position pos, boost::optional<TokenType> expected = boost::none);
+
 private:
 
-  void ret(UExpression expr) {
-    current = std::move(expr);
+  UExpression read();
+  void resynchronize(const Diagnostic& error);
+
+  void check_tokenizer() {
+    if (tokenizer->failed() && !m_failed) {
+      m_failed = true;
+      m_diagnostics.push_back(tokenizer->error());
+    }
   }
 
   std::unique_ptr<Tokenizer> tokenizer;
   Token cur_tok;
+  uint depth = 0;
 
-  UExpression m_end = make_unique<EndOfFile>();
-  UExpression current = make_unique<EndOfFile>();
+  // opening minus closing brackets consumed so far.
+  int brackets = 0;
+  bool recover;
+
+  bool m_failed = false;
+  std::vector<Diagnostic> m_diagnostics;
+};
+
+struct ReadResult {
+  std::list<UExpression> forms;
+  std::vector<Diagnostic> diagnostics;
+
+  bool ok() const {
+    return diagnostics.empty();
+  }
 };
 
+/*
+ * Reads many small inputs in a row, such as the messages of a wire format,
+ * with one scanner, tokenizer and reader. reset() points it at the next
+ * input, which is read in place and has to stay alive while reading; apart
+ * from the expressions read nothing is allocated per input.
+ */
+class MessageReader {
+
+public:
+  explicit MessageReader(bool recover = false);
+
+  void reset(const char* data, size_t size);
+
+  void reset(const std::string& data) {
+    reset(data.data(), data.size());
+  }
+
+  // see Reader
+  UExpression try_next() {
+    return reader.try_next();
+  }
+
+  UExpression next() {
+    return reader.next();
+  }
+
+  bool failed() const {
+    return reader.failed();
+  }
+
+  const std::vector<Diagnostic>& diagnostics() const {
+    return reader.diagnostics();
+  }
+
+private:
+  // owned by the tokenizer of the reader
+  SpanScanner* scanner;
+  Reader reader;
+};
+
+// the value of a literal that Integer::accepts, false when it does not fit or is not a valid integer.
+bool parse_integer(const std::string& text, long& value);
+
+// the value of a literal that Float::accepts, false when it is out of range.
+bool parse_float(const std::string& text, double& value);
+
+/*
+ * Reads all top-level forms in source. forms holds those read before the
+ * first diagnostic, or with recover every form outside the malformed ones.
+ */
+ReadResult try_read_forms(const std::string& source, bool recover = false);
+
+/*
+ * Reads all top-level forms in source, throws ReaderException on malformed input.
+ */
+std::list<UExpression> read_forms(const std::string& source);
+
 #endif //PUNCH_READER_HPP
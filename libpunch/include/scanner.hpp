@@ -21,6 +21,11 @@
 typedef unsigned int uint;
 typedef std::tuple<uint, uint> position;
 
+/*
+ * Lines and columns count from 1. Columns count code points rather than
+ * bytes, the scanners take the input to be UTF-8.
+ */
+
 class Scanner
 {
 public:
@@ -32,26 +37,94 @@ public:
   virtual void flush_line() = 0;
   virtual ::position position() = 0;
 
+  // the input from the current character on when it is in memory, nullptr when it is not.
+  virtual const char* remaining(size_t& size) {
+    size = 0;
+    return nullptr;
+  }
+
+  // pops n characters.
+  virtual void skip(size_t n) {
+    while (n-- > 0) {
+      pop();
+    }
+  }
+
+  /*
+   * Whether the input from the current character on is valid UTF-8; when it
+   * is not, where is set to the first byte that is not. Input that is not in
+   * memory is taken to be valid unless the scanner overrides this.
+   */
+  virtual bool validate(::position& where);
+
+  /*
+   * Set once the scanner ran out of input because reading it failed, for
+   * scanners that read while they are scanned; only asked at the end of
+   * the input.
+   */
+  virtual bool error(std::string&, ::position&) {
+    return false;
+  }
 };
 
 class StringScanner : public Scanner {
 
 public:
-  StringScanner(const std::string& in)
-    : chars(in), size (in.size()), index(0), line(1), col(1) {}
+  StringScanner(const std::string& in);
+
+  // scans in from offset on, which is at start in the whole of in.
+  StringScanner(const std::string& in, size_t offset, ::position start);
+
   boost::optional<char> current_char() override;
   boost::optional<char> next_char() override;
   boost::optional<char> previous_char() override;
   void pop() override;
   void flush_line() override;
   ::position position() override;
+  const char* remaining(size_t& size) override;
+  void skip(size_t n) override;
 
 private:
   std::string chars;
   uint size;
   uint index;
   uint line;
+
+  // the column at counted, counted up to index when the position is asked for.
+  uint col;
+  uint counted;
+};
+
+/*
+ * Scans memory owned by the caller, which has to stay alive while it is
+ * scanned. reset() points the scanner at new input without allocating, so
+ * one scanner can serve any number of small inputs.
+ */
+class SpanScanner : public Scanner {
+
+public:
+  SpanScanner(const char* data = nullptr, size_t size = 0, ::position start = ::position(1, 1));
+
+  void reset(const char* data, size_t size, ::position start = ::position(1, 1));
+
+  boost::optional<char> current_char() override;
+  boost::optional<char> next_char() override;
+  boost::optional<char> previous_char() override;
+  void pop() override;
+  void flush_line() override;
+  ::position position() override;
+  const char* remaining(size_t& size) override;
+  void skip(size_t n) override;
+
+private:
+  const char* data;
+  size_t size;
+  size_t index;
+  uint line;
+
+  // the column at counted, see StringScanner.
   uint col;
+  size_t counted;
 };
 
 class LineScanner : public Scanner {
@@ -64,6 +137,7 @@ public:
   void pop() override;
   void flush_line() override;
   ::position position() override;
+  bool validate(::position& where) override;
 
 private:
 
@@ -73,7 +147,17 @@ private:
   ::position current;
   ::position next;
   ::position previous;
+
+  // the last column asked for, in code points, at byte counted_char of counted_line.
+  int counted_line = -1;
+  int counted_char = 0;
+  uint counted_col = 1;
 };
 
+/*
+ * Reads the whole file into buffer, reusing its capacity. Returns false when
+ * the file could not be opened.
+ */
+bool load_file(const std::string& path, std::string& buffer);
 
 #endif /* _SCANNER_H_ */
@@ -0,0 +1,180 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_STATS_HPP
+#define PUNCH_STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <reader.hpp>
+
+/*
+ * Counters and timers for the scanner, tokenizer and reader.
+ *
+ * Counting is compiled in when PUNCH_STATS is defined (the PUNCH_STATS cmake
+ * option) and then still has to be switched on at runtime with
+ * stats::enable(). Without PUNCH_STATS the PUNCH_STAT macros compile to
+ * nothing.
+ *
+ * Every thread counts into its own Stats; flush() adds them to the process
+ * wide totals, which is what snapshot() reports together with the counts of
+ * the calling thread.
+ *
+ * Heap allocations are only counted in programs that link the punchalloc
+ * object, which replaces the global allocation functions. Each allocation is
+ * attributed to the stage of the innermost running StageTimer and, within
+ * the reader, to the kind of expression being created.
+ */
+namespace stats {
+
+  enum class Stage {
+    Scanner, Tokenizer, Reader
+  };
+
+  const size_t stages = static_cast<size_t>(Stage::Reader) + 1;
+  const size_t token_types = static_cast<size_t>(TokenType::Char) + 1;
+  const size_t expression_types = static_cast<size_t>(ExpressionType::Vector) + 1;
+
+  struct Allocations {
+    uint64_t count;
+    uint64_t bytes;
+  };
+
+  struct Stats {
+    uint64_t bytes_scanned;
+    uint64_t tokens[token_types];
+    uint64_t expressions[expression_types];
+    uint64_t max_depth;
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+    Allocations stage_allocations[stages];
+    Allocations expression_allocations[expression_types];
+    uint64_t nanoseconds[stages];
+
+    void merge(const Stats& other);
+  };
+
+  extern std::atomic<bool> enabled;
+
+  inline void enable(bool on = true) {
+    enabled.store(on, std::memory_order_relaxed);
+  }
+
+  inline bool is_enabled() {
+    return enabled.load(std::memory_order_relaxed);
+  }
+
+  // counters of the calling thread
+  Stats& local();
+
+  // what the allocations of the calling thread are attributed to, 0 for nothing, else the enum value + 1.
+  struct Attribution {
+    uint8_t stage;
+    uint8_t expression;
+  };
+
+  Attribution& attribution();
+
+  // called by the replaced allocation functions.
+  void count_allocation(size_t bytes);
+
+  // set when the punchalloc allocation functions are linked in.
+  extern bool allocations_counted;
+
+  void flush();
+  Stats snapshot();
+  void reset();
+
+  const char* name(Stage stage);
+  const char* name(TokenType type);
+  const char* name(ExpressionType type);
+
+  std::string to_text(const Stats& s);
+  std::string to_json(const Stats& s);
+
+  inline uint64_t now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+  /*
+   * Adds the time between construction and destruction to a stage, minus
+   * the time that was added to the excluded stage in the meantime.
+   */
+  class StageTimer {
+  public:
+    explicit StageTimer(Stage stage, bool active = true)
+      : stage(stage), excluded(stage), start(active && is_enabled() ? now() : 0), excluded_start(0) {
+      attribute();
+    }
+
+    StageTimer(Stage stage, Stage excluded, bool active = true)
+      : stage(stage), excluded(excluded), start(active && is_enabled() ? now() : 0),
+        excluded_start(local().nanoseconds[static_cast<size_t>(excluded)]) {
+      attribute();
+    }
+
+    ~StageTimer() {
+      if (start != 0) {
+        uint64_t elapsed = now() - start;
+        if (excluded != stage) {
+          elapsed -= local().nanoseconds[static_cast<size_t>(excluded)] - excluded_start;
+        }
+        local().nanoseconds[static_cast<size_t>(stage)] += elapsed;
+        attribution().stage = previous;
+      }
+    }
+
+  private:
+    void attribute() {
+      if (start != 0) {
+        previous = attribution().stage;
+        attribution().stage = static_cast<uint8_t>(static_cast<size_t>(stage) + 1);
+      }
+    }
+
+    Stage stage;
+    Stage excluded;
+    uint64_t start;
+    uint64_t excluded_start;
+    uint8_t previous;
+  };
+
+  /*
+   * Attributes the allocations of the reader to an expression kind until
+   * destruction.
+   */
+  class ExpressionScope {
+  public:
+    explicit ExpressionScope(ExpressionType type) : previous(attribution().expression) {
+      attribution().expression = static_cast<uint8_t>(static_cast<size_t>(type) + 1);
+    }
+
+    ~ExpressionScope() {
+      attribution().expression = previous;
+    }
+
+  private:
+    uint8_t previous;
+  };
+}
+
+#ifdef PUNCH_STATS
+#define PUNCH_STAT(...) do { if (::stats::is_enabled()) { __VA_ARGS__; } } while (0)
+#define PUNCH_STAT_TIMER(name, ...) ::stats::StageTimer name(__VA_ARGS__)
+#define PUNCH_STAT_EXPRESSION(name, type) ::stats::ExpressionScope name(type)
+#else
+#define PUNCH_STAT(...) do { } while (0)
+#define PUNCH_STAT_TIMER(name, ...) do { } while (0)
+#define PUNCH_STAT_EXPRESSION(name, type) do { } while (0)
+#endif
+
+#endif //PUNCH_STATS_HPP
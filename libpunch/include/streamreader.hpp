@@ -0,0 +1,217 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_STREAMREADER_HPP
+#define PUNCH_STREAMREADER_HPP
+
+#ifdef PUNCH_COROUTINES
+
+#include <coroutine>
+#include <deque>
+#include <string>
+#include <vector>
+#include <coroutine.hpp>
+#include <reader.hpp>
+
+/*
+ * Cuts input that arrives in pieces into the text of whole top-level forms.
+ *
+ * It follows the character rules of the Tokenizer (strings, comments, chars
+ * and dispatch) closely enough to count brackets, so a form is only handed
+ * out once it is complete and only the form being received is buffered.
+ * Every slice starts where the previous one ended, so it includes the
+ * whitespace and comments before its form.
+ */
+class FormSplitter {
+
+public:
+  void feed(const char* data, size_t size);
+
+  // no more input follows; what is left becomes the last slice.
+  void close();
+
+  // takes the next complete slice, which starts at pos in the whole input.
+  bool next(std::string& slice, position& pos);
+
+  bool closed() const {
+    return m_closed;
+  }
+
+  // bytes received but not handed out yet.
+  size_t buffered() const {
+    return buffer.size() - head;
+  }
+
+private:
+  enum class State {
+    Space, Comment, String, Escape, Atom
+  };
+
+  void split();
+  void consume();
+  void complete();
+
+  std::string buffer;
+  std::deque<std::pair<size_t, position>> ends;
+
+  size_t head = 0;
+  position head_pos = position(1, 1);
+  size_t scan = 0;
+  uint line = 1;
+  uint col = 1;
+
+  State state = State::Space;
+  size_t depth = 0;
+  bool content = false;
+  bool m_closed = false;
+};
+
+/*
+ * Tokenizer for input that is fed in pieces, for instance from a socket or
+ * a pipe. co_await next() gives the next token like Tokenizer::next(), and
+ * suspends the awaiting coroutine while the input received so far ends in
+ * the middle of a form; feed() and close() resume it. Many streams can be
+ * read concurrently on one thread this way.
+ */
+class StreamTokenizer {
+
+public:
+  class Awaiter {
+  public:
+    explicit Awaiter(StreamTokenizer& stream) : stream(stream) {}
+
+    bool await_ready() {
+      return stream.prepare();
+    }
+
+    void await_suspend(std::coroutine_handle<> coroutine) {
+      stream.waiting = coroutine;
+    }
+
+    Token await_resume() {
+      return stream.take();
+    }
+
+  private:
+    StreamTokenizer& stream;
+  };
+
+  void feed(const char* data, size_t size);
+
+  void feed(const std::string& data) {
+    feed(data.data(), data.size());
+  }
+
+  void close();
+
+  // EndOfFile once the input is closed and every token was taken, or the input turned out malformed.
+  Awaiter next() {
+    return Awaiter(*this);
+  }
+
+  bool failed() const {
+    return m_failed;
+  }
+
+  const Diagnostic& error() const {
+    return m_error;
+  }
+
+  size_t buffered() const {
+    return splitter.buffered();
+  }
+
+private:
+  bool prepare();
+  Token take();
+  void wake();
+
+  FormSplitter splitter;
+  std::deque<Token> tokens;
+  std::coroutine_handle<> waiting;
+
+  bool m_failed = false;
+  Diagnostic m_error;
+};
+
+/*
+ * Reader for input that is fed in pieces, see StreamTokenizer. co_await
+ * next() gives what Reader::try_next() would: the next form, EndOfFile at
+ * the end, or nullptr when the input is malformed.
+ *
+ * Every top-level form is read on its own, so with recover a malformed form
+ * is reported in diagnostics() and reading goes on with the next form.
+ */
+class StreamReader {
+
+public:
+  class Awaiter {
+  public:
+    explicit Awaiter(StreamReader& stream) : stream(stream) {}
+
+    bool await_ready() {
+      return stream.prepare();
+    }
+
+    void await_suspend(std::coroutine_handle<> coroutine) {
+      stream.waiting = coroutine;
+    }
+
+    UExpression await_resume() {
+      return stream.take();
+    }
+
+  private:
+    StreamReader& stream;
+  };
+
+  explicit StreamReader(bool recover = false) : recover(recover) {}
+
+  void feed(const char* data, size_t size);
+
+  void feed(const std::string& data) {
+    feed(data.data(), data.size());
+  }
+
+  void close();
+
+  Awaiter next() {
+    return Awaiter(*this);
+  }
+
+  bool failed() const {
+    return m_failed;
+  }
+
+  const std::vector<Diagnostic>& diagnostics() const {
+    return m_diagnostics;
+  }
+
+  size_t buffered() const {
+    return splitter.buffered();
+  }
+
+private:
+  bool prepare();
+  UExpression take();
+  void wake();
+
+  FormSplitter splitter;
+  UExpression form;
+  std::coroutine_handle<> waiting;
+
+  bool recover;
+  bool m_failed = false;
+  std::vector<Diagnostic> m_diagnostics;
+};
+
+#endif //PUNCH_COROUTINES
+
+#endif //PUNCH_STREAMREADER_HPP
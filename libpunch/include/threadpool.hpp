@@ -0,0 +1,73 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_THREADPOOL_HPP
+#define PUNCH_THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed size pool where every worker owns a deque of tasks. A worker takes
+ * work from the front of its own deque and, once that runs dry, steals from
+ * the back of the other deques. Tasks are handed the index of the worker
+ * running them so callers can keep per-worker state without locking.
+ */
+class ThreadPool {
+
+public:
+  typedef std::function<void(unsigned)> Task;
+
+  explicit ThreadPool(unsigned workers = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(Task task);
+  void submit(unsigned worker, Task task);
+  void wait();
+
+  unsigned size() const {
+    return static_cast<unsigned>(threads.size());
+  }
+
+  static unsigned default_workers();
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void run(unsigned self);
+  bool pop(unsigned self, Task& task);
+  bool steal(unsigned self, Task& task);
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> threads;
+
+  std::mutex state_mutex;
+  std::condition_variable work_available;
+  std::condition_variable all_done;
+
+  std::atomic<unsigned> next_queue;
+  size_t queued = 0;
+  size_t unfinished = 0;
+  bool stopping = false;
+};
+
+#endif //PUNCH_THREADPOOL_HPP
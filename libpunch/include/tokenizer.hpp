@@ -12,6 +12,7 @@
 #define PUNCH_TOKENIZER_H
 
 #include <boost/assign/list_of.hpp>
+#include <boost/optional.hpp>
 #include <boost/unordered_map.hpp>
 #include <memory>
 #include <iterator>
@@ -37,6 +38,10 @@ const char SQUARE_CLOSE = ']';
 const std::set<char> whitespace = boost::assign::list_of(' ')(',')('\n')('\t')('\12');
 const std::set<char> delimiters = boost::assign::list_of('{')('}')('[')(']')('(')(')')('\\')(';')('"');
 
+// whitespace and delimiters, what ends a literal, char or dispatch.
+const std::set<char> atom_end = boost::assign::list_of(' ')(',')('\n')('\t')('\12')
+    ('{')('}')('[')(']')('(')(')')('\\')(';')('"');
+
 namespace token {
 
   enum class TokenType {
@@ -45,6 +50,9 @@ namespace token {
     SetOpen, FunctionOpen, Dispatch, String, Regex, Char
   };
 
+  const std::set<TokenType> openTypes = boost::assign::list_of
+      (TokenType::RoundOpen)(TokenType::CurlyOpen)(TokenType::SquareOpen)(TokenType::SetOpen)(TokenType::FunctionOpen);
+
   const std::set<TokenType> closeTypes = boost::assign::list_of
       (TokenType::RoundClose)(TokenType::CurlyClose)(TokenType::SquareClose);
 
@@ -92,8 +100,8 @@ namespace token {
       }
     }
 
-    bool operator==(const Token other) const;
-    bool operator!=(const Token other) const;
+    bool operator==(const Token& other) const;
+    bool operator!=(const Token& other) const;
 
     TokenType type;
     std::string value;
@@ -102,7 +110,7 @@ namespace token {
     static Token EndOfFile;
 
     static Token Literal(std::string value, position pos) {
-      return Token(TokenType::Literal, value, pos);
+      return Token(TokenType::Literal, std::move(value), pos);
     }
 
     static Token RoundOpen(position pos) {
@@ -138,24 +146,24 @@ namespace token {
     }
 
     static Token Dispatch(std::string value, position pos) {
-      return Token(TokenType::Dispatch, value, pos);
+      return Token(TokenType::Dispatch, std::move(value), pos);
     }
 
     static Token String(std::string value, position pos) {
-      return Token(TokenType::String, value, pos);
+      return Token(TokenType::String, std::move(value), pos);
     }
 
     static Token Regex(std::string value, position pos) {
-      return Token(TokenType::Regex, value, pos);
+      return Token(TokenType::Regex, std::move(value), pos);
     }
 
     static Token Char(std::string value, position pos) {
-      return Token(TokenType::Char, value, pos);
+      return Token(TokenType::Char, std::move(value), pos);
     }
 
   private:
     Token(TokenType type, std::string value, position pos)
-        : type(type), value(value), pos(pos) { }
+        : type(type), value(std::move(value)), pos(pos) { }
   };
 
   inline ::std::ostream &operator<<(::std::ostream &os, const Token &token) {
@@ -165,6 +173,16 @@ namespace token {
 
 using namespace token;
 
+/*
+ * A problem found in the input. expected is set when a single token would
+ * have been accepted at pos.
+ */
+struct Diagnostic {
+  std::string message;
+  position pos;
+  boost::optional<TokenType> expected;
+};
+
 class Tokenizer {
 
 public:
@@ -177,18 +195,47 @@ public:
 
   Token next();
 
+  // forgets the state of the previous input, for a scanner that was reset to new input.
+  void reset();
+
+  // set once the input turned out malformed, next() only returns EndOfFile from then on.
+  bool failed() const {
+    return m_failed;
+  }
+
+  const Diagnostic& error() const {
+    return m_error;
+  }
+
 private:
+  Token scan();
+  Token fail(const std::string& message, position pos, TokenType expected);
+
+  // EndOfFile, or the failure the scanner ended the input with.
+  Token end();
   void mark_ready();
   void ret(Token);
 
   bool is_next(const char&);
-  bool is_next(const std::set<char>);
+  bool is_next(const std::set<char>&);
   bool is_prev_whitespace();
-  std::string slurp_until(const std::initializer_list<std::set<char>>&);
-  std::string slurp_until(const char);
+  std::string slurp_until(const std::set<char>&);
   void flush_line();
 
+  // the text up to the closing quote, which is left current. Escapes are decoded unless
+  // raw, which keeps them as written; false at the end of the input or on a bad escape.
+  bool slurp_string(std::string& result, bool raw);
+  bool unescape(std::string& result);
+
   bool ready = false;
+  bool m_failed = false;
+
+  // whether the input was checked to be UTF-8, which is done once before its first token.
+  bool validated = false;
+  Diagnostic m_error;
+
+  // the text of the token being scanned
+  std::string text;
 
   std::unique_ptr<Scanner> scanner;
   Token m_end = Token::EndOfFile;
@@ -0,0 +1,130 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_TRACE_HPP
+#define PUNCH_TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/*
+ * Timeline of the reading pipeline in the Chrome trace event format, which
+ * chrome://tracing and Perfetto load directly.
+ *
+ * Like the statistics, tracing is compiled in when PUNCH_TRACE is defined and
+ * then switched on at runtime with trace::enable(). Every thread records its
+ * spans into its own buffer without locking; the buffer is handed over to
+ * the process wide list when the thread exits or calls flush(), and every
+ * thread becomes its own track.
+ */
+namespace trace {
+
+  struct Event {
+    const char* name;
+    const char* category;
+    uint64_t start;
+    uint64_t duration;
+
+    // up to two numeric arguments and one text argument, unused when the name is null.
+    const char* arg_names[2];
+    int64_t args[2];
+    const char* text_name;
+    std::string text;
+  };
+
+  extern std::atomic<bool> enabled;
+  extern std::atomic<bool> forms;
+
+  // forms adds a span for every top-level form, which is one event per form.
+  void enable(bool on = true, bool with_forms = false);
+
+  inline bool is_enabled() {
+    return enabled.load(std::memory_order_relaxed);
+  }
+
+  inline bool forms_enabled() {
+    return forms.load(std::memory_order_relaxed);
+  }
+
+  inline uint64_t now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+  // names the track of the calling thread.
+  void set_thread_name(const std::string& name);
+
+  void record(Event&& event);
+
+  // hands the events of the calling thread over to the process wide list.
+  void flush();
+
+  // writes all flushed events and those of the calling thread.
+  void write_json(std::ostream& os);
+  std::string to_json();
+
+  void reset();
+
+  /*
+   * Records the time between construction and destruction as a complete
+   * event. Names must outlive the trace, string literals in practice.
+   */
+  class Span {
+  public:
+    Span(const char* name, const char* category, bool active = true) {
+      event.name = name;
+      event.category = category;
+      event.start = active && is_enabled() ? now() : 0;
+      event.arg_names[0] = event.arg_names[1] = nullptr;
+      event.text_name = nullptr;
+    }
+
+    ~Span() {
+      if (event.start != 0) {
+        event.duration = now() - event.start;
+        record(std::move(event));
+      }
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    Span& arg(const char* name, int64_t value) {
+      size_t i = event.arg_names[0] == nullptr ? 0 : 1;
+      event.arg_names[i] = name;
+      event.args[i] = value;
+      return *this;
+    }
+
+    Span& arg(const char* name, const std::string& value) {
+      if (event.start != 0) {
+        event.text_name = name;
+        event.text = value;
+      }
+      return *this;
+    }
+
+  private:
+    Event event;
+  };
+}
+
+#ifdef PUNCH_TRACE
+#define PUNCH_TRACING(...) do { if (::trace::is_enabled()) { __VA_ARGS__; } } while (0)
+#define PUNCH_TRACE_SPAN(name, ...) ::trace::Span name(__VA_ARGS__)
+#else
+#define PUNCH_TRACING(...) do { } while (0)
+#define PUNCH_TRACE_SPAN(name, ...) do { } while (0)
+#endif
+
+#endif //PUNCH_TRACE_HPP
@@ -0,0 +1,37 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_UTF8_HPP
+#define PUNCH_UTF8_HPP
+
+#include <cstddef>
+
+/*
+ * UTF-8 checks on input buffers. Both run sixteen bytes at a time where SSE2
+ * is there; runs of ASCII, the common case for source text, are skipped
+ * without decoding anything.
+ */
+namespace utf8 {
+
+  // offset of the first byte that does not start a valid UTF-8 sequence, size when all of data is valid.
+  size_t validate(const char* data, size_t size);
+
+  // the code points in data, its bytes less the continuation bytes.
+  size_t code_points(const char* data, size_t size);
+
+  // moves line and column, which count code points, past data.
+  void advance(const char* data, size_t size, unsigned& line, unsigned& column);
+
+  inline bool is_continuation(char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+  }
+}
+
+#endif //PUNCH_UTF8_HPP
@@ -12,10 +12,30 @@
 #ifndef PUNCH_UTIL_HPP
 #define PUNCH_UTIL_HPP
 
+#include <cstdint>
+#include <memory>
+
+#if __cplusplus >= 201402L
+// the same function as the one argument dependent lookup finds for std types.
+using std::make_unique;
+#else
 template<typename T, typename ...Args>
 std::unique_ptr<T> make_unique( Args&& ...args )
 {
   return std::unique_ptr<T>( new T( std::forward<Args>(args)... ) );
 }
+#endif
+
+/*
+ * 64 bit FNV-1a, used to key caches on file contents.
+ */
+inline uint64_t content_hash(const char* data, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
 
 #endif //PUNCH_UTIL_HPP
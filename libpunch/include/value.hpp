@@ -0,0 +1,332 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_VALUE_HPP
+#define PUNCH_VALUE_HPP
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <reader.hpp>
+
+/*
+ * Runtime values for evaluating punch forms, shared by the evaluators.
+ *
+ * A Value is nil, a boolean, an integer or a float held in place, or a
+ * reference counted object: keywords, symbols, strings, lists, vectors,
+ * maps, sets and functions. Collections are immutable once made, so they
+ * are shared freely; maps and sets are small vectors searched in order,
+ * which keeps the order they were written in. Reference counts are not
+ * atomic, values belong to the thread that evaluates them.
+ */
+namespace eval {
+
+  enum class Type : uint8_t {
+    Nil, Boolean, Integer, Float, Keyword, Symbol, String, List, Vector, Map, Set, Function
+  };
+
+  class Object {
+  public:
+    Object() {}
+    virtual ~Object() {}
+
+    Object(const Object&) = delete;
+    Object& operator=(const Object&) = delete;
+
+    uint32_t refs = 0;
+  };
+
+  class Value {
+
+  public:
+    Value() : m_type(Type::Nil), m_integer(0) {}
+
+    // takes a reference to object, which is of the given heap type.
+    Value(Type type, Object* object) : m_type(type), m_object(object) {
+      ++object->refs;
+    }
+
+    Value(const Value& other) : m_type(other.m_type), m_integer(other.m_integer) {
+      if (heap()) {
+        ++m_object->refs;
+      }
+    }
+
+    Value(Value&& other) noexcept : m_type(other.m_type), m_integer(other.m_integer) {
+      other.m_type = Type::Nil;
+    }
+
+    Value& operator=(const Value& other) {
+      Value copy(other);
+      swap(copy);
+      return *this;
+    }
+
+    // leaves other nil, which the evaluators rely on for stack slots.
+    Value& operator=(Value&& other) noexcept {
+      if (this != &other) {
+        Value old(std::move(*this));
+        m_type = other.m_type;
+        m_integer = other.m_integer;
+        other.m_type = Type::Nil;
+      }
+      return *this;
+    }
+
+    ~Value() {
+      if (heap() && --m_object->refs == 0) {
+        delete m_object;
+      }
+    }
+
+    static Value boolean(bool b) {
+      Value v;
+      v.m_type = Type::Boolean;
+      v.m_boolean = b;
+      return v;
+    }
+
+    static Value integer(long i) {
+      Value v;
+      v.m_type = Type::Integer;
+      v.m_integer = i;
+      return v;
+    }
+
+    static Value floating(double f) {
+      Value v;
+      v.m_type = Type::Float;
+      v.m_float = f;
+      return v;
+    }
+
+    void swap(Value& other) noexcept {
+      std::swap(m_type, other.m_type);
+      std::swap(m_integer, other.m_integer);
+    }
+
+    Type type() const {
+      return m_type;
+    }
+
+    bool is_nil() const {
+      return m_type == Type::Nil;
+    }
+
+    // everything but nil and false.
+    bool truthy() const {
+      return m_type > Type::Boolean || (m_type == Type::Boolean && m_boolean);
+    }
+
+    bool is_number() const {
+      return m_type == Type::Integer || m_type == Type::Float;
+    }
+
+    bool as_boolean() const {
+      return m_boolean;
+    }
+
+    long as_integer() const {
+      return m_integer;
+    }
+
+    double as_float() const {
+      return m_float;
+    }
+
+    // integers converted.
+    double to_double() const {
+      return m_type == Type::Integer ? static_cast<double>(m_integer) : m_float;
+    }
+
+    template <class T>
+    T& as() const {
+      return *static_cast<T*>(m_object);
+    }
+
+    Object* object() const {
+      return heap() ? m_object : nullptr;
+    }
+
+  private:
+    bool heap() const {
+      return m_type >= Type::Keyword;
+    }
+
+    Type m_type;
+    union {
+      bool m_boolean;
+      long m_integer;
+      double m_float;
+      Object* m_object;
+    };
+  };
+
+  // keywords, symbols and strings; keywords without their colon.
+  class Text : public Object {
+  public:
+    explicit Text(std::string value) : value(std::move(value)) {}
+
+    std::string value;
+  };
+
+  // the items of lists, vectors and sets.
+  class Sequence : public Object {
+  public:
+    explicit Sequence(std::vector<Value> items) : items(std::move(items)) {}
+
+    std::vector<Value> items;
+  };
+
+  class Mapping : public Object {
+  public:
+    explicit Mapping(std::vector<std::pair<Value, Value>> entries) : entries(std::move(entries)) {}
+
+    // nullptr when key is not in the map.
+    const Value* find(const Value& key) const;
+
+    std::vector<std::pair<Value, Value>> entries;
+  };
+
+  class Function : public Object {
+  public:
+    explicit Function(std::string name) : name(std::move(name)) {}
+
+    virtual Value call(const Value* args, size_t argc) = 0;
+
+    std::string name;
+
+    // set by an evaluator for the functions it runs itself, instead of through call.
+    const void* owner = nullptr;
+  };
+
+  class Native : public Function {
+  public:
+    typedef Value (*Body)(const Value* args, size_t argc);
+
+    // max -1 takes any number of arguments from min.
+    Native(std::string name, int min, int max, Body body) : Function(std::move(name)), min(min), max(max), body(body) {}
+
+    Value call(const Value* args, size_t argc) override;
+
+    int min;
+    int max;
+    Body body;
+  };
+
+  /*
+   * Thrown for forms that cannot be compiled and for errors while running
+   * them, with the position of the form when it is known.
+   */
+  class EvalError : public std::runtime_error {
+  public:
+    explicit EvalError(const std::string& message, position pos = std::make_tuple(0, 0))
+      : std::runtime_error(message), pos(pos) {}
+
+    position pos;
+  };
+
+  Value keyword(std::string name);
+  Value symbol(std::string name);
+  Value string(std::string value);
+
+  // type is List, Vector or Set; set items have to be distinct already.
+  Value sequence(Type type, std::vector<Value> items);
+
+  Value map(std::vector<std::pair<Value, Value>> entries);
+
+  const std::vector<Value>& items(const Value& v);
+
+  // the value of a quoted form: true, false and nil become themselves, other literals symbols.
+  Value from_expression(const Expression& e);
+
+  // same type and value, collections compared item by item.
+  bool equal(const Value& a, const Value& b);
+
+  // punch syntax, strings quoted.
+  std::string print(const Value& v);
+  void print(const Value& v, std::string& out);
+
+  const char* type_name(Type type);
+
+  // the arithmetic of + - * /; integers stay integers unless / does not divide them, overflow is an error.
+  Value add(const Value& a, const Value& b);
+  Value subtract(const Value& a, const Value& b);
+  Value multiply(const Value& a, const Value& b);
+  Value divide(const Value& a, const Value& b);
+
+  // -1, 0 or 1, numbers only.
+  int compare(const Value& a, const Value& b);
+
+  // calls a function; keywords and maps called with a map or key look it up, as get.
+  Value invoke(const Value& f, const Value* args, size_t argc);
+
+  /*
+   * The global variables of an evaluation, by slot. Compilers resolve a
+   * name to its slot once, evaluation reads the slot. A new environment
+   * holds the core functions, see core.
+   */
+  class Environment {
+
+  public:
+    Environment();
+
+    // the slot of name, made unbound when it is new.
+    uint32_t slot(const std::string& name);
+
+    bool find(const std::string& name, uint32_t& slot) const;
+
+    bool bound(uint32_t slot) const {
+      return m_bound[slot];
+    }
+
+    const Value& get(uint32_t slot) const {
+      return values[slot];
+    }
+
+    void set(uint32_t slot, Value v) {
+      values[slot] = std::move(v);
+      m_bound[slot] = true;
+    }
+
+    void define(const std::string& name, Value v) {
+      set(slot(name), std::move(v));
+    }
+
+    // the value of name, throws EvalError when it is unbound.
+    const Value& lookup(const std::string& name) const;
+
+    const std::string& name(uint32_t slot) const {
+      return names[slot];
+    }
+
+    // still the core function that was defined under this name, which evaluators may inline.
+    bool is_core(uint32_t slot) const {
+      return slot < core.size() && core[slot].object() && values[slot].object() == core[slot].object();
+    }
+
+    size_t size() const {
+      return values.size();
+    }
+
+  private:
+    std::vector<Value> values;
+    std::vector<bool> m_bound;
+    std::vector<std::string> names;
+    // held, so their addresses are not reused.
+    std::vector<Value> core;
+    std::unordered_map<std::string, uint32_t> slots;
+  };
+}
+
+#endif //PUNCH_VALUE_HPP
@@ -0,0 +1,192 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <printer.hpp>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+  void append_long(std::string& out, long v) {
+    char buf[24];
+    int n = std::snprintf(buf, sizeof(buf), "%ld", v);
+    out.append(buf, n);
+  }
+
+  void append_uint(std::string& out, uint v) {
+    char buf[16];
+    int n = std::snprintf(buf, sizeof(buf), "%u", v);
+    out.append(buf, n);
+  }
+
+  void append_debug_double(std::string& out, double v) {
+    // same as std::to_string
+    char buf[512];
+    int n = std::snprintf(buf, sizeof(buf), "%f", v);
+    out.append(buf, n);
+  }
+
+  void append_punch_double(std::string& out, double v) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%.17g", v);
+    out.append(buf, n);
+
+    // without a dot or exponent it would read back as an integer.
+    if (!std::strpbrk(buf, ".eEn")) {
+      out.append(".0");
+    }
+  }
+
+  // quotes and backslashes escaped, so the string reads back the same.
+  void append_escaped(std::string& out, const std::string& value) {
+    size_t start = 0;
+    for (size_t i = value.find_first_of("\"\\"); i != std::string::npos; i = value.find_first_of("\"\\", i + 1)) {
+      out.append(value, start, i - start);
+      out.push_back('\\');
+      out.push_back(value[i]);
+      start = i + 1;
+    }
+    out.append(value, start, std::string::npos);
+  }
+
+  void children(std::string& out, const std::list<UExpression>& inner, Printer::Format format) {
+    if (format == Printer::Format::Debug) {
+      for (auto it = inner.begin(); it != inner.end(); ++it) {
+        Printer::append(out, **it, format);
+        out.append(", ");
+      }
+    }
+    else {
+      for (auto it = inner.begin(); it != inner.end(); ++it) {
+        if (it != inner.begin()) {
+          out.push_back(' ');
+        }
+        Printer::append(out, **it, format);
+      }
+    }
+  }
+
+  void collection(std::string& out, const char* debug_name, const char* open, char close,
+                  const std::list<UExpression>& inner, Printer::Format format) {
+    if (format == Printer::Format::Debug) {
+      out.append(debug_name);
+      out.append(" (");
+      children(out, inner, format);
+      out.push_back(')');
+    }
+    else {
+      out.append(open);
+      children(out, inner, format);
+      out.push_back(close);
+    }
+  }
+
+  void scalar(std::string& out, const char* debug_name, const char* prefix, const char* suffix,
+              const std::string& value, Printer::Format format) {
+    if (format == Printer::Format::Debug) {
+      out.append(debug_name);
+      out.append(" (");
+      out.append(value);
+      out.push_back(')');
+    }
+    else {
+      out.append(prefix);
+      out.append(value);
+      out.append(suffix);
+    }
+  }
+}
+
+void Printer::append(std::string& out, const Expression& e, Format format) {
+  bool debug = format == Format::Debug;
+
+  switch (e.type()) {
+    case ExpressionType::EndOfFile:
+      if (debug) {
+        out.append("EOF");
+      }
+      break;
+    case ExpressionType::Keyword:
+      scalar(out, "KW", ":", "", static_cast<const Keyword&>(e).value(), format);
+      break;
+    case ExpressionType::Literal:
+      scalar(out, "LIT", "", "", static_cast<const Literal&>(e).value(), format);
+      break;
+    case ExpressionType::String:
+      if (debug) {
+        scalar(out, "STR", "", "", static_cast<const String&>(e).value(), format);
+      }
+      else {
+        out.push_back('"');
+        append_escaped(out, static_cast<const String&>(e).value());
+        out.push_back('"');
+      }
+      break;
+    case ExpressionType::Integer:
+      if (debug) {
+        out.append("INT (");
+      }
+      append_long(out, static_cast<const Integer&>(e).value());
+      if (debug) {
+        out.push_back(')');
+      }
+      break;
+    case ExpressionType::Float:
+      if (debug) {
+        out.append("FLOAT (");
+        append_debug_double(out, static_cast<const Float&>(e).value());
+        out.push_back(')');
+      }
+      else {
+        append_punch_double(out, static_cast<const Float&>(e).value());
+      }
+      break;
+    case ExpressionType::Ratio:
+      if (debug) {
+        out.append("RATIO (");
+      }
+      append_long(out, static_cast<const Ratio&>(e).numerator());
+      out.push_back('/');
+      append_long(out, static_cast<const Ratio&>(e).denominator());
+      if (debug) {
+        out.push_back(')');
+      }
+      break;
+    case ExpressionType::List:
+      collection(out, "LIST", "(", ')', static_cast<const List&>(e).inner(), format);
+      break;
+    case ExpressionType::Map:
+      collection(out, "MAP", "{", '}', static_cast<const Map&>(e).inner(), format);
+      break;
+    case ExpressionType::Set:
+      collection(out, "SET", "#{", '}', static_cast<const Set&>(e).inner(), format);
+      break;
+    case ExpressionType::Vector:
+      collection(out, "VEC", "[", ']', static_cast<const Vector&>(e).inner(), format);
+      break;
+  }
+}
+
+void Printer::append(std::string& out, const Token& token) {
+  out.append(tokenTypeTranslations.at(token.type));
+  if (!token.value.empty()) {
+    out.push_back(' ');
+    out.append(token.value);
+  }
+  out.append(" (");
+  append_uint(out, std::get<0>(token.pos));
+  out.append(", ");
+  append_uint(out, std::get<1>(token.pos));
+  out.push_back(')');
+}
+
+void expression::append_debug(const Expression& e, std::string& out) {
+  Printer::append(out, e, Printer::Format::Debug);
+}
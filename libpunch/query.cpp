@@ -0,0 +1,408 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <query.hpp>
+#include <trace.hpp>
+
+namespace query {
+
+  namespace {
+
+  // the key of e in the index of a map: its type, then its value.
+  std::string key_of(const Expression& e) {
+    std::string key(1, static_cast<char>(e.type()));
+    switch (e.type()) {
+      case ExpressionType::Keyword:
+        key += static_cast<const expression::Keyword&>(e).value();
+        break;
+      case ExpressionType::Literal:
+        key += static_cast<const expression::Literal&>(e).value();
+        break;
+      case ExpressionType::String:
+        key += static_cast<const expression::String&>(e).value();
+        break;
+      case ExpressionType::Integer:
+        key += std::to_string(static_cast<const expression::Integer&>(e).value());
+        break;
+      default:
+        append_debug(e, key);
+        break;
+    }
+    return key;
+  }
+
+  bool matches(const Plan::Step& step, const Expression& key) {
+    if (step.kind != Plan::Step::Kind::Key || key.type() != step.type) {
+      return false;
+    }
+
+    switch (key.type()) {
+      case ExpressionType::Keyword:
+        return static_cast<const expression::Keyword&>(key).value() == step.text;
+      case ExpressionType::Literal:
+        return static_cast<const expression::Literal&>(key).value() == step.text;
+      case ExpressionType::String:
+        return static_cast<const expression::String&>(key).value() == step.text;
+      case ExpressionType::Integer:
+        return static_cast<const expression::Integer&>(key).value() == step.integer;
+      default:
+        return false;
+    }
+  }
+
+  const std::list<UExpression>* children(const Expression& e) {
+    switch (e.type()) {
+      case ExpressionType::List:
+        return &static_cast<const expression::List&>(e).inner();
+      case ExpressionType::Map:
+        return &static_cast<const expression::Map&>(e).inner();
+      case ExpressionType::Set:
+        return &static_cast<const expression::Set&>(e).inner();
+      case ExpressionType::Vector:
+        return &static_cast<const expression::Vector&>(e).inner();
+      default:
+        return nullptr;
+    }
+  }
+
+  TokenType close_of(TokenType open) {
+    switch (open) {
+      case TokenType::RoundOpen:
+      case TokenType::FunctionOpen:
+        return TokenType::RoundClose;
+      case TokenType::SquareOpen:
+        return TokenType::SquareClose;
+      default:
+        return TokenType::CurlyClose;
+    }
+  }
+
+  /*
+   * Walks the token stream of a reader. Every call starts at the first
+   * token of a value and leaves the token after it current; false once the
+   * reader failed.
+   */
+  class LazySelector {
+  public:
+    LazySelector(const Plan& plan, Reader& r, std::list<UExpression>& out) : plan(plan), r(r), out(out) {}
+
+    bool walk(size_t step) {
+      if (step == plan.size()) {
+        auto e = r.try_next();
+        if (!e) {
+          return false;
+        }
+        out.push_back(std::move(e));
+        return true;
+      }
+
+      switch (r.current_token().type) {
+        case TokenType::CurlyOpen:
+          return map(plan.steps()[step], step);
+        case TokenType::RoundOpen:
+        case TokenType::SquareOpen:
+        case TokenType::SetOpen:
+          return sequence(plan.steps()[step], step);
+        default:
+          return skip();
+      }
+    }
+
+    // counts brackets only, nothing is read.
+    bool skip() {
+      const Token& first = r.current_token();
+      if (closeTypes.find(first.type) != closeTypes.end()) {
+        r.fail("Closing tag without open", first.pos);
+        return false;
+      }
+      if (openTypes.find(first.type) == openTypes.end()) {
+        r.pop_token();
+        return !r.failed();
+      }
+
+      closes.clear();
+      std::vector<position> starts;
+      do {
+        const Token& t = r.current_token();
+        if (openTypes.find(t.type) != openTypes.end()) {
+          closes.push_back(close_of(t.type));
+          starts.push_back(t.pos);
+        }
+        else if (t.type == TokenType::EndOfFile) {
+          r.fail(std::string("EOF, expected ") + tokenTypeTranslations.at(closes.back()), starts.back(), closes.back());
+          return false;
+        }
+        else if (closeTypes.find(t.type) != closeTypes.end()) {
+          if (t.type != closes.back()) {
+            r.fail(std::string("Expected ") + tokenTypeTranslations.at(closes.back()) + " got " +
+                   tokenTypeTranslations.at(t.type), t.pos, closes.back());
+            return false;
+          }
+          closes.pop_back();
+          starts.pop_back();
+        }
+
+        r.pop_token();
+        if (r.failed()) {
+          return false;
+        }
+      } while (!closes.empty());
+
+      return true;
+    }
+
+  private:
+    bool map(const Plan::Step& step, size_t at) {
+      position start = r.current_token().pos;
+      r.pop_token();
+      bool found = false;
+
+      while (r.current_token().type != TokenType::CurlyClose) {
+        if (!check(start, TokenType::CurlyClose)) {
+          return false;
+        }
+
+        // keys are only read until the first one that matches.
+        bool take = step.kind == Plan::Step::Kind::Wildcard;
+        if (take || found) {
+          if (!skip()) {
+            return false;
+          }
+        }
+        else {
+          auto key = r.try_next();
+          if (!key) {
+            return false;
+          }
+          take = found = matches(step, *key);
+        }
+
+        if (r.current_token().type == TokenType::CurlyClose) {
+          r.fail("Map entries should be even", start);
+          return false;
+        }
+        if (!check(start, TokenType::CurlyClose) || !(take ? walk(at + 1) : skip())) {
+          return false;
+        }
+      }
+
+      r.pop_token();
+      return !r.failed();
+    }
+
+    bool sequence(const Plan::Step& step, size_t at) {
+      TokenType close = close_of(r.current_token().type);
+      bool set = r.current_token().type == TokenType::SetOpen;
+      position start = r.current_token().pos;
+      r.pop_token();
+
+      for (long i = 0; r.current_token().type != close; ++i) {
+        if (!check(start, close)) {
+          return false;
+        }
+
+        bool take = step.kind == Plan::Step::Kind::Wildcard ||
+            (!set && step.type == ExpressionType::Integer && step.integer == i);
+        if (!(take ? walk(at + 1) : skip())) {
+          return false;
+        }
+      }
+
+      r.pop_token();
+      return !r.failed();
+    }
+
+    // fails at the end of the input and at a close of the wrong kind, as the reader does.
+    bool check(position start, TokenType close) {
+      const Token& t = r.current_token();
+      if (r.failed()) {
+        return false;
+      }
+      if (t.type == TokenType::EndOfFile) {
+        r.fail(std::string("EOF, expected ") + tokenTypeTranslations.at(close), start, close);
+        return false;
+      }
+      if (closeTypes.find(t.type) != closeTypes.end() && t.type != close) {
+        r.fail(std::string("Expected ") + tokenTypeTranslations.at(close) + " got " + tokenTypeTranslations.at(t.type),
+               t.pos, close);
+        return false;
+      }
+      return true;
+    }
+
+    const Plan& plan;
+    Reader& r;
+    std::list<UExpression>& out;
+    std::vector<TokenType> closes;
+  };
+
+  }
+
+  Plan::Plan(const std::string& path) {
+    auto forms = read_forms(path);
+    if (forms.size() != 1 || forms.front()->type() != ExpressionType::Vector) {
+      throw ReaderException("Query path should be a single vector");
+    }
+
+    auto& inner = static_cast<const expression::Vector&>(*forms.front()).inner();
+    for (auto it = inner.begin(); it != inner.end(); ++it) {
+      const Expression& e = **it;
+      Step step{Step::Kind::Key, e.type(), "", 0, key_of(e)};
+
+      switch (e.type()) {
+        case ExpressionType::Literal:
+          if (static_cast<const expression::Literal&>(e).value() == "*") {
+            step.kind = Step::Kind::Wildcard;
+            step.key.clear();
+            break;
+          }
+          step.text = static_cast<const expression::Literal&>(e).value();
+          break;
+        case ExpressionType::Keyword:
+          step.text = static_cast<const expression::Keyword&>(e).value();
+          break;
+        case ExpressionType::String:
+          step.text = static_cast<const expression::String&>(e).value();
+          break;
+        case ExpressionType::Integer:
+          step.integer = static_cast<const expression::Integer&>(e).value();
+          break;
+        default:
+          throw ReaderException("Unsupported query step " + e.DebugInfo());
+      }
+
+      m_steps.push_back(std::move(step));
+    }
+  }
+
+  std::vector<const Expression*> Engine::select(const Plan& plan, const Expression& root) {
+    std::vector<const Expression*> out;
+    walk(plan, 0, root, out, true);
+    return out;
+  }
+
+  std::vector<const Expression*> Engine::select(const Plan& plan, const std::list<UExpression>& forms) {
+    std::vector<const Expression*> out;
+    for (auto it = forms.begin(); it != forms.end(); ++it) {
+      walk(plan, 0, **it, out, true);
+    }
+    return out;
+  }
+
+  const Expression* Engine::first(const Plan& plan, const Expression& root) {
+    std::vector<const Expression*> out;
+    walk(plan, 0, root, out, false);
+    return out.empty() ? nullptr : out.front();
+  }
+
+  void Engine::walk(const Plan& plan, size_t step, const Expression& e, std::vector<const Expression*>& out, bool all) {
+    if (step == plan.size()) {
+      out.push_back(&e);
+      return;
+    }
+
+    const Plan::Step& s = plan.steps()[step];
+    if (s.kind == Plan::Step::Kind::Key) {
+      const Expression* c = child(s, e);
+      if (c) {
+        walk(plan, step + 1, *c, out, all);
+      }
+      return;
+    }
+
+    const std::list<UExpression>* inner = children(e);
+    if (!inner) {
+      return;
+    }
+
+    bool map = e.type() == ExpressionType::Map;
+    auto it = inner->begin();
+    while (it != inner->end() && (all || out.empty())) {
+      if (map) {
+        ++it;
+      }
+      walk(plan, step + 1, **it, out, all);
+      ++it;
+    }
+  }
+
+  const Expression* Engine::child(const Plan::Step& step, const Expression& e) {
+    const std::list<UExpression>* inner = children(e);
+    if (!inner) {
+      return nullptr;
+    }
+
+    if (e.type() == ExpressionType::Map) {
+      if (inner->size() / 2 >= min_size) {
+        auto& keys = index(e).keys;
+        auto found = keys.find(step.key);
+        return found == keys.end() ? nullptr : found->second;
+      }
+
+      for (auto it = inner->begin(); it != inner->end(); std::advance(it, 2)) {
+        if (matches(step, **it)) {
+          return std::next(it)->get();
+        }
+      }
+      return nullptr;
+    }
+
+    if (e.type() == ExpressionType::Set || step.type != ExpressionType::Integer ||
+        step.integer < 0 || static_cast<unsigned long>(step.integer) >= inner->size()) {
+      return nullptr;
+    }
+
+    if (inner->size() >= min_size) {
+      return index(e).elements[step.integer];
+    }
+    return std::next(inner->begin(), step.integer)->get();
+  }
+
+  const Engine::Index& Engine::index(const Expression& e) {
+    auto found = indexes.find(&e);
+    if (found != indexes.end()) {
+      return found->second;
+    }
+
+    PUNCH_TRACE_SPAN(span, "index collection", "query");
+    Index& index = indexes[&e];
+    const std::list<UExpression>& inner = *children(e);
+
+    if (e.type() == ExpressionType::Map) {
+      index.keys.reserve(inner.size() / 2);
+      for (auto it = inner.begin(); it != inner.end(); std::advance(it, 2)) {
+        // the first entry of a key wins, as when scanning.
+        index.keys.emplace(key_of(**it), std::next(it)->get());
+      }
+    }
+    else {
+      index.elements.reserve(inner.size());
+      for (auto it = inner.begin(); it != inner.end(); ++it) {
+        index.elements.push_back(it->get());
+      }
+    }
+
+    return index;
+  }
+
+  ReadResult select(const Plan& plan, const std::string& source) {
+    PUNCH_TRACE_SPAN(span, "select", "query");
+    Reader reader(make_unique<Tokenizer>(make_unique<StringScanner>(source)));
+    ReadResult result;
+    LazySelector selector(plan, reader, result.forms);
+
+    while (!reader.failed() && reader.current_token().type != TokenType::EndOfFile) {
+      selector.walk(0);
+    }
+
+    result.diagnostics = reader.diagnostics();
+    return result;
+  }
+}
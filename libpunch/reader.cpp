@@ -9,6 +9,11 @@
  */
 
 #include <reader.hpp>
+#include <stats.hpp>
+#include <trace.hpp>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
 #include <string>
 #include <boost/regex.hpp>
 
@@ -29,13 +34,18 @@ const boost::regex int_pattern("([-+]?)(([0]?)|([1-9][0-9]*)|0[xX]([0-9A-Fa-f]+)
 const boost::regex float_pattern("([-+]?[0-9]+(\\.[0-9]*)?([eE][-+]?[0-9]+)?)(M)?");
 const boost::regex ratio_pattern("([-+]?[0-9]+)/([0-9]+)");
 
+// match results keep their storage between matches, a fresh one allocates on every match.
+boost::smatch& scratch_match() {
+  thread_local boost::smatch match;
+  return match;
+}
+
 bool Integer::accepts(Token& tok) {
 
   try {
 
     if (might_be_number(tok)) {
-      boost::smatch match;
-      return boost::regex_match(tok.value, match, int_pattern);
+      return boost::regex_match(tok.value, scratch_match(), int_pattern);
     }
 
     return false;
@@ -55,7 +65,7 @@ bool Float::accepts(Token& tok) {
   const boost::regex float_regex(float_pattern);
 
   if (might_be_number(tok)) {
-    return boost::regex_match(tok.value, float_regex);
+    return boost::regex_match(tok.value, scratch_match(), float_regex);
   }
 
   return false;
@@ -65,7 +75,7 @@ bool Ratio::accepts(Token& tok) {
   const boost::regex ratio_regex(ratio_pattern);
 
   if (might_be_number(tok)) {
-    return boost::regex_match(tok.value, ratio_regex);
+    return boost::regex_match(tok.value, scratch_match(), ratio_regex);
   }
 
   return false;
@@ -95,51 +105,189 @@ bool Vector::accepts(Token& tok) {
   return tok.type == TokenType::SquareOpen;
 }
 
+// allocations made while creating T are attributed to its expression type.
+template <class T>
+UExpression create(Reader* r, ExpressionType type) {
+  PUNCH_STAT_EXPRESSION(scope, type);
+  return T::create(r);
+}
+
+struct DepthGuard {
+  DepthGuard(uint& depth) : depth(depth) {
+    ++depth;
+  }
+
+  ~DepthGuard() {
+    --depth;
+  }
+
+  uint& depth;
+};
+
 UExpression Reader::next() {
+  auto expr = try_next();
+  if (!expr) {
+    throw ReaderException(m_diagnostics.back().message);
+  }
+
+  return expr;
+}
+
+void Reader::reset() {
+  tokenizer->reset();
+  cur_tok = tokenizer->next();
+  depth = 0;
+  brackets = 0;
+  m_failed = false;
+  m_diagnostics.clear();
+  check_tokenizer();
+}
+
+MessageReader::MessageReader(bool recover)
+  : scanner(new SpanScanner()), reader(make_unique<Tokenizer>(std::unique_ptr<Scanner>(scanner)), recover) {
+}
+
+void MessageReader::reset(const char* data, size_t size) {
+  scanner->reset(data, size);
+  reader.reset();
+}
+
+UExpression Reader::fail(std::string message, position pos, boost::optional<TokenType> expected) {
+  if (!m_failed) {
+    m_failed = true;
+    m_diagnostics.push_back(Diagnostic{std::move(message), pos, expected});
+  }
+
+  return nullptr;
+}
+
+UExpression Reader::try_next() {
+  auto expr = read();
+
+  // nested reads pass the failure up to the top-level one, which recovers.
+  while (!expr && recover && depth == 0 && !tokenizer->failed()) {
+    resynchronize(m_diagnostics.back());
+    m_failed = false;
+    expr = read();
+  }
+
+  return expr;
+}
+
+void Reader::resynchronize(const Diagnostic& error) {
+  // a missing close found at a column 1 bracket is already at the boundary.
+  bool at_boundary = std::get<1>(cur_tok.pos) == 1 && std::get<0>(cur_tok.pos) > std::get<0>(error.pos) &&
+      openTypes.find(cur_tok.type) != openTypes.end();
+
+  // a close of the wrong kind is stray, skipping it does not close anything.
+  if (error.expected && *error.expected != cur_tok.type && closeTypes.find(cur_tok.type) != closeTypes.end()) {
+    ++brackets;
+  }
+
+  if (!at_boundary) {
+    // the token reading failed at is always skipped, so reading makes progress.
+    do {
+      pop_token();
+    } while (cur_tok != Token::EndOfFile && brackets > 0 &&
+        !(std::get<1>(cur_tok.pos) == 1 && openTypes.find(cur_tok.type) != openTypes.end()));
+  }
+
+  brackets = 0;
+}
+
+UExpression Reader::read() {
+
+  if (m_failed) {
+    return nullptr;
+  }
 
   if (cur_tok == Token::EndOfFile) {
-    return std::move(m_end);
+    return make_unique<EndOfFile>();
   }
 
+  position pos = cur_tok.pos;
+
+  // nested expressions are part of the time of the top-level one.
+  PUNCH_STAT_TIMER(timer, stats::Stage::Reader, stats::Stage::Tokenizer, depth == 0);
+  PUNCH_TRACE_SPAN(span, "form", "reader", depth == 0 && trace::forms_enabled());
+  PUNCH_TRACING(span.arg("line", std::get<0>(pos)));
+  DepthGuard guard(depth);
+  PUNCH_STAT(stats::local().max_depth = std::max<uint64_t>(stats::local().max_depth, depth));
+
+  UExpression expr;
+
   if (Keyword::accepts(cur_tok)) {
-    ret(Keyword::create(this));
+    expr = create<Keyword>(this, ExpressionType::Keyword);
   }
   else if (Integer::accepts(cur_tok)) {
-    ret(Integer::create(this));
+    expr = create<Integer>(this, ExpressionType::Integer);
   }
   else if (Float::accepts(cur_tok)) {
-    ret(Float::create(this));
+    expr = create<Float>(this, ExpressionType::Float);
   }
   else if (Ratio::accepts(cur_tok)) {
-    ret(Ratio::create(this));
+    expr = create<Ratio>(this, ExpressionType::Ratio);
   }
   else if (Literal::accepts(cur_tok)) {
-    ret(Literal::create(this));
+    expr = create<Literal>(this, ExpressionType::Literal);
   }
   else if (List::accepts(cur_tok)) {
-    ret(List::create(this));
+    expr = create<List>(this, ExpressionType::List);
   }
   else if (Map::accepts(cur_tok)) {
-    ret(Map::create(this));
+    expr = create<Map>(this, ExpressionType::Map);
   }
   else if (Set::accepts(cur_tok)) {
-    ret(Set::create(this));
+    expr = create<Set>(this, ExpressionType::Set);
   }
   else if (String::accepts(cur_tok)) {
-    ret(String::create(this));
+    expr = create<String>(this, ExpressionType::String);
   }
   else if (Vector::accepts(cur_tok)) {
-    ret(Vector::create(this));
+    expr = create<Vector>(this, ExpressionType::Vector);
   }
   else if (closeTypes.find(cur_tok.type) != closeTypes.end()) {
-    throw ReaderException("Closing tag without open");
+    return fail("Closing tag without open", pos);
   }
   else {
-    //throw ReaderException();
+    return fail(std::string("Unsupported token ") + tokenTypeTranslations.at(cur_tok.type), pos);
   }
 
-  cur_tok = tokenizer->next();
-  return std::move(current);
+  if (!expr) {
+    return nullptr;
+  }
+
+  expr->pos = pos;
+  PUNCH_STAT(stats::local().expressions[static_cast<size_t>(expr->type())]++);
+
+  pop_token();
+  return expr;
+}
+
+ReadResult try_read_forms(const std::string& source, bool recover) {
+  PUNCH_TRACE_SPAN(span, "read forms", "reader");
+  Reader reader(make_unique<Tokenizer>(make_unique<StringScanner>(source)), recover);
+  ReadResult result;
+
+  auto expr = reader.try_next();
+  while (expr && expr->type() != ExpressionType::EndOfFile) {
+    result.forms.push_back(std::move(expr));
+    expr = reader.try_next();
+  }
+
+  result.diagnostics = reader.diagnostics();
+
+  PUNCH_TRACING(span.arg("bytes", source.size()).arg("forms", result.forms.size()));
+  return result;
+}
+
+std::list<UExpression> read_forms(const std::string& source) {
+  auto result = try_read_forms(source);
+  if (!result.ok()) {
+    throw ReaderException(result.diagnostics.front().message);
+  }
+
+  return std::move(result.forms);
 }
 
 template <class T>
@@ -150,31 +298,73 @@ std::set<T> without(const std::set<T>& orig, const T& value) {
   return result;
 }
 
-void read_until(Reader* r, TokenType tt, const std::set<TokenType>& not_in, std::list<UExpression>& l) {
+// the closes that are wrong inside each kind of collection, built once rather than per collection.
+const std::set<TokenType> without_round_close = without(closeTypes, TokenType::RoundClose);
+const std::set<TokenType> without_curly_close = without(closeTypes, TokenType::CurlyClose);
+const std::set<TokenType> without_square_close = without(closeTypes, TokenType::SquareClose);
+
+// reads the elements of a collection opened at start, false once the reader failed.
+bool read_until(Reader* r, position start, TokenType tt, const std::set<TokenType>& not_in, std::list<UExpression>& l) {
 
   while (r->current_token().type != tt) {
+    if (r->failed()) {
+      return false;
+    }
+
     if (r->current_token() == Token::EndOfFile) {
-      throw ReaderException(std::string("EOF, expected ") + tokenTypeTranslations.at(tt));
+      r->fail(std::string("EOF, expected ") + tokenTypeTranslations.at(tt), start, tt);
+      return false;
+    }
+
+    position pos = r->current_token().pos;
+    if (r->recovering() && std::get<1>(pos) == 1 && std::get<0>(pos) > std::get<0>(start) &&
+        openTypes.find(r->current_token().type) != openTypes.end()) {
+      r->fail(std::string("Expected ") + tokenTypeTranslations.at(tt) + " before the next top-level form", start, tt);
+      return false;
     }
 
     if (not_in.find(r->current_token().type) != not_in.end()) {
-      throw ReaderException(std::string("Expected ") + tokenTypeTranslations.at(tt) + " got " + tokenTypeTranslations.at(r->current_token().type));
+      r->fail(std::string("Expected ") + tokenTypeTranslations.at(tt) + " got " + tokenTypeTranslations.at(r->current_token().type),
+              r->current_token().pos, tt);
+      return false;
+    }
+
+    auto expr = r->try_next();
+    if (!expr) {
+      return false;
     }
 
-    l.push_back(std::move(r->next()));
+    l.push_back(std::move(expr));
+  }
+
+  return !r->failed();
+}
+
+// parses all of s, false on anything left over or on overflow.
+bool parse_long(const std::string& s, int radix, long& value) {
+  if (radix < 2 || radix > 36 || s.empty()) {
+    return false;
   }
+
+  char* end;
+  errno = 0;
+  value = std::strtol(s.c_str(), &end, radix);
+
+  return errno == 0 && *end == '\0';
 }
 
 UExpression Keyword::create(Reader *r) {
-  return make_unique<Keyword>(r->current_token().value.substr(1));
+  std::string value = r->take_value();
+  value.erase(0, 1);
+  return make_unique<Keyword>(std::move(value));
 }
 
-UExpression Integer::create(Reader *r) {
+bool parse_integer(const std::string& text, long& value) {
 
   /* regex breaks first number after [+-], so we check for it and remove it*/
 
   bool negate = false;
-  std::string input = r->current_token().value;
+  std::string input = text;
   if (sign_start.find(input.at(0)) != sign_start.end()) {
     if (input.find("-") == 0) {
       negate = true;
@@ -182,7 +372,7 @@ UExpression Integer::create(Reader *r) {
     input = input.substr(1);
   }
 
-  boost::smatch match;
+  boost::smatch& match = scratch_match();
   boost::regex_match(input, match, int_pattern);
 
   //bool negate = (n.matched && std::string(n.first, n.second).compare("-") == 0);
@@ -191,14 +381,14 @@ UExpression Integer::create(Reader *r) {
   {
     if(match[9].matched) {
       // not yet bigint thingies.
-      return make_unique<Integer>(0);
+      value = 0;
+      return true;
     }
 
-    return make_unique<Integer>(0);
+    value = 0;
+    return true;
   }
 
-  auto n = match[1];
-
   int group = 0;
   int radix = 10;
 
@@ -216,18 +406,21 @@ UExpression Integer::create(Reader *r) {
   }
   else if(match[8].matched) {
     auto r = match[7];
-    radix = std::stoi(std::string(r.first, r.second));
+    radix = std::atoi(std::string(r.first, r.second).c_str());
     group = 8;
   }
 
   if(group == 0) {
-    throw ReaderException("Invalid integer");
+    return false;
   }
 
   auto m = match[group];
   //std::cout << m.length() << " INT! " << group << " : [" << std::string(m.first, m.second)  << "] : " <<  radix << std::endl;
 
-  long value = std::stol(std::string(m.first, m.second), nullptr, radix);
+  if (!parse_long(std::string(m.first, m.second), radix, value)) {
+    return false;
+  }
+
   if(negate) {
     value = -value;
   }
@@ -236,27 +429,45 @@ UExpression Integer::create(Reader *r) {
 //    // bigint not supported
 //  }
 
+  return true;
+}
+
+UExpression Integer::create(Reader *r) {
+  long value;
+  if (!parse_integer(r->current_token().value, value)) {
+    return r->fail("Invalid integer", r->current_token().pos);
+  }
+
   return make_unique<Integer>(value);
 }
 
-UExpression Float::create(Reader *r) {
-  boost::smatch match;
-  boost::regex_match(r->current_token().value, match, float_pattern);
+bool parse_float(const std::string& text, double& d) {
+  boost::smatch& match = scratch_match();
+  boost::regex_match(text, match, float_pattern);
 
-  std::string value = r->current_token().value;
+  std::string value = text;
 
   if (match[4].matched) {
     // no decimals yet
     value = value.substr(0, value.size() - 1);
   }
 
-  double d = std::stod(value);
+  errno = 0;
+  d = std::strtod(value.c_str(), nullptr);
+  return !(errno == ERANGE && (d == HUGE_VAL || d == -HUGE_VAL));
+}
+
+UExpression Float::create(Reader *r) {
+  double d;
+  if (!parse_float(r->current_token().value, d)) {
+    return r->fail("Float out of range", r->current_token().pos);
+  }
 
   return make_unique<Float>(d);
 }
 
 UExpression Ratio::create(Reader *r) {
-  boost::smatch match;
+  boost::smatch& match = scratch_match();
 
   boost::regex_match(r->current_token().value, match, ratio_pattern);
 
@@ -270,64 +481,70 @@ UExpression Ratio::create(Reader *r) {
   auto d = match[2];
   std::string d_str(d.first, d.second);
 
-  long numerator = stol(n_str, 0, 10);
-  long denominator = stol(d_str, 0, 10);
+  long numerator, denominator;
+  if (!parse_long(n_str, 10, numerator) || !parse_long(d_str, 10, denominator)) {
+    return r->fail("Invalid ratio", r->current_token().pos);
+  }
 
   return make_unique<Ratio>(numerator,denominator);
 }
 
 UExpression Literal::create(Reader *r) {
-  return make_unique<Literal>(r->current_token().value);
+  return make_unique<Literal>(r->take_value());
 }
 
 UExpression List::create(Reader *r) {
+  position start = r->current_token().pos;
   r->pop_token();
 
-  auto without_round_close = without(closeTypes, TokenType::RoundClose);
-
   std::list<UExpression> l;
-  read_until(r, TokenType::RoundClose, without_round_close, l);
+  if (!read_until(r, start, TokenType::RoundClose, without_round_close, l)) {
+    return nullptr;
+  }
 
   return make_unique<List>(l);
 }
 
 UExpression Map::create(Reader *r) {
+  position start = r->current_token().pos;
   r->pop_token();
 
-  auto without_curly_close = without(closeTypes, TokenType::CurlyClose);
-
   std::list<UExpression> l;
-  read_until(r, TokenType::CurlyClose, without_curly_close, l);
+  if (!read_until(r, start, TokenType::CurlyClose, without_curly_close, l)) {
+    return nullptr;
+  }
 
   if (l.size() % 2 == 1) {
-    throw ReaderException("Map entries should be even");
+    return r->fail("Map entries should be even", start);
   }
 
   return make_unique<Map>(l);
 }
 
 UExpression Set::create(Reader *r) {
+  position start = r->current_token().pos;
   r->pop_token();
 
-  auto without_curly_close = without(closeTypes, TokenType::CurlyClose);
-
   std::list<UExpression> l;
-  read_until(r, TokenType::CurlyClose, without_curly_close, l);
+  if (!read_until(r, start, TokenType::CurlyClose, without_curly_close, l)) {
+    return nullptr;
+  }
 
   return make_unique<Set>(l);
 }
 
 UExpression String::create(Reader *r) {
-  return make_unique<String>(r->current_token().value);
+  return make_unique<String>(r->take_value());
 }
 
 UExpression Vector::create(Reader *r) {
+  position start = r->current_token().pos;
   r->pop_token();
 
-  auto without_square_close = without(closeTypes, TokenType::SquareClose);
-
   std::list<UExpression> l;
-  read_until(r, TokenType::SquareClose, without_square_close, l);
+  if (!read_until(r, start, TokenType::SquareClose, without_square_close, l)) {
+    return nullptr;
+  }
 
   return make_unique<Vector>(l);
 }
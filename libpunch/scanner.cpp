@@ -9,7 +9,61 @@
  */
 
 #include <scanner.hpp>
+#include <stats.hpp>
+#include <trace.hpp>
+#include <utf8.hpp>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <sys/stat.h>
+
+namespace {
+
+  // counts the lines in the n bytes at data into line; the start of the last line they begin, nullptr when there is none.
+  const char* skip_lines(const char* data, size_t n, uint& line) {
+    const char* end = data + n;
+    const char* start = nullptr;
+    for (const char* p = data; (p = static_cast<const char*>(std::memchr(p, '\n', end - p))); ++p) {
+      ++line;
+      start = p + 1;
+    }
+    return start;
+  }
+}
+
+bool Scanner::validate(::position& where) {
+  size_t size;
+  const char* data = remaining(size);
+  if (!data) {
+    return true;
+  }
+
+  size_t invalid = utf8::validate(data, size);
+  if (invalid == size) {
+    return true;
+  }
+
+  uint line, col;
+  std::tie(line, col) = position();
+  utf8::advance(data, invalid, line, col);
+  where = std::make_tuple(line, col);
+  return false;
+}
+
+StringScanner::StringScanner(const std::string& in)
+  : size (in.size()), index(0), line(1), col(1), counted(0) {
+  // the copy is made in the body so its allocation is counted as scanner work.
+  PUNCH_STAT_TIMER(timer, stats::Stage::Scanner);
+  chars = in;
+  PUNCH_STAT(stats::local().bytes_scanned += size);
+}
+
+StringScanner::StringScanner(const std::string& in, size_t offset, ::position start)
+  : size (in.size() - offset), index(0), line(std::get<0>(start)), col(std::get<1>(start)), counted(0) {
+  PUNCH_STAT_TIMER(timer, stats::Stage::Scanner);
+  chars.assign(in, offset, std::string::npos);
+  PUNCH_STAT(stats::local().bytes_scanned += size);
+}
 
 boost::optional<char> StringScanner::current_char() {
   if (this->index < this->size) {
@@ -41,12 +95,10 @@ boost::optional<char> StringScanner::previous_char() {
 void StringScanner::pop() {
   if (this->index < this->size) {
 
-    if (this->current_char() == '\n') {
+    if (this->chars[this->index] == '\n') {
       line+=1;
       col = 1;
-    }
-    else {
-      col+=1;
+      counted = this->index + 1;
     }
 
     this->index += 1;
@@ -66,20 +118,120 @@ void StringScanner::flush_line() {
 }
 
 ::position StringScanner::position() {
+  if (counted < index) {
+    col += utf8::code_points(chars.data() + counted, index - counted);
+    counted = index;
+  }
   return std::make_tuple(line, col);
 }
 
+const char* StringScanner::remaining(size_t& n) {
+  n = size - index;
+  return chars.data() + index;
+}
+
+void StringScanner::skip(size_t n) {
+  n = std::min<size_t>(n, size - index);
+  const char* start = skip_lines(chars.data() + index, n, line);
+  if (start) {
+    col = 1;
+    counted = static_cast<uint>(start - chars.data());
+  }
+  index += n;
+}
+
+SpanScanner::SpanScanner(const char* data, size_t size, ::position start) {
+  reset(data, size, start);
+}
+
+void SpanScanner::reset(const char* data, size_t size, ::position start) {
+  this->data = data;
+  this->size = size;
+  index = 0;
+  line = std::get<0>(start);
+  col = std::get<1>(start);
+  counted = 0;
+  PUNCH_STAT(stats::local().bytes_scanned += size);
+}
+
+boost::optional<char> SpanScanner::current_char() {
+  if (index < size) {
+    return data[index];
+  }
+  return boost::none;
+}
+
+boost::optional<char> SpanScanner::next_char() {
+  if (index + 1 < size) {
+    return data[index + 1];
+  }
+  return boost::none;
+}
+
+boost::optional<char> SpanScanner::previous_char() {
+  if (index > 0 && index <= size) {
+    return data[index - 1];
+  }
+  return boost::none;
+}
+
+void SpanScanner::pop() {
+  if (index < size) {
+    if (data[index] == '\n') {
+      line += 1;
+      col = 1;
+      counted = index + 1;
+    }
+    index += 1;
+  }
+}
+
+void SpanScanner::flush_line() {
+  while (index < size) {
+    char c = data[index];
+    pop();
+    if (c == '\n') {
+      break;
+    }
+  }
+}
+
+::position SpanScanner::position() {
+  if (counted < index) {
+    col += static_cast<uint>(utf8::code_points(data + counted, index - counted));
+    counted = index;
+  }
+  return std::make_tuple(line, col);
+}
+
+const char* SpanScanner::remaining(size_t& n) {
+  n = size - index;
+  return data + index;
+}
+
+void SpanScanner::skip(size_t n) {
+  n = std::min(n, size - index);
+  const char* start = skip_lines(data + index, n, line);
+  if (start) {
+    col = 1;
+    counted = start - data;
+  }
+  index += n;
+}
 
 LineScanner::LineScanner(const std::string& file) :
   current (std::make_tuple(0, 0)),
   next (std::make_tuple(0,1)),
   previous (std::make_tuple(0,-1))
 {
+  PUNCH_STAT_TIMER(timer, stats::Stage::Scanner);
+  PUNCH_TRACE_SPAN(span, "scan file", "scanner");
   std::ifstream infile(file);
 
   for(std::string line; std::getline(infile, line);) {
     std::vector<char> chars(line.begin(), line.end());
     this->lines.push_back(std::make_tuple(line.size(), chars));
+    PUNCH_STAT(stats::local().bytes_scanned += line.size() + 1);
   }
 
   infile.close();
@@ -156,5 +308,69 @@ void LineScanner::flush_line() {
   int l, c;
   std::tie(l,c) = this->current;
 
-  return std::make_tuple(l + 1, c + 1);
+  if (l >= this->lines.size()) {
+    return std::make_tuple(l + 1, c + 1);
+  }
+
+  // counted on from the column asked for last, which is usually on the same line.
+  if (l != counted_line || c < counted_char) {
+    counted_line = l;
+    counted_char = 0;
+    counted_col = 1;
+  }
+
+  const std::vector<char>& chars = std::get<1>(this->lines[l]);
+  int upto = std::min<int>(c, chars.size());
+  counted_col += utf8::code_points(chars.data() + counted_char, upto - counted_char);
+  counted_char = upto;
+
+  // past the end is the newline.
+  return std::make_tuple(l + 1, counted_col + (c - upto));
+}
+
+bool LineScanner::validate(::position& where) {
+  int l, c;
+  std::tie(l,c) = this->current;
+
+  for (; l < this->lines.size(); ++l, c = 0) {
+    const std::vector<char>& chars = std::get<1>(this->lines[l]);
+    size_t from = std::min<size_t>(std::max(c, 0), chars.size());
+    size_t invalid = from + utf8::validate(chars.data() + from, chars.size() - from);
+    if (invalid < chars.size()) {
+      where = std::make_tuple(l + 1, 1 + utf8::code_points(chars.data(), invalid));
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool load_file(const std::string& path, std::string& buffer) {
+  PUNCH_TRACE_SPAN(span, "load file", "scanner");
+  // directories open fine and seek to a size that is not there.
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+    return false;
+  }
+
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  if (!in) {
+    return false;
+  }
+
+  in.seekg(0, std::ios::end);
+  std::streamoff size = in.tellg();
+  if (size < 0) {
+    return false;
+  }
+
+  buffer.resize(static_cast<size_t>(size));
+  in.seekg(0, std::ios::beg);
+  if (!in.read(&buffer[0], buffer.size()) || in.gcount() != size) {
+    buffer.clear();
+    return false;
+  }
+  PUNCH_TRACING(span.arg("bytes", buffer.size()));
+
+  return true;
 }
@@ -0,0 +1,241 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <stats.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+namespace stats {
+
+  std::atomic<bool> enabled(false);
+  bool allocations_counted = false;
+
+  namespace {
+
+  // plain data, so it is zero initialised without a guard and may be used
+  // from allocation hooks.
+  thread_local Stats thread_stats;
+  thread_local Attribution thread_attribution;
+
+  std::mutex totals_mutex;
+  Stats totals;
+
+  const char* stage_names[] = {"scanner", "tokenizer", "reader"};
+
+  const char* token_names[] = {
+      "EndOfFile", "Literal", "RoundOpen", "RoundClose", "SquareOpen", "SquareClose", "CurlyOpen", "CurlyClose",
+      "SetOpen", "FunctionOpen", "Dispatch", "String", "Regex", "Char"
+  };
+
+  const char* expression_names[] = {
+      "EndOfFile", "Keyword", "Integer", "Float", "Ratio", "Literal", "List", "Map", "Set", "String", "Vector"
+  };
+
+  void appendf(std::string& out, const char* format, const char* name, unsigned long long value) {
+    char buf[128];
+    int n = std::snprintf(buf, sizeof(buf), format, name, value);
+    out.append(buf, n);
+  }
+
+  void appendf(std::string& out, const char* format, const char* name, const Allocations& value) {
+    char buf[160];
+    int n = std::snprintf(buf, sizeof(buf), format, name,
+                          static_cast<unsigned long long>(value.count), static_cast<unsigned long long>(value.bytes));
+    out.append(buf, n);
+  }
+
+  void add(Allocations& to, const Allocations& other) {
+    to.count += other.count;
+    to.bytes += other.bytes;
+  }
+
+  uint64_t total_tokens(const Stats& s) {
+    uint64_t n = 0;
+    for (size_t i = 0; i < token_types; ++i) {
+      n += s.tokens[i];
+    }
+    return n;
+  }
+
+  uint64_t total_expressions(const Stats& s) {
+    uint64_t n = 0;
+    for (size_t i = 0; i < expression_types; ++i) {
+      n += s.expressions[i];
+    }
+    return n;
+  }
+
+  }
+
+  void Stats::merge(const Stats& other) {
+    bytes_scanned += other.bytes_scanned;
+    for (size_t i = 0; i < token_types; ++i) {
+      tokens[i] += other.tokens[i];
+    }
+    for (size_t i = 0; i < expression_types; ++i) {
+      expressions[i] += other.expressions[i];
+    }
+    max_depth = std::max(max_depth, other.max_depth);
+    allocations += other.allocations;
+    allocated_bytes += other.allocated_bytes;
+    for (size_t i = 0; i < stages; ++i) {
+      add(stage_allocations[i], other.stage_allocations[i]);
+    }
+    for (size_t i = 0; i < expression_types; ++i) {
+      add(expression_allocations[i], other.expression_allocations[i]);
+    }
+    for (size_t i = 0; i < stages; ++i) {
+      nanoseconds[i] += other.nanoseconds[i];
+    }
+  }
+
+  Stats& local() {
+    return thread_stats;
+  }
+
+  Attribution& attribution() {
+    return thread_attribution;
+  }
+
+  void count_allocation(size_t bytes) {
+    Stats& s = thread_stats;
+    ++s.allocations;
+    s.allocated_bytes += bytes;
+
+    const Attribution& a = thread_attribution;
+    if (a.stage != 0) {
+      Allocations& stage = s.stage_allocations[a.stage - 1];
+      ++stage.count;
+      stage.bytes += bytes;
+
+      // tokens and scanned input are not part of the expression being read.
+      if (a.expression != 0 && a.stage - 1 == static_cast<size_t>(Stage::Reader)) {
+        Allocations& expression = s.expression_allocations[a.expression - 1];
+        ++expression.count;
+        expression.bytes += bytes;
+      }
+    }
+  }
+
+  void flush() {
+    std::lock_guard<std::mutex> lock(totals_mutex);
+    totals.merge(thread_stats);
+    std::memset(&thread_stats, 0, sizeof(thread_stats));
+  }
+
+  Stats snapshot() {
+    std::lock_guard<std::mutex> lock(totals_mutex);
+    Stats result = totals;
+    result.merge(thread_stats);
+    return result;
+  }
+
+  void reset() {
+    std::lock_guard<std::mutex> lock(totals_mutex);
+    std::memset(&totals, 0, sizeof(totals));
+    std::memset(&thread_stats, 0, sizeof(thread_stats));
+  }
+
+  const char* name(Stage stage) {
+    return stage_names[static_cast<size_t>(stage)];
+  }
+
+  const char* name(TokenType type) {
+    return token_names[static_cast<size_t>(type)];
+  }
+
+  const char* name(ExpressionType type) {
+    return expression_names[static_cast<size_t>(type)];
+  }
+
+  std::string to_text(const Stats& s) {
+    std::string out;
+
+    appendf(out, "%-22s %llu\n", "bytes scanned", s.bytes_scanned);
+    appendf(out, "%-22s %llu\n", "tokens", total_tokens(s));
+    for (size_t i = 0; i < token_types; ++i) {
+      if (s.tokens[i] != 0) {
+        appendf(out, "  %-20s %llu\n", token_names[i], s.tokens[i]);
+      }
+    }
+
+    appendf(out, "%-22s %llu\n", "expressions", total_expressions(s));
+    for (size_t i = 0; i < expression_types; ++i) {
+      if (s.expressions[i] != 0) {
+        appendf(out, "  %-20s %llu\n", expression_names[i], s.expressions[i]);
+      }
+    }
+
+    appendf(out, "%-22s %llu\n", "max depth", s.max_depth);
+    appendf(out, "%-22s %llu\n", "allocations", s.allocations);
+    appendf(out, "%-22s %llu\n", "allocated bytes", s.allocated_bytes);
+    for (size_t i = 0; i < stages; ++i) {
+      if (s.stage_allocations[i].count != 0) {
+        appendf(out, "  %-20s %llu (%llu bytes)\n", stage_names[i], s.stage_allocations[i]);
+      }
+    }
+    for (size_t i = 0; i < expression_types; ++i) {
+      if (s.expression_allocations[i].count != 0) {
+        appendf(out, "    %-18s %llu (%llu bytes)\n", expression_names[i], s.expression_allocations[i]);
+      }
+    }
+
+    for (size_t i = 0; i < stages; ++i) {
+      char buf[128];
+      int n = std::snprintf(buf, sizeof(buf), "%-22s %.3f ms\n",
+                            (std::string(stage_names[i]) + " time").c_str(), s.nanoseconds[i] / 1e6);
+      out.append(buf, n);
+    }
+
+    return out;
+  }
+
+  std::string to_json(const Stats& s) {
+    std::string out = "{";
+
+    appendf(out, "\"%s\":%llu,", "bytes_scanned", s.bytes_scanned);
+
+    out += "\"tokens\":{";
+    for (size_t i = 0; i < token_types; ++i) {
+      appendf(out, i == 0 ? "\"%s\":%llu" : ",\"%s\":%llu", token_names[i], s.tokens[i]);
+    }
+    out += "},\"expressions\":{";
+    for (size_t i = 0; i < expression_types; ++i) {
+      appendf(out, i == 0 ? "\"%s\":%llu" : ",\"%s\":%llu", expression_names[i], s.expressions[i]);
+    }
+    out += "},";
+
+    appendf(out, "\"%s\":%llu,", "max_depth", s.max_depth);
+    appendf(out, "\"%s\":%llu,", "allocations", s.allocations);
+    appendf(out, "\"%s\":%llu,", "allocated_bytes", s.allocated_bytes);
+
+    out += "\"stage_allocations\":{";
+    for (size_t i = 0; i < stages; ++i) {
+      appendf(out, i == 0 ? "\"%s\":{\"count\":%llu,\"bytes\":%llu}" : ",\"%s\":{\"count\":%llu,\"bytes\":%llu}",
+              stage_names[i], s.stage_allocations[i]);
+    }
+    out += "},\"expression_allocations\":{";
+    for (size_t i = 0; i < expression_types; ++i) {
+      appendf(out, i == 0 ? "\"%s\":{\"count\":%llu,\"bytes\":%llu}" : ",\"%s\":{\"count\":%llu,\"bytes\":%llu}",
+              expression_names[i], s.expression_allocations[i]);
+    }
+    out += "},";
+
+    out += "\"nanoseconds\":{";
+    for (size_t i = 0; i < stages; ++i) {
+      appendf(out, i == 0 ? "\"%s\":%llu" : ",\"%s\":%llu", stage_names[i], s.nanoseconds[i]);
+    }
+    out += "}}";
+
+    return out;
+  }
+}
@@ -0,0 +1,290 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <streamreader.hpp>
+#include <utf8.hpp>
+
+#ifdef PUNCH_COROUTINES
+
+namespace {
+
+  bool is_open(char c) {
+    return c == ROUND_OPEN || c == SQUARE_OPEN || c == CURLY_OPEN;
+  }
+
+  bool is_close(char c) {
+    return c == ROUND_CLOSE || c == SQUARE_CLOSE || c == CURLY_CLOSE;
+  }
+
+  bool ends_atom(char c) {
+    return whitespace.find(c) != whitespace.end() || delimiters.find(c) != delimiters.end();
+  }
+}
+
+void FormSplitter::feed(const char* data, size_t size) {
+  // drop what was handed out once it is at least half of the buffer, so every byte is moved at most once on average.
+  if (head > 0 && head >= buffer.size() / 2) {
+    buffer.erase(0, head);
+    scan -= head;
+    for (auto it = ends.begin(); it != ends.end(); ++it) {
+      it->first -= head;
+    }
+    head = 0;
+  }
+
+  buffer.append(data, size);
+  split();
+}
+
+void FormSplitter::close() {
+  m_closed = true;
+  split();
+
+  if (content) {
+    complete();
+  }
+}
+
+bool FormSplitter::next(std::string& slice, position& pos) {
+  if (ends.empty()) {
+    return false;
+  }
+
+  slice.assign(buffer, head, ends.front().first - head);
+  pos = head_pos;
+  head = ends.front().first;
+  head_pos = ends.front().second;
+  ends.pop_front();
+
+  return true;
+}
+
+void FormSplitter::consume() {
+  if (buffer[scan] == '\n') {
+    ++line;
+    col = 1;
+  }
+  else if (!utf8::is_continuation(buffer[scan])) {
+    ++col;
+  }
+  ++scan;
+}
+
+void FormSplitter::complete() {
+  ends.push_back(std::make_pair(scan, position(line, col)));
+  content = false;
+}
+
+void FormSplitter::split() {
+  while (scan < buffer.size()) {
+    char c = buffer[scan];
+
+    switch (state) {
+      case State::Comment:
+        consume();
+        if (c == '\n') {
+          state = State::Space;
+        }
+        break;
+
+      case State::Escape:
+        consume();
+        state = State::String;
+        break;
+
+      case State::String:
+        consume();
+        if (c == BACKSLASH) {
+          state = State::Escape;
+        }
+        else if (c == DOUBLE_QUOTE) {
+          state = State::Space;
+          if (depth == 0) {
+            complete();
+          }
+        }
+        break;
+
+      case State::Atom:
+        if (ends_atom(c)) {
+          state = State::Space;
+          if (depth == 0) {
+            complete();
+          }
+        }
+        else {
+          consume();
+        }
+        break;
+
+      case State::Space:
+        // dispatch and chars take the next character whatever it is, wait until it arrived.
+        if ((c == DISPATCH || c == BACKSLASH) && scan + 1 == buffer.size() && !m_closed) {
+          return;
+        }
+
+        if (whitespace.find(c) != whitespace.end()) {
+          consume();
+        }
+        else if (c == SEMICOLON || (c == DISPATCH && scan + 1 < buffer.size() && buffer[scan + 1] == BANG)) {
+          consume();
+          state = State::Comment;
+        }
+        else if (c == DOUBLE_QUOTE) {
+          content = true;
+          consume();
+          state = State::String;
+        }
+        else if (c == DISPATCH || c == BACKSLASH) {
+          content = true;
+          consume();
+          if (scan == buffer.size()) {
+            state = State::Atom;
+            break;
+          }
+
+          char n = buffer[scan];
+          consume();
+          if (c == DISPATCH && (n == CURLY_OPEN || n == ROUND_OPEN)) {
+            ++depth;
+          }
+          else if (c == DISPATCH && n == DOUBLE_QUOTE) {
+            state = State::String;
+          }
+          else {
+            state = State::Atom;
+          }
+        }
+        else if (is_open(c)) {
+          content = true;
+          consume();
+          ++depth;
+        }
+        else if (is_close(c)) {
+          // a close without an open is a form of its own, the reader reports it.
+          content = true;
+          consume();
+          if (depth > 0) {
+            --depth;
+          }
+          if (depth == 0) {
+            complete();
+          }
+        }
+        else {
+          content = true;
+          consume();
+          state = State::Atom;
+        }
+        break;
+    }
+  }
+}
+
+void StreamTokenizer::feed(const char* data, size_t size) {
+  splitter.feed(data, size);
+  wake();
+}
+
+void StreamTokenizer::close() {
+  splitter.close();
+  wake();
+}
+
+void StreamTokenizer::wake() {
+  if (waiting && prepare()) {
+    auto coroutine = waiting;
+    waiting = nullptr;
+    coroutine.resume();
+  }
+}
+
+bool StreamTokenizer::prepare() {
+  while (tokens.empty() && !m_failed) {
+    std::string slice;
+    position pos;
+    if (!splitter.next(slice, pos)) {
+      return splitter.closed();
+    }
+
+    Tokenizer tokenizer(make_unique<StringScanner>(slice, 0, pos));
+    for (auto token = tokenizer.next(); token != Token::EndOfFile; token = tokenizer.next()) {
+      tokens.push_back(std::move(token));
+    }
+
+    if (tokenizer.failed()) {
+      m_failed = true;
+      m_error = tokenizer.error();
+    }
+  }
+
+  return true;
+}
+
+Token StreamTokenizer::take() {
+  if (tokens.empty()) {
+    return Token::EndOfFile;
+  }
+
+  Token token = std::move(tokens.front());
+  tokens.pop_front();
+  return token;
+}
+
+void StreamReader::feed(const char* data, size_t size) {
+  splitter.feed(data, size);
+  wake();
+}
+
+void StreamReader::close() {
+  splitter.close();
+  wake();
+}
+
+void StreamReader::wake() {
+  if (waiting && prepare()) {
+    auto coroutine = waiting;
+    waiting = nullptr;
+    coroutine.resume();
+  }
+}
+
+bool StreamReader::prepare() {
+  while (!form && !m_failed) {
+    std::string slice;
+    position pos;
+    if (!splitter.next(slice, pos)) {
+      return splitter.closed();
+    }
+
+    Reader reader(make_unique<Tokenizer>(make_unique<StringScanner>(slice, 0, pos)));
+    form = reader.try_next();
+
+    if (!form) {
+      m_diagnostics.insert(m_diagnostics.end(), reader.diagnostics().begin(), reader.diagnostics().end());
+      m_failed = !recover;
+    }
+  }
+
+  return true;
+}
+
+UExpression StreamReader::take() {
+  if (form) {
+    return std::move(form);
+  }
+  if (m_failed) {
+    return nullptr;
+  }
+
+  return make_unique<EndOfFile>();
+}
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <threadpool.hpp>
+#include <trace.hpp>
+#include <util.hpp>
+
+unsigned ThreadPool::default_workers() {
+  unsigned n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : n;
+}
+
+ThreadPool::ThreadPool(unsigned workers) : next_queue(0) {
+  if (workers == 0) {
+    workers = default_workers();
+  }
+
+  for (unsigned i = 0; i < workers; ++i) {
+    queues.push_back(make_unique<Queue>());
+  }
+
+  for (unsigned i = 0; i < workers; ++i) {
+    threads.push_back(std::thread(&ThreadPool::run, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    stopping = true;
+  }
+  work_available.notify_all();
+
+  for (auto it = threads.begin(); it != threads.end(); ++it) {
+    it->join();
+  }
+}
+
+void ThreadPool::submit(Task task) {
+  submit(next_queue++ % size(), std::move(task));
+}
+
+void ThreadPool::submit(unsigned worker, Task task) {
+  {
+    // the counters are bumped under the same lock as the push, so a worker
+    // that takes the task always sees them accounted for.
+    std::lock_guard<std::mutex> lock(state_mutex);
+    Queue& queue = *queues.at(worker % size());
+    {
+      std::lock_guard<std::mutex> queue_lock(queue.mutex);
+      queue.tasks.push_back(std::move(task));
+    }
+    ++queued;
+    ++unfinished;
+  }
+  work_available.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(state_mutex);
+  all_done.wait(lock, [this] { return unfinished == 0; });
+}
+
+bool ThreadPool::pop(unsigned self, Task& task) {
+  Queue& queue = *queues[self];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+
+  if (queue.tasks.empty()) {
+    return false;
+  }
+
+  task = std::move(queue.tasks.front());
+  queue.tasks.pop_front();
+  return true;
+}
+
+bool ThreadPool::steal(unsigned self, Task& task) {
+  for (unsigned i = 1; i < size(); ++i) {
+    Queue& victim = *queues[(self + i) % size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.back());
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::run(unsigned self) {
+  PUNCH_TRACING(trace::set_thread_name("worker " + std::to_string(self)));
+
+  for (;;) {
+    Task task;
+
+    if (pop(self, task) || steal(self, task)) {
+      {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        --queued;
+      }
+
+      task(self);
+
+      std::lock_guard<std::mutex> lock(state_mutex);
+      if (--unfinished == 0) {
+        all_done.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(state_mutex);
+    work_available.wait(lock, [this] { return stopping || queued > 0; });
+
+    if (stopping && queued == 0) {
+      return;
+    }
+  }
+}
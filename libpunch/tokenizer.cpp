@@ -9,15 +9,65 @@
  */
 
 #include <tokenizer.hpp>
-#include <reader.hpp>
+#include <stats.hpp>
+#include <cctype>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+  // index of the first '"' or '\\' in data, size when there is none. Sixteen bytes at a time where SSE2 is there.
+  size_t find_quote_or_backslash(const char* data, size_t size) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8(DOUBLE_QUOTE);
+    const __m128i backslash = _mm_set1_epi8(BACKSLASH);
+    for (; i + 16 <= size; i += 16) {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+      if (mask != 0) {
+        return i + __builtin_ctz(mask);
+      }
+    }
+#endif
+    for (; i < size; ++i) {
+      if (data[i] == DOUBLE_QUOTE || data[i] == BACKSLASH) {
+        return i;
+      }
+    }
+    return size;
+  }
+
+  void append_utf8(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+      out += static_cast<char>(code);
+    }
+    else if (code < 0x800) {
+      out += static_cast<char>(0xC0 | (code >> 6));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else if (code < 0x10000) {
+      out += static_cast<char>(0xE0 | (code >> 12));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else {
+      out += static_cast<char>(0xF0 | (code >> 18));
+      out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+  }
+}
 
 Token Token::EndOfFile = Token(TokenType::EndOfFile, "", std::make_tuple(-1, -1));
 
-bool Token::operator==(const Token other) const {
+bool Token::operator==(const Token& other) const {
   return type == other.type && value == other.value && pos == other.pos;
 }
 
-bool Token::operator!=(const Token other) const {
+bool Token::operator!=(const Token& other) const {
   return !(*this == other);
 }
 
@@ -38,7 +88,7 @@ bool Tokenizer::is_next(const char &c) {
   return false;
 }
 
-bool Tokenizer::is_next(const std::set<char> cs) {
+bool Tokenizer::is_next(const std::set<char>& cs) {
   if (scanner->next_char()) {
     return cs.find(*scanner->next_char()) != cs.end();
   }
@@ -46,51 +96,155 @@ bool Tokenizer::is_next(const std::set<char> cs) {
   return false;
 }
 
-std::string Tokenizer::slurp_until(const std::initializer_list<std::set<char>>& stop_lists) {
+std::string Tokenizer::slurp_until(const std::set<char>& stop) {
 
-  std::string result;
+  text.clear();
 
   while (scanner->current_char()) {
-    result += *scanner->current_char();
-
-    if (scanner->next_char())
-    {
-      for (auto it = stop_lists.begin(); it != stop_lists.end(); ++it) {
-        if (is_next(*it)) {
-          goto ret;
-        }
-      }
+    text += *scanner->current_char();
 
+    if (scanner->next_char() && !is_next(stop)) {
       scanner->pop();
     }
     else {
       break;
     }
   }
-  ret:
-  return result;
+
+  // copied out at its final size, the buffer keeps its capacity for the next token.
+  return text;
 }
 
-std::string Tokenizer::slurp_until(const char c) {
-  std::string result;
+bool Tokenizer::slurp_string(std::string& result, bool raw) {
+  while (true) {
+    // runs without escapes are copied at once when the input is in memory.
+    size_t size;
+    if (const char* data = scanner->remaining(size)) {
+      size_t n = find_quote_or_backslash(data, size);
+      result.append(data, n);
+      scanner->skip(n);
+    }
 
-  while (scanner->current_char()) {
-    result += *scanner->current_char();
+    auto c = scanner->current_char();
+    if (!c) {
+      return false;
+    }
+    if (*c == DOUBLE_QUOTE) {
+      return true;
+    }
 
-    if (scanner->next_char() && !is_next(c))
-    {
+    if (*c != BACKSLASH) {
+      result += *c;
       scanner->pop();
     }
-    else {
-      break;
+    else if (raw) {
+      result += BACKSLASH;
+      scanner->pop();
+      if (!scanner->current_char()) {
+        return false;
+      }
+      result += *scanner->current_char();
+      scanner->pop();
+    }
+    else if (!unescape(result)) {
+      return false;
+    }
+  }
+}
+
+bool Tokenizer::unescape(std::string& result) {
+  position pos = scanner->position();
+  scanner->pop();
+  if (!scanner->current_char()) {
+    return false;
+  }
+
+  char c = *scanner->current_char();
+  scanner->pop();
+
+  switch (c) {
+    case 'n': result += '\n'; return true;
+    case 't': result += '\t'; return true;
+    case 'r': result += '\r'; return true;
+    case 'b': result += '\b'; return true;
+    case 'f': result += '\f'; return true;
+    case '"': result += '"'; return true;
+    case '\\': result += '\\'; return true;
+    case 'u': break;
+    default:
+      fail(std::string("Unsupported escape \\") + c, pos, TokenType::String);
+      return false;
+  }
+
+  auto hex = [this](uint32_t& unit) {
+    unit = 0;
+    for (int i = 0; i < 4; ++i) {
+      auto c = scanner->current_char();
+      int digit = !c ? -1 : std::isdigit(*c) ? *c - '0' : std::isxdigit(*c) ? std::tolower(*c) - 'a' + 10 : -1;
+      if (digit < 0) {
+        return false;
+      }
+      unit = unit * 16 + digit;
+      scanner->pop();
     }
+    return true;
+  };
+
+  uint32_t code;
+  if (!hex(code)) {
+    fail("Invalid unicode escape", pos, TokenType::String);
+    return false;
   }
 
-  if (!scanner->next_char()) {
-    throw ReaderException("Unexpected stream end");
+  // a surrogate pair is one code point, a lone surrogate is not a character.
+  if (code >= 0xD800 && code < 0xDC00) {
+    uint32_t low;
+    if (scanner->current_char() != BACKSLASH || scanner->next_char() != 'u') {
+      fail("Invalid unicode escape", pos, TokenType::String);
+      return false;
+    }
+    scanner->pop();
+    scanner->pop();
+    if (!hex(low) || low < 0xDC00 || low >= 0xE000) {
+      fail("Invalid unicode escape", pos, TokenType::String);
+      return false;
+    }
+    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+  }
+  else if (code >= 0xDC00 && code < 0xE000) {
+    fail("Invalid unicode escape", pos, TokenType::String);
+    return false;
   }
 
-  return result;
+  append_utf8(result, code);
+  return true;
+}
+
+Token Tokenizer::fail(const std::string& message, position pos, TokenType expected) {
+  m_failed = true;
+  m_error = Diagnostic{message, pos, expected};
+
+  // input that ended early because it could not be read is reported as that.
+  std::string cause;
+  position where;
+  if (!scanner->current_char() && scanner->error(cause, where)) {
+    m_error = Diagnostic{cause, where, TokenType::EndOfFile};
+  }
+
+  // skip the rest, the input can not be tokenized reliably after this.
+  while (scanner->current_char()) {
+    scanner->pop();
+  }
+
+  return m_end;
+}
+
+void Tokenizer::reset() {
+  ready = false;
+  m_failed = false;
+  validated = false;
+  m_error = Diagnostic();
+  current = Token(m_end);
 }
 
 void Tokenizer::flush_line() {
@@ -98,12 +252,32 @@ void Tokenizer::flush_line() {
 }
 
 Token Tokenizer::next() {
+  PUNCH_STAT_TIMER(timer, stats::Stage::Tokenizer);
+
+  Token token = scan();
+  PUNCH_STAT(stats::local().tokens[static_cast<size_t>(token.type)]++);
+
+  return token;
+}
+
+Token Tokenizer::scan() {
 
   ready = false;
 
-  if (!scanner->current_char()) {
+  if (m_failed) {
     return m_end;
   }
+  if (!scanner->current_char()) {
+    return end();
+  }
+
+  if (!validated) {
+    validated = true;
+    position where;
+    if (!scanner->validate(where)) {
+      return fail("Invalid UTF-8", where, TokenType::EndOfFile);
+    }
+  }
 
   while (scanner->current_char()) {
     char c = *scanner->current_char();
@@ -111,8 +285,11 @@ Token Tokenizer::next() {
     if (c == DOUBLE_QUOTE) {
       position pos = scanner->position();
       scanner->pop();
-      ret(Token::String(slurp_until(DOUBLE_QUOTE), pos));
-      scanner->pop();
+      text.clear();
+      if (!slurp_string(text, false)) {
+        return m_failed ? m_end : fail("Unexpected stream end", pos, TokenType::String);
+      }
+      ret(Token::String(text, pos));
     }
     else if (c == SEMICOLON || (c == DISPATCH && is_next(BANG))) {
       flush_line();
@@ -124,7 +301,7 @@ Token Tokenizer::next() {
     else if (c == BACKSLASH) {
       position pos = scanner->position();
       scanner->pop();
-      ret(Token::Char(slurp_until({whitespace, delimiters}), pos));
+      ret(Token::Char(slurp_until(atom_end), pos));
     }
     else if (c == DISPATCH && is_next(CURLY_OPEN)) {
       ret(Token::SetOpen(scanner->position()));
@@ -138,13 +315,16 @@ Token Tokenizer::next() {
       position pos = scanner->position();
       scanner->pop();
       scanner->pop();
-      ret(Token::Regex(slurp_until(DOUBLE_QUOTE), pos));
-      scanner->pop();
+      text.clear();
+      if (!slurp_string(text, true)) {
+        return fail("Unexpected stream end", pos, TokenType::Regex);
+      }
+      ret(Token::Regex(text, pos));
     }
     else if (c == DISPATCH) {
       position pos = scanner->position();
       scanner->pop();
-      ret(Token::Dispatch(slurp_until({whitespace, delimiters}), pos));
+      ret(Token::Dispatch(slurp_until(atom_end), pos));
     }
     else if (c == ROUND_OPEN) {
       ret(Token::RoundOpen(scanner->position()));
@@ -166,7 +346,7 @@ Token Tokenizer::next() {
     }
     else {
       position pos = scanner->position();
-      ret(Token::Literal(slurp_until({whitespace, delimiters}), pos));
+      ret(Token::Literal(slurp_until(atom_end), pos));
     }
 
     scanner->pop();
@@ -178,9 +358,19 @@ Token Tokenizer::next() {
   }
 
   if (ready) {
-    return current;
+    return std::move(current);
   }
   else {
-    return m_end;
+    return end();
   }
 }
+
+Token Tokenizer::end() {
+  std::string message;
+  position where;
+  if (!m_failed && scanner->error(message, where)) {
+    return fail(message, where, TokenType::EndOfFile);
+  }
+
+  return m_end;
+}
@@ -0,0 +1,190 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <trace.hpp>
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <mutex>
+#include <vector>
+
+namespace trace {
+
+  std::atomic<bool> enabled(false);
+  std::atomic<bool> forms(false);
+
+  namespace {
+
+  struct Collected {
+    std::mutex mutex;
+    std::vector<std::pair<unsigned, std::vector<Event>>> events;
+    std::map<unsigned, std::string> thread_names;
+    uint64_t epoch = now();
+  };
+
+  // never destroyed, threads may still flush while the process exits.
+  Collected& collected() {
+    static Collected* c = new Collected();
+    return *c;
+  }
+
+  std::atomic<unsigned> next_tid(1);
+
+  struct Buffer {
+    unsigned tid = next_tid++;
+    std::vector<Event> events;
+
+    void flush() {
+      if (!events.empty()) {
+        Collected& c = collected();
+        std::lock_guard<std::mutex> lock(c.mutex);
+        c.events.push_back(std::make_pair(tid, std::move(events)));
+        events.clear();
+      }
+    }
+
+    ~Buffer() {
+      flush();
+    }
+  };
+
+  thread_local Buffer buffer;
+
+  void escape(std::string& out, const std::string& s) {
+    for (auto it = s.begin(); it != s.end(); ++it) {
+      unsigned char c = static_cast<unsigned char>(*it);
+      if (c == '"' || c == '\\') {
+        out.push_back('\\');
+        out.push_back(*it);
+      }
+      else if (c < 0x20) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+        out.append(buf);
+      }
+      else {
+        out.push_back(*it);
+      }
+    }
+  }
+
+  void append_event(std::string& out, unsigned tid, const Event& e, uint64_t epoch) {
+    char buf[160];
+    // timestamps are microseconds, the fraction keeps nanosecond resolution.
+    std::snprintf(buf, sizeof(buf), "{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":\"",
+                  tid, e.start > epoch ? (e.start - epoch) / 1e3 : 0.0, e.duration / 1e3);
+    out.append(buf);
+    out.append(e.name);
+    out.append("\",\"cat\":\"");
+    out.append(e.category);
+    out.append("\"");
+
+    if (e.arg_names[0] != nullptr || e.text_name != nullptr) {
+      out.append(",\"args\":{");
+      bool first = true;
+      for (size_t i = 0; i < 2 && e.arg_names[i] != nullptr; ++i) {
+        std::snprintf(buf, sizeof(buf), "%s\"%s\":%lld", first ? "" : ",", e.arg_names[i],
+                      static_cast<long long>(e.args[i]));
+        out.append(buf);
+        first = false;
+      }
+      if (e.text_name != nullptr) {
+        out.append(first ? "\"" : ",\"");
+        out.append(e.text_name);
+        out.append("\":\"");
+        escape(out, e.text);
+        out.append("\"");
+      }
+      out.append("}");
+    }
+
+    out.append("}");
+  }
+
+  }
+
+  void enable(bool on, bool with_forms) {
+    if (on && !is_enabled()) {
+      Collected& c = collected();
+      std::lock_guard<std::mutex> lock(c.mutex);
+      c.epoch = now();
+    }
+    forms.store(on && with_forms, std::memory_order_relaxed);
+    enabled.store(on, std::memory_order_relaxed);
+  }
+
+  void set_thread_name(const std::string& name) {
+    Collected& c = collected();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    c.thread_names[buffer.tid] = name;
+  }
+
+  void record(Event&& event) {
+    buffer.events.push_back(std::move(event));
+  }
+
+  void flush() {
+    buffer.flush();
+  }
+
+  void write_json(std::ostream& os) {
+    flush();
+
+    Collected& c = collected();
+    std::lock_guard<std::mutex> lock(c.mutex);
+
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+
+    for (auto it = c.thread_names.begin(); it != c.thread_names.end(); ++it) {
+      char buf[96];
+      std::snprintf(buf, sizeof(buf), "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"",
+                    first ? "" : ",\n", it->first);
+      out.append(buf);
+      escape(out, it->second);
+      out.append("\"}}");
+      first = false;
+    }
+
+    for (auto chunk = c.events.begin(); chunk != c.events.end(); ++chunk) {
+      for (auto it = chunk->second.begin(); it != chunk->second.end(); ++it) {
+        if (!first) {
+          out.append(",\n");
+        }
+        append_event(out, chunk->first, *it, c.epoch);
+        first = false;
+
+        if (out.size() > (1 << 16)) {
+          os.write(out.data(), out.size());
+          out.clear();
+        }
+      }
+    }
+
+    out.append("\n]}\n");
+    os.write(out.data(), out.size());
+  }
+
+  std::string to_json() {
+    std::ostringstream os;
+    write_json(os);
+    return os.str();
+  }
+
+  void reset() {
+    buffer.events.clear();
+
+    Collected& c = collected();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    c.events.clear();
+    c.thread_names.clear();
+    c.epoch = now();
+  }
+}
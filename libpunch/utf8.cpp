@@ -0,0 +1,121 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <utf8.hpp>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+  // bytes in the sequence at p when it is valid UTF-8, 0 when it is not; n bytes are left.
+  size_t sequence(const unsigned char* p, size_t n) {
+    unsigned char c = p[0];
+    size_t length;
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+
+    if (c < 0x80) {
+      return 1;
+    }
+    else if (c >= 0xC2 && c <= 0xDF) {
+      length = 2;
+    }
+    else if (c >= 0xE0 && c <= 0xEF) {
+      length = 3;
+      // no overlong forms and no surrogates.
+      low = c == 0xE0 ? 0xA0 : 0x80;
+      high = c == 0xED ? 0x9F : 0xBF;
+    }
+    else if (c >= 0xF0 && c <= 0xF4) {
+      length = 4;
+      // no overlong forms and nothing past U+10FFFF.
+      low = c == 0xF0 ? 0x90 : 0x80;
+      high = c == 0xF4 ? 0x8F : 0xBF;
+    }
+    else {
+      return 0;
+    }
+
+    if (n < length || p[1] < low || p[1] > high) {
+      return 0;
+    }
+    for (size_t i = 2; i < length; ++i) {
+      if (p[i] < 0x80 || p[i] > 0xBF) {
+        return 0;
+      }
+    }
+    return length;
+  }
+}
+
+size_t utf8::validate(const char* data, size_t size) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  size_t i = 0;
+
+  while (i < size) {
+#ifdef __SSE2__
+    int mask = 0;
+    for (; i + 16 <= size; i += 16) {
+      mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+      if (mask != 0) {
+        break;
+      }
+    }
+    if (mask != 0) {
+      i += __builtin_ctz(mask);
+    }
+#endif
+    // the rest of the input, or the multibyte run that stopped the fast path, one sequence at a time.
+    while (i < size) {
+      size_t n = sequence(bytes + i, size - i);
+      if (n == 0) {
+        return i;
+      }
+      i += n;
+#ifdef __SSE2__
+      if (n == 1 && i + 16 <= size) {
+        break;
+      }
+#endif
+    }
+  }
+
+  return size;
+}
+
+size_t utf8::code_points(const char* data, size_t size) {
+  size_t continuations = 0;
+  size_t i = 0;
+#ifdef __SSE2__
+  // continuation bytes are 0x80 to 0xBF, which are the signed bytes below -64.
+  const __m128i limit = _mm_set1_epi8(-64);
+  for (; i + 16 <= size; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    continuations += __builtin_popcount(_mm_movemask_epi8(_mm_cmplt_epi8(chunk, limit)));
+  }
+#endif
+  for (; i < size; ++i) {
+    continuations += is_continuation(data[i]);
+  }
+  return size - continuations;
+}
+
+void utf8::advance(const char* data, size_t size, unsigned& line, unsigned& column) {
+  const char* end = data + size;
+  const char* start = nullptr;
+  for (const char* p = data; (p = static_cast<const char*>(std::memchr(p, '\n', end - p))); ++p) {
+    ++line;
+    start = p + 1;
+  }
+
+  column = start ? 1 + code_points(start, end - start) : column + code_points(data, size);
+}
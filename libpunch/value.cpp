@@ -0,0 +1,1145 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <value.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace eval {
+
+  namespace {
+
+  const std::vector<Value> no_items;
+
+  EvalError type_error(const char* what, const Value& v) {
+    return EvalError(std::string(what) + ", got " + type_name(v.type()));
+  }
+
+  void numbers(const char* op, const Value& a, const Value& b) {
+    if (!a.is_number() || !b.is_number()) {
+      throw EvalError(std::string("Cannot ") + op + " " + type_name(a.type()) + " and " + type_name(b.type()));
+    }
+  }
+
+  long integer_of(const Value& v) {
+    if (v.type() != Type::Integer) {
+      throw type_error("Expected an integer", v);
+    }
+    return v.as_integer();
+  }
+
+  double number_of(const Value& v) {
+    if (!v.is_number()) {
+      throw type_error("Expected a number", v);
+    }
+    return v.to_double();
+  }
+
+  const std::string& text_of(const Value& v) {
+    if (v.type() != Type::String && v.type() != Type::Keyword && v.type() != Type::Symbol) {
+      throw type_error("Expected a string", v);
+    }
+    return v.as<Text>().value;
+  }
+
+  void append_double(std::string& out, double v) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%.17g", v);
+    out.append(buf, n);
+
+    // without a dot or exponent it would read back as an integer.
+    if (!std::strpbrk(buf, ".eEn")) {
+      out.append(".0");
+    }
+  }
+
+  // calls f with every item of v; the entries of maps as [key value] vectors.
+  template <class F>
+  void each(const Value& v, F f) {
+    if (v.type() == Type::Map) {
+      for (auto& e : v.as<Mapping>().entries) {
+        f(sequence(Type::Vector, {e.first, e.second}));
+      }
+      return;
+    }
+
+    for (auto& item : items(v)) {
+      f(item);
+    }
+  }
+
+  std::vector<Value> collect(const Value& v) {
+    std::vector<Value> out;
+    each(v, [&out](const Value& item) {
+      out.push_back(item);
+    });
+    return out;
+  }
+
+  Value list(std::vector<Value> items) {
+    return sequence(Type::List, std::move(items));
+  }
+
+  bool contains(const std::vector<Value>& items, const Value& v) {
+    for (auto& item : items) {
+      if (equal(item, v)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  Value get(const Value& coll, const Value& key, const Value& otherwise) {
+    switch (coll.type()) {
+      case Type::Map: {
+        const Value* found = coll.as<Mapping>().find(key);
+        return found ? *found : otherwise;
+      }
+      case Type::Vector:
+        if (key.type() == Type::Integer && key.as_integer() >= 0 &&
+            static_cast<size_t>(key.as_integer()) < coll.as<Sequence>().items.size()) {
+          return coll.as<Sequence>().items[key.as_integer()];
+        }
+        return otherwise;
+      case Type::Set:
+        return contains(coll.as<Sequence>().items, key) ? key : otherwise;
+      default:
+        return otherwise;
+    }
+  }
+
+  Value assoc(const Value& coll, const Value& key, const Value& v) {
+    if (coll.type() == Type::Vector) {
+      long i = integer_of(key);
+      std::vector<Value> items = coll.as<Sequence>().items;
+      if (i < 0 || static_cast<size_t>(i) > items.size()) {
+        throw EvalError("Index out of bounds");
+      }
+      if (static_cast<size_t>(i) == items.size()) {
+        items.push_back(v);
+      }
+      else {
+        items[i] = v;
+      }
+      return sequence(Type::Vector, std::move(items));
+    }
+
+    std::vector<std::pair<Value, Value>> entries;
+    if (coll.type() == Type::Map) {
+      entries = coll.as<Mapping>().entries;
+    }
+    else if (!coll.is_nil()) {
+      throw type_error("Expected a map or vector", coll);
+    }
+
+    for (auto& e : entries) {
+      if (equal(e.first, key)) {
+        e.second = v;
+        return map(std::move(entries));
+      }
+    }
+    entries.emplace_back(key, v);
+    return map(std::move(entries));
+  }
+
+  Value conj(const Value& coll, const Value& v) {
+    switch (coll.type()) {
+      case Type::Nil:
+        return list({v});
+      case Type::List: {
+        std::vector<Value> items;
+        items.reserve(coll.as<Sequence>().items.size() + 1);
+        items.push_back(v);
+        items.insert(items.end(), coll.as<Sequence>().items.begin(), coll.as<Sequence>().items.end());
+        return list(std::move(items));
+      }
+      case Type::Vector: {
+        std::vector<Value> items = coll.as<Sequence>().items;
+        items.push_back(v);
+        return sequence(Type::Vector, std::move(items));
+      }
+      case Type::Set: {
+        if (contains(coll.as<Sequence>().items, v)) {
+          return coll;
+        }
+        std::vector<Value> items = coll.as<Sequence>().items;
+        items.push_back(v);
+        return sequence(Type::Set, std::move(items));
+      }
+      case Type::Map: {
+        auto& entry = items(v);
+        if (v.type() != Type::Vector || entry.size() != 2) {
+          throw EvalError("A map takes [key value] vectors");
+        }
+        return assoc(coll, entry[0], entry[1]);
+      }
+      default:
+        throw type_error("Expected a collection", coll);
+    }
+  }
+
+  Value core_add(const Value* args, size_t argc) {
+    Value r = Value::integer(0);
+    for (size_t i = 0; i < argc; ++i) {
+      r = add(r, args[i]);
+    }
+    return r;
+  }
+
+  Value core_multiply(const Value* args, size_t argc) {
+    Value r = Value::integer(1);
+    for (size_t i = 0; i < argc; ++i) {
+      r = multiply(r, args[i]);
+    }
+    return r;
+  }
+
+  Value core_subtract(const Value* args, size_t argc) {
+    if (argc == 1) {
+      return subtract(Value::integer(0), args[0]);
+    }
+    Value r = args[0];
+    for (size_t i = 1; i < argc; ++i) {
+      r = subtract(r, args[i]);
+    }
+    return r;
+  }
+
+  Value core_divide(const Value* args, size_t argc) {
+    if (argc == 1) {
+      return divide(Value::integer(1), args[0]);
+    }
+    Value r = args[0];
+    for (size_t i = 1; i < argc; ++i) {
+      r = divide(r, args[i]);
+    }
+    return r;
+  }
+
+  template <bool (*Holds)(int)>
+  Value core_compare(const Value* args, size_t argc) {
+    if (argc == 1) {
+      number_of(args[0]);
+    }
+    for (size_t i = 1; i < argc; ++i) {
+      if (!Holds(compare(args[i - 1], args[i]))) {
+        return Value::boolean(false);
+      }
+    }
+    return Value::boolean(true);
+  }
+
+  bool less(int c) { return c < 0; }
+  bool greater(int c) { return c > 0; }
+  bool less_equal(int c) { return c <= 0; }
+  bool greater_equal(int c) { return c >= 0; }
+
+  Value core_equal(const Value* args, size_t argc) {
+    for (size_t i = 1; i < argc; ++i) {
+      if (!equal(args[0], args[i])) {
+        return Value::boolean(false);
+      }
+    }
+    return Value::boolean(true);
+  }
+
+  Value core_not_equal(const Value* args, size_t argc) {
+    return Value::boolean(!core_equal(args, argc).as_boolean());
+  }
+
+  Value core_inc(const Value* args, size_t) {
+    return add(args[0], Value::integer(1));
+  }
+
+  Value core_dec(const Value* args, size_t) {
+    return subtract(args[0], Value::integer(1));
+  }
+
+  Value core_mod(const Value* args, size_t) {
+    long a = integer_of(args[0]);
+    long b = integer_of(args[1]);
+    if (b == 0) {
+      throw EvalError("Divide by zero");
+    }
+    long m = a % b;
+    return Value::integer(m != 0 && (m < 0) != (b < 0) ? m + b : m);
+  }
+
+  Value core_rem(const Value* args, size_t) {
+    long b = integer_of(args[1]);
+    if (b == 0) {
+      throw EvalError("Divide by zero");
+    }
+    return Value::integer(integer_of(args[0]) % b);
+  }
+
+  Value core_quot(const Value* args, size_t) {
+    long b = integer_of(args[1]);
+    if (b == 0) {
+      throw EvalError("Divide by zero");
+    }
+    return Value::integer(integer_of(args[0]) / b);
+  }
+
+  Value core_min(const Value* args, size_t argc) {
+    Value r = args[0];
+    for (size_t i = 1; i < argc; ++i) {
+      if (compare(args[i], r) < 0) {
+        r = args[i];
+      }
+    }
+    return r;
+  }
+
+  Value core_max(const Value* args, size_t argc) {
+    Value r = args[0];
+    for (size_t i = 1; i < argc; ++i) {
+      if (compare(args[i], r) > 0) {
+        r = args[i];
+      }
+    }
+    return r;
+  }
+
+  Value core_abs(const Value* args, size_t) {
+    if (args[0].type() == Type::Integer) {
+      return Value::integer(args[0].as_integer() < 0 ? -args[0].as_integer() : args[0].as_integer());
+    }
+    return Value::floating(std::fabs(number_of(args[0])));
+  }
+
+  Value core_sqrt(const Value* args, size_t) {
+    return Value::floating(std::sqrt(number_of(args[0])));
+  }
+
+  Value core_double(const Value* args, size_t) {
+    return Value::floating(number_of(args[0]));
+  }
+
+  Value core_int(const Value* args, size_t) {
+    return Value::integer(static_cast<long>(number_of(args[0])));
+  }
+
+  Value core_not(const Value* args, size_t) {
+    return Value::boolean(!args[0].truthy());
+  }
+
+  Value core_is_nil(const Value* args, size_t) {
+    return Value::boolean(args[0].is_nil());
+  }
+
+  Value core_is_zero(const Value* args, size_t) {
+    return Value::boolean(number_of(args[0]) == 0);
+  }
+
+  Value core_is_pos(const Value* args, size_t) {
+    return Value::boolean(number_of(args[0]) > 0);
+  }
+
+  Value core_is_neg(const Value* args, size_t) {
+    return Value::boolean(number_of(args[0]) < 0);
+  }
+
+  Value core_is_even(const Value* args, size_t) {
+    return Value::boolean(integer_of(args[0]) % 2 == 0);
+  }
+
+  Value core_is_odd(const Value* args, size_t) {
+    return Value::boolean(integer_of(args[0]) % 2 != 0);
+  }
+
+  Value core_is_empty(const Value* args, size_t) {
+    if (args[0].type() == Type::Map) {
+      return Value::boolean(args[0].as<Mapping>().entries.empty());
+    }
+    return Value::boolean(items(args[0]).empty());
+  }
+
+  Value core_count(const Value* args, size_t) {
+    switch (args[0].type()) {
+      case Type::Map:
+        return Value::integer(static_cast<long>(args[0].as<Mapping>().entries.size()));
+      case Type::String:
+        return Value::integer(static_cast<long>(args[0].as<Text>().value.size()));
+      default:
+        return Value::integer(static_cast<long>(items(args[0]).size()));
+    }
+  }
+
+  Value core_first(const Value* args, size_t) {
+    if (args[0].type() == Type::Map) {
+      auto& entries = args[0].as<Mapping>().entries;
+      return entries.empty() ? Value() : sequence(Type::Vector, {entries[0].first, entries[0].second});
+    }
+    auto& all = items(args[0]);
+    return all.empty() ? Value() : all[0];
+  }
+
+  Value core_second(const Value* args, size_t) {
+    auto all = args[0].type() == Type::Map ? collect(args[0]) : items(args[0]);
+    return all.size() < 2 ? Value() : all[1];
+  }
+
+  Value core_last(const Value* args, size_t) {
+    auto all = args[0].type() == Type::Map ? collect(args[0]) : items(args[0]);
+    return all.empty() ? Value() : all.back();
+  }
+
+  Value core_rest(const Value* args, size_t) {
+    auto all = collect(args[0]);
+    if (all.empty()) {
+      return list({});
+    }
+    return list(std::vector<Value>(std::make_move_iterator(all.begin() + 1), std::make_move_iterator(all.end())));
+  }
+
+  Value core_next(const Value* args, size_t argc) {
+    Value r = core_rest(args, argc);
+    return items(r).empty() ? Value() : r;
+  }
+
+  Value core_nth(const Value* args, size_t argc) {
+    auto& all = items(args[0]);
+    long i = integer_of(args[1]);
+    if (i >= 0 && static_cast<size_t>(i) < all.size()) {
+      return all[i];
+    }
+    if (argc == 3) {
+      return args[2];
+    }
+    throw EvalError("Index out of bounds");
+  }
+
+  Value core_get(const Value* args, size_t argc) {
+    return get(args[0], args[1], argc == 3 ? args[2] : Value());
+  }
+
+  Value core_contains(const Value* args, size_t) {
+    switch (args[0].type()) {
+      case Type::Map:
+        return Value::boolean(args[0].as<Mapping>().find(args[1]) != nullptr);
+      case Type::Set:
+        return Value::boolean(contains(args[0].as<Sequence>().items, args[1]));
+      case Type::Vector:
+        return Value::boolean(args[1].type() == Type::Integer && args[1].as_integer() >= 0 &&
+                              static_cast<size_t>(args[1].as_integer()) < items(args[0]).size());
+      default:
+        return Value::boolean(false);
+    }
+  }
+
+  Value core_assoc(const Value* args, size_t argc) {
+    if (argc % 2 == 0) {
+      throw EvalError("assoc takes key value pairs");
+    }
+    Value r = args[0];
+    for (size_t i = 1; i < argc; i += 2) {
+      r = assoc(r, args[i], args[i + 1]);
+    }
+    return r;
+  }
+
+  Value core_dissoc(const Value* args, size_t argc) {
+    if (args[0].is_nil()) {
+      return Value();
+    }
+    if (args[0].type() != Type::Map) {
+      throw type_error("Expected a map", args[0]);
+    }
+    std::vector<std::pair<Value, Value>> entries;
+    for (auto& e : args[0].as<Mapping>().entries) {
+      bool removed = false;
+      for (size_t i = 1; i < argc && !removed; ++i) {
+        removed = equal(e.first, args[i]);
+      }
+      if (!removed) {
+        entries.push_back(e);
+      }
+    }
+    return map(std::move(entries));
+  }
+
+  Value core_conj(const Value* args, size_t argc) {
+    Value r = args[0];
+    for (size_t i = 1; i < argc; ++i) {
+      r = conj(r, args[i]);
+    }
+    return r;
+  }
+
+  Value core_cons(const Value* args, size_t) {
+    std::vector<Value> all{args[0]};
+    each(args[1], [&all](const Value& v) {
+      all.push_back(v);
+    });
+    return list(std::move(all));
+  }
+
+  Value core_list(const Value* args, size_t argc) {
+    return list(std::vector<Value>(args, args + argc));
+  }
+
+  Value core_vector(const Value* args, size_t argc) {
+    return sequence(Type::Vector, std::vector<Value>(args, args + argc));
+  }
+
+  Value core_hash_map(const Value* args, size_t argc) {
+    if (argc % 2 != 0) {
+      throw EvalError("hash-map takes key value pairs");
+    }
+    Value r = map({});
+    for (size_t i = 0; i < argc; i += 2) {
+      r = assoc(r, args[i], args[i + 1]);
+    }
+    return r;
+  }
+
+  Value core_hash_set(const Value* args, size_t argc) {
+    Value r = sequence(Type::Set, {});
+    for (size_t i = 0; i < argc; ++i) {
+      r = conj(r, args[i]);
+    }
+    return r;
+  }
+
+  Value core_vec(const Value* args, size_t) {
+    return sequence(Type::Vector, collect(args[0]));
+  }
+
+  Value core_keys(const Value* args, size_t) {
+    if (args[0].is_nil()) {
+      return Value();
+    }
+    if (args[0].type() != Type::Map) {
+      throw type_error("Expected a map", args[0]);
+    }
+    std::vector<Value> out;
+    for (auto& e : args[0].as<Mapping>().entries) {
+      out.push_back(e.first);
+    }
+    return list(std::move(out));
+  }
+
+  Value core_vals(const Value* args, size_t) {
+    if (args[0].is_nil()) {
+      return Value();
+    }
+    if (args[0].type() != Type::Map) {
+      throw type_error("Expected a map", args[0]);
+    }
+    std::vector<Value> out;
+    for (auto& e : args[0].as<Mapping>().entries) {
+      out.push_back(e.second);
+    }
+    return list(std::move(out));
+  }
+
+  Value core_range(const Value* args, size_t argc) {
+    long start = argc > 1 ? integer_of(args[0]) : 0;
+    long end = integer_of(args[argc > 1 ? 1 : 0]);
+    long step = argc > 2 ? integer_of(args[2]) : 1;
+    if (step == 0) {
+      throw EvalError("range step is zero");
+    }
+
+    std::vector<Value> out;
+    for (long i = start; step > 0 ? i < end : i > end; i += step) {
+      out.push_back(Value::integer(i));
+    }
+    return list(std::move(out));
+  }
+
+  Value core_concat(const Value* args, size_t argc) {
+    std::vector<Value> out;
+    for (size_t i = 0; i < argc; ++i) {
+      each(args[i], [&out](const Value& v) {
+        out.push_back(v);
+      });
+    }
+    return list(std::move(out));
+  }
+
+  Value core_reverse(const Value* args, size_t) {
+    auto all = collect(args[0]);
+    std::reverse(all.begin(), all.end());
+    return list(std::move(all));
+  }
+
+  Value core_into(const Value* args, size_t) {
+    Value r = args[0];
+    each(args[1], [&r](const Value& v) {
+      r = conj(r, v);
+    });
+    return r;
+  }
+
+  Value core_map(const Value* args, size_t argc) {
+    std::vector<std::vector<Value>> colls;
+    size_t length = SIZE_MAX;
+    for (size_t i = 1; i < argc; ++i) {
+      colls.push_back(collect(args[i]));
+      length = std::min(length, colls.back().size());
+    }
+
+    std::vector<Value> out;
+    out.reserve(length);
+    std::vector<Value> call(colls.size());
+    for (size_t i = 0; i < length; ++i) {
+      for (size_t c = 0; c < colls.size(); ++c) {
+        call[c] = colls[c][i];
+      }
+      out.push_back(invoke(args[0], call.data(), call.size()));
+    }
+    return list(std::move(out));
+  }
+
+  Value core_filter(const Value* args, size_t) {
+    std::vector<Value> out;
+    each(args[1], [&out, args](const Value& v) {
+      if (invoke(args[0], &v, 1).truthy()) {
+        out.push_back(v);
+      }
+    });
+    return list(std::move(out));
+  }
+
+  Value core_reduce(const Value* args, size_t argc) {
+    auto all = collect(args[argc - 1]);
+    size_t i = 0;
+    Value call[2];
+    if (argc == 3) {
+      call[0] = args[1];
+    }
+    else if (all.empty()) {
+      return invoke(args[0], nullptr, 0);
+    }
+    else {
+      call[0] = all[i++];
+    }
+
+    for (; i < all.size(); ++i) {
+      call[1] = all[i];
+      call[0] = invoke(args[0], call, 2);
+    }
+    return call[0];
+  }
+
+  Value core_apply(const Value* args, size_t argc) {
+    std::vector<Value> all(args + 1, args + argc - 1);
+    each(args[argc - 1], [&all](const Value& v) {
+      all.push_back(v);
+    });
+    return invoke(args[0], all.data(), all.size());
+  }
+
+  Value core_identity(const Value* args, size_t) {
+    return args[0];
+  }
+
+  // the text of strings, print of everything else, nil as nothing.
+  void append_str(const Value& v, std::string& out) {
+    if (v.type() == Type::String) {
+      out += v.as<Text>().value;
+    }
+    else if (!v.is_nil()) {
+      print(v, out);
+    }
+  }
+
+  Value core_str(const Value* args, size_t argc) {
+    std::string out;
+    for (size_t i = 0; i < argc; ++i) {
+      append_str(args[i], out);
+    }
+    return string(std::move(out));
+  }
+
+  Value core_println(const Value* args, size_t argc) {
+    std::string out;
+    for (size_t i = 0; i < argc; ++i) {
+      if (i > 0) {
+        out.push_back(' ');
+      }
+      append_str(args[i], out);
+    }
+    out.push_back('\n');
+    std::cout << out;
+    return Value();
+  }
+
+  Value core_keyword(const Value* args, size_t) {
+    return keyword(text_of(args[0]));
+  }
+
+  template <Type T>
+  Value core_is(const Value* args, size_t) {
+    return Value::boolean(args[0].type() == T);
+  }
+
+  Value core_is_number(const Value* args, size_t) {
+    return Value::boolean(args[0].is_number());
+  }
+
+  struct CoreFunction {
+    const char* name;
+    int min;
+    int max;
+    Native::Body body;
+  };
+
+  const CoreFunction core_functions[] = {
+      {"+", 0, -1, core_add},
+      {"-", 1, -1, core_subtract},
+      {"*", 0, -1, core_multiply},
+      {"/", 1, -1, core_divide},
+      {"<", 1, -1, core_compare<less>},
+      {">", 1, -1, core_compare<greater>},
+      {"<=", 1, -1, core_compare<less_equal>},
+      {">=", 1, -1, core_compare<greater_equal>},
+      {"=", 1, -1, core_equal},
+      {"not=", 1, -1, core_not_equal},
+      {"inc", 1, 1, core_inc},
+      {"dec", 1, 1, core_dec},
+      {"mod", 2, 2, core_mod},
+      {"rem", 2, 2, core_rem},
+      {"quot", 2, 2, core_quot},
+      {"min", 1, -1, core_min},
+      {"max", 1, -1, core_max},
+      {"abs", 1, 1, core_abs},
+      {"sqrt", 1, 1, core_sqrt},
+      {"double", 1, 1, core_double},
+      {"int", 1, 1, core_int},
+      {"not", 1, 1, core_not},
+      {"nil?", 1, 1, core_is_nil},
+      {"zero?", 1, 1, core_is_zero},
+      {"pos?", 1, 1, core_is_pos},
+      {"neg?", 1, 1, core_is_neg},
+      {"even?", 1, 1, core_is_even},
+      {"odd?", 1, 1, core_is_odd},
+      {"empty?", 1, 1, core_is_empty},
+      {"number?", 1, 1, core_is_number},
+      {"string?", 1, 1, core_is<Type::String>},
+      {"keyword?", 1, 1, core_is<Type::Keyword>},
+      {"vector?", 1, 1, core_is<Type::Vector>},
+      {"map?", 1, 1, core_is<Type::Map>},
+      {"fn?", 1, 1, core_is<Type::Function>},
+      {"count", 1, 1, core_count},
+      {"first", 1, 1, core_first},
+      {"second", 1, 1, core_second},
+      {"last", 1, 1, core_last},
+      {"rest", 1, 1, core_rest},
+      {"next", 1, 1, core_next},
+      {"nth", 2, 3, core_nth},
+      {"get", 2, 3, core_get},
+      {"contains?", 2, 2, core_contains},
+      {"assoc", 3, -1, core_assoc},
+      {"dissoc", 1, -1, core_dissoc},
+      {"conj", 1, -1, core_conj},
+      {"cons", 2, 2, core_cons},
+      {"list", 0, -1, core_list},
+      {"vector", 0, -1, core_vector},
+      {"hash-map", 0, -1, core_hash_map},
+      {"hash-set", 0, -1, core_hash_set},
+      {"vec", 1, 1, core_vec},
+      {"keys", 1, 1, core_keys},
+      {"vals", 1, 1, core_vals},
+      {"range", 1, 3, core_range},
+      {"concat", 0, -1, core_concat},
+      {"reverse", 1, 1, core_reverse},
+      {"into", 2, 2, core_into},
+      {"map", 2, -1, core_map},
+      {"filter", 2, 2, core_filter},
+      {"reduce", 2, 3, core_reduce},
+      {"apply", 2, -1, core_apply},
+      {"identity", 1, 1, core_identity},
+      {"str", 0, -1, core_str},
+      {"println", 0, -1, core_println},
+      {"keyword", 1, 1, core_keyword},
+  };
+
+  }
+
+  const Value* Mapping::find(const Value& key) const {
+    for (auto& e : entries) {
+      if (equal(e.first, key)) {
+        return &e.second;
+      }
+    }
+    return nullptr;
+  }
+
+  Value Native::call(const Value* args, size_t argc) {
+    if (argc < static_cast<size_t>(min) || (max >= 0 && argc > static_cast<size_t>(max))) {
+      throw EvalError("Wrong number of args (" + std::to_string(argc) + ") passed to " + name);
+    }
+    return body(args, argc);
+  }
+
+  Value keyword(std::string name) {
+    return Value(Type::Keyword, new Text(std::move(name)));
+  }
+
+  Value symbol(std::string name) {
+    return Value(Type::Symbol, new Text(std::move(name)));
+  }
+
+  Value string(std::string value) {
+    return Value(Type::String, new Text(std::move(value)));
+  }
+
+  Value sequence(Type type, std::vector<Value> items) {
+    return Value(type, new Sequence(std::move(items)));
+  }
+
+  Value map(std::vector<std::pair<Value, Value>> entries) {
+    return Value(Type::Map, new Mapping(std::move(entries)));
+  }
+
+  const std::vector<Value>& items(const Value& v) {
+    switch (v.type()) {
+      case Type::Nil:
+        return no_items;
+      case Type::List:
+      case Type::Vector:
+      case Type::Set:
+        return v.as<Sequence>().items;
+      default:
+        throw type_error("Expected a sequence", v);
+    }
+  }
+
+  Value from_expression(const Expression& e) {
+    switch (e.type()) {
+      case ExpressionType::Keyword:
+        return keyword(static_cast<const expression::Keyword&>(e).value());
+      case ExpressionType::Integer:
+        return Value::integer(static_cast<const expression::Integer&>(e).value());
+      case ExpressionType::Float:
+        return Value::floating(static_cast<const expression::Float&>(e).value());
+      case ExpressionType::Ratio: {
+        auto& ratio = static_cast<const expression::Ratio&>(e);
+        return Value::floating(static_cast<double>(ratio.numerator()) / ratio.denominator());
+      }
+      case ExpressionType::Literal: {
+        auto& value = static_cast<const expression::Literal&>(e).value();
+        if (value == "nil") {
+          return Value();
+        }
+        if (value == "true" || value == "false") {
+          return Value::boolean(value == "true");
+        }
+        return symbol(value);
+      }
+      case ExpressionType::String:
+        return string(static_cast<const expression::String&>(e).value());
+      case ExpressionType::List:
+      case ExpressionType::Vector:
+      case ExpressionType::Set: {
+        auto& inner = e.type() == ExpressionType::List ? static_cast<const expression::List&>(e).inner()
+            : e.type() == ExpressionType::Vector ? static_cast<const expression::Vector&>(e).inner()
+            : static_cast<const expression::Set&>(e).inner();
+        std::vector<Value> out;
+        for (auto& item : inner) {
+          Value v = from_expression(*item);
+          if (e.type() != ExpressionType::Set || !contains(out, v)) {
+            out.push_back(std::move(v));
+          }
+        }
+        return sequence(e.type() == ExpressionType::List ? Type::List
+                        : e.type() == ExpressionType::Vector ? Type::Vector : Type::Set, std::move(out));
+      }
+      case ExpressionType::Map: {
+        auto& inner = static_cast<const expression::Map&>(e).inner();
+        Value r = map({});
+        for (auto it = inner.begin(); it != inner.end(); std::advance(it, 2)) {
+          r = assoc(r, from_expression(**it), from_expression(**std::next(it)));
+        }
+        return r;
+      }
+      case ExpressionType::EndOfFile:
+        break;
+    }
+    throw EvalError("Cannot evaluate end of file", e.pos);
+  }
+
+  bool equal(const Value& a, const Value& b) {
+    bool sequential_a = a.type() == Type::List || a.type() == Type::Vector;
+    bool sequential_b = b.type() == Type::List || b.type() == Type::Vector;
+    if (a.type() != b.type() && !(sequential_a && sequential_b)) {
+      return false;
+    }
+
+    switch (a.type()) {
+      case Type::Nil:
+        return true;
+      case Type::Boolean:
+        return a.as_boolean() == b.as_boolean();
+      case Type::Integer:
+        return a.as_integer() == b.as_integer();
+      case Type::Float:
+        return a.as_float() == b.as_float();
+      case Type::Keyword:
+      case Type::Symbol:
+      case Type::String:
+        return a.as<Text>().value == b.as<Text>().value;
+      case Type::List:
+      case Type::Vector: {
+        auto& x = a.as<Sequence>().items;
+        auto& y = b.as<Sequence>().items;
+        if (x.size() != y.size()) {
+          return false;
+        }
+        for (size_t i = 0; i < x.size(); ++i) {
+          if (!equal(x[i], y[i])) {
+            return false;
+          }
+        }
+        return true;
+      }
+      case Type::Set: {
+        auto& x = a.as<Sequence>().items;
+        auto& y = b.as<Sequence>().items;
+        if (x.size() != y.size()) {
+          return false;
+        }
+        for (auto& item : x) {
+          if (!contains(y, item)) {
+            return false;
+          }
+        }
+        return true;
+      }
+      case Type::Map: {
+        auto& x = a.as<Mapping>().entries;
+        if (x.size() != b.as<Mapping>().entries.size()) {
+          return false;
+        }
+        for (auto& e : x) {
+          const Value* found = b.as<Mapping>().find(e.first);
+          if (!found || !equal(e.second, *found)) {
+            return false;
+          }
+        }
+        return true;
+      }
+      case Type::Function:
+        return a.object() == b.object();
+    }
+    return false;
+  }
+
+  std::string print(const Value& v) {
+    std::string out;
+    print(v, out);
+    return out;
+  }
+
+  void print(const Value& v, std::string& out) {
+    switch (v.type()) {
+      case Type::Nil:
+        out += "nil";
+        break;
+      case Type::Boolean:
+        out += v.as_boolean() ? "true" : "false";
+        break;
+      case Type::Integer:
+        out += std::to_string(v.as_integer());
+        break;
+      case Type::Float:
+        append_double(out, v.as_float());
+        break;
+      case Type::Keyword:
+        out.push_back(':');
+        out += v.as<Text>().value;
+        break;
+      case Type::Symbol:
+        out += v.as<Text>().value;
+        break;
+      case Type::String:
+        out.push_back('"');
+        for (char c : v.as<Text>().value) {
+          if (c == '"' || c == '\\') {
+            out.push_back('\\');
+          }
+          out.push_back(c);
+        }
+        out.push_back('"');
+        break;
+      case Type::List:
+      case Type::Vector:
+      case Type::Set: {
+        out += v.type() == Type::List ? "(" : v.type() == Type::Vector ? "[" : "#{";
+        auto& all = v.as<Sequence>().items;
+        for (size_t i = 0; i < all.size(); ++i) {
+          if (i > 0) {
+            out.push_back(' ');
+          }
+          print(all[i], out);
+        }
+        out += v.type() == Type::List ? ")" : v.type() == Type::Vector ? "]" : "}";
+        break;
+      }
+      case Type::Map: {
+        out.push_back('{');
+        auto& entries = v.as<Mapping>().entries;
+        for (size_t i = 0; i < entries.size(); ++i) {
+          if (i > 0) {
+            out.push_back(' ');
+          }
+          print(entries[i].first, out);
+          out.push_back(' ');
+          print(entries[i].second, out);
+        }
+        out.push_back('}');
+        break;
+      }
+      case Type::Function:
+        out += "#<fn " + v.as<Function>().name + ">";
+        break;
+    }
+  }
+
+  const char* type_name(Type type) {
+    switch (type) {
+      case Type::Nil: return "nil";
+      case Type::Boolean: return "boolean";
+      case Type::Integer: return "integer";
+      case Type::Float: return "float";
+      case Type::Keyword: return "keyword";
+      case Type::Symbol: return "symbol";
+      case Type::String: return "string";
+      case Type::List: return "list";
+      case Type::Vector: return "vector";
+      case Type::Map: return "map";
+      case Type::Set: return "set";
+      case Type::Function: return "function";
+    }
+    return "unknown";
+  }
+
+  Value add(const Value& a, const Value& b) {
+    if (a.type() == Type::Integer && b.type() == Type::Integer) {
+      long r;
+      if (__builtin_add_overflow(a.as_integer(), b.as_integer(), &r)) {
+        throw EvalError("Integer overflow");
+      }
+      return Value::integer(r);
+    }
+    numbers("add", a, b);
+    return Value::floating(a.to_double() + b.to_double());
+  }
+
+  Value subtract(const Value& a, const Value& b) {
+    if (a.type() == Type::Integer && b.type() == Type::Integer) {
+      long r;
+      if (__builtin_sub_overflow(a.as_integer(), b.as_integer(), &r)) {
+        throw EvalError("Integer overflow");
+      }
+      return Value::integer(r);
+    }
+    numbers("subtract", a, b);
+    return Value::floating(a.to_double() - b.to_double());
+  }
+
+  Value multiply(const Value& a, const Value& b) {
+    if (a.type() == Type::Integer && b.type() == Type::Integer) {
+      long r;
+      if (__builtin_mul_overflow(a.as_integer(), b.as_integer(), &r)) {
+        throw EvalError("Integer overflow");
+      }
+      return Value::integer(r);
+    }
+    numbers("multiply", a, b);
+    return Value::floating(a.to_double() * b.to_double());
+  }
+
+  Value divide(const Value& a, const Value& b) {
+    numbers("divide", a, b);
+    if (a.type() == Type::Integer && b.type() == Type::Integer) {
+      if (b.as_integer() == 0) {
+        throw EvalError("Divide by zero");
+      }
+      if (b.as_integer() != -1 && a.as_integer() % b.as_integer() == 0) {
+        return Value::integer(a.as_integer() / b.as_integer());
+      }
+    }
+    return Value::floating(a.to_double() / b.to_double());
+  }
+
+  int compare(const Value& a, const Value& b) {
+    if (a.type() == Type::Integer && b.type() == Type::Integer) {
+      return a.as_integer() < b.as_integer() ? -1 : a.as_integer() > b.as_integer() ? 1 : 0;
+    }
+    numbers("compare", a, b);
+    double x = a.to_double();
+    double y = b.to_double();
+    return x < y ? -1 : x > y ? 1 : 0;
+  }
+
+  Value invoke(const Value& f, const Value* args, size_t argc) {
+    switch (f.type()) {
+      case Type::Function:
+        return f.as<Function>().call(args, argc);
+      case Type::Keyword:
+      case Type::Map:
+        if (argc == 1 || argc == 2) {
+          Value otherwise = argc == 2 ? args[1] : Value();
+          return f.type() == Type::Keyword ? get(args[0], f, otherwise) : get(f, args[0], otherwise);
+        }
+        throw EvalError("Wrong number of args (" + std::to_string(argc) + ") passed to " + print(f));
+      default:
+        throw EvalError(std::string("Cannot call ") + type_name(f.type()));
+    }
+  }
+
+  Environment::Environment() {
+    for (auto& f : core_functions) {
+      Value native(Type::Function, new Native(f.name, f.min, f.max, f.body));
+      uint32_t at = slot(f.name);
+      core.resize(at + 1);
+      core[at] = native;
+      set(at, std::move(native));
+    }
+  }
+
+  uint32_t Environment::slot(const std::string& name) {
+    auto found = slots.find(name);
+    if (found != slots.end()) {
+      return found->second;
+    }
+
+    uint32_t at = static_cast<uint32_t>(values.size());
+    values.emplace_back();
+    m_bound.push_back(false);
+    names.push_back(name);
+    slots.emplace(name, at);
+    return at;
+  }
+
+  bool Environment::find(const std::string& name, uint32_t& slot) const {
+    auto found = slots.find(name);
+    if (found == slots.end()) {
+      return false;
+    }
+    slot = found->second;
+    return true;
+  }
+
+  const Value& Environment::lookup(const std::string& name) const {
+    uint32_t at;
+    if (!find(name, at) || !m_bound[at]) {
+      throw EvalError("Unable to resolve symbol: " + name);
+    }
+    return values[at];
+  }
+}
@@ -9,28 +9,88 @@
  *   You must not remove this notice, or any other, from this software.
  */
 
+#include <cctype>
+#include <csignal>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 
 #include <tokenizer.hpp>
 #include <reader.hpp>
+#include <batchreader.hpp>
+#include <compressedscanner.hpp>
+#include <daemon.hpp>
+#include <definitionindex.hpp>
+#include <printer.hpp>
+#include <stats.hpp>
+#include <trace.hpp>
 #include <util.hpp>
 
 namespace po = boost::program_options;
 
+void report(const std::string& file, const std::vector<Diagnostic>& diagnostics) {
+  for (auto it = diagnostics.begin(); it != diagnostics.end(); ++it) {
+    std::cerr << file << ":" << std::get<0>(it->pos) << ":" << std::get<1>(it->pos) << ": error: " << it->message << std::endl;
+  }
+}
+
+// diagnostics of a daemon response come as "line:column: error: message" lines.
+void report(const std::string& file, const std::string& diagnostics) {
+  std::istringstream in(diagnostics);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::cerr << file << (std::isdigit(static_cast<unsigned char>(line[0])) ? ":" : ": error: ") << line << std::endl;
+  }
+}
+
+DaemonServer* running_server = nullptr;
+
+void stop_server(int) {
+  if (running_server) {
+    running_server->stop();
+  }
+}
+
 int main(int argc, char *argv[]) {
 
   boost::filesystem::path exe = argv[0];
   std::string exe_name = exe.stem().string();
 
   std::string input_file;
+  std::string read_root;
+  unsigned jobs = 0;
+  std::string cache_dir;
+  std::string print_format;
+  std::string stats_format = "text";
+  std::string trace_file;
+  std::string serve_socket;
+  std::string query_socket;
+  size_t cache_size = 64;
+  std::string definitions_file;
+  std::string lookup_name;
 
   po::options_description desc("Usage " + exe_name + " [FILE]: \nAllowed options");
   desc.add_options()
       ("help,h", "shows this help")
       ("input-file,f", po::value<std::string>(&input_file), "input file")
+      ("read,r", po::value<std::string>(&read_root), "read all .p files below a directory")
+      ("jobs,j", po::value<unsigned>(&jobs), "number of reader threads, defaults to one per core")
+      ("cache", po::value<std::string>(&cache_dir), "directory for cached binary forms of unchanged files")
+      ("print,p", po::value<std::string>(&print_format), "print the read forms of the input file as 'debug', 'punch' or 'binary'")
+      ("index", "print the position and head of every top-level form of the input file")
+      ("stats", "report reader statistics on stderr")
+      ("stats-format", po::value<std::string>(&stats_format), "statistics as 'text' (default) or 'json'")
+      ("recover", "keep reading after malformed forms and report all of them")
+      ("trace", po::value<std::string>(&trace_file), "write a Chrome trace of the reading pipeline to a json file")
+      ("trace-forms", "add a span for every top-level form to the trace")
+      ("serve", po::value<std::string>(&serve_socket), "answer queries on a unix socket, keeping read files in memory")
+      ("socket", po::value<std::string>(&query_socket), "ask the daemon listening on a unix socket about the input file")
+      ("cache-size", po::value<size_t>(&cache_size), "megabytes of read files the daemon keeps, 64 by default")
+      ("definitions", po::value<std::string>(&definitions_file), "index file of the definitions in the files found with --read, updated for changed files")
+      ("lookup", po::value<std::string>(&lookup_name), "print where a name is defined, from the --definitions index")
       ;
 
   po::positional_options_description p;
@@ -48,15 +108,194 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
-  if (vm.count("input-file")) {
-    Tokenizer tokenizer(make_unique<LineScanner>(input_file));
+  if (vm.count("stats")) {
+#ifdef PUNCH_STATS
+    if (stats_format != "text" && stats_format != "json") {
+      std::cerr << "Unknown stats format " << stats_format << std::endl;
+      return 1;
+    }
+    stats::enable();
+#else
+    std::cerr << "Statistics are not compiled in, rebuild with -DPUNCH_STATS=ON" << std::endl;
+    return 1;
+#endif
+  }
+
+  if (vm.count("trace")) {
+#ifdef PUNCH_TRACE
+    trace::enable(true, vm.count("trace-forms") != 0);
+    trace::set_thread_name("main");
+#else
+    std::cerr << "Tracing is not compiled in, rebuild with -DPUNCH_TRACE=ON" << std::endl;
+    return 1;
+#endif
+  }
+
+  int status = 0;
+
+  if (vm.count("serve")) {
+    FileCache cache(cache_size << 20);
+    try {
+      DaemonServer server(serve_socket, cache);
+      running_server = &server;
+      std::signal(SIGINT, stop_server);
+      std::signal(SIGTERM, stop_server);
+      server.run();
+      running_server = nullptr;
+    }
+    catch (const std::system_error& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+  }
+  else if (vm.count("input-file") && (vm.count("socket") || vm.count("index") || print_format == "binary")) {
+    FileCache::Query query = FileCache::Query::Tokens;
+    if (vm.count("index")) {
+      query = FileCache::Query::Index;
+    }
+    else if (vm.count("print") && (print_format == "tokens" || print_format == "index" ||
+                                   !FileCache::parse(print_format, query))) {
+      std::cerr << "Unknown print format " << print_format << std::endl;
+      return 1;
+    }
+
+    FileCache::Response response;
+    if (vm.count("socket")) {
+      try {
+        response = DaemonClient(query_socket).query(query, input_file);
+      }
+      catch (const std::system_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+      }
+    }
+    else {
+      FileCache cache(0, false);
+      response = cache.get(boost::filesystem::absolute(input_file).string(), query);
+    }
+
+    if (response.ok) {
+      std::cout.write(response.body.data(), response.body.size());
+      std::cout.flush();
+    }
+    else {
+      report(input_file, response.body);
+      status = 1;
+    }
+  }
+  else if (vm.count("definitions") && vm.count("lookup")) {
+    try {
+      DefinitionIndex index(definitions_file);
+      auto entries = index.find(lookup_name);
+      for (size_t i = 0; i < entries.size(); ++i) {
+        auto entry = entries[i];
+        std::cout << entry.path() << ":" << std::get<0>(entry.position()) << ":" << std::get<1>(entry.position())
+                  << ": " << entry.head() << " " << entry.name();
+        for (size_t a = 0; a < entry.arities(); ++a) {
+          std::cout << (a == 0 ? " (" : " ") << entry.arity(a).params << (entry.arity(a).variadic ? "+" : "");
+        }
+        std::cout << (entry.arities() > 0 ? ")\n" : "\n");
+      }
+      status = entries.empty() ? 1 : 0;
+    }
+    catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+  }
+  else if (vm.count("definitions") && vm.count("read")) {
+    try {
+      auto update = update_definition_index(definitions_file, discover_sources(read_root), DefinitionHeads(), jobs);
+      std::cout << update.files << " files, " << update.read << " read, " << update.reused << " unchanged, "
+                << update.failed << " failed, " << update.definitions << " definitions" << std::endl;
+      status = update.failed == 0 ? 0 : 1;
+    }
+    catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+  }
+  else if (vm.count("read")) {
+    std::unique_ptr<FormCache> cache;
+    if (vm.count("cache")) {
+      cache = make_unique<FormCache>(cache_dir);
+    }
+
+    auto results = read_sources(discover_sources(read_root), jobs, cache.get(), vm.count("recover") != 0);
+
+    size_t failed = 0;
+    for (auto it = results.begin(); it != results.end(); ++it) {
+      if (it->ok) {
+        std::cout << it->path << ": " << it->forms.size() << " forms\n";
+      }
+      else if (!it->diagnostics.empty()) {
+        for (auto d = it->diagnostics.begin(); d != it->diagnostics.end(); ++d) {
+          std::cout << it->path << ":" << std::get<0>(d->pos) << ":" << std::get<1>(d->pos) << ": error: " << d->message << "\n";
+        }
+        ++failed;
+      }
+      else {
+        std::cout << it->path << ": error: " << it->error << "\n";
+        ++failed;
+      }
+    }
+
+    std::cout << results.size() << " files, " << failed << " failed" << std::endl;
+    status = failed == 0 ? 0 : 1;
+  }
+  else if (vm.count("input-file") && vm.count("print")) {
+    if (print_format != "debug" && print_format != "punch") {
+      std::cerr << "Unknown print format " << print_format << std::endl;
+      return 1;
+    }
+
+    Printer printer(std::cout, print_format == "debug" ? Printer::Format::Debug : Printer::Format::Punch);
+    Reader reader(make_unique<Tokenizer>(open_scanner(input_file)), vm.count("recover") != 0);
+    PUNCH_TRACE_SPAN(span, "read", "reader");
+
+    auto expr = reader.try_next();
+    while (expr && expr->type() != ExpressionType::EndOfFile) {
+      printer.print(*expr).write('\n');
+      expr = reader.try_next();
+    }
+
+    printer.flush();
+    report(input_file, reader.diagnostics());
+    status = reader.diagnostics().empty() ? 0 : 1;
+  }
+  else if (vm.count("input-file")) {
+    Tokenizer tokenizer(open_scanner(input_file));
+    Printer printer(std::cout);
+    PUNCH_TRACE_SPAN(span, "tokenize", "tokenizer");
 
     auto token = tokenizer.next();
     while (token != Token::EndOfFile) {
-      std::cout << token.DebugInfo() << ", ";
+      printer.print(token).write(", ");
       token = tokenizer.next();
     }
+
+    if (tokenizer.failed()) {
+      printer.flush();
+      report(input_file, std::vector<Diagnostic>{tokenizer.error()});
+      status = 1;
+    }
+  }
+
+  if (stats::is_enabled()) {
+    stats::enable(false);
+    auto s = stats::snapshot();
+    std::cerr << (stats_format == "json" ? stats::to_json(s) + "\n" : stats::to_text(s));
+  }
+
+  if (trace::is_enabled()) {
+    trace::enable(false);
+    std::ofstream out(trace_file, std::ios::out | std::ios::binary | std::ios::trunc);
+    trace::write_json(out);
+    if (!out) {
+      std::cerr << "Could not write trace to " << trace_file << std::endl;
+      status = 1;
+    }
   }
 
-  return 0;
+  return status;
 }
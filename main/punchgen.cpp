@@ -0,0 +1,98 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <boost/program_options.hpp>
+
+#include <generator.hpp>
+
+namespace po = boost::program_options;
+
+uint64_t parse_size(const std::string& s) {
+  size_t end = 0;
+  uint64_t value = std::stoull(s, &end);
+
+  std::string suffix = s.substr(end);
+  if (suffix == "K" || suffix == "k") {
+    return value << 10;
+  }
+  else if (suffix == "M" || suffix == "m") {
+    return value << 20;
+  }
+  else if (suffix == "G" || suffix == "g") {
+    return value << 30;
+  }
+  else if (!suffix.empty()) {
+    throw po::error("Invalid size " + s);
+  }
+
+  return value;
+}
+
+int main(int argc, char *argv[]) {
+
+  GeneratorOptions options;
+  std::string size = "1M";
+  std::string output;
+
+  po::options_description desc("Usage punchgen [OPTIONS]: writes generated punch source\nAllowed options");
+  desc.add_options()
+      ("help,h", "shows this help")
+      ("seed,s", po::value<uint64_t>(&options.seed), "random seed, the same seed gives the same output")
+      ("size,n", po::value<std::string>(&size), "bytes to generate, with an optional K, M or G suffix (1M)")
+      ("output,o", po::value<std::string>(&output), "output file, defaults to stdout")
+      ("nesting", po::value<double>(&options.nesting), "chance that an element is a nested collection (0.25)")
+      ("max-depth", po::value<unsigned>(&options.max_depth), "maximum nesting depth (8)")
+      ("max-width", po::value<unsigned>(&options.max_width), "maximum number of elements in a collection (8)")
+      ("comments", po::value<double>(&options.comments), "chance of a comment at every line break (0.05)")
+      ("line-length", po::value<unsigned>(&options.line_length), "line length before breaking (80)")
+      ("keywords", po::value<unsigned>(&options.atoms.keywords), "weight of keywords (4)")
+      ("symbols", po::value<unsigned>(&options.atoms.symbols), "weight of symbols (6)")
+      ("integers", po::value<unsigned>(&options.atoms.integers), "weight of integers (4)")
+      ("hex-integers", po::value<unsigned>(&options.atoms.hex_integers), "weight of hex integers (1)")
+      ("ratios", po::value<unsigned>(&options.atoms.ratios), "weight of ratios (1)")
+      ("floats", po::value<unsigned>(&options.atoms.floats), "weight of floats (2)")
+      ("strings", po::value<unsigned>(&options.atoms.strings), "weight of strings (2)")
+      ("regexes", po::value<unsigned>(&options.atoms.regexes), "weight of regexes (0)")
+      ("chars", po::value<unsigned>(&options.atoms.chars), "weight of characters (0)")
+      ;
+
+  try {
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+      std::cout << desc << "\n";
+      return 0;
+    }
+
+    options.size = parse_size(size);
+    CorpusGenerator generator(options);
+
+    if (output.empty()) {
+      generator.write(std::cout);
+      std::cout.flush();
+    }
+    else {
+      std::ofstream out(output, std::ios::out | std::ios::binary | std::ios::trunc);
+      generator.write(out);
+    }
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <binding.hpp>
+#include "corpus.hpp"
+
+/*
+ * Getting records into structs: bound from the tokens, against read into
+ * expressions and converted.
+ */
+struct Record {
+  std::string name;
+  long id = 0;
+  double score = 0;
+  std::vector<std::string> tags;
+};
+
+template <>
+struct binding::Schema<Record> {
+  static void describe(binding::Fields<Record>& f) {
+    f.field("name", &Record::name).field("id", &Record::id).field("score", &Record::score).field("tags", &Record::tags);
+  }
+};
+
+static std::string record(size_t i) {
+  return "{:name \"record number " + std::to_string(i) + "\" :id " + std::to_string(i) +
+         " :score 0.75 :tags [\"alpha\" \"beta\" \"gamma\"]}";
+}
+
+static Record convert(const Expression& e) {
+  Record r;
+  auto& inner = static_cast<const Map&>(e).inner();
+  for (auto it = inner.begin(); it != inner.end(); ++it) {
+    auto& key = static_cast<const Keyword&>(**it).value();
+    auto& value = **++it;
+    if (key == "name") {
+      r.name = static_cast<const String&>(value).value();
+    }
+    else if (key == "id") {
+      r.id = static_cast<const Integer&>(value).value();
+    }
+    else if (key == "score") {
+      r.score = static_cast<const Float&>(value).value();
+    }
+    else if (key == "tags") {
+      auto& tags = static_cast<const Vector&>(value).inner();
+      for (auto t = tags.begin(); t != tags.end(); ++t) {
+        r.tags.push_back(static_cast<const String&>(**t).value());
+      }
+    }
+  }
+  return r;
+}
+
+static void RecordsBound(benchmark::State& state) {
+  std::string text = record(state.iterations());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(binding::read<Record>(text));
+  }
+  corpus::report(state, text.size(), state.iterations(), "records/s");
+}
+
+static void RecordsConverted(benchmark::State& state) {
+  std::string text = record(state.iterations());
+  for (auto _ : state) {
+    auto forms = read_forms(text);
+    benchmark::DoNotOptimize(convert(*forms.front()));
+  }
+  corpus::report(state, text.size(), state.iterations(), "records/s");
+}
+
+BENCHMARK(RecordsBound);
+BENCHMARK(RecordsConverted);
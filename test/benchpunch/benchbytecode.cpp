@@ -0,0 +1,55 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <bytecode.hpp>
+#include "corpus.hpp"
+
+/*
+ * Programs run on the bytecode VM once they are compiled: recursive calls,
+ * float arithmetic on values taken out of maps, and collection functions
+ * calling closures.
+ */
+static void run(benchmark::State& state, const char* setup, const char* program, size_t calls) {
+  eval::Environment env;
+  eval::Vm vm(env);
+  vm.eval(setup);
+  auto forms = read_forms(program);
+  auto proto = eval::compile(*forms.front(), env);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(vm.run(*proto));
+  }
+
+  corpus::report(state, 0, state.iterations() * calls, "calls/s");
+}
+
+static void Fib(benchmark::State& state) {
+  // (fib 20) makes 21891 calls.
+  run(state, "(defn fib [n] (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))", "(fib 20)", 21891);
+}
+BENCHMARK(Fib);
+
+static void NBody(benchmark::State& state) {
+  const char* setup =
+      "(defn advance [b dt] {:x (+ (:x b) (* dt (:vx b))) :y (+ (:y b) (* dt (:vy b))) :vx (:vx b) :vy (:vy b)})\n"
+      "(defn energy [bs] (reduce (fn [e b] (+ e (* 0.5 (+ (* (:vx b) (:vx b)) (* (:vy b) (:vy b)))))) 0.0 bs))\n"
+      "(defn step [bs n] (if (= n 0) bs (recur (vec (map (fn [b] (advance b 0.01)) bs)) (dec n))))\n"
+      "(def bodies (vec (map (fn [i] {:x (double i) :y 0.0 :vx 1.5 :vy (- 0.5 i)}) (range 16))))\n";
+
+  // 100 steps of 16 advances and the closures calling them, then 16 energy terms.
+  run(state, setup, "(energy (step bodies 100))", 100 * 16 * 2 + 16);
+}
+BENCHMARK(NBody);
+
+static void Collections(benchmark::State& state) {
+  run(state, "", "(reduce (fn [a b] (+ a b)) 0 (filter (fn [x] (even? x)) (map (fn [x] (* x 3)) (range 1000))))",
+      1000 + 1000 + 500);
+}
+BENCHMARK(Collections);
@@ -0,0 +1,78 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <compressedscanner.hpp>
+#include "corpus.hpp"
+#ifdef PUNCH_ZLIB
+#include <zlib.h>
+#endif
+
+namespace fs = boost::filesystem;
+
+/*
+ * Tokenizing a file read through open_scanner, plain against gzip
+ * compressed. The gzip input is decompressed on the helper thread of
+ * CompressedScanner while it is tokenized.
+ */
+class CompressedFixture {
+public:
+  explicit CompressedFixture(size_t bytes)
+    : directory(fs::temp_directory_path() / fs::unique_path("punch-bench-%%%%-%%%%")),
+      text(corpus::realistic(bytes)) {
+    fs::create_directories(directory);
+    plain = (directory / "corpus.p").string();
+    std::ofstream(plain, std::ios::out | std::ios::binary) << text;
+
+#ifdef PUNCH_ZLIB
+    gzip = (directory / "corpus.p.gz").string();
+    gzFile file = gzopen(gzip.c_str(), "wb");
+    gzwrite(file, text.data(), static_cast<unsigned>(text.size()));
+    gzclose(file);
+#endif
+  }
+
+  ~CompressedFixture() {
+    fs::remove_all(directory);
+  }
+
+  fs::path directory;
+  std::string text;
+  std::string plain;
+  std::string gzip;
+};
+
+static void tokenize(benchmark::State& state, const std::string& text, const std::string& path) {
+  size_t count = 0;
+
+  for (auto _ : state) {
+    Tokenizer tokenizer(open_scanner(path));
+    while (tokenizer.next().type != TokenType::EndOfFile) {
+      ++count;
+    }
+  }
+
+  corpus::report(state, text.size(), count, "tokens/s");
+}
+
+static void TokenizePlainFile(benchmark::State& state) {
+  CompressedFixture fixture(static_cast<size_t>(state.range(0)));
+  tokenize(state, fixture.text, fixture.plain);
+}
+BENCHMARK(TokenizePlainFile)->Arg(1 << 20)->UseRealTime();
+
+#ifdef PUNCH_ZLIB
+static void TokenizeGzipFile(benchmark::State& state) {
+  CompressedFixture fixture(static_cast<size_t>(state.range(0)));
+  tokenize(state, fixture.text, fixture.gzip);
+}
+BENCHMARK(TokenizeGzipFile)->Arg(1 << 20)->UseRealTime();
+#endif
@@ -0,0 +1,40 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#if __cplusplus >= 202002L
+
+#include <constform.hpp>
+#include "corpus.hpp"
+
+/*
+ * Getting at an embedded configuration literal: read at startup, against
+ * read at compile time.
+ */
+#define CONFIG "{:port 8080 :hosts [\"a.example\" \"b.example\"] :timeout 2.5 :retries 3 :ratio 3/4 :tags #{:db :primary}}"
+
+static void EmbeddedRead(benchmark::State& state) {
+  for (auto _ : state) {
+    auto forms = read_forms(CONFIG);
+    auto& map = static_cast<const Map&>(*forms.front());
+    benchmark::DoNotOptimize(static_cast<const Integer&>(**std::next(map.inner().begin())).value());
+  }
+}
+
+static void EmbeddedConstForm(benchmark::State& state) {
+  for (auto _ : state) {
+    auto& config = constform::form<CONFIG>;
+    benchmark::DoNotOptimize(config.as<constform::Map>().inner()[1].as<constform::Integer>().value());
+  }
+}
+
+BENCHMARK(EmbeddedRead);
+BENCHMARK(EmbeddedConstForm);
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include "corpus.hpp"
+
+/*
+ * End to end throughput of scanning, tokenizing and reading whole inputs.
+ */
+static void Tokenize(benchmark::State& state, const std::string& in) {
+  size_t tokens = 0;
+
+  for (auto _ : state) {
+    Tokenizer tokenizer(make_unique<StringScanner>(in));
+    for (auto token = tokenizer.next(); token.type != TokenType::EndOfFile; token = tokenizer.next()) {
+      ++tokens;
+    }
+  }
+
+  corpus::report(state, in.size(), tokens, "tokens/s");
+}
+
+static void Read(benchmark::State& state, const std::string& in) {
+  size_t forms = 0;
+
+  for (auto _ : state) {
+    auto reader = corpus::reader(in);
+    for (auto expr = reader->next(); expr->type() != ExpressionType::EndOfFile; expr = reader->next()) {
+      ++forms;
+    }
+  }
+
+  corpus::report(state, in.size(), forms, "forms/s");
+}
+
+const size_t corpus_size = 1 << 20;
+
+BENCHMARK_CAPTURE(Tokenize, DeepNesting, corpus::deep_nesting(corpus_size, 200))->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(Tokenize, NumberHeavy, corpus::number_heavy(corpus_size))->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(Tokenize, LongStrings, corpus::long_strings(corpus_size))->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(Tokenize, CommentHeavy, corpus::comment_heavy(corpus_size))->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(Tokenize, Realistic, corpus::realistic(corpus_size))->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(Tokenize, Generated, corpus::generated(corpus_size))->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(Read, DeepNesting, corpus::deep_nesting(corpus_size, 200))->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(Read, NumberHeavy, corpus::number_heavy(corpus_size))->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(Read, LongStrings, corpus::long_strings(corpus_size))->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(Read, CommentHeavy, corpus::comment_heavy(corpus_size))->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(Read, Realistic, corpus::realistic(corpus_size))->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(Read, Generated, corpus::generated(corpus_size))->Unit(benchmark::kMillisecond);
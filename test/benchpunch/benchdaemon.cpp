@@ -0,0 +1,80 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <fstream>
+#include <thread>
+#include <boost/filesystem.hpp>
+#include <daemon.hpp>
+#include <printer.hpp>
+#include "corpus.hpp"
+
+namespace fs = boost::filesystem;
+
+/*
+ * A query on an unchanged file answered by the daemon, against reading and
+ * printing the file in process, which is what every punch run pays.
+ */
+class DaemonFixture {
+public:
+  explicit DaemonFixture(size_t bytes)
+    : directory(fs::temp_directory_path() / fs::unique_path("punch-bench-%%%%-%%%%")) {
+    fs::create_directories(directory);
+    path = (directory / "corpus.p").string();
+    std::ofstream(path, std::ios::out | std::ios::binary) << corpus::generated(bytes);
+
+    server = make_unique<DaemonServer>((directory / "punch.sock").string(), cache);
+    serving = std::thread([this] { server->run(); });
+  }
+
+  ~DaemonFixture() {
+    server->stop();
+    serving.join();
+    server.reset();
+    fs::remove_all(directory);
+  }
+
+  fs::path directory;
+  std::string path;
+  FileCache cache;
+  std::unique_ptr<DaemonServer> server;
+  std::thread serving;
+};
+
+static void DaemonQuery(benchmark::State& state) {
+  DaemonFixture daemon(static_cast<size_t>(state.range(0)));
+  DaemonClient client((daemon.directory / "punch.sock").string());
+  size_t bytes = 0;
+
+  for (auto _ : state) {
+    auto response = client.query(FileCache::Query::Index, daemon.path);
+    bytes = response.body.size();
+    benchmark::DoNotOptimize(response);
+  }
+
+  state.counters["response bytes"] = static_cast<double>(bytes);
+}
+
+static void InProcessQuery(benchmark::State& state) {
+  std::string text = corpus::generated(static_cast<size_t>(state.range(0)));
+
+  for (auto _ : state) {
+    std::string out;
+    auto result = try_read_forms(text, true);
+    for (auto it = result.forms.begin(); it != result.forms.end(); ++it) {
+      Printer::append(out, **it, Printer::Format::Punch);
+    }
+    benchmark::DoNotOptimize(out);
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+
+BENCHMARK(DaemonQuery)->Arg(64 << 10)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK(InProcessQuery)->Arg(64 << 10)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
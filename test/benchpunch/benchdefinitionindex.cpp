@@ -0,0 +1,111 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <definitionindex.hpp>
+#include "corpus.hpp"
+
+namespace fs = boost::filesystem;
+
+/*
+ * Finding where a name is defined in a tree of 200 files: building the
+ * index, updating it when nothing changed, looking names up in it, and
+ * reading every file again as tools did before.
+ */
+class IndexedTree {
+public:
+  IndexedTree() : directory(fs::temp_directory_path() / fs::unique_path("punch-bench-%%%%-%%%%")) {
+    fs::create_directories(directory / "src");
+    std::string source = corpus::realistic(8 << 10);
+    for (size_t i = 0; i < 200; ++i) {
+      std::ofstream((directory / "src" / (std::to_string(i) + ".p")).string(), std::ios::out | std::ios::binary) << source;
+    }
+    files = discover_sources((directory / "src").string());
+    total = files.size() * source.size();
+    index = (directory / "definitions.pndx").string();
+  }
+
+  ~IndexedTree() {
+    fs::remove_all(directory);
+  }
+
+  fs::path directory;
+  std::vector<SourceFile> files;
+  size_t total;
+  std::string index;
+};
+
+static void BuildDefinitionIndex(benchmark::State& state) {
+  IndexedTree tree;
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    fs::remove(tree.index);
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(update_definition_index(tree.index, tree.files));
+  }
+
+  corpus::report(state, tree.total, state.iterations() * tree.files.size(), "files/s");
+}
+BENCHMARK(BuildDefinitionIndex)->UseRealTime();
+
+static void UpdateUnchangedIndex(benchmark::State& state) {
+  IndexedTree tree;
+  update_definition_index(tree.index, tree.files);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(update_definition_index(tree.index, tree.files));
+  }
+
+  corpus::report(state, tree.total, state.iterations() * tree.files.size(), "files/s");
+}
+BENCHMARK(UpdateUnchangedIndex)->UseRealTime();
+
+static void FindDefinition(benchmark::State& state) {
+  IndexedTree tree;
+  update_definition_index(tree.index, tree.files);
+  DefinitionIndex index(tree.index);
+
+  std::vector<std::string> names;
+  for (size_t i = 1; i <= 64; ++i) {
+    names.push_back("handle-" + std::to_string(i * 3));
+  }
+
+  size_t found = 0;
+  for (auto _ : state) {
+    for (auto it = names.begin(); it != names.end(); ++it) {
+      found += index.find(*it).size();
+    }
+  }
+
+  benchmark::DoNotOptimize(found);
+  corpus::report(state, 0, state.iterations() * names.size(), "lookups/s");
+}
+BENCHMARK(FindDefinition);
+
+static void ScanForDefinition(benchmark::State& state) {
+  IndexedTree tree;
+
+  size_t found = 0;
+  for (auto _ : state) {
+    auto results = read_sources(tree.files);
+    for (auto r = results.begin(); r != results.end(); ++r) {
+      auto definitions = extract_definitions(r->forms);
+      for (auto d = definitions.begin(); d != definitions.end(); ++d) {
+        found += d->name == "handle-3";
+      }
+    }
+  }
+
+  benchmark::DoNotOptimize(found);
+  corpus::report(state, tree.total, state.iterations(), "lookups/s");
+}
+BENCHMARK(ScanForDefinition)->UseRealTime();
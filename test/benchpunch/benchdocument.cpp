@@ -0,0 +1,58 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <algorithm>
+#include <document.hpp>
+#include "corpus.hpp"
+
+/*
+ * Latency of a single edit to a 10k line document, against reading the
+ * whole text again.
+ */
+static std::string ten_thousand_lines() {
+  GeneratorOptions options;
+  options.size = 1 << 20;
+  std::string text = CorpusGenerator(options).generate();
+
+  size_t at = 0;
+  for (int line = 0; line < 10000 && at != std::string::npos; ++line) {
+    at = text.find('\n', at + 1);
+  }
+  return text.substr(0, text.rfind("\n\n", at) + 1);
+}
+
+static void DocumentEdit(benchmark::State& state) {
+  Document document(ten_thousand_lines());
+  size_t middle = document.text().find("\n(", document.text().size() / 2) + 3;
+  size_t reread = 0;
+
+  for (auto _ : state) {
+    document.edit(middle, 0, "x");
+    reread += document.reread();
+    document.edit(middle, 1, "");
+    reread += document.reread();
+  }
+
+  state.counters["edits/s"] = benchmark::Counter(static_cast<double>(state.iterations() * 2), benchmark::Counter::kIsRate);
+  state.counters["reread/edit"] = static_cast<double>(reread) / (state.iterations() * 2);
+}
+
+static void DocumentFullRead(benchmark::State& state) {
+  std::string text = ten_thousand_lines();
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(try_read_forms(text, true));
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+
+BENCHMARK(DocumentEdit)->Unit(benchmark::kMicrosecond);
+BENCHMARK(DocumentFullRead)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,114 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <bytecode.hpp>
+#include <evaluator.hpp>
+#include "corpus.hpp"
+
+/*
+ * Small configuration expressions evaluated over and over, as an embedding
+ * application would: compiled once, then run against changing input. The
+ * same expressions on the bytecode VM for comparison, and fib for calls
+ * between compiled functions.
+ */
+static const char* pricing = "(let [discount 0.9 threshold (* 10 100)]"
+                             "  (if (> (:qty order) threshold)"
+                             "    (* (:price order) (:qty order) discount)"
+                             "    (* (:price order) (:qty order))))";
+
+static std::vector<eval::Value> orders(size_t count) {
+  std::vector<eval::Value> out;
+  for (size_t i = 0; i < count; ++i) {
+    out.push_back(eval::map({{eval::keyword("qty"), eval::Value::integer(static_cast<long>(i * 37 % 2000))},
+                             {eval::keyword("price"), eval::Value::floating(1.25 + i % 7)}}));
+  }
+  return out;
+}
+
+static void ConfigExpression(benchmark::State& state) {
+  eval::Environment env;
+  eval::Evaluator evaluator(env);
+  uint32_t order = env.slot("order");
+  auto inputs = orders(64);
+  auto forms = read_forms(pricing);
+  auto compiled = evaluator.compile(*forms.front());
+
+  size_t i = 0;
+  for (auto _ : state) {
+    env.set(order, inputs[i++ % inputs.size()]);
+    benchmark::DoNotOptimize(compiled());
+  }
+
+  corpus::report(state, 0, state.iterations(), "evals/s");
+}
+BENCHMARK(ConfigExpression);
+
+static void ConfigExpressionBytecode(benchmark::State& state) {
+  eval::Environment env;
+  eval::Vm vm(env);
+  uint32_t order = env.slot("order");
+  auto inputs = orders(64);
+  auto forms = read_forms(pricing);
+  auto proto = eval::compile(*forms.front(), env);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    env.set(order, inputs[i++ % inputs.size()]);
+    benchmark::DoNotOptimize(vm.run(*proto));
+  }
+
+  corpus::report(state, 0, state.iterations(), "evals/s");
+}
+BENCHMARK(ConfigExpressionBytecode);
+
+static void ConfigFunction(benchmark::State& state) {
+  eval::Environment env;
+  eval::Evaluator evaluator(env);
+  auto inputs = orders(64);
+  eval::Value price = evaluator.eval(std::string("(fn [order] ") + pricing + ")");
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(eval::invoke(price, &inputs[i++ % inputs.size()], 1));
+  }
+
+  corpus::report(state, 0, state.iterations(), "evals/s");
+}
+BENCHMARK(ConfigFunction);
+
+static void ConfigConstant(benchmark::State& state) {
+  eval::Environment env;
+  eval::Evaluator evaluator(env);
+  auto forms = read_forms("(let [base 100 rate 0.25] {:limit (* base 4) :rate (+ rate 0.5) :burst (inc base)})");
+  auto compiled = evaluator.compile(*forms.front());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(compiled());
+  }
+
+  corpus::report(state, 0, state.iterations(), "evals/s");
+}
+BENCHMARK(ConfigConstant);
+
+static void FibEvaluator(benchmark::State& state) {
+  eval::Environment env;
+  eval::Evaluator evaluator(env);
+  evaluator.eval("(defn fib [n] (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+  auto forms = read_forms("(fib 20)");
+  auto compiled = evaluator.compile(*forms.front());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(compiled());
+  }
+
+  // (fib 20) makes 21891 calls.
+  corpus::report(state, 0, state.iterations() * 21891, "calls/s");
+}
+BENCHMARK(FibEvaluator);
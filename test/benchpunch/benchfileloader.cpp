@@ -0,0 +1,103 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <fileloader.hpp>
+#include "corpus.hpp"
+
+namespace fs = boost::filesystem;
+
+/*
+ * Loading a batch of small source files: one LineScanner per file, as
+ * punch reads files today, against FileLoader on io_uring and on threads.
+ * Arg(1) drops the files from the page cache before every iteration, so
+ * the reads go to the disk; Arg(0) reads them warm.
+ */
+class SourceTree {
+public:
+  SourceTree(size_t files, size_t bytes)
+    : directory(fs::temp_directory_path() / fs::unique_path("punch-bench-%%%%-%%%%")) {
+    fs::create_directories(directory);
+    for (size_t i = 0; i < files; ++i) {
+      paths.push_back((directory / (std::to_string(i) + ".p")).string());
+      std::ofstream(paths.back(), std::ios::out | std::ios::binary) << corpus::realistic(bytes);
+    }
+    total = files * corpus::realistic(bytes).size();
+  }
+
+  ~SourceTree() {
+    fs::remove_all(directory);
+  }
+
+  // clean pages only, which the files are once written back.
+  void drop_cache() {
+    for (auto it = paths.begin(); it != paths.end(); ++it) {
+      int fd = ::open(it->c_str(), O_RDONLY);
+      ::fdatasync(fd);
+      ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      ::close(fd);
+    }
+  }
+
+  fs::path directory;
+  std::vector<std::string> paths;
+  size_t total;
+};
+
+static void prepare(benchmark::State& state, SourceTree& tree) {
+  if (state.range(0)) {
+    state.PauseTiming();
+    tree.drop_cache();
+    state.ResumeTiming();
+  }
+}
+
+static void LoadLineScanner(benchmark::State& state) {
+  SourceTree tree(1000, 8 << 10);
+
+  for (auto _ : state) {
+    prepare(state, tree);
+    for (auto it = tree.paths.begin(); it != tree.paths.end(); ++it) {
+      LineScanner scanner(*it);
+      benchmark::DoNotOptimize(scanner.current_char());
+    }
+  }
+
+  corpus::report(state, tree.total, state.iterations() * tree.paths.size(), "files/s");
+}
+BENCHMARK(LoadLineScanner)->Arg(0)->Arg(1)->UseRealTime();
+
+static void load(benchmark::State& state, FileLoader::Backend backend) {
+  SourceTree tree(1000, 8 << 10);
+  FileLoader loader(32, 16 << 20, backend);
+
+  for (auto _ : state) {
+    prepare(state, tree);
+    loader.load(tree.paths, [](LoadedFile&& file) {
+      auto scanner = file.scanner();
+      benchmark::DoNotOptimize(scanner->current_char());
+    });
+  }
+
+  corpus::report(state, tree.total, state.iterations() * tree.paths.size(), "files/s");
+}
+
+static void LoadUring(benchmark::State& state) {
+  load(state, FileLoader::Backend::Uring);
+}
+BENCHMARK(LoadUring)->Arg(0)->Arg(1)->UseRealTime();
+
+static void LoadThreads(benchmark::State& state) {
+  load(state, FileLoader::Backend::Threads);
+}
+BENCHMARK(LoadThreads)->Arg(0)->Arg(1)->UseRealTime();
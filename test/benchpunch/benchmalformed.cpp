@@ -0,0 +1,54 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include "corpus.hpp"
+
+/*
+ * Reading malformed snippets with exceptions against reading them with
+ * collected diagnostics.
+ */
+static void MalformedThrowing(benchmark::State& state) {
+  auto snippets = corpus::malformed(1024);
+  size_t errors = 0, bytes = 0;
+
+  for (auto _ : state) {
+    for (auto it = snippets.begin(); it != snippets.end(); ++it) {
+      try {
+        benchmark::DoNotOptimize(read_forms(*it));
+      }
+      catch (const std::exception&) {
+        ++errors;
+      }
+      bytes += it->size();
+    }
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(bytes));
+  state.counters["snippets/s"] = benchmark::Counter(static_cast<double>(errors), benchmark::Counter::kIsRate);
+}
+
+static void MalformedDiagnostics(benchmark::State& state) {
+  auto snippets = corpus::malformed(1024);
+  size_t errors = 0, bytes = 0;
+
+  for (auto _ : state) {
+    for (auto it = snippets.begin(); it != snippets.end(); ++it) {
+      auto result = try_read_forms(*it);
+      errors += result.diagnostics.size();
+      bytes += it->size();
+    }
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(bytes));
+  state.counters["snippets/s"] = benchmark::Counter(static_cast<double>(errors), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(MalformedThrowing)->Unit(benchmark::kMillisecond);
+BENCHMARK(MalformedDiagnostics)->Unit(benchmark::kMillisecond);
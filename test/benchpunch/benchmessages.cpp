@@ -0,0 +1,68 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <reader.hpp>
+#include <scanner.hpp>
+#include "corpus.hpp"
+
+/*
+ * Reading many small messages with one MessageReader that is reset for
+ * every message, against setting up a scanner, tokenizer and reader for each.
+ */
+static std::vector<std::string> messages() {
+  std::vector<std::string> result;
+  for (size_t i = 0; i < 1000; ++i) {
+    result.push_back("{:id " + std::to_string(i) + " :op :update :path [\"users\" " + std::to_string(i % 37) +
+                     "] :value {:name \"n" + std::to_string(i) + "\" :tags #{:a :b}}}");
+  }
+  return result;
+}
+
+static size_t total_size(const std::vector<std::string>& texts) {
+  size_t n = 0;
+  for (auto it = texts.begin(); it != texts.end(); ++it) {
+    n += it->size();
+  }
+  return n;
+}
+
+static void MessagesReused(benchmark::State& state) {
+  auto texts = messages();
+  MessageReader reader;
+  size_t count = 0;
+
+  for (auto _ : state) {
+    for (auto it = texts.begin(); it != texts.end(); ++it) {
+      reader.reset(*it);
+      benchmark::DoNotOptimize(reader.next());
+      ++count;
+    }
+  }
+
+  corpus::report(state, total_size(texts), count, "messages/s");
+}
+
+static void MessagesFresh(benchmark::State& state) {
+  auto texts = messages();
+  size_t count = 0;
+
+  for (auto _ : state) {
+    for (auto it = texts.begin(); it != texts.end(); ++it) {
+      Reader reader(make_unique<Tokenizer>(make_unique<StringScanner>(*it)));
+      benchmark::DoNotOptimize(reader.next());
+      ++count;
+    }
+  }
+
+  corpus::report(state, total_size(texts), count, "messages/s");
+}
+
+BENCHMARK(MessagesReused);
+BENCHMARK(MessagesFresh);
@@ -0,0 +1,87 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <query.hpp>
+#include "corpus.hpp"
+
+/*
+ * get-in on a configuration of 2000 services: scanning the maps on every
+ * query, with the key indexes of the Engine, and straight from the source
+ * without reading what the path does not pass through.
+ */
+static std::string services(size_t count) {
+  std::string out = "{:version 3\n :services {\n";
+  for (size_t i = 0; i < count; ++i) {
+    std::string n = std::to_string(i);
+    out += "  :svc-" + n + " {:db {:pool-size " + n + " :hosts [\"db-" + n + "a\" \"db-" + n + "b\"] :timeout 30}\n"
+           "            :tags [:web :internal \"team-" + n + "\"] :replicas " + std::to_string(i % 5) + "\n"
+           "            :limits {:cpu 2/3 :memory 512 :burst 1.5}}\n";
+  }
+  return out + "}}\n";
+}
+
+static std::vector<query::Plan> plans() {
+  std::vector<query::Plan> out;
+  for (size_t i = 0; i < 64; ++i) {
+    out.emplace_back("[:services :svc-" + std::to_string(i * 31) + " :db :pool-size]");
+  }
+  return out;
+}
+
+static void select(benchmark::State& state, size_t min_size) {
+  std::string source = services(2000);
+  auto forms = read_forms(source);
+  auto paths = plans();
+  query::Engine engine(min_size);
+
+  for (auto _ : state) {
+    for (auto it = paths.begin(); it != paths.end(); ++it) {
+      benchmark::DoNotOptimize(engine.first(*it, *forms.front()));
+    }
+  }
+
+  corpus::report(state, 0, state.iterations() * paths.size(), "queries/s");
+}
+
+static void SelectScanning(benchmark::State& state) {
+  select(state, SIZE_MAX);
+}
+BENCHMARK(SelectScanning);
+
+static void SelectIndexed(benchmark::State& state) {
+  select(state, 8);
+}
+BENCHMARK(SelectIndexed);
+
+static void ReadThenSelect(benchmark::State& state) {
+  std::string source = services(2000);
+  query::Plan plan("[:services :svc-1000 :db :hosts]");
+
+  for (auto _ : state) {
+    auto forms = read_forms(source);
+    query::Engine engine;
+    benchmark::DoNotOptimize(engine.select(plan, forms));
+  }
+
+  corpus::report(state, source.size(), state.iterations(), "queries/s");
+}
+BENCHMARK(ReadThenSelect);
+
+static void SelectWhileReading(benchmark::State& state) {
+  std::string source = services(2000);
+  query::Plan plan("[:services :svc-1000 :db :hosts]");
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(query::select(plan, source));
+  }
+
+  corpus::report(state, source.size(), state.iterations(), "queries/s");
+}
+BENCHMARK(SelectWhileReading);
@@ -0,0 +1,40 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include "corpus.hpp"
+
+/*
+ * Reader::next on inputs made up of a single expression kind.
+ */
+static void ReaderNext(benchmark::State& state, const std::string& unit) {
+  std::string in = corpus::repeat(unit, 64 << 10);
+  size_t expressions = 0;
+
+  for (auto _ : state) {
+    auto reader = corpus::reader(in);
+    for (auto expr = reader->next(); expr->type() != ExpressionType::EndOfFile; expr = reader->next()) {
+      ++expressions;
+    }
+  }
+
+  corpus::report(state, in.size(), expressions, "forms/s");
+}
+
+BENCHMARK_CAPTURE(ReaderNext, Keyword, std::string(":keyword "));
+BENCHMARK_CAPTURE(ReaderNext, Integer, std::string("12345 "));
+BENCHMARK_CAPTURE(ReaderNext, HexInteger, std::string("0x7FFF "));
+BENCHMARK_CAPTURE(ReaderNext, Float, std::string("123.456 "));
+BENCHMARK_CAPTURE(ReaderNext, Ratio, std::string("22/7 "));
+BENCHMARK_CAPTURE(ReaderNext, Literal, std::string("symbol-name "));
+BENCHMARK_CAPTURE(ReaderNext, String, std::string("\"a short string\" "));
+BENCHMARK_CAPTURE(ReaderNext, List, std::string("(a b c) "));
+BENCHMARK_CAPTURE(ReaderNext, Vector, std::string("[a b c] "));
+BENCHMARK_CAPTURE(ReaderNext, Map, std::string("{:a b :c d} "));
+BENCHMARK_CAPTURE(ReaderNext, Set, std::string("#{a b c} "));
@@ -0,0 +1,67 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <utf8.hpp>
+#include "corpus.hpp"
+
+namespace fs = boost::filesystem;
+
+static void StringScannerPerByte(benchmark::State& state) {
+  std::string in = corpus::realistic(static_cast<size_t>(state.range(0)));
+
+  for (auto _ : state) {
+    StringScanner scanner(in);
+    while (scanner.current_char()) {
+      benchmark::DoNotOptimize(scanner.next_char());
+      scanner.pop();
+    }
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * in.size()));
+}
+BENCHMARK(StringScannerPerByte)->Arg(64 << 10)->Arg(1 << 20);
+
+static void LineScannerPerByte(benchmark::State& state) {
+  std::string in = corpus::realistic(static_cast<size_t>(state.range(0)));
+  fs::path path = fs::temp_directory_path() / fs::unique_path("benchpunch-%%%%-%%%%.p");
+  std::ofstream(path.string()) << in;
+
+  for (auto _ : state) {
+    LineScanner scanner(path.string());
+    while (scanner.current_char()) {
+      benchmark::DoNotOptimize(scanner.next_char());
+      scanner.pop();
+    }
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * in.size()));
+  fs::remove(path);
+}
+BENCHMARK(LineScannerPerByte)->Arg(64 << 10)->Arg(1 << 20);
+
+// the check made before the first token; Arg(1) puts a two byte character in every 64 bytes.
+static void ValidateUtf8(benchmark::State& state) {
+  std::string in = corpus::realistic(1 << 20);
+  if (state.range(0)) {
+    for (size_t i = 0; i + 1 < in.size(); i += 64) {
+      in[i] = '\xCE';
+      in[i + 1] = '\xBB';
+    }
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(utf8::validate(in.data(), in.size()));
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * in.size()));
+}
+BENCHMARK(ValidateUtf8)->Arg(0)->Arg(1);
@@ -0,0 +1,45 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifdef PUNCH_COROUTINES
+
+#include <streamreader.hpp>
+#include "corpus.hpp"
+
+/*
+ * Reading a corpus that arrives in chunks through a StreamReader, against
+ * reading it in one piece.
+ */
+static Task drain(StreamReader& stream, size_t& forms) {
+  for (auto form = co_await stream.next(); form && form->type() != ExpressionType::EndOfFile; form = co_await stream.next()) {
+    ++forms;
+  }
+}
+
+static void StreamRead(benchmark::State& state) {
+  std::string text = corpus::generated(1 << 20);
+  size_t chunk = static_cast<size_t>(state.range(0));
+  size_t forms = 0;
+
+  for (auto _ : state) {
+    StreamReader stream;
+    auto task = drain(stream, forms);
+    for (size_t fed = 0; fed < text.size(); fed += chunk) {
+      stream.feed(text.data() + fed, std::min(chunk, text.size() - fed));
+    }
+    stream.close();
+  }
+
+  corpus::report(state, text.size(), forms, "forms/s");
+}
+
+BENCHMARK(StreamRead)->Arg(512)->Arg(64 << 10)->Unit(benchmark::kMillisecond);
+
+#endif
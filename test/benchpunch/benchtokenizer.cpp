@@ -0,0 +1,42 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include "corpus.hpp"
+
+/*
+ * Tokenizer::next on inputs made up of a single token type.
+ */
+static void TokenizerNext(benchmark::State& state, const std::string& unit) {
+  std::string in = corpus::repeat(unit, 64 << 10);
+  size_t tokens = 0;
+
+  for (auto _ : state) {
+    Tokenizer tokenizer(make_unique<StringScanner>(in));
+    for (auto token = tokenizer.next(); token.type != TokenType::EndOfFile; token = tokenizer.next()) {
+      ++tokens;
+    }
+  }
+
+  corpus::report(state, in.size(), tokens, "tokens/s");
+}
+
+BENCHMARK_CAPTURE(TokenizerNext, Literal, std::string("symbol-name "));
+BENCHMARK_CAPTURE(TokenizerNext, Keyword, std::string(":keyword "));
+BENCHMARK_CAPTURE(TokenizerNext, Number, std::string("12345 "));
+BENCHMARK_CAPTURE(TokenizerNext, String, std::string("\"a short string\" "));
+BENCHMARK_CAPTURE(TokenizerNext, LongString, "\"" + std::string(4096, 's') + "\" ");
+BENCHMARK_CAPTURE(TokenizerNext, EscapedString, std::string("\"a \\\"quoted\\\" string\\n\" "));
+BENCHMARK_CAPTURE(TokenizerNext, Brackets, std::string("()[]{}"));
+BENCHMARK_CAPTURE(TokenizerNext, SetOpen, std::string("#{}"));
+BENCHMARK_CAPTURE(TokenizerNext, Regex, std::string("#\"[a-z]+\" "));
+BENCHMARK_CAPTURE(TokenizerNext, Char, std::string("\\a "));
+BENCHMARK_CAPTURE(TokenizerNext, Dispatch, std::string("#tag "));
+BENCHMARK_CAPTURE(TokenizerNext, Whitespace, std::string("a ,,,, \t\n"));
+BENCHMARK_CAPTURE(TokenizerNext, Comment, std::string("a ; comment until the end of the line\n"));
@@ -0,0 +1,157 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_BENCH_CORPUS_HPP
+#define PUNCH_BENCH_CORPUS_HPP
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <generator.hpp>
+#include <reader.hpp>
+
+/*
+ * Inputs for the benchmarks. Everything is generated from fixed seeds so
+ * runs are comparable, and stays within what the reader accepts.
+ */
+namespace corpus {
+
+  // the result type of mt19937 is wider than unsigned on LP64, this fits %u.
+  inline unsigned below(std::mt19937& rng, unsigned bound) {
+    return static_cast<unsigned>(rng() % bound);
+  }
+
+  inline std::string repeat(const std::string& unit, size_t bytes) {
+    std::string out;
+    out.reserve(bytes + unit.size());
+    while (out.size() < bytes) {
+      out += unit;
+    }
+    return out;
+  }
+
+  inline std::string deep_nesting(size_t bytes, size_t depth) {
+    std::string form;
+    for (size_t i = 0; i < depth; ++i) {
+      form += (i % 3 == 0) ? "(f " : (i % 3 == 1) ? "[" : "{:k ";
+    }
+    form += "x";
+    for (size_t i = depth; i > 0; --i) {
+      form += ((i - 1) % 3 == 0) ? ")" : ((i - 1) % 3 == 1) ? "]" : "}";
+    }
+    return repeat(form + "\n", bytes);
+  }
+
+  inline std::string number_heavy(size_t bytes) {
+    std::mt19937 rng(1);
+    std::string out = "[";
+    char buf[64];
+
+    while (out.size() < bytes) {
+      switch (rng() % 5) {
+        case 0: std::snprintf(buf, sizeof(buf), "%u ", below(rng, 100000)); break;
+        case 1: std::snprintf(buf, sizeof(buf), "-%u ", below(rng, 1000)); break;
+        case 2: std::snprintf(buf, sizeof(buf), "0x%X ", below(rng, 65536)); break;
+        case 3: std::snprintf(buf, sizeof(buf), "%u.%u ", below(rng, 1000), below(rng, 1000)); break;
+        default: std::snprintf(buf, sizeof(buf), "%u/%u ", below(rng, 100), 1 + below(rng, 100)); break;
+      }
+      out += buf;
+      if (rng() % 16 == 0) {
+        out += "]\n[";
+      }
+    }
+    return out + "]\n";
+  }
+
+  inline std::string long_strings(size_t bytes) {
+    std::mt19937 rng(2);
+    std::string out;
+
+    while (out.size() < bytes) {
+      out += "(log \"";
+      size_t length = 200 + rng() % 2000;
+      for (size_t i = 0; i < length; ++i) {
+        out += static_cast<char>('a' + rng() % 26);
+        if (rng() % 7 == 0) {
+          out += ' ';
+        }
+      }
+      out += "\")\n";
+    }
+    return out;
+  }
+
+  inline std::string comment_heavy(size_t bytes) {
+    return repeat(";; a comment explaining the next form, with (brackets) and \"quotes\"\n"
+                  ";; and a second line of documentation for good measure\n"
+                  "(def value 1) ; trailing comment\n", bytes);
+  }
+
+  inline std::string realistic(size_t bytes) {
+    std::mt19937 rng(3);
+    std::string out;
+    size_t n = 0;
+
+    while (out.size() < bytes) {
+      std::string id = std::to_string(++n);
+      out += ";; handles request kind " + id + "\n";
+      out += "(defn handle-" + id + " [request {:keys [id user]}]\n";
+      out += "  (let [config {:timeout " + std::to_string(below(rng, 10000));
+      out += " :retries " + std::to_string(below(rng, 5));
+      out += " :ratio " + std::to_string(1 + below(rng, 9)) + "/" + std::to_string(1 + below(rng, 9));
+      out += " :name \"handler-" + id + "\"}\n";
+      out += "        items [" + std::to_string(below(rng, 100)) + " " + std::to_string(below(rng, 100)) + " ";
+      out += std::to_string(below(rng, 100)) + " :a :b :c]]\n";
+      out += "    (if (> (count items) " + std::to_string(below(rng, 10)) + ")\n";
+      out += "      (reduce + 0 (map inc items))\n";
+      out += "      #{:small :empty " + id + "})))\n\n";
+    }
+    return out;
+  }
+
+  inline std::string generated(size_t bytes) {
+    GeneratorOptions options;
+    options.size = bytes;
+    return CorpusGenerator(options).generate();
+  }
+
+  // short snippets, every one of them malformed in one of the ways the reader reports.
+  inline std::vector<std::string> malformed(size_t count) {
+    const char* kinds[] = {
+        "(defn f [x] (inc x)",
+        "(let [a 1 b 2) a)",
+        "{:a 1 :b}",
+        "(println \"unterminated)",
+        "[1 2 3]]",
+        "(map #(inc %) xs)",
+        "(def big 99999999999999999999999)",
+        "#{a [b c} d}"
+    };
+
+    std::vector<std::string> out;
+    for (size_t i = 0; i < count; ++i) {
+      out.push_back(std::string("(ns snippet)\n(def n ") + std::to_string(i) + ")\n" + kinds[i % 8]);
+    }
+    return out;
+  }
+
+  inline std::unique_ptr<Reader> reader(const std::string& in) {
+    return make_unique<Reader>(make_unique<Tokenizer>(make_unique<StringScanner>(in)));
+  }
+
+  inline void report(benchmark::State& state, size_t bytes, size_t items, const char* items_name) {
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    state.counters[items_name] = benchmark::Counter(static_cast<double>(items), benchmark::Counter::kIsRate);
+  }
+}
+
+#endif //PUNCH_BENCH_CORPUS_HPP
@@ -0,0 +1,81 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifndef PUNCH_TEST_ALLOCATIONS_HPP
+#define PUNCH_TEST_ALLOCATIONS_HPP
+
+#include <gtest/gtest.h>
+#include <stats.hpp>
+
+/*
+ * Counts the heap allocations of the calling thread from construction on,
+ * so tests can lock in allocation targets:
+ *
+ *   AllocationTracker tracker;
+ *   tokenize(input);
+ *   EXPECT_ALLOCATIONS_AT_MOST(tracker.stage(stats::Stage::Tokenizer), 0);
+ */
+class AllocationTracker {
+public:
+  AllocationTracker() : was_enabled(stats::is_enabled()) {
+    stats::enable();
+    start = stats::local();
+  }
+
+  ~AllocationTracker() {
+    stats::enable(was_enabled);
+  }
+
+  stats::Allocations total() const {
+    const stats::Stats& now = stats::local();
+    return stats::Allocations{now.allocations - start.allocations, now.allocated_bytes - start.allocated_bytes};
+  }
+
+  stats::Allocations stage(stats::Stage stage) const {
+    size_t i = static_cast<size_t>(stage);
+    return difference(stats::local().stage_allocations[i], start.stage_allocations[i]);
+  }
+
+  stats::Allocations expression(ExpressionType type) const {
+    size_t i = static_cast<size_t>(type);
+    return difference(stats::local().expression_allocations[i], start.expression_allocations[i]);
+  }
+
+private:
+  static stats::Allocations difference(const stats::Allocations& now, const stats::Allocations& then) {
+    return stats::Allocations{now.count - then.count, now.bytes - then.bytes};
+  }
+
+  bool was_enabled;
+  stats::Stats start;
+};
+
+inline ::testing::AssertionResult allocations_at_most(const char* allocations_expr, const char* limit_expr,
+                                                      const stats::Allocations& allocations, uint64_t limit) {
+  if (!stats::allocations_counted) {
+    return ::testing::AssertionFailure() << "allocations are not counted, link the punchalloc object";
+  }
+
+  if (allocations.count <= limit) {
+    return ::testing::AssertionSuccess();
+  }
+
+  return ::testing::AssertionFailure()
+      << allocations_expr << " made " << allocations.count << " allocations (" << allocations.bytes
+      << " bytes), expected at most " << limit_expr << " (" << limit << ")";
+}
+
+#define EXPECT_ALLOCATIONS_AT_MOST(allocations, limit) \
+  EXPECT_PRED_FORMAT2(allocations_at_most, allocations, static_cast<uint64_t>(limit))
+
+#define ASSERT_ALLOCATIONS_AT_MOST(allocations, limit) \
+  ASSERT_PRED_FORMAT2(allocations_at_most, allocations, static_cast<uint64_t>(limit))
+
+#endif //PUNCH_TEST_ALLOCATIONS_HPP
@@ -0,0 +1,3 @@
+;; nested file
+(defn f [x]
+  (+ x 1))
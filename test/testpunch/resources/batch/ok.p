@@ -0,0 +1,2 @@
+(def a 1)
+(def b [1 2 3])
@@ -0,0 +1,11 @@
+;; several broken forms among good ones
+(def a 1)
+
+(defn broken [x]
+  (inc x)
+
+(def b {:k})
+
+(def c [1 2 3])
+(def d ])
+(def e 5)
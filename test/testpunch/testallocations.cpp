@@ -0,0 +1,140 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <reader.hpp>
+#include <tokenizer.hpp>
+#include <util.hpp>
+#include "allocations.hpp"
+
+class AllocationsTest : public ::testing::Test {
+public:
+  AllocationsTest() {}
+  ~AllocationsTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+#ifdef PUNCH_STATS
+
+size_t tokenize(const std::string& in) {
+  Tokenizer tokenizer(make_unique<StringScanner>(in));
+  size_t tokens = 0;
+  while (tokenizer.next() != Token::EndOfFile) {
+    ++tokens;
+  }
+  return tokens;
+}
+
+TEST_F(AllocationsTest, Counted) {
+  EXPECT_TRUE(stats::allocations_counted);
+
+  AllocationTracker tracker;
+  auto p = make_unique<std::string>(100, 'x');
+  EXPECT_EQ(2u, tracker.total().count);
+  EXPECT_LE(100u + 1u + sizeof(std::string), tracker.total().bytes);
+}
+
+TEST_F(AllocationsTest, Stages) {
+  std::string in(64, ' ');
+  in += "(a b c)";
+
+  AllocationTracker tracker;
+  auto forms = read_forms(in);
+
+  // the scanner copies the input once, tokens that short are kept in place.
+  EXPECT_EQ(1u, tracker.stage(stats::Stage::Scanner).count);
+  EXPECT_EQ(0u, tracker.stage(stats::Stage::Tokenizer).count);
+  EXPECT_LT(0u, tracker.stage(stats::Stage::Reader).count);
+  EXPECT_LE(tracker.stage(stats::Stage::Scanner).count + tracker.stage(stats::Stage::Tokenizer).count +
+                tracker.stage(stats::Stage::Reader).count, tracker.total().count);
+}
+
+TEST_F(AllocationsTest, Expressions) {
+  AllocationTracker tracker;
+  auto forms = read_forms("(f 12) :k");
+
+  // the node of every expression is attributed to its own kind, the list also holds its children.
+  EXPECT_LE(1u, tracker.expression(ExpressionType::Integer).count);
+  EXPECT_LE(1u, tracker.expression(ExpressionType::Keyword).count);
+  EXPECT_LE(1u, tracker.expression(ExpressionType::Literal).count);
+  EXPECT_LE(3u, tracker.expression(ExpressionType::List).count);
+  EXPECT_EQ(0u, tracker.expression(ExpressionType::Vector).count);
+}
+
+TEST_F(AllocationsTest, TokenizerCeiling) {
+  std::string in;
+  for (int i = 0; i < 100; ++i) {
+    in += "(def value [1 2 :k \"s\"]) ";
+  }
+
+  AllocationTracker tracker;
+  size_t tokens = tokenize(in);
+
+  // only token values too long to be stored in place allocate.
+  EXPECT_EQ(1000u, tokens);
+  EXPECT_ALLOCATIONS_AT_MOST(tracker.stage(stats::Stage::Tokenizer), 0);
+}
+
+// allocations a read expression needs: its node, the nodes of its children's list and out of place strings.
+size_t needed(const Expression& e) {
+  const std::list<UExpression>* inner = nullptr;
+  const std::string* value = nullptr;
+
+  switch (e.type()) {
+    case ExpressionType::List: inner = &static_cast<const List&>(e).inner(); break;
+    case ExpressionType::Vector: inner = &static_cast<const Vector&>(e).inner(); break;
+    case ExpressionType::Map: inner = &static_cast<const Map&>(e).inner(); break;
+    case ExpressionType::Set: inner = &static_cast<const Set&>(e).inner(); break;
+    case ExpressionType::Keyword: value = &static_cast<const Keyword&>(e).value(); break;
+    case ExpressionType::Literal: value = &static_cast<const Literal&>(e).value(); break;
+    case ExpressionType::String: value = &static_cast<const String&>(e).value(); break;
+    default: break;
+  }
+
+  size_t n = 1;
+  if (value && value->capacity() > std::string().capacity()) {
+    ++n;
+  }
+  if (inner) {
+    for (auto it = inner->begin(); it != inner->end(); ++it) {
+      n += 1 + needed(**it);
+    }
+  }
+  return n;
+}
+
+TEST_F(AllocationsTest, MessageReaderAllocatesOnlyTheResult) {
+  std::string message = "(order {:id 12345 :side :buy :price 101.25 :qty 3/4 "
+                        ":tags [\"urgent\" \"a string too long to be stored in place\"] :by #{a-rather-long-literal}})";
+
+  MessageReader reader;
+  reader.reset(message);
+  reader.next();
+
+  AllocationTracker tracker;
+  reader.reset(message);
+  auto form = reader.next();
+  auto total = tracker.total();
+
+  EXPECT_EQ(needed(*form), total.count);
+}
+
+TEST_F(AllocationsTest, Message) {
+  stats::Allocations allocations = {3, 48};
+  auto result = allocations_at_most("allocations", "2", allocations, 2);
+
+  EXPECT_FALSE(result);
+  EXPECT_EQ("allocations made 3 allocations (48 bytes), expected at most 2 (2)", std::string(result.message()));
+  EXPECT_TRUE(allocations_at_most("allocations", "3", allocations, 3));
+}
+
+#endif
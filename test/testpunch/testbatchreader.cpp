@@ -0,0 +1,96 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <batchreader.hpp>
+
+class BatchReaderTest : public ::testing::Test {
+public:
+  BatchReaderTest() {}
+  ~BatchReaderTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+TEST_F(BatchReaderTest, Discover) {
+  auto files = discover_sources("resources/batch");
+
+  ASSERT_EQ(3u, files.size());
+  EXPECT_EQ("resources/batch/broken.p", files[0].path);
+  EXPECT_EQ("resources/batch/nested/deep.p", files[1].path);
+  EXPECT_EQ("resources/batch/ok.p", files[2].path);
+  EXPECT_LT(0u, files[0].size);
+}
+
+TEST_F(BatchReaderTest, DiscoverSingleFile) {
+  auto files = discover_sources("resources/simple.p");
+
+  ASSERT_EQ(1u, files.size());
+  EXPECT_EQ("resources/simple.p", files[0].path);
+}
+
+TEST_F(BatchReaderTest, DiscoverMissingRoot) {
+  auto files = discover_sources("resources/missing");
+
+  ASSERT_EQ(1u, files.size());
+  EXPECT_EQ("resources/missing", files[0].path);
+
+  auto results = read_sources(files, 1);
+  ASSERT_EQ(1u, results.size());
+  EXPECT_FALSE(results[0].ok);
+  EXPECT_EQ("Could not open file", results[0].error);
+}
+
+TEST_F(BatchReaderTest, ReadSource) {
+  std::string buffer;
+  auto result = read_source("resources/batch/ok.p", buffer);
+
+  EXPECT_TRUE(result.ok);
+  EXPECT_EQ(2u, result.forms.size());
+
+  auto missing = read_source("resources/batch/missing.p", buffer);
+  EXPECT_FALSE(missing.ok);
+}
+
+TEST_F(BatchReaderTest, ReadSources) {
+  for (unsigned jobs = 1; jobs <= 4; ++jobs) {
+    auto results = read_sources(discover_sources("resources/batch"), jobs);
+
+    ASSERT_EQ(3u, results.size());
+
+    EXPECT_EQ("resources/batch/broken.p", results[0].path);
+    EXPECT_FALSE(results[0].ok);
+    EXPECT_EQ("Map entries should be even", results[0].error);
+
+    EXPECT_TRUE(results[1].ok);
+    EXPECT_EQ(1u, results[1].forms.size());
+
+    EXPECT_TRUE(results[2].ok);
+    EXPECT_EQ(2u, results[2].forms.size());
+  }
+}
+
+TEST_F(BatchReaderTest, ReadSourceRecover) {
+  std::string buffer;
+  auto result = read_source("resources/recover.p", buffer);
+  EXPECT_FALSE(result.ok);
+  EXPECT_EQ(1u, result.diagnostics.size());
+  EXPECT_EQ(1u, result.forms.size());
+
+  result = read_source("resources/recover.p", buffer, nullptr, true);
+  EXPECT_FALSE(result.ok);
+  ASSERT_EQ(3u, result.diagnostics.size());
+  EXPECT_EQ(std::make_tuple(4, 1), result.diagnostics[0].pos);
+  EXPECT_EQ(std::make_tuple(7, 8), result.diagnostics[1].pos);
+  EXPECT_EQ(std::make_tuple(10, 8), result.diagnostics[2].pos);
+  EXPECT_EQ("Expected ) got ]", result.diagnostics[2].message);
+  EXPECT_EQ(3u, result.forms.size());
+}
@@ -0,0 +1,75 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <binaryform.hpp>
+#include <util.hpp>
+
+class BinaryFormTest : public ::testing::Test {
+public:
+  BinaryFormTest() {}
+  ~BinaryFormTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+void roundtrip(const std::string& in, bool positions) {
+  auto forms = read_forms(in);
+  auto decoded = binaryform::decode(binaryform::encode(forms, positions));
+
+  ASSERT_EQ(forms.size(), decoded.size());
+  for (auto a = forms.begin(), b = decoded.begin(); a != forms.end(); ++a, ++b) {
+    EXPECT_EQ(*a, *b);
+    if (positions) {
+      EXPECT_EQ((*a)->pos, (*b)->pos);
+    }
+    else {
+      EXPECT_EQ(std::make_tuple(0u, 0u), (*b)->pos);
+    }
+  }
+}
+
+TEST_F(BinaryFormTest, Roundtrip) {
+  std::string in = "(defn test [a b]\n  {:a 1 :b -2.5 :c 3/4})\n"
+                   "#{:x :y} \"string\" -12345678901 0x7f\n"
+                   "[[[[]]]] (+ a a a a)";
+
+  roundtrip(in, true);
+  roundtrip(in, false);
+  roundtrip("", true);
+}
+
+TEST_F(BinaryFormTest, InternsStrings) {
+  auto once = binaryform::encode(read_forms("(symbol-with-a-long-name)"));
+  auto many = binaryform::encode(read_forms("(symbol-with-a-long-name symbol-with-a-long-name symbol-with-a-long-name)"));
+
+  // every repeat costs a tag, a position and a one byte index.
+  EXPECT_GT(once.size() + 10, many.size());
+}
+
+TEST_F(BinaryFormTest, RejectsCorruptData) {
+  auto data = binaryform::encode(read_forms("(a [b c] {:d 1})"));
+
+  EXPECT_THROW(binaryform::decode(""), ReaderException);
+  EXPECT_THROW(binaryform::decode("XNCH"), ReaderException);
+  EXPECT_THROW(binaryform::decode(data.substr(0, data.size() - 1)), ReaderException);
+  EXPECT_THROW(binaryform::decode(data + "x"), ReaderException);
+
+  for (size_t i = 4; i < data.size(); ++i) {
+    std::string damaged = data;
+    damaged[i] = '\xff';
+    try {
+      binaryform::decode(damaged);
+    }
+    catch (const ReaderException&) {
+    }
+  }
+}
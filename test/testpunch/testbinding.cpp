@@ -0,0 +1,175 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <binding.hpp>
+#include "allocations.hpp"
+
+class BindingTest : public ::testing::Test {
+public:
+  BindingTest() {}
+  ~BindingTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+struct Endpoint {
+  std::string host;
+  int port = 0;
+};
+
+struct Service {
+  std::string name;
+  Endpoint endpoint;
+  std::vector<Endpoint> replicas;
+  std::vector<std::string> tags;
+  boost::optional<double> timeout;
+  boost::optional<long> retries;
+  bool enabled = false;
+};
+
+struct Limits {
+  short low = 0;
+  long floor = 0;
+  unsigned count = 0;
+  unsigned long total = 0;
+};
+
+template <>
+struct binding::Schema<Limits> {
+  static void describe(binding::Fields<Limits>& f) {
+    f.field("low", &Limits::low).field("floor", &Limits::floor).field("count", &Limits::count).field("total", &Limits::total);
+  }
+};
+
+template <>
+struct binding::Schema<Endpoint> {
+  static void describe(binding::Fields<Endpoint>& f) {
+    f.field("host", &Endpoint::host).field("port", &Endpoint::port);
+  }
+};
+
+template <>
+struct binding::Schema<Service> {
+  static void describe(binding::Fields<Service>& f) {
+    f.field("name", &Service::name)
+     .field("endpoint", &Service::endpoint)
+     .field("replicas", &Service::replicas)
+     .field("tags", &Service::tags)
+     .field("timeout", &Service::timeout)
+     .field("retries", &Service::retries)
+     .field("enabled", &Service::enabled);
+  }
+};
+
+TEST_F(BindingTest, Nested) {
+  auto service = binding::read<Service>(
+      "{:name \"db\" :endpoint {:host \"primary\" :port 5432}\n"
+      " :replicas [{:port 5433 :host \"r1\"} {:host \"r2\" :port 5434}]\n"
+      " :tags [\"sql\" \"main\"] :timeout 2.5 :enabled true} ; trailing comment");
+
+  EXPECT_EQ("db", service.name);
+  EXPECT_EQ("primary", service.endpoint.host);
+  EXPECT_EQ(5432, service.endpoint.port);
+  ASSERT_EQ(2u, service.replicas.size());
+  EXPECT_EQ("r1", service.replicas[0].host);
+  EXPECT_EQ(5434, service.replicas[1].port);
+  EXPECT_EQ((std::vector<std::string>{"sql", "main"}), service.tags);
+  ASSERT_TRUE(service.timeout);
+  EXPECT_DOUBLE_EQ(2.5, *service.timeout);
+  EXPECT_FALSE(service.retries);
+  EXPECT_TRUE(service.enabled);
+}
+
+TEST_F(BindingTest, Optional) {
+  Service service;
+  service.retries = 3;
+
+  auto diagnostics = binding::try_read(
+      "{:name \"a\" :endpoint {:host \"h\" :port 1} :replicas [] :tags [] :timeout nil :enabled false}", service);
+  ASSERT_TRUE(diagnostics.empty()) << diagnostics.front().message;
+  EXPECT_FALSE(service.timeout);
+  EXPECT_FALSE(service.retries);
+
+  // integers are read as floating point too.
+  diagnostics = binding::try_read(
+      "{:name \"a\" :endpoint {:host \"h\" :port 1} :replicas [] :tags [] :timeout 3 :retries 0x10 :enabled false}", service);
+  ASSERT_TRUE(diagnostics.empty()) << diagnostics.front().message;
+  EXPECT_DOUBLE_EQ(3.0, *service.timeout);
+  EXPECT_EQ(16, *service.retries);
+}
+
+void expect_error(const std::string& source, const std::string& message, position pos) {
+  Endpoint endpoint;
+  auto diagnostics = binding::try_read(source, endpoint);
+  ASSERT_EQ(1u, diagnostics.size()) << source;
+  EXPECT_EQ(message, diagnostics[0].message) << source;
+  EXPECT_EQ(pos, diagnostics[0].pos) << source;
+}
+
+TEST_F(BindingTest, Errors) {
+  expect_error("{:host \"h\"\n :port \"80\"}", "Expected integer, got STR", std::make_tuple(2, 8));
+  expect_error("{:host h :port 80}", "Expected string, got h", std::make_tuple(1, 8));
+  expect_error("{:host \"h\" :port 99999999999}", "Invalid integer", std::make_tuple(1, 18));
+  expect_error("{:host \"h\" :prot 80}", "Unknown key :prot", std::make_tuple(1, 12));
+  expect_error("{:host \"h\" :host \"i\"}", "Duplicate key :host", std::make_tuple(1, 12));
+  expect_error("{:host \"h\"}", "Missing key :port", std::make_tuple(1, 1));
+  expect_error("{:host \"h\" :port}", "Map entries should be even", std::make_tuple(1, 1));
+  expect_error("{:host \"h\" :port 80", "EOF, expected }", std::make_tuple(1, 1));
+  expect_error("[:host \"h\"]", "Expected map, got [", std::make_tuple(1, 1));
+  expect_error("{:host \"h\" :port 80} {}", "Expected a single form", std::make_tuple(1, 22));
+  expect_error("", "Expected a form", std::make_tuple(1, 1));
+  expect_error("{:host \"h", "Unexpected stream end", std::make_tuple(1, 8));
+}
+
+TEST_F(BindingTest, IntegerRanges) {
+  auto endpoint = binding::read<Endpoint>("{:host \"h\" :port -1}");
+  EXPECT_EQ(-1, endpoint.port);
+
+  auto limits = binding::read<Limits>("{:low -32768 :floor -9223372036854775807 :count 4294967295 :total 9223372036854775807}");
+  EXPECT_EQ(-32768, limits.low);
+  EXPECT_EQ(-std::numeric_limits<long>::max(), limits.floor);
+  EXPECT_EQ(4294967295u, limits.count);
+  EXPECT_EQ(9223372036854775807ul, limits.total);
+
+  EXPECT_THROW(binding::read<Limits>("{:low -32769 :floor 0 :count 0 :total 0}"), ReaderException);
+  EXPECT_THROW(binding::read<Limits>("{:low 32768 :floor 0 :count 0 :total 0}"), ReaderException);
+  EXPECT_THROW(binding::read<Limits>("{:low 0 :floor 0 :count -1 :total 0}"), ReaderException);
+  EXPECT_THROW(binding::read<Limits>("{:low 0 :floor 0 :count 4294967296 :total 0}"), ReaderException);
+  EXPECT_THROW(binding::read<Limits>("{:low 0 :floor 0 :count 0 :total -1}"), ReaderException);
+  expect_error("{:host \"h\" :port -2147483649}", "Invalid integer", std::make_tuple(1, 18));
+}
+
+TEST_F(BindingTest, Throws) {
+  EXPECT_THROW(binding::read<Endpoint>("{:host 1 :port 2}"), ReaderException);
+}
+
+#ifdef PUNCH_STATS
+
+TEST_F(BindingTest, NoExpressions) {
+  std::string source = "{:host \"primary.example\" :port 5432}";
+  auto forms = read_forms(source);
+
+  AllocationTracker reading;
+  read_forms(source);
+  auto read = reading.total();
+
+  AllocationTracker binding;
+  auto endpoint = binding::read<Endpoint>(source);
+  auto bound = binding.total();
+
+  EXPECT_EQ(5432, endpoint.port);
+  // the scanner, the tokenizer and the host string.
+  EXPECT_ALLOCATIONS_AT_MOST(bound, 3);
+  EXPECT_LT(bound.count, read.count);
+}
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <bytecode.hpp>
+
+using namespace eval;
+
+class BytecodeTest : public ::testing::Test {
+public:
+  BytecodeTest() {}
+  ~BytecodeTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+namespace {
+  std::string run(Vm& vm, const std::string& source) {
+    return print(vm.eval(source));
+  }
+
+  std::string run(const std::string& source) {
+    Environment env;
+    Vm vm(env);
+    return run(vm, source);
+  }
+
+  std::string error(const std::string& source) {
+    try {
+      run(source);
+    }
+    catch (const EvalError& e) {
+      return e.what();
+    }
+    return "";
+  }
+
+  std::string disassembled(const std::string& source) {
+    Environment env;
+    auto forms = read_forms(source);
+    return disassemble(*compile(*forms.front(), env));
+  }
+}
+
+TEST_F(BytecodeTest, Literals) {
+  EXPECT_EQ("1", run("1"));
+  EXPECT_EQ("10000000000", run("10000000000"));
+  EXPECT_EQ("nil", run("nil"));
+  EXPECT_EQ("\"s\"", run("\"s\""));
+  EXPECT_EQ(":k", run(":k"));
+  EXPECT_EQ("0.5", run("1/2"));
+  EXPECT_EQ("[1 [2] {:a 3}]", run("[1 [2] {:a 3}]"));
+  EXPECT_EQ("()", run("()"));
+}
+
+TEST_F(BytecodeTest, Arithmetic) {
+  EXPECT_EQ("10", run("(+ 1 2 3 4)"));
+  EXPECT_EQ("0", run("(+)"));
+  EXPECT_EQ("-5", run("(- 5)"));
+  EXPECT_EQ("4", run("(- 10 5 1)"));
+  EXPECT_EQ("24", run("(* 2 3 4)"));
+  EXPECT_EQ("2.5", run("(/ 5 2)"));
+  EXPECT_EQ("3.5", run("(+ 1 2.5)"));
+  EXPECT_EQ("true", run("(< 1 2)"));
+  EXPECT_EQ("true", run("(<= 2 2.0)"));
+  EXPECT_EQ("true", run("(< 1 2 3)"));
+  EXPECT_EQ("false", run("(= [1 2] [1 3])"));
+  EXPECT_EQ("6", run("(inc 5)"));
+  EXPECT_EQ("4", run("(dec 5)"));
+}
+
+TEST_F(BytecodeTest, InlinesCoreArithmetic) {
+  EXPECT_EQ("top-level (0 params, 0 slots)\n"
+            "  0 Integer 0\n"
+            "  1 Integer 1\n"
+            "  2 Add\n"
+            "  3 Integer 2\n"
+            "  4 Add\n"
+            "  5 Return\n",
+            disassembled("(+ 1 2)"));
+
+  EXPECT_NE(std::string::npos, disassembled("(< 1 2)").find("Less"));
+  EXPECT_NE(std::string::npos, disassembled("(< 1 2 3)").find("Call 3"));
+  EXPECT_NE(std::string::npos, disassembled("(fn [+] (+ 1 2))").find("Call 2"));
+}
+
+TEST_F(BytecodeTest, RedefinedCoreFunctionsAreCalled) {
+  Environment env;
+  Vm vm(env);
+  EXPECT_EQ("3", run(vm, "(+ 1 2)"));
+  run(vm, "(def + (fn [a b] (* a b)))");
+  EXPECT_EQ("2", run(vm, "(+ 1 2)"));
+}
+
+TEST_F(BytecodeTest, SpecialForms) {
+  EXPECT_EQ("3", run("(let [a 1 b (+ a 1)] (+ a b))"));
+  EXPECT_EQ("2", run("(let [a 1] (let [a 2] a))"));
+  EXPECT_EQ("1", run("(let [a 1] (let [b 2] b) a)"));
+  EXPECT_EQ(":yes", run("(if (< 1 2) :yes :no)"));
+  EXPECT_EQ(":no", run("(if nil :yes :no)"));
+  EXPECT_EQ("nil", run("(if false :yes)"));
+  EXPECT_EQ("0", run("(if 0 0 1)"));
+  EXPECT_EQ("3", run("(do 1 2 3)"));
+  EXPECT_EQ("nil", run("(do)"));
+  EXPECT_EQ("(a b [c])", run("(quote (a b [c]))"));
+  EXPECT_EQ("45", run("(loop [i 0 acc 0] (if (< i 10) (recur (inc i) (+ acc i)) acc))"));
+}
+
+TEST_F(BytecodeTest, Globals) {
+  Environment env;
+  Vm vm(env);
+  EXPECT_EQ("42", run(vm, "(def answer 42)"));
+  EXPECT_EQ("43", run(vm, "(inc answer)"));
+  run(vm, "(defn twice \"doc\" [x] (* 2 x))");
+  EXPECT_EQ("84", run(vm, "(twice answer)"));
+  EXPECT_EQ("#<fn twice>", run(vm, "twice"));
+
+  // resolved when compiling, bound when running.
+  run(vm, "(defn later [] (helper))");
+  run(vm, "(defn helper [] :helped)");
+  EXPECT_EQ(":helped", run(vm, "(later)"));
+}
+
+TEST_F(BytecodeTest, FunctionsAndClosures) {
+  EXPECT_EQ("3", run("((fn [a b] (+ a b)) 1 2)"));
+  EXPECT_EQ("15", run("(let [x 10] ((fn [y] (+ x y)) 5))"));
+  EXPECT_EQ("7", run("(let [add (fn [a] (fn [b] (fn [c] (+ a b c))))] (((add 1) 2) 4))"));
+  EXPECT_EQ("120", run("((fn fact [n] (if (< n 2) 1 (* n (fact (dec n))))) 5)"));
+  EXPECT_EQ("[1 (2 3)]", run("((fn [a & more] [a more]) 1 2 3)"));
+  EXPECT_EQ("[1 ()]", run("((fn [a & more] [a more]) 1)"));
+  EXPECT_EQ("10", run("((fn [n acc] (if (= n 0) acc (recur (dec n) (+ acc n)))) 4 0)"));
+  EXPECT_EQ("[1 2]", run("(let [a 1 f (fn [b] [a b])] (f 2))"));
+}
+
+TEST_F(BytecodeTest, Recursion) {
+  Environment env;
+  Vm vm(env);
+  run(vm, "(defn fib [n] (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+  EXPECT_EQ("6765", run(vm, "(fib 20)"));
+
+  // the inner fn refers to the outer one through its capture.
+  EXPECT_EQ("6", run(vm, "((fn count-down [n] (if (= n 0) 6 ((fn [] (count-down (dec n)))))) 3)"));
+}
+
+TEST_F(BytecodeTest, NativesCallClosures) {
+  EXPECT_EQ("(2 3 4)", run("(map inc [1 2 3])"));
+  EXPECT_EQ("(11 12)", run("(let [n 10] (map (fn [x] (+ x n)) [1 2]))"));
+  EXPECT_EQ("(0 2 4)", run("(filter (fn [x] (even? x)) (range 6))"));
+  EXPECT_EQ("4950", run("(reduce (fn [a b] (+ a b)) 0 (range 100))"));
+  EXPECT_EQ("6", run("(apply + 1 [2 3])"));
+  EXPECT_EQ("1", run("(:a {:a 1})"));
+}
+
+TEST_F(BytecodeTest, Collections) {
+  EXPECT_EQ("[1 2 3]", run("(let [a 2] [1 a (inc a)])"));
+  EXPECT_EQ("{:a 1 :b 2}", run("(let [a 1] {:a a :b (inc a)})"));
+  EXPECT_EQ("#{1 2}", run("(let [a 1] #{a 2})"));
+  EXPECT_EQ("{:a 1 :b 2}", run("(assoc {:a 1} :b 2)"));
+  EXPECT_EQ("3", run("(count (conj [1 2] 3))"));
+}
+
+TEST_F(BytecodeTest, Errors) {
+  EXPECT_EQ("Unable to resolve symbol: nope", error("(+ 1 nope)"));
+  EXPECT_EQ("Wrong number of args (1) passed to f", error("((fn f [a b] a) 1)"));
+  EXPECT_EQ("Can only recur from tail position", error("(loop [i 0] (+ 1 (recur i)))"));
+  EXPECT_EQ("recur outside of loop or fn", error("(recur 1)"));
+  EXPECT_EQ("Mismatched argument count to recur, expected 1 args, got 2", error("(loop [i 0] (recur 1 2))"));
+  EXPECT_EQ("Multi-arity fn is not supported", error("(fn ([a] a) ([a b] b))"));
+  EXPECT_EQ("Stack overflow", error("((fn f [n] (+ 1 (f n))) 1)"));
+  EXPECT_FALSE(error("(/ 1 0)").empty());
+}
+
+TEST_F(BytecodeTest, ErrorsHavePositions) {
+  Environment env;
+  Vm vm(env);
+  try {
+    vm.eval("(let [a 1]\n  (+ a\n     :b))");
+    FAIL();
+  }
+  catch (const EvalError& e) {
+    EXPECT_EQ(std::make_tuple(2u, 3u), e.pos);
+  }
+
+  // the stack is unwound, the vm can go on.
+  EXPECT_EQ("3", run(vm, "(+ 1 2)"));
+  EXPECT_THROW(vm.eval("(map (fn [x] (+ x :a)) [1])"), EvalError);
+  EXPECT_EQ("[2]", run(vm, "(vec (map inc [1]))"));
+}
@@ -0,0 +1,185 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <boost/optional/optional_io.hpp>
+#include <compressedscanner.hpp>
+#include <tokenizer.hpp>
+#include <util.hpp>
+#ifdef PUNCH_ZLIB
+#include <zlib.h>
+#endif
+
+namespace fs = boost::filesystem;
+
+class CompressedScannerTest : public ::testing::Test {
+public:
+  CompressedScannerTest() {}
+  ~CompressedScannerTest() {}
+
+  void SetUp() {
+    dir = fs::temp_directory_path() / fs::unique_path("testpunch-%%%%-%%%%");
+    fs::create_directories(dir);
+  }
+
+  void TearDown() {
+    fs::remove_all(dir);
+  }
+
+  std::string path(const std::string& name) {
+    return (dir / name).string();
+  }
+
+  fs::path dir;
+};
+
+static std::vector<Token> tokens(std::unique_ptr<Scanner> scanner, Diagnostic* error = nullptr) {
+  Tokenizer tokenizer(std::move(scanner));
+  std::vector<Token> result;
+  for (Token token = tokenizer.next(); token != Token::EndOfFile; token = tokenizer.next()) {
+    result.push_back(token);
+  }
+  if (error) {
+    *error = tokenizer.failed() ? tokenizer.error() : Diagnostic();
+  }
+  return result;
+}
+
+static std::string sample() {
+  std::string out;
+  for (int i = 0; i < 200; ++i) {
+    out += "(defn f" + std::to_string(i) + " [x] {:name \"caf\xC3\xA9 \xE2\x82\xAC" + std::to_string(i) + "\" "
+           ":sym \xCE\xBB-" + std::to_string(i) + " :n " + std::to_string(i * 31) + "}) ; \xF0\x9F\x98\x80\n";
+  }
+  return out;
+}
+
+TEST_F(CompressedScannerTest, Detect) {
+  std::ofstream(path("plain.p")) << "(a)";
+  std::ofstream(path("zstd.p"), std::ios::binary) << std::string("\x28\xB5\x2F\xFD", 4) << "rest";
+
+  CompressedScanner::Format format;
+  EXPECT_FALSE(CompressedScanner::detect(path("plain.p"), format));
+  EXPECT_FALSE(CompressedScanner::detect(path("missing.p"), format));
+  EXPECT_TRUE(CompressedScanner::detect(path("zstd.p"), format));
+  EXPECT_EQ(CompressedScanner::Format::Zstd, format);
+
+  EXPECT_EQ(tokens(make_unique<StringScanner>("(a)")), tokens(open_scanner(path("plain.p"))));
+}
+
+TEST_F(CompressedScannerTest, MissingFile) {
+  Diagnostic error;
+  tokens(make_unique<CompressedScanner>(path("missing.p.gz"), CompressedScanner::Format::Gzip), &error);
+  EXPECT_EQ("Could not open file", error.message);
+}
+
+#ifndef PUNCH_ZSTD
+TEST_F(CompressedScannerTest, ZstdNotBuilt) {
+  std::ofstream(path("zstd.p"), std::ios::binary) << std::string("\x28\xB5\x2F\xFD", 4) << "rest";
+
+  Diagnostic error;
+  EXPECT_TRUE(tokens(open_scanner(path("zstd.p")), &error).empty());
+  EXPECT_EQ("Zstd input is not supported by this build", error.message);
+}
+#endif
+
+#ifdef PUNCH_ZLIB
+
+static void write_gzip(const std::string& path, const std::string& text, const char* mode = "wb") {
+  gzFile file = gzopen(path.c_str(), mode);
+  gzwrite(file, text.data(), static_cast<unsigned>(text.size()));
+  gzclose(file);
+}
+
+TEST_F(CompressedScannerTest, Gzip) {
+  std::string text = sample();
+  write_gzip(path("sample.p.gz"), text);
+
+  CompressedScanner::Format format;
+  ASSERT_TRUE(CompressedScanner::detect(path("sample.p.gz"), format));
+  EXPECT_EQ(CompressedScanner::Format::Gzip, format);
+
+  auto expected = tokens(make_unique<StringScanner>(text));
+  EXPECT_EQ(expected, tokens(open_scanner(path("sample.p.gz"))));
+
+  // small chunks, so tokens and characters are cut at every place.
+  for (size_t chunk : {16u, 17u, 61u, 1000u}) {
+    Diagnostic error;
+    EXPECT_EQ(expected, tokens(make_unique<CompressedScanner>(path("sample.p.gz"), format, chunk, 1), &error)) << chunk;
+    EXPECT_EQ("", error.message);
+  }
+}
+
+TEST_F(CompressedScannerTest, Characters) {
+  write_gzip(path("chars.p.gz"), "ab\ncd");
+  CompressedScanner scanner(path("chars.p.gz"), CompressedScanner::Format::Gzip, 16, 1);
+
+  EXPECT_EQ('a', scanner.current_char());
+  EXPECT_EQ('b', scanner.next_char());
+  EXPECT_EQ(boost::none, scanner.previous_char());
+  scanner.flush_line();
+  EXPECT_EQ('c', scanner.current_char());
+  EXPECT_EQ('\n', scanner.previous_char());
+  EXPECT_EQ(std::make_tuple(2u, 1u), scanner.position());
+  scanner.skip(5);
+  EXPECT_EQ(boost::none, scanner.current_char());
+  EXPECT_EQ(std::make_tuple(2u, 3u), scanner.position());
+}
+
+TEST_F(CompressedScannerTest, Members) {
+  write_gzip(path("members.p.gz"), "(first)\n");
+  write_gzip(path("members.p.gz"), "(second)\n", "ab");
+
+  auto read = tokens(open_scanner(path("members.p.gz")));
+  ASSERT_EQ(6u, read.size());
+  EXPECT_EQ(Token::Literal("second", std::make_tuple(2u, 2u)), read[4]);
+}
+
+TEST_F(CompressedScannerTest, Truncated) {
+  std::string text = sample();
+  write_gzip(path("full.p.gz"), text);
+  std::ifstream in(path("full.p.gz"), std::ios::binary);
+  std::string compressed((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  std::ofstream(path("cut.p.gz"), std::ios::binary) << compressed.substr(0, compressed.size() / 2);
+
+  Diagnostic error;
+  auto read = tokens(open_scanner(path("cut.p.gz")), &error);
+  EXPECT_FALSE(read.empty());
+  EXPECT_EQ("Compressed input ends early", error.message);
+
+  std::string corrupt = compressed;
+  corrupt[corrupt.size() / 2] ^= 0x55;
+  corrupt[corrupt.size() / 2 + 1] ^= 0x55;
+  std::ofstream(path("corrupt.p.gz"), std::ios::binary) << corrupt;
+  tokens(open_scanner(path("corrupt.p.gz")), &error);
+  EXPECT_EQ(0u, error.message.find("Corrupt gzip stream")) << error.message;
+}
+
+TEST_F(CompressedScannerTest, InvalidUtf8) {
+  write_gzip(path("invalid.p.gz"), std::string(100, ' ') + "(a\n  \xCE\xBB \xFF)");
+
+  Diagnostic error;
+  auto read = tokens(make_unique<CompressedScanner>(path("invalid.p.gz"), CompressedScanner::Format::Gzip, 16, 1), &error);
+  EXPECT_EQ(3u, read.size());
+  EXPECT_EQ("Invalid UTF-8", error.message);
+  EXPECT_EQ(std::make_tuple(2u, 5u), error.pos);
+}
+
+TEST_F(CompressedScannerTest, StopsEarly) {
+  write_gzip(path("sample.p.gz"), sample());
+
+  // the helper is waiting for room when the scanner goes.
+  CompressedScanner scanner(path("sample.p.gz"), CompressedScanner::Format::Gzip, 16, 1);
+  EXPECT_EQ('(', scanner.current_char());
+}
+
+#endif
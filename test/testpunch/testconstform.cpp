@@ -0,0 +1,120 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#if __cplusplus >= 202002L
+
+#include <gtest/gtest.h>
+#include <constform.hpp>
+#include "allocations.hpp"
+
+class ConstFormTest : public ::testing::Test {
+public:
+  ConstFormTest() {}
+  ~ConstFormTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+constexpr auto& config = constform::form<"(def config {:port 8080 :ratio 3/4 :load 0.5 :name \"db\"})">;
+
+static_assert(config.type() == ExpressionType::List);
+static_assert(config.as<constform::List>().inner()[1].as<constform::Literal>().value() == "config");
+static_assert(config.as<constform::List>().inner()[2].as<constform::Map>().inner()[1].as<constform::Integer>().value() == 8080);
+
+// what is wrong, and where, for a literal that does not compile.
+constexpr std::tuple<constform::Error, uint32_t, uint32_t> error_of(std::string_view text) {
+  auto m = constform::detail::measure(text);
+  return std::make_tuple(m.error, m.line, m.column);
+}
+
+static_assert(error_of("(a [b 1)") == std::make_tuple(constform::Error::MismatchedClose, 1u, 8u));
+static_assert(error_of("(a\n  [b 1]") == std::make_tuple(constform::Error::UnclosedCollection, 1u, 1u));
+static_assert(error_of("{:a}") == std::make_tuple(constform::Error::OddMapEntries, 1u, 1u));
+static_assert(error_of("a ]") == std::make_tuple(constform::Error::ClosingTagWithoutOpen, 1u, 3u));
+static_assert(error_of("\"open") == std::make_tuple(constform::Error::UnexpectedStreamEnd, 1u, 1u));
+static_assert(error_of("#(inc %)") == std::make_tuple(constform::Error::UnsupportedToken, 1u, 1u));
+static_assert(error_of("[09]") == std::make_tuple(constform::Error::InvalidInteger, 1u, 2u));
+static_assert(error_of("99999999999999999999") == std::make_tuple(constform::Error::InvalidInteger, 1u, 1u));
+static_assert(error_of("1e999") == std::make_tuple(constform::Error::FloatOutOfRange, 1u, 1u));
+static_assert(error_of("\"a\\qb\"") == std::make_tuple(constform::Error::InvalidEscape, 1u, 3u));
+static_assert(error_of("(\xce\xbb \xff)") == std::make_tuple(constform::Error::InvalidUtf8, 1u, 4u));
+static_assert(error_of("; only a comment\n") == std::make_tuple(constform::Error::None, 0u, 0u));
+
+TEST_F(ConstFormTest, Accessors) {
+  ASSERT_EQ(ExpressionType::List, config.type());
+  EXPECT_EQ(std::make_tuple(1u, 1u), config.pos);
+
+  auto list = config.as<constform::List>().inner();
+  ASSERT_EQ(3u, list.size());
+  EXPECT_EQ("def", list[0].as<constform::Literal>().value());
+
+  auto map = list[2].as<constform::Map>().inner();
+  ASSERT_EQ(8u, map.size());
+  EXPECT_EQ("port", map[0].as<constform::Keyword>().value());
+  EXPECT_EQ(std::make_tuple(1u, 14u), map[0].pos);
+  EXPECT_EQ(8080, map[1].as<constform::Integer>().value());
+  EXPECT_EQ(3, map[3].as<constform::Ratio>().numerator());
+  EXPECT_EQ(4, map[3].as<constform::Ratio>().denominator());
+  EXPECT_DOUBLE_EQ(0.5, map[5].as<constform::Float>().value());
+  EXPECT_EQ("db", map[7].as<constform::String>().value());
+}
+
+// strings without escapes are views into the literal, the others are decoded once.
+constexpr auto& strings = constform::forms<"\"plain\" \"tab\\there\" \"\\u20ac\"">;
+static_assert(strings[0].as<constform::String>().value() == "plain");
+static_assert(strings[1].as<constform::String>().value() == "tab\there");
+static_assert(strings[2].as<constform::String>().value() == "\xe2\x82\xac");
+
+// columns count code points.
+constexpr auto& unicode = constform::form<"(\xce\xbb \xe2\x82\xac)">;
+static_assert(std::get<1>(unicode.as<constform::List>().inner()[1].pos) == 4);
+
+TEST_F(ConstFormTest, SameAsReader) {
+  constexpr auto& forms = constform::forms<
+      "(defn test [a b]\n  {:a 1 :b -2.5 :c 3/4})\n#{:x :y} \"string\" [[[[]]]] () ; comment\n"
+      "[0 -0 +7 0x1F 017 2r1010 36rZZ 12N -9223372036854775807 1. 1.5M 6.02e23 -1e-5 0.1 +3/4 -1/2]\n"
+      "#!shebang\n:kw sym-bol \xce\xbb-x +a -> nil \"\" \"q\\\"uote\\\\\\n\\ud83d\\ude00\"">;
+
+  auto read = read_forms(
+      "(defn test [a b]\n  {:a 1 :b -2.5 :c 3/4})\n#{:x :y} \"string\" [[[[]]]] () ; comment\n"
+      "[0 -0 +7 0x1F 017 2r1010 36rZZ 12N -9223372036854775807 1. 1.5M 6.02e23 -1e-5 0.1 +3/4 -1/2]\n"
+      "#!shebang\n:kw sym-bol \xce\xbb-x +a -> nil \"\" \"q\\\"uote\\\\\\n\\ud83d\\ude00\"");
+
+  ASSERT_EQ(read.size(), forms.size());
+
+  auto it = read.begin();
+  for (auto form : forms) {
+    auto copy = constform::to_expression(form);
+    EXPECT_EQ(*it, copy);
+    EXPECT_EQ((*it)->pos, copy->pos);
+    ++it;
+  }
+}
+
+#ifdef PUNCH_STATS
+
+TEST_F(ConstFormTest, NoRuntimeAllocations) {
+  AllocationTracker tracker;
+
+  size_t keywords = 0;
+  for (auto node : config.as<constform::List>().inner()[2].as<constform::Map>().inner()) {
+    if (node.type() == ExpressionType::Keyword) {
+      ++keywords;
+    }
+  }
+
+  EXPECT_EQ(4u, keywords);
+  EXPECT_ALLOCATIONS_AT_MOST(tracker.total(), 0);
+}
+
+#endif
+
+#endif
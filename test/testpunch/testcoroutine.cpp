@@ -0,0 +1,97 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifdef PUNCH_COROUTINES
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+#include <coroutine.hpp>
+#include <util.hpp>
+
+class CoroutineTest : public ::testing::Test {
+public:
+  CoroutineTest() {}
+  ~CoroutineTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+Generator<int> count_to(int n) {
+  for (int i = 1; i <= n; ++i) {
+    co_yield i;
+  }
+}
+
+Generator<int> fail_after(int n) {
+  for (int i = 1; i <= n; ++i) {
+    co_yield i;
+  }
+  throw std::runtime_error("failed");
+}
+
+TEST_F(CoroutineTest, Generator) {
+  std::vector<int> values;
+  for (int i : count_to(3)) {
+    values.push_back(i);
+  }
+  EXPECT_EQ(std::vector<int>({1, 2, 3}), values);
+
+  auto empty = count_to(0);
+  EXPECT_TRUE(empty.begin() == empty.end());
+
+  std::vector<int> before;
+  EXPECT_THROW({
+    for (int i : fail_after(2)) {
+      before.push_back(i);
+    }
+  }, std::runtime_error);
+  EXPECT_EQ(std::vector<int>({1, 2}), before);
+}
+
+TEST_F(CoroutineTest, Tokens) {
+  Tokenizer tokenizer(make_unique<StringScanner>("(a \"b\")"));
+  std::vector<Token> result;
+  for (auto& token : tokens(tokenizer)) {
+    result.push_back(token);
+  }
+
+  ASSERT_EQ(4u, result.size());
+  EXPECT_EQ(Token::RoundOpen(std::make_tuple(1, 1)), result[0]);
+  EXPECT_EQ(Token::String("b", std::make_tuple(1, 4)), result[2]);
+  EXPECT_EQ(Token::RoundClose(std::make_tuple(1, 7)), result[3]);
+}
+
+TEST_F(CoroutineTest, Forms) {
+  Reader reader(make_unique<Tokenizer>(make_unique<StringScanner>("(a) [b] {:c 1} (d")));
+  std::vector<UExpression> result;
+  for (auto& form : forms(reader)) {
+    result.push_back(std::move(form));
+  }
+
+  ASSERT_EQ(3u, result.size());
+  EXPECT_EQ(ExpressionType::Map, result[2]->type());
+  EXPECT_TRUE(reader.failed());
+}
+
+TEST_F(CoroutineTest, TaskRunsUntilItAwaits) {
+  int steps = 0;
+  auto task = [&steps]() -> Task {
+    ++steps;
+    co_await std::suspend_always();
+    ++steps;
+  }();
+
+  EXPECT_EQ(1, steps);
+  EXPECT_FALSE(task.done());
+}
+
+#endif
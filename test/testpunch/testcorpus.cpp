@@ -0,0 +1,42 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <corpus.hpp>
+
+class CorpusTest : public ::testing::Test {
+public:
+  CorpusTest() {}
+  ~CorpusTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+// the benchmarks time reading these, so they have to be well-formed.
+TEST_F(CorpusTest, ReadsWithoutDiagnostics) {
+  const size_t bytes = 64 << 10;
+
+  EXPECT_TRUE(try_read_forms(corpus::realistic(bytes)).ok());
+  EXPECT_TRUE(try_read_forms(corpus::number_heavy(bytes)).ok());
+  EXPECT_TRUE(try_read_forms(corpus::long_strings(bytes)).ok());
+  EXPECT_TRUE(try_read_forms(corpus::comment_heavy(bytes)).ok());
+  EXPECT_TRUE(try_read_forms(corpus::deep_nesting(bytes, 64)).ok());
+}
+
+TEST_F(CorpusTest, RealisticFormsAreComplete) {
+  auto result = try_read_forms(corpus::realistic(16 << 10));
+
+  ASSERT_TRUE(result.ok());
+  for (auto it = result.forms.begin(); it != result.forms.end(); ++it) {
+    EXPECT_EQ(ExpressionType::List, (*it)->type());
+  }
+  EXPECT_GT(result.forms.size(), 16u);
+}
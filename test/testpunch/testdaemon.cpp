@@ -0,0 +1,162 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <system_error>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+#include <daemon.hpp>
+
+namespace fs = boost::filesystem;
+
+class DaemonTest : public ::testing::Test {
+public:
+  DaemonTest() {}
+  ~DaemonTest() {}
+
+  void SetUp() {
+    directory = fs::temp_directory_path() / fs::unique_path("punch-daemon-%%%%-%%%%");
+    fs::create_directories(directory);
+    socket = (directory / "punch.sock").string();
+  }
+
+  void TearDown() {
+    fs::remove_all(directory);
+  }
+
+  std::string write(const std::string& name, const std::string& contents) {
+    std::string path = (directory / name).string();
+    std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    out << contents;
+    return path;
+  }
+
+  // a connection that sends raw bytes, -1 when it could not connect.
+  int connect_raw() {
+    sockaddr_un addr = sockaddr_un();
+    addr.sun_family = AF_UNIX;
+    socket.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+      ::close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  fs::path directory;
+  std::string socket;
+};
+
+TEST_F(DaemonTest, Handle) {
+  FileCache cache;
+  DaemonServer server(socket, cache);
+  auto path = write("a.p", "(a 1)");
+
+  EXPECT_EQ(std::string("\0(a 1)\n", 7), server.handle("punch " + path));
+  EXPECT_EQ("\1Unknown request\n", server.handle("eval " + path));
+  EXPECT_EQ("\1Unknown request\n", server.handle("punch"));
+  EXPECT_EQ("\1Path must be absolute\n", server.handle("punch a.p"));
+}
+
+TEST_F(DaemonTest, QueriesOverTheSocket) {
+  FileCache cache;
+  DaemonServer server(socket, cache);
+  std::thread serving([&server] { server.run(); });
+
+  auto path = write("a.p", "(defn f [x] x)\n");
+  {
+    DaemonClient client(socket);
+    auto index = client.query(FileCache::Query::Index, path);
+    EXPECT_TRUE(index.ok);
+    EXPECT_EQ("1:1 List defn\n", index.body);
+
+    for (int i = 0; i < 10; ++i) {
+      EXPECT_EQ("(defn f [x] x)\n", client.query(FileCache::Query::Punch, path).body);
+    }
+
+    write("a.p", "(defn f [x");
+    auto broken = client.query(FileCache::Query::Punch, path);
+    EXPECT_FALSE(broken.ok);
+    EXPECT_EQ("1:9: error: EOF, expected ]\n", broken.body.substr(0, broken.body.find('\n') + 1));
+  }
+
+  // a second connection after the first one closed
+  EXPECT_TRUE(DaemonClient(socket).query(FileCache::Query::Tokens, path).body.find("LIT defn") != std::string::npos);
+
+  server.stop();
+  serving.join();
+  EXPECT_EQ(9u, cache.hits());
+}
+
+TEST_F(DaemonTest, OneDaemonPerSocket) {
+  FileCache cache;
+  DaemonServer server(socket, cache);
+  std::thread serving([&server] { server.run(); });
+
+  EXPECT_THROW(DaemonServer(socket, cache), std::system_error);
+
+  server.stop();
+  serving.join();
+}
+
+TEST_F(DaemonTest, NoDaemon) {
+  EXPECT_THROW(DaemonClient client(socket), std::system_error);
+}
+
+TEST_F(DaemonTest, PartialRequestsDoNotBlock) {
+  FileCache cache;
+  DaemonServer server(socket, cache);
+  std::thread serving([&server] { server.run(); });
+  auto path = write("a.p", "(a 1)");
+
+  std::string request = "punch " + path;
+  std::string frame(4, '\0');
+  frame[0] = static_cast<char>(request.size());
+  frame[1] = static_cast<char>(request.size() >> 8);
+  frame += request;
+
+  int stalled = connect_raw();
+  ASSERT_GE(stalled, 0);
+  ASSERT_EQ(2, ::send(stalled, frame.data(), 2, 0));
+
+  EXPECT_EQ("(a 1)\n", DaemonClient(socket).query(FileCache::Query::Punch, path).body);
+
+  // the rest of the stalled request arrives later and is answered.
+  ASSERT_EQ(static_cast<ssize_t>(frame.size() - 2), ::send(stalled, frame.data() + 2, frame.size() - 2, 0));
+  char response[11];
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(response)), ::recv(stalled, response, sizeof(response), MSG_WAITALL));
+  EXPECT_EQ(std::string("\x07\0\0\0\0(a 1)\n", 11), std::string(response, sizeof(response)));
+  ::close(stalled);
+
+  server.stop();
+  serving.join();
+}
+
+TEST_F(DaemonTest, OversizedRequestsCloseTheConnection) {
+  FileCache cache;
+  DaemonServer server(socket, cache);
+  std::thread serving([&server] { server.run(); });
+
+  int fd = connect_raw();
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(4, ::send(fd, "\xff\xff\xff\xff", 4, 0));
+
+  char c;
+  EXPECT_EQ(0, ::recv(fd, &c, 1, 0));
+  ::close(fd);
+
+  server.stop();
+  serving.join();
+}
@@ -0,0 +1,235 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <definitionindex.hpp>
+
+namespace fs = boost::filesystem;
+
+TEST(DefinitionIndexTest, Extract) {
+  auto forms = read_forms("(ns app.core)\n"
+                          "(def limit 10)\n"
+                          "(defn handle \"doc\" {:added 1} [request & options] (go request))\n"
+                          "(defmacro when-ok ([x] x) ([x y & more] y))\n"
+                          "(let [a 1] (defn nested [] a))\n"
+                          "[defn not-a-list []]\n"
+                          "(defn)\n"
+                          "(println limit)");
+  auto definitions = extract_definitions(forms);
+
+  ASSERT_EQ(4u, definitions.size());
+  EXPECT_EQ("ns", definitions[0].head);
+  EXPECT_EQ("app.core", definitions[0].name);
+  EXPECT_EQ(std::make_tuple(1u, 1u), definitions[0].pos);
+  EXPECT_TRUE(definitions[0].arities.empty());
+
+  EXPECT_EQ("limit", definitions[1].name);
+  EXPECT_TRUE(definitions[1].arities.empty());
+
+  EXPECT_EQ("defn", definitions[2].head);
+  EXPECT_EQ("handle", definitions[2].name);
+  EXPECT_EQ(std::make_tuple(3u, 1u), definitions[2].pos);
+  ASSERT_EQ(1u, definitions[2].arities.size());
+  EXPECT_EQ(1u, definitions[2].arities[0].params);
+  EXPECT_TRUE(definitions[2].arities[0].variadic);
+
+  EXPECT_EQ("when-ok", definitions[3].name);
+  ASSERT_EQ(2u, definitions[3].arities.size());
+  EXPECT_EQ(1u, definitions[3].arities[0].params);
+  EXPECT_FALSE(definitions[3].arities[0].variadic);
+  EXPECT_EQ(2u, definitions[3].arities[1].params);
+  EXPECT_TRUE(definitions[3].arities[1].variadic);
+}
+
+TEST(DefinitionIndexTest, ConfiguredHeads) {
+  DefinitionHeads heads;
+  heads.plain = {"defrecord"};
+  heads.functions = {"defn-"};
+
+  auto definitions = extract_definitions(read_forms("(def a 1) (defrecord Point [x y]) (defn- helper [a b] a)"), heads);
+
+  ASSERT_EQ(2u, definitions.size());
+  EXPECT_EQ("Point", definitions[0].name);
+  EXPECT_TRUE(definitions[0].arities.empty());
+  EXPECT_EQ("helper", definitions[1].name);
+  ASSERT_EQ(1u, definitions[1].arities.size());
+  EXPECT_EQ(2u, definitions[1].arities[0].params);
+}
+
+class DefinitionIndexFileTest : public ::testing::Test {
+public:
+  void SetUp() {
+    directory = fs::temp_directory_path() / fs::unique_path("punch-index-%%%%-%%%%");
+    fs::create_directories(directory / "src");
+    index = (directory / "definitions.pndx").string();
+  }
+
+  void TearDown() {
+    fs::remove_all(directory);
+  }
+
+  void write(const std::string& name, const std::string& contents) {
+    std::ofstream((directory / "src" / name).string(), std::ios::out | std::ios::binary | std::ios::trunc) << contents;
+  }
+
+  std::vector<SourceFile> sources() {
+    return discover_sources((directory / "src").string());
+  }
+
+  fs::path directory;
+  std::string index;
+};
+
+TEST_F(DefinitionIndexFileTest, Find) {
+  write("a.p", "(ns a)\n(defn run [x] x)\n(def shared 1)");
+  write("b.p", "(ns b)\n\n(defn run\n  ([] 0)\n  ([x] x))\n(def shared 2)");
+
+  auto update = update_definition_index(index, sources(), DefinitionHeads(), 2);
+  EXPECT_EQ(2u, update.files);
+  EXPECT_EQ(2u, update.read);
+  EXPECT_EQ(0u, update.reused);
+  EXPECT_EQ(0u, update.failed);
+  EXPECT_EQ(6u, update.definitions);
+
+  DefinitionIndex mapped(index);
+  EXPECT_EQ(6u, mapped.size());
+  EXPECT_EQ(2u, mapped.files());
+
+  auto runs = mapped.find("run");
+  ASSERT_EQ(2u, runs.size());
+  EXPECT_EQ((directory / "src" / "a.p").string(), runs[0].path().to_string());
+  EXPECT_EQ(std::make_tuple(2u, 1u), runs[0].position());
+  EXPECT_EQ("defn", runs[0].head().to_string());
+  ASSERT_EQ(1u, runs[0].arities());
+  EXPECT_EQ(1u, runs[0].arity(0).params);
+
+  EXPECT_EQ((directory / "src" / "b.p").string(), runs[1].path().to_string());
+  EXPECT_EQ(std::make_tuple(3u, 1u), runs[1].position());
+  ASSERT_EQ(2u, runs[1].arities());
+  EXPECT_EQ(0u, runs[1].arity(0).params);
+  EXPECT_EQ(1u, runs[1].arity(1).params);
+
+  EXPECT_EQ(2u, mapped.find("shared").size());
+  EXPECT_EQ(1u, mapped.find("a").size());
+  EXPECT_TRUE(mapped.find("missing").empty());
+  EXPECT_TRUE(mapped.find("ru").empty());
+}
+
+TEST_F(DefinitionIndexFileTest, ManyNames) {
+  std::string source;
+  for (int i = 0; i < 1000; ++i) {
+    source += "(defn f" + std::to_string(i) + " [a] a)\n";
+  }
+  write("many.p", source);
+
+  update_definition_index(index, sources());
+  DefinitionIndex mapped(index);
+
+  for (uint i = 0; i < 1000; ++i) {
+    auto entries = mapped.find("f" + std::to_string(i));
+    ASSERT_EQ(1u, entries.size());
+    EXPECT_EQ(std::make_tuple(i + 1, 1u), entries[0].position());
+  }
+  EXPECT_TRUE(mapped.find("f1000").empty());
+}
+
+TEST_F(DefinitionIndexFileTest, Incremental) {
+  write("a.p", "(defn one [] 1)");
+  write("b.p", "(defn two [] 2)");
+  write("c.p", "(defn three [] 3)");
+  update_definition_index(index, sources());
+
+  write("b.p", "(defn two [x y] 2)\n(defn four [] 4)");
+  fs::remove(directory / "src" / "c.p");
+
+  auto update = update_definition_index(index, sources());
+  EXPECT_EQ(2u, update.files);
+  EXPECT_EQ(1u, update.read);
+  EXPECT_EQ(1u, update.reused);
+  EXPECT_EQ(3u, update.definitions);
+
+  DefinitionIndex mapped(index);
+  EXPECT_EQ(2u, mapped.files());
+  ASSERT_EQ(1u, mapped.find("one").size());
+  ASSERT_EQ(1u, mapped.find("two").size());
+  EXPECT_EQ(2u, mapped.find("two")[0].arity(0).params);
+  EXPECT_EQ(1u, mapped.find("four").size());
+  EXPECT_TRUE(mapped.find("three").empty());
+
+  update = update_definition_index(index, sources());
+  EXPECT_EQ(0u, update.read);
+  EXPECT_EQ(2u, update.reused);
+}
+
+TEST_F(DefinitionIndexFileTest, ChangedHeadsReadAgain) {
+  write("a.p", "(def a 1) (defrecord R [x])");
+  update_definition_index(index, sources());
+
+  DefinitionHeads heads;
+  heads.plain.push_back("defrecord");
+  auto update = update_definition_index(index, sources(), heads);
+  EXPECT_EQ(1u, update.read);
+  EXPECT_EQ(0u, update.reused);
+
+  DefinitionIndex mapped(index);
+  EXPECT_EQ(1u, mapped.find("R").size());
+}
+
+TEST_F(DefinitionIndexFileTest, MalformedFiles) {
+  write("a.p", "(defn ok [] 1)\n(defn broken [] (\n(defn after [] 2)");
+  std::vector<SourceFile> files = sources();
+  files.push_back(SourceFile{(directory / "src" / "missing.p").string(), 0});
+
+  auto update = update_definition_index(index, files);
+  EXPECT_EQ(1u, update.read);
+  EXPECT_EQ(1u, update.failed);
+
+  DefinitionIndex mapped(index);
+  ASSERT_EQ(1u, mapped.files());
+  EXPECT_EQ(1u, mapped.file_diagnostics(0));
+  EXPECT_EQ(1u, mapped.find("ok").size());
+  EXPECT_EQ(1u, mapped.find("after").size());
+  EXPECT_TRUE(mapped.find("broken").empty());
+}
+
+TEST_F(DefinitionIndexFileTest, Invalid) {
+  EXPECT_THROW(DefinitionIndex{index}, ReaderException);
+
+  write("a.p", "(defn one [] 1)");
+  update_definition_index(index, sources());
+  std::string data;
+  ASSERT_TRUE(load_file(index, data));
+
+  std::string error;
+  EXPECT_TRUE(DefinitionIndex::validate(data.data(), data.size(), error));
+  EXPECT_FALSE(DefinitionIndex::validate(data.data(), data.size() - 1, error));
+  EXPECT_EQ("Sections out of bounds", error);
+
+  std::string damaged = data;
+  damaged[0] = 'X';
+  EXPECT_FALSE(DefinitionIndex::validate(damaged.data(), damaged.size(), error));
+  EXPECT_EQ("Not a definition index", error);
+
+  // the name of the only definition pointing past the strings.
+  damaged = data;
+  damaged[40 + 24] = '\xff';
+  EXPECT_FALSE(DefinitionIndex::validate(damaged.data(), damaged.size(), error));
+  EXPECT_EQ("String out of bounds", error);
+
+  std::ofstream(index, std::ios::out | std::ios::binary | std::ios::trunc) << damaged;
+  EXPECT_THROW(DefinitionIndex{index}, ReaderException);
+
+  // a damaged index is rebuilt.
+  auto update = update_definition_index(index, sources());
+  EXPECT_EQ(1u, update.read);
+  EXPECT_EQ(1u, DefinitionIndex(index).find("one").size());
+}
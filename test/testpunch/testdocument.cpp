@@ -0,0 +1,182 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <random>
+#include <gtest/gtest.h>
+#include <document.hpp>
+#include <generator.hpp>
+#include <printer.hpp>
+#include <utf8.hpp>
+
+class DocumentTest : public ::testing::Test {
+public:
+  DocumentTest() {}
+  ~DocumentTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+// the debug form together with the position of every expression.
+void describe(const Expression& e, std::string& out) {
+  out += std::to_string(std::get<0>(e.pos)) + ":" + std::to_string(std::get<1>(e.pos)) + " ";
+  Printer::append(out, e, Printer::Format::Punch);
+  out += "\n";
+
+  const std::list<UExpression>* inner = nullptr;
+  switch (e.type()) {
+    case ExpressionType::List: inner = &static_cast<const List&>(e).inner(); break;
+    case ExpressionType::Map: inner = &static_cast<const Map&>(e).inner(); break;
+    case ExpressionType::Set: inner = &static_cast<const Set&>(e).inner(); break;
+    case ExpressionType::Vector: inner = &static_cast<const Vector&>(e).inner(); break;
+    default: return;
+  }
+
+  for (auto it = inner->begin(); it != inner->end(); ++it) {
+    describe(**it, out);
+  }
+}
+
+void describe(const std::vector<Diagnostic>& diagnostics, std::string& out) {
+  for (auto it = diagnostics.begin(); it != diagnostics.end(); ++it) {
+    out += std::to_string(std::get<0>(it->pos)) + ":" + std::to_string(std::get<1>(it->pos)) + " " + it->message + "\n";
+  }
+}
+
+std::string describe(Document& document) {
+  std::string out;
+  for (size_t i = 0; i < document.size(); ++i) {
+    describe(document.form(i), out);
+  }
+  describe(document.diagnostics(), out);
+  return out;
+}
+
+std::string describe(const std::string& text) {
+  auto result = try_read_forms(text, true);
+  std::string out;
+  for (auto it = result.forms.begin(); it != result.forms.end(); ++it) {
+    describe(**it, out);
+  }
+  describe(result.diagnostics, out);
+  return out;
+}
+
+TEST_F(DocumentTest, Read) {
+  Document document("(a b)\n[c]\n{:d}");
+
+  EXPECT_EQ(2u, document.size());
+  EXPECT_EQ(ExpressionType::Vector, document.form(1).type());
+  EXPECT_EQ(1u, document.diagnostics().size());
+  EXPECT_EQ(describe(document.text()), describe(document));
+}
+
+TEST_F(DocumentTest, EditRereadsOnlyTheDamagedForm) {
+  std::string text;
+  for (int i = 0; i < 100; ++i) {
+    text += "(def v" + std::to_string(i) + " [" + std::to_string(i) + " 2 3])\n";
+  }
+
+  Document document(text);
+  ASSERT_EQ(100u, document.size());
+
+  // renames v50 and breaks the line after it
+  size_t at = text.find("(def v50 ") + 5;
+  document.edit(at, 3, "w50\n  ");
+
+  EXPECT_GE(2u, document.reread());
+  EXPECT_EQ(100u, document.size());
+  EXPECT_EQ(std::make_tuple(54u, 1u), document.form(52).pos);
+  EXPECT_EQ(describe(document.text()), describe(document));
+}
+
+TEST_F(DocumentTest, EditsThatSpread) {
+  Document document("(a)\n(b)\n(c)\n");
+
+  // opening a string swallows the rest of the text
+  document.edit(5, 0, "\"");
+  EXPECT_EQ(describe(document.text()), describe(document));
+  EXPECT_EQ(1u, document.size());
+
+  document.edit(5, 1, "");
+  EXPECT_EQ(describe(document.text()), describe(document));
+  EXPECT_EQ(3u, document.size());
+
+  // commenting out a form, and the comment before the first form
+  document.edit(4, 0, ";");
+  EXPECT_EQ(2u, document.size());
+  document.edit(0, 0, ";");
+  EXPECT_EQ(1u, document.size());
+  document.edit(0, 1, "");
+  EXPECT_EQ(describe(document.text()), describe(document));
+
+  // joining two literals
+  Document literals("ab cd");
+  literals.edit(2, 1, "");
+  EXPECT_EQ(1u, literals.size());
+  EXPECT_EQ(describe(literals.text()), describe(literals));
+
+  EXPECT_THROW(literals.edit(5, 0, "x"), std::out_of_range);
+
+  // columns count code points, not bytes
+  Document text("(def a \"\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\") (b)\n(c)\n");
+  text.edit(text.text().find('b'), 1, "x");
+  EXPECT_EQ(3u, text.size());
+  EXPECT_EQ(describe(text.text()), describe(text));
+
+  // invalid UTF-8 anywhere rejects all of the text, until it is valid again
+  text.edit(text.text().find('c'), 0, "\xC3");
+  EXPECT_EQ(0u, text.size());
+  EXPECT_EQ(describe(text.text()), describe(text));
+  text.edit(9, 1, "");
+  EXPECT_EQ(describe(text.text()), describe(text));
+  text.edit(9, 0, "\xA9");
+  EXPECT_EQ(describe(text.text()), describe(text));
+  text.edit(text.text().find('c') - 1, 1, "");
+  EXPECT_EQ(3u, text.size());
+  EXPECT_EQ(describe(text.text()), describe(text));
+}
+
+TEST_F(DocumentTest, RandomEditsMatchFullRead) {
+  GeneratorOptions options;
+  options.size = 8 << 10;
+  options.comments = 0.2;
+  std::string text = CorpusGenerator(options).generate();
+
+  Document document(text);
+  std::mt19937 rng(7);
+  const char* pieces[] = {"(", ")", "[", "]", "{", "}", "\"", ";", "\n", " ", "x", ":k", "12", "#{", "\n(f 1)\n",
+                          "\xC3\xA9", "\"\xE6\x97\xA5\xE6\x9C\xAC\" ", "(\xC3\xBC \xF0\x9F\x98\x80)"};
+
+  for (int i = 0; i < 400; ++i) {
+    size_t size = document.text().size();
+    size_t offset = rng() % (size + 1);
+    size_t removed = std::min<size_t>(rng() % 4, size - offset);
+
+    // whole code points only, so the text stays valid UTF-8 and is read incrementally.
+    while (offset > 0 && utf8::is_continuation(document.text()[offset])) {
+      --offset;
+      ++removed;
+    }
+    while (offset + removed < size && utf8::is_continuation(document.text()[offset + removed])) {
+      ++removed;
+    }
+    std::string inserted = rng() % 3 == 0 ? "" : pieces[rng() % 18];
+
+    document.edit(offset, removed, inserted);
+
+    // checking every edit reads positions of every form, which hides lazy shifting; check some only.
+    if (i % 20 == 19) {
+      ASSERT_EQ(describe(document.text()), describe(document)) << "after edit " << i;
+    }
+  }
+
+  EXPECT_EQ(describe(document.text()), describe(document));
+}
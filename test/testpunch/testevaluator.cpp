@@ -0,0 +1,210 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <evaluator.hpp>
+
+using namespace eval;
+
+class EvaluatorTest : public ::testing::Test {
+public:
+  EvaluatorTest() {}
+  ~EvaluatorTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+namespace {
+  std::string run(Evaluator& evaluator, const std::string& source) {
+    return print(evaluator.eval(source));
+  }
+
+  std::string run(const std::string& source) {
+    Environment env;
+    Evaluator evaluator(env);
+    return run(evaluator, source);
+  }
+
+  std::string error(const std::string& source) {
+    try {
+      run(source);
+    }
+    catch (const EvalError& e) {
+      return e.what();
+    }
+    return "";
+  }
+
+  bool folded(const std::string& source) {
+    Environment env;
+    Evaluator evaluator(env);
+    auto forms = read_forms(source);
+    return evaluator.compile(*forms.front()).constant();
+  }
+}
+
+TEST_F(EvaluatorTest, Literals) {
+  EXPECT_EQ("1", run("1"));
+  EXPECT_EQ("nil", run("nil"));
+  EXPECT_EQ("\"s\"", run("\"s\""));
+  EXPECT_EQ(":k", run(":k"));
+  EXPECT_EQ("0.5", run("1/2"));
+  EXPECT_EQ("[1 [2] {:a 3}]", run("[1 [2] {:a 3}]"));
+  EXPECT_EQ("#{1 2}", run("#{1 2}"));
+  EXPECT_EQ("()", run("()"));
+}
+
+TEST_F(EvaluatorTest, Arithmetic) {
+  EXPECT_EQ("10", run("(+ 1 2 3 4)"));
+  EXPECT_EQ("0", run("(+)"));
+  EXPECT_EQ("-5", run("(- 5)"));
+  EXPECT_EQ("4", run("(- 10 5 1)"));
+  EXPECT_EQ("24", run("(* 2 3 4)"));
+  EXPECT_EQ("2.5", run("(/ 5 2)"));
+  EXPECT_EQ("3.5", run("(+ 1 2.5)"));
+  EXPECT_EQ("true", run("(< 1 2)"));
+  EXPECT_EQ("true", run("(< 1 2 3)"));
+  EXPECT_EQ("false", run("(= [1 2] [1 3])"));
+  EXPECT_EQ("6", run("(let [f (fn [x] (inc x))] (f 5))"));
+  EXPECT_EQ("-1", run("(let [f (fn [x y] (- x y))] (f 1 2))"));
+  EXPECT_EQ("true", run("(let [f (fn [x] (>= 2 x))] (f 2))"));
+}
+
+TEST_F(EvaluatorTest, FoldsConstants) {
+  EXPECT_TRUE(folded("(+ 1 (* 2 3))"));
+  EXPECT_TRUE(folded("(count [1 2 3])"));
+  EXPECT_TRUE(folded("(let [rate 0.5 base 10] (* base rate))"));
+  EXPECT_TRUE(folded("(if (< 1 2) :yes (undefined))"));
+  EXPECT_TRUE(folded("(do 1 2 [3 (inc 3)])"));
+  EXPECT_TRUE(folded("(fn [x] (* x 2))"));
+  EXPECT_TRUE(folded("(let [k 2] (fn [x] (* x k)))"));
+
+  EXPECT_FALSE(folded("(+ 1 x)"));
+  EXPECT_FALSE(folded("(println 1)"));
+  EXPECT_FALSE(folded("((fn [x] (fn [y] (+ x y))) 1)"));
+  EXPECT_FALSE(folded("(loop [i 0] i)"));
+
+  // errors are left for running, so they get their position.
+  EXPECT_FALSE(folded("(/ 1 0)"));
+  EXPECT_FALSE(error("(/ 1 0)").empty());
+}
+
+TEST_F(EvaluatorTest, RedefinedCoreFunctionsAreCalled) {
+  Environment env;
+  Evaluator evaluator(env);
+  EXPECT_EQ("3", run(evaluator, "(+ 1 2)"));
+  run(evaluator, "(def + (fn [a b] (* a b)))");
+  EXPECT_EQ("2", run(evaluator, "(+ 1 2)"));
+  EXPECT_EQ("3", run(evaluator, "(let [+ -] (+ 4 1))"));
+}
+
+TEST_F(EvaluatorTest, SpecialForms) {
+  EXPECT_EQ("3", run("(let [a 1 b (+ a 1)] (+ a b))"));
+  EXPECT_EQ("2", run("(let [a 1] (let [a 2] a))"));
+  EXPECT_EQ(":no", run("(let [t (fn [] nil)] (if (t) :yes :no))"));
+  EXPECT_EQ("nil", run("(if false :yes)"));
+  EXPECT_EQ("3", run("(do 1 2 3)"));
+  EXPECT_EQ("nil", run("(do)"));
+  EXPECT_EQ("(a b [c])", run("(quote (a b [c]))"));
+  EXPECT_EQ("45", run("(loop [i 0 acc 0] (if (< i 10) (recur (inc i) (+ acc i)) acc))"));
+  EXPECT_EQ("[2 1]", run("(loop [i 0 j 3] (if (< i j) (recur (inc i) (dec j)) [i j]))"));
+  EXPECT_EQ("6", run("(loop [n 3 acc 0] (if (= n 0) acc (recur (dec n) (loop [k n s acc] (if (= k 0) s (recur (dec k) (inc s)))))))"));
+}
+
+TEST_F(EvaluatorTest, Globals) {
+  Environment env;
+  Evaluator evaluator(env);
+  EXPECT_EQ("42", run(evaluator, "(def answer 42)"));
+  EXPECT_EQ("43", run(evaluator, "(inc answer)"));
+  run(evaluator, "(defn twice \"doc\" [x] (* 2 x))");
+  EXPECT_EQ("84", run(evaluator, "(twice answer)"));
+  EXPECT_EQ("#<fn twice>", run(evaluator, "twice"));
+
+  run(evaluator, "(defn later [] (helper))");
+  run(evaluator, "(defn helper [] :helped)");
+  EXPECT_EQ(":helped", run(evaluator, "(later)"));
+
+  // compiled once, the global is read on every run.
+  auto forms = read_forms("(* answer 2)");
+  auto compiled = evaluator.compile(*forms.front());
+  EXPECT_EQ("84", print(compiled()));
+  env.define("answer", Value::integer(5));
+  EXPECT_EQ("10", print(compiled()));
+}
+
+TEST_F(EvaluatorTest, FunctionsAndClosures) {
+  EXPECT_EQ("3", run("((fn [a b] (+ a b)) 1 2)"));
+  EXPECT_EQ("15", run("(let [x (inc 9)] ((fn [y] (+ x y)) 5))"));
+  EXPECT_EQ("7", run("(let [add (fn [a] (fn [b] (fn [c] (+ a b c))))] (((add 1) 2) 4))"));
+  EXPECT_EQ("120", run("((fn fact [n] (if (< n 2) 1 (* n (fact (dec n))))) 5)"));
+  EXPECT_EQ("[1 (2 3)]", run("((fn [a & more] [a more]) 1 2 3)"));
+  EXPECT_EQ("[1 ()]", run("((fn [a & more] [a more]) 1)"));
+  EXPECT_EQ("10", run("((fn [n acc] (if (= n 0) acc (recur (dec n) (+ acc n)))) 4 0)"));
+  EXPECT_EQ("6", run("((fn count-down [n] (if (= n 0) 6 ((fn [] (count-down (dec n)))))) 3)"));
+}
+
+TEST_F(EvaluatorTest, Recursion) {
+  Environment env;
+  Evaluator evaluator(env);
+  run(evaluator, "(defn fib [n] (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+  EXPECT_EQ("6765", run(evaluator, "(fib 20)"));
+}
+
+TEST_F(EvaluatorTest, FunctionsAreCalledFromCpp) {
+  Environment env;
+  Evaluator evaluator(env);
+  Value price = evaluator.eval("(fn [order] (if (> (:qty order) 10) (* (:price order) 0.9) (:price order)))");
+
+  Value order = map({{keyword("qty"), Value::integer(20)}, {keyword("price"), Value::integer(10)}});
+  EXPECT_EQ("9.0", print(invoke(price, &order, 1)));
+  EXPECT_THROW(invoke(price, nullptr, 0), EvalError);
+}
+
+TEST_F(EvaluatorTest, NativesCallFunctions) {
+  EXPECT_EQ("(2 3 4)", run("(map inc [1 2 3])"));
+  EXPECT_EQ("(11 12)", run("(let [n (inc 9)] (map (fn [x] (+ x n)) [1 2]))"));
+  EXPECT_EQ("(0 2 4)", run("(filter (fn [x] (even? x)) (range 6))"));
+  EXPECT_EQ("4950", run("(reduce (fn [a b] (+ a b)) 0 (range 100))"));
+  EXPECT_EQ("1", run("(:a {:a 1})"));
+}
+
+TEST_F(EvaluatorTest, Collections) {
+  EXPECT_EQ("[1 2 3]", run("(let [f (fn [a] [1 a (inc a)])] (f 2))"));
+  EXPECT_EQ("{:a 1 :b 2}", run("(let [f (fn [a] {:a a :b (inc a)})] (f 1))"));
+  EXPECT_EQ("#{1 2}", run("(let [f (fn [a] #{a 2 1})] (f 1))"));
+}
+
+TEST_F(EvaluatorTest, Errors) {
+  EXPECT_EQ("Unable to resolve symbol: nope", error("(+ 1 nope)"));
+  EXPECT_EQ("Wrong number of args (1) passed to f", error("((fn f [a b] a) 1)"));
+  EXPECT_EQ("Can only recur from tail position", error("(loop [i 0] (+ 1 (recur i)))"));
+  EXPECT_EQ("recur outside of loop or fn", error("(recur 1)"));
+  EXPECT_EQ("Multi-arity fn is not supported", error("(fn ([a] a) ([a b] b))"));
+  EXPECT_EQ("Stack overflow", error("((fn f [n] (+ 1 (f n))) 1)"));
+  EXPECT_EQ("Stack overflow", error("(defn g [n] (+ 1 (first (map g [n])))) (g 1)"));
+}
+
+TEST_F(EvaluatorTest, ErrorsHavePositions) {
+  Environment env;
+  Evaluator evaluator(env);
+  try {
+    evaluator.eval("(let [a (inc 0)]\n  (+ a\n     :b))");
+    FAIL();
+  }
+  catch (const EvalError& e) {
+    EXPECT_EQ(std::make_tuple(2u, 3u), e.pos);
+  }
+
+  // the stack is cut back, the evaluator can go on.
+  EXPECT_EQ("3", run(evaluator, "(let [f (fn [a] (+ a 2))] (f 1))"));
+  EXPECT_THROW(evaluator.eval("(map (fn [x] (+ x :a)) [1])"), EvalError);
+  EXPECT_EQ("[2]", run(evaluator, "(vec (map inc [1]))"));
+}
@@ -0,0 +1,172 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <binaryform.hpp>
+#include <filecache.hpp>
+
+namespace fs = boost::filesystem;
+
+class FileCacheTest : public ::testing::Test {
+public:
+  FileCacheTest() {}
+  ~FileCacheTest() {}
+
+  void SetUp() {
+    directory = fs::temp_directory_path() / fs::unique_path("punch-files-%%%%-%%%%");
+    fs::create_directories(directory);
+  }
+
+  void TearDown() {
+    fs::remove_all(directory);
+  }
+
+  std::string write(const std::string& name, const std::string& contents) {
+    std::string path = (directory / name).string();
+    std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    out << contents;
+    return path;
+  }
+
+  fs::path directory;
+};
+
+TEST_F(FileCacheTest, RendersEveryQuery) {
+  FileCache cache;
+  auto path = write("a.p", "(defn f [x] (inc x))\n:k\n");
+
+  auto& binary = cache.get(path, FileCache::Query::Binary);
+  ASSERT_TRUE(binary.ok);
+  auto forms = binaryform::decode(binary.body);
+  ASSERT_EQ(2u, forms.size());
+  EXPECT_EQ(ExpressionType::List, forms.front()->type());
+
+  EXPECT_EQ("(defn f [x] (inc x))\n:k\n", cache.get(path, FileCache::Query::Punch).body);
+  EXPECT_NE(std::string::npos, cache.get(path, FileCache::Query::Debug).body.find("\nKW (k)\n"));
+  EXPECT_EQ("1:1 List defn\n2:1 Keyword\n", cache.get(path, FileCache::Query::Index).body);
+  EXPECT_EQ(0u, cache.get(path, FileCache::Query::Tokens).body.find("( (1, 1), LIT defn (1, 2), "));
+}
+
+TEST_F(FileCacheTest, RepeatedQueriesHit) {
+  FileCache cache;
+  auto path = write("a.p", "(a b c)");
+
+  cache.get(path, FileCache::Query::Punch);
+  EXPECT_EQ(0u, cache.hits());
+
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ("(a b c)\n", cache.get(path, FileCache::Query::Punch).body);
+  }
+  EXPECT_EQ(3u, cache.hits());
+  EXPECT_EQ(1u, cache.misses());
+}
+
+TEST_F(FileCacheTest, LoadingIsAMiss) {
+  FileCache cache;
+  auto path = write("a.p", "(a b c)");
+
+  cache.get(path, FileCache::Query::Binary);
+  EXPECT_EQ(0u, cache.hits());
+  EXPECT_EQ(1u, cache.misses());
+
+  cache.get(path, FileCache::Query::Binary);
+  EXPECT_EQ(1u, cache.hits());
+}
+
+TEST_F(FileCacheTest, ChangedFileIsReadAgain) {
+  for (bool watch : {true, false}) {
+    FileCache cache(64 << 20, watch);
+    auto path = write("a.p", "(a)");
+    EXPECT_EQ("(a)\n", cache.get(path, FileCache::Query::Punch).body);
+
+    // same size and, on coarse clocks, the same modification time; only inotify can tell.
+    write("a.p", "(b)");
+    if (watch && cache.watch_fd() >= 0) {
+      EXPECT_EQ("(b)\n", cache.get(path, FileCache::Query::Punch).body);
+    }
+
+    write("a.p", "(c d)");
+    EXPECT_EQ("(c d)\n", cache.get(path, FileCache::Query::Punch).body);
+  }
+}
+
+TEST_F(FileCacheTest, UnchangedContentsKeepRenderedQueries) {
+  FileCache cache;
+  auto path = write("a.p", "(a)");
+  cache.get(path, FileCache::Query::Index);
+
+  write("a.p", "(a)");
+  fs::last_write_time(path, fs::last_write_time(path) + 10);
+
+  EXPECT_EQ("1:1 List a\n", cache.get(path, FileCache::Query::Index).body);
+  EXPECT_EQ(1u, cache.hits());
+}
+
+TEST_F(FileCacheTest, MalformedAndMissingFiles) {
+  FileCache cache;
+  auto path = write("bad.p", "(a\n(b))");
+
+  auto& read = cache.get(path, FileCache::Query::Punch);
+  EXPECT_FALSE(read.ok);
+  EXPECT_EQ("1:1: error: Expected ) before the next top-level form\n", read.body.substr(0, read.body.find('\n') + 1));
+
+  auto& missing = cache.get((directory / "missing.p").string(), FileCache::Query::Index);
+  EXPECT_FALSE(missing.ok);
+  EXPECT_EQ(1u, cache.entries());
+
+  fs::remove(path);
+  EXPECT_FALSE(cache.get(path, FileCache::Query::Punch).ok);
+  EXPECT_EQ(0u, cache.entries());
+  EXPECT_EQ(0u, cache.bytes());
+}
+
+TEST_F(FileCacheTest, EvictsLeastRecentlyUsed) {
+  std::string contents(1000, ' ');
+  contents += "(a)";
+  FileCache cache(2500);
+
+  auto a = write("a.p", contents);
+  auto b = write("b.p", contents);
+  auto c = write("c.p", contents);
+
+  cache.get(a, FileCache::Query::Index);
+  cache.get(b, FileCache::Query::Index);
+  cache.get(a, FileCache::Query::Index);
+  EXPECT_EQ(2u, cache.entries());
+
+  cache.get(c, FileCache::Query::Index);
+  EXPECT_EQ(2u, cache.entries());
+  EXPECT_LE(cache.bytes(), 2500u);
+
+  size_t misses = cache.misses();
+  cache.get(a, FileCache::Query::Index);
+  EXPECT_EQ(misses, cache.misses());
+  cache.get(b, FileCache::Query::Index);
+  EXPECT_EQ(misses + 1, cache.misses());
+}
+
+TEST_F(FileCacheTest, LoadingEvicts) {
+  std::string contents(1000, ' ');
+  contents += "(a)";
+  FileCache cache(2500);
+
+  auto a = write("a.p", contents);
+  auto b = write("b.p", contents);
+  auto c = write("c.p", contents);
+
+  // only the binary form, which loading the file renders.
+  cache.get(a, FileCache::Query::Binary);
+  cache.get(b, FileCache::Query::Binary);
+  cache.get(c, FileCache::Query::Binary);
+  EXPECT_EQ(2u, cache.entries());
+  EXPECT_LE(cache.bytes(), 2500u);
+}
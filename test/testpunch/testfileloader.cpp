@@ -0,0 +1,146 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+#include <fileloader.hpp>
+#include <tokenizer.hpp>
+
+namespace fs = boost::filesystem;
+
+class FileLoaderTest : public ::testing::Test {
+public:
+  FileLoaderTest() {}
+  ~FileLoaderTest() {}
+
+  void SetUp() {
+    dir = fs::temp_directory_path() / fs::unique_path("testpunch-%%%%-%%%%");
+    fs::create_directories(dir);
+  }
+
+  void TearDown() {
+    fs::remove_all(dir);
+  }
+
+  std::string write(const std::string& name, const std::string& contents) {
+    std::string path = (dir / name).string();
+    std::ofstream(path, std::ios::binary) << contents;
+    return path;
+  }
+
+  fs::path dir;
+};
+
+static const FileLoader::Backend backends[] = {FileLoader::Backend::Auto, FileLoader::Backend::Threads};
+
+TEST_F(FileLoaderTest, Load) {
+  std::vector<std::string> paths;
+  std::vector<std::string> contents;
+  for (int i = 0; i < 50; ++i) {
+    contents.push_back(std::string(i * 997, static_cast<char>('a' + i % 26)) + "(" + std::to_string(i) + ")");
+    paths.push_back(write(std::to_string(i) + ".p", contents.back()));
+  }
+  paths.push_back(write("empty.p", ""));
+  contents.push_back("");
+  paths.push_back((dir / "missing.p").string());
+  contents.push_back("");
+
+  for (auto backend : backends) {
+    FileLoader loader(4, 64 << 10, backend);
+    std::vector<int> seen(paths.size());
+
+    loader.load(paths, [&](LoadedFile&& file) {
+      ++seen.at(file.index());
+      if (file.index() + 1 == paths.size()) {
+        EXPECT_EQ(ENOENT, file.error());
+        return;
+      }
+      EXPECT_EQ(0, file.error());
+      EXPECT_EQ(contents[file.index()], std::string(file.data(), file.size()));
+    });
+
+    EXPECT_EQ(std::vector<int>(paths.size(), 1), seen);
+    EXPECT_LE(loader.peak_bytes(), 64u << 10);
+  }
+}
+
+TEST_F(FileLoaderTest, Backend) {
+  EXPECT_EQ(FileLoader::Backend::Threads, FileLoader(4, 1 << 20, FileLoader::Backend::Threads).backend());
+  EXPECT_NE(FileLoader::Backend::Auto, FileLoader().backend());
+}
+
+TEST_F(FileLoaderTest, Scanner) {
+  std::vector<std::string> paths = {write("form.p", "(def a 1)")};
+
+  for (auto backend : backends) {
+    FileLoader loader(2, 1 << 20, backend);
+    loader.load(paths, [](LoadedFile&& file) {
+      // the scanner reads the loaded buffer itself.
+      auto scanner = file.scanner();
+      size_t size;
+      EXPECT_EQ(file.data(), scanner->remaining(size));
+
+      Tokenizer tokenizer(std::move(scanner));
+      EXPECT_EQ(TokenType::RoundOpen, tokenizer.next().type);
+      EXPECT_EQ("def", tokenizer.next().value);
+    });
+  }
+}
+
+TEST_F(FileLoaderTest, BoundedBytes) {
+  std::vector<std::string> paths;
+  for (int i = 0; i < 20; ++i) {
+    paths.push_back(write(std::to_string(i) + ".p", std::string(10 << 10, 'x')));
+  }
+  // larger than the budget, read on its own.
+  paths.push_back(write("large.p", std::string(100 << 10, 'y')));
+
+  for (auto backend : backends) {
+    FileLoader loader(8, 32 << 10, backend);
+    size_t bytes = 0;
+    loader.load(paths, [&bytes](LoadedFile&& file) {
+      bytes += file.size();
+    });
+    EXPECT_EQ(300u << 10, bytes);
+    EXPECT_LE(loader.peak_bytes(), 100u << 10);
+
+    // kept files hold their bytes, the others are read one at a time meanwhile.
+    std::vector<LoadedFile> kept;
+    loader.load(paths, [&kept](LoadedFile&& file) {
+      kept.push_back(std::move(file));
+    });
+    EXPECT_EQ(paths.size(), kept.size());
+    kept.clear();
+  }
+}
+
+TEST_F(FileLoaderTest, ConsumerThrows) {
+  std::vector<std::string> paths;
+  for (int i = 0; i < 20; ++i) {
+    paths.push_back(write(std::to_string(i) + ".p", std::string(4096, 'z')));
+  }
+
+  for (auto backend : backends) {
+    FileLoader loader(4, 16 << 10, backend);
+    EXPECT_THROW(loader.load(paths, [](LoadedFile&&) {
+      throw std::runtime_error("stop");
+    }), std::runtime_error);
+
+    // the loader is usable again and has all of its budget.
+    size_t count = 0;
+    loader.load(paths, [&count](LoadedFile&&) {
+      ++count;
+    });
+    EXPECT_EQ(paths.size(), count);
+    EXPECT_LE(loader.peak_bytes(), 16u << 10);
+  }
+}
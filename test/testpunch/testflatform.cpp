@@ -0,0 +1,122 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <boost/filesystem.hpp>
+#include <flatform.hpp>
+
+namespace fs = boost::filesystem;
+
+class FlatFormTest : public ::testing::Test {
+public:
+  FlatFormTest() {}
+  ~FlatFormTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+TEST_F(FlatFormTest, Accessors) {
+  auto data = flatform::write(read_forms("(def config {:port 8080 :ratio 3/4 :load 0.5 :name \"db\"})"));
+
+  std::string error;
+  ASSERT_TRUE(flatform::validate(data.data(), data.size(), error)) << error;
+
+  flatform::Forms forms(data.data(), data.size());
+  ASSERT_EQ(1u, forms.size());
+  ASSERT_EQ(ExpressionType::List, forms[0].type());
+  EXPECT_EQ(std::make_tuple(1u, 1u), forms[0].position());
+
+  auto list = forms[0].as<flatform::List>().inner();
+  ASSERT_EQ(3u, list.size());
+  EXPECT_EQ("def", list[0].as<flatform::Literal>().value());
+  EXPECT_EQ("config", list[1].as<flatform::Literal>().value());
+
+  auto map = list[2].as<flatform::Map>().inner();
+  ASSERT_EQ(8u, map.size());
+  EXPECT_EQ(ExpressionType::Keyword, map[0].type());
+  EXPECT_EQ("port", map[0].as<flatform::Keyword>().value());
+  EXPECT_EQ(8080, map[1].as<flatform::Integer>().value());
+  EXPECT_EQ(3, map[3].as<flatform::Ratio>().numerator());
+  EXPECT_EQ(4, map[3].as<flatform::Ratio>().denominator());
+  EXPECT_DOUBLE_EQ(0.5, map[5].as<flatform::Float>().value());
+  EXPECT_EQ("db", map[7].as<flatform::String>().value());
+
+  size_t keys = 0;
+  for (auto it = map.begin(); it != map.end(); ++it) {
+    if ((*it).type() == ExpressionType::Keyword) {
+      ++keys;
+    }
+  }
+  EXPECT_EQ(4u, keys);
+}
+
+TEST_F(FlatFormTest, Roundtrip) {
+  auto forms = read_forms("(defn test [a b]\n  {:a 1 :b -2.5 :c 3/4})\n#{:x :y} \"string\" [[[[]]]] ()");
+  auto data = flatform::write(forms);
+
+  flatform::Forms view(data.data(), data.size());
+  ASSERT_EQ(forms.size(), view.size());
+
+  size_t i = 0;
+  for (auto it = forms.begin(); it != forms.end(); ++it, ++i) {
+    auto copy = flatform::to_expression(view[i]);
+    EXPECT_EQ(*it, copy);
+    EXPECT_EQ((*it)->pos, copy->pos);
+  }
+}
+
+TEST_F(FlatFormTest, MappedFile) {
+  fs::path path = fs::temp_directory_path() / fs::unique_path("punch-flat-%%%%-%%%%.pflat");
+  flatform::write_file(read_forms("(a 1) [b 2]"), path.string());
+
+  {
+    flatform::MappedFile file(path.string());
+    ASSERT_EQ(2u, file.forms().size());
+    EXPECT_EQ(ExpressionType::Vector, file.forms()[1].type());
+    EXPECT_EQ("b", file.forms()[1].as<flatform::Vector>().inner()[0].as<flatform::Literal>().value());
+  }
+
+  fs::remove(path);
+  EXPECT_THROW(flatform::MappedFile(path.string()), ReaderException);
+}
+
+TEST_F(FlatFormTest, RejectsInvalidData) {
+  auto data = flatform::write(read_forms("(a [b c] {:d 1} \"str\")"));
+  std::string error;
+
+  EXPECT_FALSE(flatform::validate(data.data(), 8, error));
+  EXPECT_FALSE(flatform::validate(data.data(), data.size() - 4, error));
+
+  std::string bad_magic = data;
+  bad_magic[0] = 'X';
+  EXPECT_FALSE(flatform::validate(bad_magic.data(), bad_magic.size(), error));
+
+  // a child pointing at its own parent would make traversal loop forever.
+  std::string cycle = data;
+  uint32_t root;
+  std::memcpy(&root, &cycle[flatform::header_size], 4);
+  root += flatform::header_size;
+  int32_t self = -int32_t(flatform::node_header_size);
+  std::memcpy(&cycle[root + flatform::node_header_size], &self, 4);
+  EXPECT_FALSE(flatform::validate(cycle.data(), cycle.size(), error));
+  EXPECT_EQ("Reference does not point backwards", error);
+
+  for (size_t i = 0; i < data.size(); ++i) {
+    std::string damaged = data;
+    damaged[i] = static_cast<char>(damaged[i] ^ 0x5a);
+    if (flatform::validate(damaged.data(), damaged.size(), error)) {
+      flatform::Forms view(damaged.data(), damaged.size());
+      for (size_t f = 0; f < view.size(); ++f) {
+        flatform::to_expression(view[f]);
+      }
+    }
+  }
+}
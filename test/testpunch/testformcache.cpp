@@ -0,0 +1,84 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <boost/filesystem.hpp>
+#include <formcache.hpp>
+
+namespace fs = boost::filesystem;
+
+class FormCacheTest : public ::testing::Test {
+public:
+  FormCacheTest() {}
+  ~FormCacheTest() {}
+
+  void SetUp() {
+    directory = fs::temp_directory_path() / fs::unique_path("punch-cache-%%%%-%%%%");
+  }
+
+  void TearDown() {
+    fs::remove_all(directory);
+  }
+
+  fs::path directory;
+};
+
+TEST_F(FormCacheTest, MissThenHit) {
+  FormCache cache(directory.string());
+  std::string source = "(def a {:b [1 2 3]})";
+
+  auto first = cache.read(source);
+  EXPECT_EQ(0u, cache.hits());
+  EXPECT_EQ(1u, cache.misses());
+  EXPECT_TRUE(fs::exists(cache.entry_path(source)));
+
+  auto second = cache.read(source);
+  EXPECT_EQ(1u, cache.hits());
+  EXPECT_EQ(1u, cache.misses());
+
+  ASSERT_EQ(1u, second.size());
+  EXPECT_EQ(first.front(), second.front());
+  EXPECT_EQ(std::make_tuple(1u, 1u), second.front()->pos);
+}
+
+TEST_F(FormCacheTest, ChangedSourceMisses) {
+  FormCache cache(directory.string());
+
+  cache.read("(a)");
+  cache.read("(b)");
+
+  EXPECT_EQ(2u, cache.misses());
+  EXPECT_NE(cache.entry_path("(a)"), cache.entry_path("(b)"));
+}
+
+TEST_F(FormCacheTest, DamagedEntryIsReplaced) {
+  FormCache cache(directory.string());
+  std::string source = "[1 2 3]";
+
+  cache.read(source);
+  {
+    std::ofstream out(cache.entry_path(source), std::ios::trunc);
+    out << "garbage";
+  }
+
+  auto forms = cache.read(source);
+  EXPECT_EQ(2u, cache.misses());
+  EXPECT_EQ(1u, forms.size());
+
+  cache.read(source);
+  EXPECT_EQ(1u, cache.hits());
+}
+
+TEST_F(FormCacheTest, ErrorsAreNotCached) {
+  FormCache cache(directory.string());
+
+  EXPECT_THROW(cache.read("(a"), ReaderException);
+  EXPECT_FALSE(fs::exists(cache.entry_path("(a")));
+}
@@ -0,0 +1,130 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <sstream>
+#include <gtest/gtest.h>
+#include <generator.hpp>
+#include <reader.hpp>
+#include <tokenizer.hpp>
+#include <util.hpp>
+
+class GeneratorTest : public ::testing::Test {
+public:
+  GeneratorTest() {}
+  ~GeneratorTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+size_t depth(const Expression& e) {
+  const std::list<UExpression>* inner = nullptr;
+
+  switch (e.type()) {
+    case ExpressionType::List: inner = &static_cast<const List&>(e).inner(); break;
+    case ExpressionType::Vector: inner = &static_cast<const Vector&>(e).inner(); break;
+    case ExpressionType::Map: inner = &static_cast<const Map&>(e).inner(); break;
+    case ExpressionType::Set: inner = &static_cast<const Set&>(e).inner(); break;
+    default: return 0;
+  }
+
+  size_t deepest = 0;
+  for (auto it = inner->begin(); it != inner->end(); ++it) {
+    deepest = std::max(deepest, depth(**it));
+  }
+  return deepest + 1;
+}
+
+TEST_F(GeneratorTest, Deterministic) {
+  GeneratorOptions options;
+  options.size = 16 << 10;
+
+  auto a = CorpusGenerator(options).generate();
+  auto b = CorpusGenerator(options).generate();
+  EXPECT_EQ(a, b);
+
+  options.seed = 2;
+  EXPECT_NE(a, CorpusGenerator(options).generate());
+}
+
+TEST_F(GeneratorTest, Size) {
+  GeneratorOptions options;
+  options.size = 64 << 10;
+
+  auto out = CorpusGenerator(options).generate();
+  EXPECT_LE(options.size, out.size());
+  EXPECT_GT(options.size + (8 << 10), out.size());
+}
+
+TEST_F(GeneratorTest, StreamsSameOutput) {
+  GeneratorOptions options;
+  options.size = 32 << 10;
+
+  std::ostringstream os;
+  CorpusGenerator(options).write(os, 1024);
+  EXPECT_EQ(CorpusGenerator(options).generate(), os.str());
+}
+
+TEST_F(GeneratorTest, Readable) {
+  GeneratorOptions options;
+  options.size = 64 << 10;
+  options.max_depth = 5;
+  options.nesting = 0.6;
+  options.comments = 0.3;
+
+  auto forms = read_forms(CorpusGenerator(options).generate());
+  ASSERT_LT(0u, forms.size());
+
+  size_t deepest = 0;
+  for (auto it = forms.begin(); it != forms.end(); ++it) {
+    EXPECT_EQ(ExpressionType::List, (*it)->type());
+    deepest = std::max(deepest, depth(**it));
+  }
+  EXPECT_EQ(5u, deepest);
+}
+
+TEST_F(GeneratorTest, AtomMix) {
+  GeneratorOptions options;
+  options.size = 8 << 10;
+  options.nesting = 0;
+  options.comments = 0;
+  options.atoms = AtomMix();
+  options.atoms.keywords = 0;
+  options.atoms.symbols = 0;
+  options.atoms.integers = 0;
+  options.atoms.hex_integers = 0;
+  options.atoms.ratios = 0;
+  options.atoms.floats = 0;
+  options.atoms.strings = 0;
+  options.atoms.regexes = 1;
+  options.atoms.chars = 1;
+
+  auto out = CorpusGenerator(options).generate();
+  EXPECT_EQ(std::string::npos, out.find(';'));
+
+  Tokenizer tokenizer(make_unique<StringScanner>(out));
+  size_t regexes = 0, chars = 0;
+  for (auto token = tokenizer.next(); token.type != TokenType::EndOfFile; token = tokenizer.next()) {
+    regexes += token.type == TokenType::Regex;
+    chars += token.type == TokenType::Char;
+  }
+
+  EXPECT_LT(0u, regexes);
+  EXPECT_LT(0u, chars);
+}
+
+TEST_F(GeneratorTest, NeedsAtoms) {
+  GeneratorOptions options;
+  options.atoms = AtomMix();
+  options.atoms.keywords = options.atoms.symbols = options.atoms.integers = 0;
+  options.atoms.hex_integers = options.atoms.ratios = options.atoms.floats = options.atoms.strings = 0;
+
+  EXPECT_THROW(CorpusGenerator generator(options), std::invalid_argument);
+}
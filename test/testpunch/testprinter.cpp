@@ -0,0 +1,89 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <sstream>
+#include <gtest/gtest.h>
+#include <printer.hpp>
+#include <util.hpp>
+
+class PrinterTest : public ::testing::Test {
+public:
+  PrinterTest() {}
+  ~PrinterTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+std::string punch(const std::string& in) {
+  std::string out;
+  auto forms = read_forms(in);
+  for (auto it = forms.begin(); it != forms.end(); ++it) {
+    if (it != forms.begin()) {
+      out += " ";
+    }
+    Printer::append(out, **it, Printer::Format::Punch);
+  }
+  return out;
+}
+
+TEST_F(PrinterTest, Debug) {
+  auto forms = read_forms("(+ :a 1 -1.5 3/4 \"s\" [x] {k v} #{})");
+
+  EXPECT_EQ("LIST (LIT (+), KW (a), INT (1), FLOAT (-1.500000), RATIO (3/4), STR (s), "
+            "VEC (LIT (x), ), MAP (LIT (k), LIT (v), ), SET (), )",
+            forms.front()->DebugInfo());
+
+  EXPECT_EQ(forms.front()->DebugInfo(), Printer::to_string(*forms.front(), Printer::Format::Debug));
+  EXPECT_EQ("EOF", EndOfFile().DebugInfo());
+}
+
+TEST_F(PrinterTest, Punch) {
+  EXPECT_EQ("(+ :a 1 -1.5 3/4 \"s\" [x] {k v} #{})", punch("(+ :a 1 -1.5 3/4 \"s\" [x] {k v} #{})"));
+  EXPECT_EQ("17 8 0.0 2.0", punch("0x11 010 0. 2.0"));
+  EXPECT_EQ("() [] {}", punch("(),[],{}"));
+  EXPECT_EQ("\"say \\\"hi\\\" \\\\ bye\"", punch("\"say \\\"hi\\\" \\\\ bye\""));
+}
+
+TEST_F(PrinterTest, PunchReadsBack) {
+  std::string in = "(defn test [a b]\n  {:a 1 :b -2.5 :c 3/4 :d 1e10 :e 0.1})\n#{:x :y} \"string\" [[[[]]]] \"q\\\"uote\\n\"";
+
+  auto forms = read_forms(in);
+  auto again = read_forms(punch(in));
+
+  ASSERT_EQ(forms.size(), again.size());
+  for (auto a = forms.begin(), b = again.begin(); a != forms.end(); ++a, ++b) {
+    EXPECT_EQ(*a, *b);
+  }
+}
+
+TEST_F(PrinterTest, Tokens) {
+  std::string out;
+  Printer::append(out, Token::Literal("abc", std::make_tuple(1, 2)));
+  EXPECT_EQ(Token::Literal("abc", std::make_tuple(1, 2)).DebugInfo(), out);
+
+  out.clear();
+  Printer::append(out, Token::RoundOpen(std::make_tuple(3, 4)));
+  EXPECT_EQ(Token::RoundOpen(std::make_tuple(3, 4)).DebugInfo(), out);
+}
+
+TEST_F(PrinterTest, Stream) {
+  std::ostringstream os;
+  {
+    // a tiny capacity forces a bulk write on every print.
+    Printer printer(os, Printer::Format::Punch, 4);
+    auto forms = read_forms("(a b) [c d]");
+    for (auto it = forms.begin(); it != forms.end(); ++it) {
+      printer.print(**it).write('\n');
+    }
+  }
+
+  EXPECT_EQ("(a b)\n[c d]\n", os.str());
+}
@@ -0,0 +1,197 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <generator.hpp>
+#include <printer.hpp>
+#include <query.hpp>
+
+namespace {
+  std::vector<std::string> printed(const std::vector<const Expression*>& values) {
+    std::vector<std::string> out;
+    for (auto it = values.begin(); it != values.end(); ++it) {
+      out.push_back((*it)->DebugInfo());
+    }
+    return out;
+  }
+
+  std::vector<std::string> printed(const std::list<UExpression>& values) {
+    std::vector<std::string> out;
+    for (auto it = values.begin(); it != values.end(); ++it) {
+      out.push_back((*it)->DebugInfo());
+    }
+    return out;
+  }
+
+  std::vector<std::string> printed(const std::string& source) {
+    return printed(read_forms(source));
+  }
+
+  const std::string config = "{:services {:db {:pool-size 10 :hosts [\"a\" \"b\"]}\n"
+                             "            :cache {:pool-size 4 :hosts [\"c\"]}}\n"
+                             " \"name\" \"app\"\n"
+                             " 1 :one\n"
+                             " enabled true\n"
+                             " :steps ((:build 1) (:test 2))}";
+}
+
+TEST(QueryTest, Plan) {
+  query::Plan plan("[:a \"b\" c 2 *]");
+
+  ASSERT_EQ(5u, plan.size());
+  EXPECT_EQ(ExpressionType::Keyword, plan.steps()[0].type);
+  EXPECT_EQ("a", plan.steps()[0].text);
+  EXPECT_EQ(ExpressionType::String, plan.steps()[1].type);
+  EXPECT_EQ(ExpressionType::Literal, plan.steps()[2].type);
+  EXPECT_EQ(2, plan.steps()[3].integer);
+  EXPECT_EQ(query::Plan::Step::Kind::Key, plan.steps()[3].kind);
+  EXPECT_EQ(query::Plan::Step::Kind::Wildcard, plan.steps()[4].kind);
+
+  EXPECT_EQ(0u, query::Plan("[]").size());
+  EXPECT_THROW(query::Plan("(:a)"), ReaderException);
+  EXPECT_THROW(query::Plan("[:a] [:b]"), ReaderException);
+  EXPECT_THROW(query::Plan("[1.5]"), ReaderException);
+  EXPECT_THROW(query::Plan("[[:a]]"), ReaderException);
+  EXPECT_THROW(query::Plan("[:a"), ReaderException);
+}
+
+TEST(QueryTest, Select) {
+  auto forms = read_forms(config);
+  const Expression& root = *forms.front();
+  query::Engine engine;
+
+  EXPECT_EQ(printed("10"), printed(engine.select(query::Plan("[:services :db :pool-size]"), root)));
+  EXPECT_EQ(printed("\"b\""), printed(engine.select(query::Plan("[:services :db :hosts 1]"), root)));
+  EXPECT_EQ(printed("10 4"), printed(engine.select(query::Plan("[:services * :pool-size]"), root)));
+  EXPECT_EQ(printed("\"a\" \"b\" \"c\""), printed(engine.select(query::Plan("[:services * :hosts *]"), root)));
+  EXPECT_EQ(printed("\"app\""), printed(engine.select(query::Plan("[\"name\"]"), root)));
+  EXPECT_EQ(printed(":one"), printed(engine.select(query::Plan("[1]"), root)));
+  EXPECT_EQ(printed("true"), printed(engine.select(query::Plan("[enabled]"), root)));
+  EXPECT_EQ(printed("2"), printed(engine.select(query::Plan("[:steps 1 1]"), root)));
+  EXPECT_EQ(printed(config), printed(engine.select(query::Plan("[]"), root)));
+
+  EXPECT_TRUE(engine.select(query::Plan("[:services :queue]"), root).empty());
+  EXPECT_TRUE(engine.select(query::Plan("[:services :db :hosts 2]"), root).empty());
+  EXPECT_TRUE(engine.select(query::Plan("[:services :db :hosts -1]"), root).empty());
+  EXPECT_TRUE(engine.select(query::Plan("[:services :db :pool-size *]"), root).empty());
+  EXPECT_TRUE(engine.select(query::Plan("[name]"), root).empty());
+
+  EXPECT_EQ("INT (4)", engine.first(query::Plan("[:services :cache :pool-size]"), root)->DebugInfo());
+  EXPECT_EQ("INT (10)", engine.first(query::Plan("[:services * :pool-size]"), root)->DebugInfo());
+  EXPECT_EQ(nullptr, engine.first(query::Plan("[:missing]"), root));
+}
+
+TEST(QueryTest, Forms) {
+  auto forms = read_forms("{:a 1} [2 3] {:a 4}");
+  query::Engine engine;
+
+  EXPECT_EQ(printed("1 4"), printed(engine.select(query::Plan("[:a]"), forms)));
+  EXPECT_EQ(printed("3"), printed(engine.select(query::Plan("[1]"), forms)));
+}
+
+TEST(QueryTest, Indexes) {
+  std::string source = "{";
+  for (int i = 0; i < 100; ++i) {
+    source += ":k" + std::to_string(i) + " [" + std::to_string(i) + " " + std::to_string(i * 2) + "] ";
+  }
+  source += ":k5 :duplicate}";
+  auto forms = read_forms(source);
+
+  query::Engine engine(8);
+  query::Engine scanning(1000);
+
+  for (int i = 0; i < 100; i += 7) {
+    query::Plan plan("[:k" + std::to_string(i) + " 1]");
+    EXPECT_EQ(printed(std::to_string(i * 2)), printed(engine.select(plan, *forms.front())));
+    EXPECT_EQ(printed(std::to_string(i * 2)), printed(scanning.select(plan, *forms.front())));
+  }
+
+  // the first entry of a key is the one selected.
+  EXPECT_EQ(printed("[5 10]"), printed(engine.select(query::Plan("[:k5]"), *forms.front())));
+  EXPECT_EQ(printed("[5 10]"), printed(scanning.select(query::Plan("[:k5]"), *forms.front())));
+
+  // the map only, its vectors are too small.
+  EXPECT_EQ(1u, engine.indexed());
+  EXPECT_EQ(0u, scanning.indexed());
+
+  engine.clear();
+  EXPECT_EQ(0u, engine.indexed());
+}
+
+TEST(QueryTest, ReadSelected) {
+  auto result = query::select(query::Plan("[:services * :hosts]"), config);
+  ASSERT_TRUE(result.ok());
+  EXPECT_EQ(printed("[\"a\" \"b\"] [\"c\"]"), printed(result.forms));
+  EXPECT_EQ(std::make_tuple(1u, 39u), result.forms.front()->pos);
+
+  result = query::select(query::Plan("[:a]"), "{:a 1}\n(:a 2)\n{:b 3 :a {:c 4}}");
+  ASSERT_TRUE(result.ok());
+  EXPECT_EQ(printed("1 {:c 4}"), printed(result.forms));
+
+  result = query::select(query::Plan("[]"), config);
+  ASSERT_TRUE(result.ok());
+  EXPECT_EQ(printed(config), printed(result.forms));
+}
+
+TEST(QueryTest, ReadSelectedSkipsOtherValues) {
+  // the reader does not read regexes, which only matters where they are selected.
+  std::string source = "{:patterns [#\"a+\" #\"b+\"] :size 3}";
+  EXPECT_FALSE(try_read_forms(source).ok());
+
+  auto result = query::select(query::Plan("[:size]"), source);
+  ASSERT_TRUE(result.ok());
+  EXPECT_EQ(printed("3"), printed(result.forms));
+
+  result = query::select(query::Plan("[:patterns 0]"), source);
+  ASSERT_EQ(1u, result.diagnostics.size());
+  EXPECT_EQ("Unsupported token #\"", result.diagnostics[0].message);
+}
+
+TEST(QueryTest, ReadSelectedErrors) {
+  auto result = query::select(query::Plan("[:b]"), "{:a [1 2 :b 3}");
+  ASSERT_EQ(1u, result.diagnostics.size());
+  EXPECT_EQ("Expected ] got }", result.diagnostics[0].message);
+  EXPECT_EQ(std::make_tuple(1u, 14u), result.diagnostics[0].pos);
+
+  result = query::select(query::Plan("[:b]"), "{:a 1 :b");
+  ASSERT_EQ(1u, result.diagnostics.size());
+  EXPECT_EQ("EOF, expected }", result.diagnostics[0].message);
+
+  result = query::select(query::Plan("[:b]"), "{:a {:x 1 :b}");
+  ASSERT_EQ(1u, result.diagnostics.size());
+  EXPECT_EQ("EOF, expected }", result.diagnostics[0].message);
+
+  result = query::select(query::Plan("[:b]"), "{:b 1 :a}");
+  ASSERT_EQ(1u, result.diagnostics.size());
+  EXPECT_EQ("Map entries should be even", result.diagnostics[0].message);
+
+  result = query::select(query::Plan("[:b]"), "{:b 1} )");
+  EXPECT_EQ(printed("1"), printed(result.forms));
+  ASSERT_EQ(1u, result.diagnostics.size());
+  EXPECT_EQ("Closing tag without open", result.diagnostics[0].message);
+}
+
+TEST(QueryTest, ReadSelectedSameAsEngine) {
+  GeneratorOptions options;
+  options.size = 64 << 10;
+  options.nesting = 0.4;
+  std::string source = CorpusGenerator(options).generate();
+  auto forms = read_forms(source);
+
+  const char* paths[] = {"[]", "[*]", "[0]", "[1 *]", "[* *]", "[* 0 *]", "[2 * 1]", "[* * *]"};
+  for (auto path : paths) {
+    query::Plan plan(path);
+    query::Engine engine(4);
+
+    auto lazy = query::select(plan, source);
+    ASSERT_TRUE(lazy.ok()) << path;
+    EXPECT_EQ(printed(engine.select(plan, forms)), printed(lazy.forms)) << path;
+  }
+}
@@ -287,4 +287,154 @@ TEST_F(ReaderTest, InterleavedErrors) {
   assert_reader_error("#{[}]");
   assert_reader_error("#{(})");
   assert_reader_error("{({)}{][)");
-}
\ No newline at end of file
+}
+
+Diagnostic first_diagnostic(std::string in) {
+  auto result = try_read_forms(in);
+  EXPECT_FALSE(result.ok());
+  return result.ok() ? Diagnostic() : result.diagnostics.front();
+}
+
+TEST_F(ReaderTest, Diagnostics) {
+  auto d = first_diagnostic("(a\n  [b c)");
+  EXPECT_EQ("Expected ] got )", d.message);
+  EXPECT_EQ(std::make_tuple(2, 7), d.pos);
+  EXPECT_EQ(TokenType::SquareClose, *d.expected);
+
+  d = first_diagnostic("(a)\n(b [c]");
+  EXPECT_EQ("EOF, expected )", d.message);
+  EXPECT_EQ(std::make_tuple(2, 1), d.pos);
+  EXPECT_EQ(TokenType::RoundClose, *d.expected);
+
+  d = first_diagnostic("{:a 1 :b}");
+  EXPECT_EQ("Map entries should be even", d.message);
+  EXPECT_EQ(std::make_tuple(1, 1), d.pos);
+  EXPECT_FALSE(d.expected);
+
+  d = first_diagnostic("a ]");
+  EXPECT_EQ("Closing tag without open", d.message);
+  EXPECT_EQ(std::make_tuple(1, 3), d.pos);
+
+  d = first_diagnostic("(a \"bc");
+  EXPECT_EQ("Unexpected stream end", d.message);
+  EXPECT_EQ(std::make_tuple(1, 4), d.pos);
+  EXPECT_EQ(TokenType::String, *d.expected);
+
+  d = first_diagnostic("[#(inc %)]");
+  EXPECT_EQ("Unsupported token #(", d.message);
+
+  d = first_diagnostic("99999999999999999999999");
+  EXPECT_EQ("Invalid integer", d.message);
+}
+
+TEST_F(ReaderTest, TryReadKeepsFormsBeforeError) {
+  auto result = try_read_forms("(a) [b] {:c}");
+
+  ASSERT_EQ(2u, result.forms.size());
+  EXPECT_EQ(ExpressionType::List, result.forms.front()->type());
+  EXPECT_EQ(1u, result.diagnostics.size());
+}
+
+TEST_F(ReaderTest, FailedReaderStaysFailed) {
+  Reader reader(make_unique<Tokenizer>(make_unique<StringScanner>("] (a)")));
+
+  EXPECT_FALSE(reader.try_next());
+  EXPECT_TRUE(reader.failed());
+  EXPECT_FALSE(reader.try_next());
+  EXPECT_EQ(1u, reader.diagnostics().size());
+  EXPECT_THROW(reader.next(), std::exception);
+}
+
+ReadResult recover(std::string in) {
+  return try_read_forms(in, true);
+}
+
+std::string printed(const ReadResult& result) {
+  std::string out;
+  for (auto it = result.forms.begin(); it != result.forms.end(); ++it) {
+    out += (*it)->DebugInfo() + "; ";
+  }
+  return out;
+}
+
+TEST_F(ReaderTest, RecoverBalanced) {
+  auto result = recover("(a [b c) d)\n(e)\n{:f 1 :g}\n[h]");
+
+  ASSERT_EQ(2u, result.diagnostics.size());
+  EXPECT_EQ("Expected ] got )", result.diagnostics[0].message);
+  EXPECT_EQ("Map entries should be even", result.diagnostics[1].message);
+  EXPECT_EQ(std::make_tuple(3, 1), result.diagnostics[1].pos);
+  EXPECT_EQ("LIST (LIT (e), ); VEC (LIT (h), ); ", printed(result));
+}
+
+TEST_F(ReaderTest, RecoverMissingClose) {
+  auto result = recover("(defn f [x]\n  (inc x)\n\n(def y 1)\n(def z [1 2)\n(def w 3)");
+
+  ASSERT_EQ(2u, result.diagnostics.size());
+  EXPECT_EQ("Expected ) before the next top-level form", result.diagnostics[0].message);
+  EXPECT_EQ(std::make_tuple(1, 1), result.diagnostics[0].pos);
+  EXPECT_EQ(TokenType::RoundClose, *result.diagnostics[0].expected);
+  EXPECT_EQ("Expected ] got )", result.diagnostics[1].message);
+  EXPECT_EQ("LIST (LIT (def), LIT (y), INT (1), ); LIST (LIT (def), LIT (w), INT (3), ); ", printed(result));
+}
+
+TEST_F(ReaderTest, RecoverTopLevel) {
+  auto result = recover("a ] b 99999999999999999999999 c #(x) d");
+
+  ASSERT_EQ(3u, result.diagnostics.size());
+  EXPECT_EQ("Closing tag without open", result.diagnostics[0].message);
+  EXPECT_EQ("Invalid integer", result.diagnostics[1].message);
+  EXPECT_EQ("Unsupported token #(", result.diagnostics[2].message);
+  EXPECT_EQ("LIT (a); LIT (b); LIT (c); LIT (d); ", printed(result));
+}
+
+TEST_F(ReaderTest, RecoverEndOfInput) {
+  auto result = recover("(a) (b [c]\n  d");
+  ASSERT_EQ(1u, result.diagnostics.size());
+  EXPECT_EQ("EOF, expected )", result.diagnostics[0].message);
+  EXPECT_EQ(1u, result.forms.size());
+
+  result = recover("(a) \"open");
+  ASSERT_EQ(1u, result.diagnostics.size());
+  EXPECT_EQ("Unexpected stream end", result.diagnostics[0].message);
+}
+
+TEST_F(ReaderTest, RecoverNothingToDo) {
+  auto result = recover("(a)\n[b]");
+  EXPECT_TRUE(result.ok());
+  EXPECT_EQ(2u, result.forms.size());
+
+  // without recovery column 1 inside a form is fine.
+  EXPECT_TRUE(try_read_forms("(def x\n[1 2])").ok());
+}
+
+TEST_F(ReaderTest, MessageReader) {
+  MessageReader reader;
+
+  std::string first = "(order :id 1)";
+  reader.reset(first);
+  EXPECT_EQ("LIST (LIT (order), KW (id), INT (1), )", reader.next()->DebugInfo());
+  EXPECT_EQ(ExpressionType::EndOfFile, reader.next()->type());
+
+  // a malformed message does not carry over to the next one.
+  std::string broken = "[1 2";
+  reader.reset(broken);
+  EXPECT_EQ(nullptr, reader.try_next());
+  EXPECT_EQ(1u, reader.diagnostics().size());
+
+  std::string unterminated = "\"abc";
+  reader.reset(unterminated);
+  EXPECT_EQ(nullptr, reader.try_next());
+  EXPECT_EQ("Unexpected stream end", reader.diagnostics().front().message);
+
+  std::string second = ":a \"long enough to not fit in place\"";
+  reader.reset(second);
+  EXPECT_TRUE(reader.diagnostics().empty());
+  EXPECT_EQ("KW (a)", reader.next()->DebugInfo());
+  auto s = reader.next();
+  EXPECT_EQ("STR (long enough to not fit in place)", s->DebugInfo());
+  EXPECT_EQ(std::make_tuple(1u, 4u), s->pos);
+
+  reader.reset("", 0);
+  EXPECT_EQ(ExpressionType::EndOfFile, reader.next()->type());
+}
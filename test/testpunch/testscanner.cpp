@@ -10,6 +10,8 @@
 
 #include <gtest/gtest.h>
 #include <scanner.hpp>
+#include <fstream>
+#include <boost/filesystem.hpp>
 #include <boost/optional/optional_io.hpp>
 
 class ScannerTest : public ::testing::Test {
@@ -65,6 +67,33 @@ TEST_F(ScannerTest, StringScannerMinTest) {
   EXPECT_EQ(boost::none, scanner.next_char());
 }
 
+TEST_F(ScannerTest, SpanScannerTest) {
+  std::string first = "ab\nc";
+  SpanScanner scanner(first.data(), first.size());
+
+  EXPECT_EQ('a', scanner.current_char());
+  EXPECT_EQ('b', scanner.next_char());
+  scanner.flush_line();
+  EXPECT_EQ('c', scanner.current_char());
+  EXPECT_EQ('\n', scanner.previous_char());
+  EXPECT_EQ(std::make_tuple(2u, 1u), scanner.position());
+
+  std::string second = "xy";
+  scanner.reset(second.data(), second.size(), std::make_tuple(5u, 3u));
+  EXPECT_EQ('x', scanner.current_char());
+  EXPECT_EQ(boost::none, scanner.previous_char());
+  EXPECT_EQ(std::make_tuple(5u, 3u), scanner.position());
+
+  scanner.pop();
+  scanner.pop();
+  EXPECT_EQ(boost::none, scanner.current_char());
+  EXPECT_EQ('y', scanner.previous_char());
+  EXPECT_EQ(std::make_tuple(5u, 5u), scanner.position());
+
+  scanner.reset(nullptr, 0);
+  EXPECT_EQ(boost::none, scanner.current_char());
+}
+
 TEST_F(ScannerTest, LineScannerTest) {
   LineScanner scanner("resources/scanner_test.txt");
 
@@ -97,3 +126,75 @@ TEST_F(ScannerTest, LineScannerTest) {
   EXPECT_EQ(boost::none, scanner.previous_char());
   EXPECT_EQ(boost::none, scanner.next_char());
 }
+
+TEST_F(ScannerTest, CodePointColumns) {
+  // \xC3\xA9 and \xE2\x82\xAC are one column each.
+  std::string in = "a\xC3\xA9\xE2\x82\xAC b\n\xC3\xA9x";
+  StringScanner strings(in);
+  SpanScanner spans(in.data(), in.size());
+
+  for (Scanner* scanner : {static_cast<Scanner*>(&strings), static_cast<Scanner*>(&spans)}) {
+    scanner->skip(6);
+    EXPECT_EQ(std::make_tuple(1u, 4u), scanner->position());
+    scanner->pop();
+    EXPECT_EQ('b', scanner->current_char());
+    EXPECT_EQ(std::make_tuple(1u, 5u), scanner->position());
+
+    scanner->skip(4);
+    EXPECT_EQ('x', scanner->current_char());
+    EXPECT_EQ(std::make_tuple(2u, 2u), scanner->position());
+  }
+
+  std::string rest = "\xCE\xBBz";
+  StringScanner tail(rest, 2, std::make_tuple(3u, 7u));
+  EXPECT_EQ(std::make_tuple(3u, 7u), tail.position());
+  tail.pop();
+  EXPECT_EQ(std::make_tuple(3u, 8u), tail.position());
+}
+
+TEST_F(ScannerTest, LineScannerCodePointColumns) {
+  boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::ofstream(path.string()) << "\xC3\xA9\xC3\xA9x\n\xCE\xBB\xFFy\n";
+
+  LineScanner scanner(path.string());
+  scanner.pop();
+  scanner.pop();
+  scanner.pop();
+  scanner.pop();
+  EXPECT_EQ('x', scanner.current_char());
+  EXPECT_EQ(std::make_tuple(1u, 3u), scanner.position());
+
+  position where;
+  EXPECT_FALSE(scanner.validate(where));
+  EXPECT_EQ(std::make_tuple(2u, 2u), where);
+
+  boost::filesystem::remove(path);
+}
+
+TEST_F(ScannerTest, Validate) {
+  position where;
+  StringScanner valid("(\xC3\xA9 \xF4\x8F\xBF\xBF)");
+  EXPECT_TRUE(valid.validate(where));
+
+  std::string in = "ab\ncd\xC3\xA9\xF5";
+  SpanScanner invalid(in.data(), in.size());
+  EXPECT_FALSE(invalid.validate(where));
+  EXPECT_EQ(std::make_tuple(2u, 4u), where);
+
+  // only what is left is checked.
+  invalid.skip(7);
+  EXPECT_FALSE(invalid.validate(where));
+  EXPECT_EQ(std::make_tuple(2u, 4u), where);
+  invalid.pop();
+  EXPECT_TRUE(invalid.validate(where));
+}
+
+TEST_F(ScannerTest, LoadFile) {
+  std::string buffer;
+  ASSERT_TRUE(load_file("resources/simple.p", buffer));
+  EXPECT_FALSE(buffer.empty());
+
+  EXPECT_FALSE(load_file("resources/missing.p", buffer));
+  // opens, but has no contents to load.
+  EXPECT_FALSE(load_file("resources", buffer));
+}
@@ -0,0 +1,87 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <stats.hpp>
+#include <util.hpp>
+
+class StatsTest : public ::testing::Test {
+public:
+  StatsTest() {}
+  ~StatsTest() {}
+
+  void SetUp() {
+    stats::reset();
+    stats::enable();
+  }
+
+  void TearDown() {
+    stats::enable(false);
+    stats::reset();
+  }
+};
+
+#ifdef PUNCH_STATS
+
+TEST_F(StatsTest, Counts) {
+  read_forms("(def a {:b [1 2.5]}) \"str\"");
+  auto s = stats::snapshot();
+
+  EXPECT_EQ(26u, s.bytes_scanned);
+  EXPECT_EQ(1u, s.tokens[static_cast<size_t>(TokenType::RoundOpen)]);
+  EXPECT_EQ(1u, s.tokens[static_cast<size_t>(TokenType::CurlyOpen)]);
+  EXPECT_EQ(1u, s.tokens[static_cast<size_t>(TokenType::String)]);
+  EXPECT_EQ(1u, s.tokens[static_cast<size_t>(TokenType::EndOfFile)]);
+
+  EXPECT_EQ(1u, s.expressions[static_cast<size_t>(ExpressionType::List)]);
+  EXPECT_EQ(1u, s.expressions[static_cast<size_t>(ExpressionType::Map)]);
+  EXPECT_EQ(1u, s.expressions[static_cast<size_t>(ExpressionType::Vector)]);
+  EXPECT_EQ(1u, s.expressions[static_cast<size_t>(ExpressionType::Keyword)]);
+  EXPECT_EQ(1u, s.expressions[static_cast<size_t>(ExpressionType::Integer)]);
+  EXPECT_EQ(1u, s.expressions[static_cast<size_t>(ExpressionType::Float)]);
+  EXPECT_EQ(2u, s.expressions[static_cast<size_t>(ExpressionType::Literal)]);
+  EXPECT_EQ(1u, s.expressions[static_cast<size_t>(ExpressionType::String)]);
+
+  EXPECT_EQ(4u, s.max_depth);
+  EXPECT_LT(0u, s.nanoseconds[static_cast<size_t>(stats::Stage::Tokenizer)]);
+  EXPECT_LT(0u, s.nanoseconds[static_cast<size_t>(stats::Stage::Reader)]);
+}
+
+TEST_F(StatsTest, Flush) {
+  read_forms("(a)");
+  stats::flush();
+  read_forms("(b)");
+
+  auto s = stats::snapshot();
+  EXPECT_EQ(2u, s.expressions[static_cast<size_t>(ExpressionType::List)]);
+}
+
+TEST_F(StatsTest, Disabled) {
+  stats::enable(false);
+  read_forms("(a)");
+
+  auto s = stats::snapshot();
+  EXPECT_EQ(0u, s.bytes_scanned);
+  EXPECT_EQ(0u, s.expressions[static_cast<size_t>(ExpressionType::List)]);
+}
+
+#endif
+
+TEST_F(StatsTest, Json) {
+  stats::Stats s = {};
+  s.bytes_scanned = 12;
+  s.tokens[static_cast<size_t>(TokenType::Literal)] = 3;
+  s.max_depth = 2;
+
+  auto json = stats::to_json(s);
+  EXPECT_EQ(0u, json.find("{\"bytes_scanned\":12,\"tokens\":{\"EndOfFile\":0,\"Literal\":3,"));
+  EXPECT_NE(std::string::npos, json.find("\"max_depth\":2,"));
+  EXPECT_NE(std::string::npos, json.find("\"nanoseconds\":{\"scanner\":0,\"tokenizer\":0,\"reader\":0}}"));
+}
@@ -0,0 +1,236 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#ifdef PUNCH_COROUTINES
+
+#include <gtest/gtest.h>
+#include <random>
+#include <generator.hpp>
+#include <printer.hpp>
+#include <streamreader.hpp>
+
+class StreamReaderTest : public ::testing::Test {
+public:
+  StreamReaderTest() {}
+  ~StreamReaderTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+// reads everything the stream gives into out, debug printed with positions.
+Task collect(StreamReader& stream, std::vector<std::string>& out, bool& finished) {
+  while (true) {
+    auto form = co_await stream.next();
+    if (!form || form->type() == ExpressionType::EndOfFile) {
+      break;
+    }
+    out.push_back(Printer::to_string(*form, Printer::Format::Debug) + " @" +
+                  std::to_string(std::get<0>(form->pos)) + ":" + std::to_string(std::get<1>(form->pos)));
+  }
+  finished = true;
+}
+
+Task collect(StreamTokenizer& stream, std::vector<Token>& out) {
+  for (auto token = co_await stream.next(); token != Token::EndOfFile; token = co_await stream.next()) {
+    out.push_back(std::move(token));
+  }
+}
+
+std::vector<std::string> read_whole(const std::string& text) {
+  std::vector<std::string> out;
+  auto result = try_read_forms(text, true);
+  for (auto it = result.forms.begin(); it != result.forms.end(); ++it) {
+    out.push_back(Printer::to_string(**it, Printer::Format::Debug) + " @" +
+                  std::to_string(std::get<0>((*it)->pos)) + ":" + std::to_string(std::get<1>((*it)->pos)));
+  }
+  return out;
+}
+
+TEST_F(StreamReaderTest, SuspendsUntilAFormIsComplete) {
+  StreamReader stream;
+  std::vector<std::string> out;
+  bool finished = false;
+  auto task = collect(stream, out, finished);
+
+  stream.feed("(def a ");
+  EXPECT_TRUE(out.empty());
+  EXPECT_EQ(7u, stream.buffered());
+
+  stream.feed("[1 2]) ; done\n:k");
+  ASSERT_EQ(1u, out.size());
+  EXPECT_EQ("LIST (LIT (def), LIT (a), VEC (INT (1), INT (2), ), ) @1:1", out[0]);
+
+  // the keyword could still go on
+  stream.feed("w");
+  EXPECT_EQ(1u, out.size());
+
+  stream.feed(" \"a (string\"");
+  ASSERT_EQ(3u, out.size());
+  EXPECT_EQ("KW (kw) @2:1", out[1]);
+  EXPECT_EQ("STR (a (string) @2:5", out[2]);
+  EXPECT_FALSE(finished);
+
+  stream.close();
+  EXPECT_TRUE(finished);
+  EXPECT_TRUE(task.done());
+  EXPECT_TRUE(stream.diagnostics().empty());
+}
+
+TEST_F(StreamReaderTest, CharsDispatchAndComments) {
+  std::string text = "#{a \\) b} ; (\n#!(ignored\n#(x) \\( (f #\"[\" \\[)";
+  FormSplitter splitter;
+  for (char c : text) {
+    splitter.feed(&c, 1);
+  }
+  splitter.close();
+
+  std::vector<std::string> slices;
+  std::string slice;
+  position pos;
+  while (splitter.next(slice, pos)) {
+    slices.push_back(slice);
+  }
+
+  EXPECT_EQ(std::vector<std::string>({"#{a \\) b}", " ; (\n#!(ignored\n#(x)", " \\(", " (f #\"[\" \\[)"}), slices);
+}
+
+TEST_F(StreamReaderTest, EscapedQuotes) {
+  std::string text = "\"a \\\" (\" [\"\\\\\" 1] #\"\\\"\"";
+  FormSplitter splitter;
+  for (char c : text) {
+    splitter.feed(&c, 1);
+  }
+  splitter.close();
+
+  std::vector<std::string> slices;
+  std::string slice;
+  position pos;
+  while (splitter.next(slice, pos)) {
+    slices.push_back(slice);
+  }
+
+  EXPECT_EQ(std::vector<std::string>({"\"a \\\" (\"", " [\"\\\\\" 1]", " #\"\\\"\""}), slices);
+}
+
+TEST_F(StreamReaderTest, MalformedInput) {
+  StreamReader stream;
+  std::vector<std::string> out;
+  bool finished = false;
+  auto task = collect(stream, out, finished);
+
+  stream.feed("(a) ] (b)");
+  EXPECT_TRUE(finished);
+  EXPECT_TRUE(stream.failed());
+  ASSERT_EQ(1u, stream.diagnostics().size());
+  EXPECT_EQ(std::make_tuple(1u, 5u), stream.diagnostics()[0].pos);
+  EXPECT_EQ(1u, out.size());
+}
+
+TEST_F(StreamReaderTest, RecoverGoesOnWithTheNextForm) {
+  StreamReader stream(true);
+  std::vector<std::string> out;
+  bool finished = false;
+  auto task = collect(stream, out, finished);
+
+  stream.feed("(a) ] (b) (c");
+  stream.close();
+
+  EXPECT_EQ(2u, out.size());
+  ASSERT_EQ(2u, stream.diagnostics().size());
+  EXPECT_EQ(std::make_tuple(1u, 11u), stream.diagnostics()[1].pos);
+}
+
+TEST_F(StreamReaderTest, InterleavedStreamsMatchWholeReads) {
+  GeneratorOptions options;
+  options.size = 32 << 10;
+
+  const size_t streams = 4;
+  std::vector<std::string> texts;
+  std::vector<std::unique_ptr<StreamReader>> readers;
+  std::vector<std::vector<std::string>> out(streams);
+  bool finished[streams] = {};
+  std::vector<Task> tasks;
+
+  for (size_t i = 0; i < streams; ++i) {
+    options.seed = i + 1;
+    texts.push_back(CorpusGenerator(options).generate());
+    readers.push_back(make_unique<StreamReader>());
+    tasks.push_back(collect(*readers[i], out[i], finished[i]));
+  }
+
+  // feed all streams round robin from one thread, in pieces of random size.
+  std::mt19937 rng(7);
+  std::vector<size_t> fed(streams);
+  for (bool more = true; more; ) {
+    more = false;
+    for (size_t i = 0; i < streams; ++i) {
+      size_t n = std::min<size_t>(rng() % 64, texts[i].size() - fed[i]);
+      readers[i]->feed(texts[i].data() + fed[i], n);
+      fed[i] += n;
+      more = more || fed[i] < texts[i].size();
+
+      // only about one form is ever buffered
+      EXPECT_LT(readers[i]->buffered(), 4096u);
+    }
+  }
+
+  for (size_t i = 0; i < streams; ++i) {
+    readers[i]->close();
+    EXPECT_TRUE(finished[i]);
+    EXPECT_EQ(read_whole(texts[i]), out[i]);
+  }
+}
+
+TEST_F(StreamReaderTest, TokensMatchTheTokenizer) {
+  GeneratorOptions options;
+  options.size = 32 << 10;
+  options.atoms.regexes = 1;
+  options.atoms.chars = 1;
+  options.comments = 0.2;
+  std::string text = CorpusGenerator(options).generate();
+
+  StreamTokenizer stream;
+  std::vector<Token> out;
+  auto task = collect(stream, out);
+
+  std::mt19937 rng(3);
+  for (size_t fed = 0; fed < text.size(); ) {
+    size_t n = std::min<size_t>(rng() % 32, text.size() - fed);
+    stream.feed(text.data() + fed, n);
+    fed += n;
+  }
+  stream.close();
+  EXPECT_TRUE(task.done());
+
+  Tokenizer tokenizer(make_unique<StringScanner>(text));
+  std::vector<Token> whole;
+  for (auto token = tokenizer.next(); token != Token::EndOfFile; token = tokenizer.next()) {
+    whole.push_back(token);
+  }
+  EXPECT_EQ(whole, out);
+}
+
+TEST_F(StreamReaderTest, UnterminatedString) {
+  StreamTokenizer stream;
+  std::vector<Token> out;
+  auto task = collect(stream, out);
+
+  stream.feed("(a) \"b");
+  EXPECT_EQ(3u, out.size());
+  EXPECT_FALSE(task.done());
+
+  stream.close();
+  EXPECT_TRUE(task.done());
+  EXPECT_TRUE(stream.failed());
+  EXPECT_EQ("Unexpected stream end", stream.error().message);
+}
+
+#endif
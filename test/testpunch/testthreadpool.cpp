@@ -0,0 +1,84 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <atomic>
+#include <set>
+#include <gtest/gtest.h>
+#include <threadpool.hpp>
+
+class ThreadPoolTest : public ::testing::Test {
+public:
+  ThreadPoolTest() {}
+  ~ThreadPoolTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+TEST_F(ThreadPoolTest, RunsAllTasks) {
+  ThreadPool pool(4);
+  std::atomic<int> sum(0);
+
+  for (int i = 1; i <= 1000; ++i) {
+    pool.submit([i, &sum](unsigned) { sum += i; });
+  }
+
+  pool.wait();
+  EXPECT_EQ(500500, sum);
+}
+
+TEST_F(ThreadPoolTest, WorkerIndexInRange) {
+  ThreadPool pool(3);
+  std::atomic<bool> in_range(true);
+
+  for (int i = 0; i < 100; ++i) {
+    pool.submit([&pool, &in_range](unsigned worker) {
+      if (worker >= pool.size()) {
+        in_range = false;
+      }
+    });
+  }
+
+  pool.wait();
+  EXPECT_TRUE(in_range);
+}
+
+TEST_F(ThreadPoolTest, IdleWorkersSteal) {
+  ThreadPool pool(4);
+  std::mutex mutex;
+  std::set<unsigned> workers;
+
+  // everything lands on worker 0, the others can only get work by stealing.
+  for (int i = 0; i < 64; ++i) {
+    pool.submit(0, [&mutex, &workers](unsigned worker) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      std::lock_guard<std::mutex> lock(mutex);
+      workers.insert(worker);
+    });
+  }
+
+  pool.wait();
+  EXPECT_LT(1u, workers.size());
+}
+
+TEST_F(ThreadPoolTest, WaitIsReusable) {
+  ThreadPool pool(2);
+  std::atomic<int> count(0);
+
+  pool.wait();
+
+  pool.submit([&count](unsigned) { ++count; });
+  pool.wait();
+  EXPECT_EQ(1, count);
+
+  pool.submit([&count](unsigned) { ++count; });
+  pool.wait();
+  EXPECT_EQ(2, count);
+}
@@ -107,6 +107,81 @@ TEST_F(TokenizerTest, ParseStrings) {
           });
 }
 
+TEST_F(TokenizerTest, StringEscapes) {
+  compare("\"a\\\"b\" \"\" \"tab\\there\\\\\\n\"",
+          {Token::String("a\"b", pos(1,1)),
+           Token::String("", pos(1,8)),
+           Token::String("tab\there\\\n", pos(1,11))
+          });
+
+  compare("\"\\u00e9\\u20AC\\ud83d\\ude00\" x",
+          {Token::String("\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80", pos(1,1)),
+           Token::Literal("x", pos(1,28))
+          });
+
+  // regexes keep escapes as written, an escaped quote does not end them.
+  compare("#\"\\d+\\\"\" 1",
+          {Token::Regex("\\d+\\\"", pos(1,1)),
+           Token::Literal("1", pos(1,10))
+          });
+}
+
+TEST_F(TokenizerTest, LongStrings) {
+  std::string text(1000, 'x');
+  text[500] = '\n';
+  std::string in = "\"" + text + "\" \"" + text + "\\\"" + text + "\" end";
+
+  // long runs without escapes are copied at once, lines and columns still follow every character.
+  compare(in,
+          {Token::String(text, pos(1,1)),
+           Token::String(text + "\"" + text, pos(2,502)),
+           Token::Literal("end", pos(4,502))
+          });
+}
+
+void expect_failure(const std::string& in, const std::string& message, position at) {
+  Tokenizer tokenizer(make_unique<StringScanner>(in));
+  consume(tokenizer);
+  ASSERT_TRUE(tokenizer.failed()) << in;
+  EXPECT_EQ(message, tokenizer.error().message) << in;
+  EXPECT_EQ(at, tokenizer.error().pos) << in;
+}
+
+TEST_F(TokenizerTest, BadEscapes) {
+  expect_failure("\"a\\qb\"", "Unsupported escape \\q", pos(1,3));
+  expect_failure("(\"\\u12\")", "Invalid unicode escape", pos(1,3));
+  expect_failure("\"\\udc00\"", "Invalid unicode escape", pos(1,2));
+  expect_failure("\"\\ud83d\"", "Invalid unicode escape", pos(1,2));
+  expect_failure("\"open\\\"", "Unexpected stream end", pos(1,1));
+  expect_failure("\"open\\", "Unexpected stream end", pos(1,1));
+}
+
+TEST_F(TokenizerTest, Unicode) {
+  // columns count code points, and symbols may hold any of them.
+  compare("(d\xC3\xA9" "f \xCE\xBB)\n[\"\xE2\x82\xAC\" \xF0\x9F\x98\x80]",
+          {Token::RoundOpen(pos(1,1)),
+           Token::Literal("d\xC3\xA9" "f", pos(1,2)),
+           Token::Literal("\xCE\xBB", pos(1,6)),
+           Token::RoundClose(pos(1,7)),
+           Token::SquareOpen(pos(2,1)),
+           Token::String("\xE2\x82\xAC", pos(2,2)),
+           Token::Literal("\xF0\x9F\x98\x80", pos(2,6)),
+           Token::SquareClose(pos(2,7))
+          });
+}
+
+TEST_F(TokenizerTest, InvalidUtf8) {
+  expect_failure("(a \xFF)", "Invalid UTF-8", pos(1,4));
+  expect_failure("(\xCE\xBB\n  \"\xC0\xAF\")", "Invalid UTF-8", pos(2,4));
+  expect_failure("(\xED\xA0\x80)", "Invalid UTF-8", pos(1,2));
+  expect_failure("(\xE2\x82", "Invalid UTF-8", pos(1,2));
+
+  // the whole input is rejected, also the forms before the invalid byte.
+  Tokenizer tokenizer(make_unique<StringScanner>("(ok) \x80"));
+  EXPECT_EQ(Token::EndOfFile, tokenizer.next());
+  EXPECT_TRUE(tokenizer.failed());
+}
+
 TEST_F(TokenizerTest, MultiForms) {
   compare("(1) [2] 12   \";;12\" {",
           {Token::RoundOpen(pos(1,1)),
@@ -0,0 +1,110 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <trace.hpp>
+#include <batchreader.hpp>
+#include <reader.hpp>
+#include <thread>
+
+class TraceTest : public ::testing::Test {
+public:
+  TraceTest() {}
+  ~TraceTest() {}
+
+  void SetUp() {
+    trace::reset();
+  }
+
+  void TearDown() {
+    trace::enable(false);
+    trace::reset();
+  }
+};
+
+size_t count(const std::string& haystack, const std::string& needle) {
+  size_t n = 0;
+  for (size_t pos = haystack.find(needle); pos != std::string::npos; pos = haystack.find(needle, pos + 1)) {
+    ++n;
+  }
+  return n;
+}
+
+TEST_F(TraceTest, Spans) {
+  trace::enable();
+  {
+    trace::Span span("outer", "test");
+    span.arg("n", 3).arg("path", "a \"quoted\" path");
+  }
+
+  auto json = trace::to_json();
+  EXPECT_EQ(0u, json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"outer\",\"cat\":\"test\",\"args\":{\"n\":3,\"path\":\"a \\\"quoted\\\" path\"}}"));
+  EXPECT_NE(std::string::npos, json.find("{\"ph\":\"X\",\"pid\":1,\"tid\":"));
+}
+
+TEST_F(TraceTest, Disabled) {
+  {
+    trace::Span span("outer", "test");
+  }
+
+  EXPECT_EQ(std::string::npos, trace::to_json().find("outer"));
+}
+
+TEST_F(TraceTest, ThreadTracks) {
+  trace::enable();
+  trace::set_thread_name("main");
+
+  std::thread worker([] {
+    trace::set_thread_name("other");
+    trace::Span span("in thread", "test");
+  });
+  worker.join();
+
+  {
+    trace::Span span("in main", "test");
+  }
+
+  auto json = trace::to_json();
+  EXPECT_EQ(2u, count(json, "\"name\":\"thread_name\""));
+  EXPECT_NE(std::string::npos, json.find("\"args\":{\"name\":\"other\"}"));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"in thread\""));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"in main\""));
+}
+
+#ifdef PUNCH_TRACE
+
+TEST_F(TraceTest, Forms) {
+  trace::enable(true, false);
+  read_forms("(a) (b)\n[c]");
+  auto json = trace::to_json();
+  EXPECT_EQ(1u, count(json, "\"name\":\"read forms\""));
+  EXPECT_EQ(0u, count(json, "\"name\":\"form\""));
+
+  trace::reset();
+  trace::enable(true, true);
+  read_forms("(a) (b)\n[c]");
+  json = trace::to_json();
+  EXPECT_EQ(3u, count(json, "\"name\":\"form\""));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"form\",\"cat\":\"reader\",\"args\":{\"line\":2}"));
+}
+
+TEST_F(TraceTest, Workers) {
+  trace::enable();
+  read_sources(discover_sources("resources/batch"), 2);
+
+  auto json = trace::to_json();
+  EXPECT_EQ(1u, count(json, "\"args\":{\"name\":\"worker 0\"}"));
+  EXPECT_EQ(1u, count(json, "\"args\":{\"name\":\"worker 1\"}"));
+  EXPECT_EQ(3u, count(json, "\"name\":\"read source\""));
+  EXPECT_EQ(1u, count(json, "\"name\":\"read sources\""));
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include <utf8.hpp>
+
+TEST(Utf8Test, Validate) {
+  EXPECT_EQ(0u, utf8::validate("", 0));
+
+  auto invalid_at = [](const std::string& in) {
+    return utf8::validate(in.data(), in.size());
+  };
+
+  EXPECT_EQ(3u, invalid_at("abc"));
+  EXPECT_EQ(9u, invalid_at("\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80"));
+  EXPECT_EQ(10u, invalid_at("\x7F\xDF\xBF\xEF\xBF\xBF\xF4\x8F\xBF\xBF"));
+
+  // stray continuation, overlong forms, surrogates, past U+10FFFF and cut off sequences.
+  EXPECT_EQ(1u, invalid_at("a\x80"));
+  EXPECT_EQ(0u, invalid_at("\xC0\xAF"));
+  EXPECT_EQ(0u, invalid_at("\xE0\x9F\xBF"));
+  EXPECT_EQ(0u, invalid_at("\xF0\x8F\xBF\xBF"));
+  EXPECT_EQ(0u, invalid_at("\xED\xA0\x80"));
+  EXPECT_EQ(0u, invalid_at("\xF4\x90\x80\x80"));
+  EXPECT_EQ(0u, invalid_at("\xF5\x80\x80\x80"));
+  EXPECT_EQ(2u, invalid_at("ab\xE2\x82"));
+  EXPECT_EQ(1u, invalid_at("a\xE2\x28\xA1"));
+}
+
+TEST(Utf8Test, ValidateLongInput) {
+  // past the sixteen bytes done at once, on either side of a multibyte run.
+  std::string in(100, 'a');
+  EXPECT_EQ(in.size(), utf8::validate(in.data(), in.size()));
+
+  for (size_t at : {0u, 15u, 16u, 31u, 40u, 97u, 99u}) {
+    std::string bad = in;
+    bad[at] = '\xFF';
+    EXPECT_EQ(at, utf8::validate(bad.data(), bad.size())) << at;
+  }
+
+  std::string mixed = in + "\xCE\xBB" + in + "\xE2\x82\xAC" + in;
+  EXPECT_EQ(mixed.size(), utf8::validate(mixed.data(), mixed.size()));
+  mixed[250] = '\x80';
+  EXPECT_EQ(250u, utf8::validate(mixed.data(), mixed.size()));
+}
+
+TEST(Utf8Test, CodePoints) {
+  EXPECT_EQ(0u, utf8::code_points("", 0));
+
+  std::string in = "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80";
+  EXPECT_EQ(4u, utf8::code_points(in.data(), in.size()));
+
+  std::string repeated;
+  for (int i = 0; i < 20; ++i) {
+    repeated += in;
+  }
+  EXPECT_EQ(80u, utf8::code_points(repeated.data(), repeated.size()));
+}
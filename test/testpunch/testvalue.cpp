@@ -0,0 +1,89 @@
+/*
+ *   Copyright (c) 2015 Raymond Kroon. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file LICENSE.txt at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ */
+
+#include <gtest/gtest.h>
+#include <value.hpp>
+
+using namespace eval;
+
+class ValueTest : public ::testing::Test {
+public:
+  ValueTest() {}
+  ~ValueTest() {}
+
+  void SetUp() {}
+  void TearDown() {}
+};
+
+TEST_F(ValueTest, RefcountsSharedObjects) {
+  Value a = string("text");
+  EXPECT_EQ(1u, a.object()->refs);
+  {
+    Value b = a;
+    EXPECT_EQ(2u, a.object()->refs);
+  }
+  EXPECT_EQ(1u, a.object()->refs);
+
+  Value c = std::move(a);
+  EXPECT_TRUE(a.is_nil());
+  EXPECT_EQ(1u, c.object()->refs);
+}
+
+TEST_F(ValueTest, FromExpression) {
+  auto forms = read_forms("[1 2.5 :k \"s\" nil true sym 1/4] {:a #{1}}");
+  EXPECT_EQ("[1 2.5 :k \"s\" nil true sym 0.25]", print(from_expression(*forms.front())));
+  EXPECT_EQ("{:a #{1}}", print(from_expression(*forms.back())));
+}
+
+TEST_F(ValueTest, Equality) {
+  EXPECT_FALSE(equal(Value::integer(1), Value::floating(1.0)));
+  EXPECT_TRUE(equal(sequence(Type::List, {Value::integer(1)}), sequence(Type::Vector, {Value::integer(1)})));
+  EXPECT_FALSE(equal(keyword("a"), symbol("a")));
+  EXPECT_TRUE(equal(map({{keyword("a"), Value::integer(1)}, {keyword("b"), Value()}}),
+                    map({{keyword("b"), Value()}, {keyword("a"), Value::integer(1)}})));
+}
+
+TEST_F(ValueTest, Arithmetic) {
+  EXPECT_EQ("5", print(add(Value::integer(2), Value::integer(3))));
+  EXPECT_EQ("2.5", print(add(Value::integer(2), Value::floating(0.5))));
+  EXPECT_EQ("3", print(divide(Value::integer(6), Value::integer(2))));
+  EXPECT_EQ("1.5", print(divide(Value::integer(3), Value::integer(2))));
+  EXPECT_THROW(divide(Value::integer(1), Value::integer(0)), EvalError);
+  EXPECT_THROW(add(Value::integer(LONG_MAX), Value::integer(1)), EvalError);
+  EXPECT_THROW(add(Value::integer(1), string("a")), EvalError);
+  EXPECT_LT(compare(Value::integer(1), Value::floating(1.5)), 0);
+}
+
+TEST_F(ValueTest, Environment) {
+  Environment env;
+  uint32_t plus;
+  ASSERT_TRUE(env.find("+", plus));
+  EXPECT_TRUE(env.is_core(plus));
+
+  Value args[] = {Value::integer(1), Value::integer(2)};
+  EXPECT_EQ("3", print(invoke(env.lookup("+"), args, 2)));
+
+  env.define("+", Value::integer(0));
+  EXPECT_FALSE(env.is_core(plus));
+
+  uint32_t x = env.slot("x");
+  EXPECT_FALSE(env.bound(x));
+  EXPECT_EQ("x", env.name(x));
+  EXPECT_THROW(env.lookup("x"), EvalError);
+}
+
+TEST_F(ValueTest, KeywordsAndMapsAreCallable) {
+  Environment env;
+  Value m = map({{keyword("a"), Value::integer(1)}});
+  Value k = keyword("a");
+  EXPECT_EQ("1", print(invoke(k, &m, 1)));
+  EXPECT_EQ("1", print(invoke(m, &k, 1)));
+  EXPECT_THROW(invoke(Value::integer(1), nullptr, 0), EvalError);
+}